@@ -0,0 +1,98 @@
+#![allow(dead_code, non_camel_case_types)]
+
+use core::marker::PhantomData;
+use core::mem;
+
+/// Mirror of struct fmt_writer in src/fmt.h, field for field.
+#[repr(C)]
+pub struct fmt_writer {
+    buf: *mut u8,
+    len: u32,
+    max_len: u32,
+    windowed: bool,
+    skip: u32,
+    total_len: u32,
+    overflow: bool,
+}
+
+/// FMT_WRITER_SIZE in src/fmt.h.
+const FMT_WRITER_SIZE: usize = mem::size_of::<*mut u8>() + 6 * mem::size_of::<u32>();
+
+// Fail the build if the mirror drifts from the C struct.
+const _: [(); FMT_WRITER_SIZE] = [(); mem::size_of::<fmt_writer>()];
+const _: [(); mem::align_of::<*mut u8>()] = [(); mem::align_of::<fmt_writer>()];
+
+extern "C" {
+    fn fmt_writer_init(writer: *mut fmt_writer, buf: *mut u8, max_len: u32);
+    fn fmt_writer_finish(writer: *mut fmt_writer) -> isize;
+
+    fn fmt_put_ch(writer: *mut fmt_writer, ch: u8);
+    fn fmt_put_u32(writer: *mut fmt_writer, value: u32);
+    fn fmt_put_i32(writer: *mut fmt_writer, value: i32);
+    fn fmt_put_hex_u8(writer: *mut fmt_writer, value: u8);
+    fn fmt_put_float(writer: *mut fmt_writer, value: f32, num_decimals: u8);
+}
+
+/// Bounded output formatter for message serializers, backed by src/fmt.c.
+/// Once something doesn't fit, all further writes are ignored, and finish()
+/// returns -1.
+pub struct FmtWriter<'buf> {
+    raw: fmt_writer,
+    _buf: PhantomData<&'buf mut [u8]>,
+}
+
+impl<'buf> FmtWriter<'buf> {
+    pub fn new(buf: &'buf mut [u8]) -> FmtWriter<'buf> {
+        let mut raw = fmt_writer {
+            buf: buf.as_mut_ptr(),
+            len: 0,
+            max_len: 0,
+            windowed: false,
+            skip: 0,
+            total_len: 0,
+            overflow: false,
+        };
+
+        unsafe { fmt_writer_init(&mut raw, buf.as_mut_ptr(), buf.len() as u32) };
+
+        FmtWriter { raw: raw, _buf: PhantomData }
+    }
+
+    pub fn put_ch(&mut self, ch: u8) -> &mut Self {
+        unsafe { fmt_put_ch(&mut self.raw, ch) };
+        self
+    }
+
+    pub fn put_str(&mut self, s: &str) -> &mut Self {
+        for &ch in s.as_bytes() {
+            self.put_ch(ch);
+        }
+        self
+    }
+
+    pub fn put_u32(&mut self, value: u32) -> &mut Self {
+        unsafe { fmt_put_u32(&mut self.raw, value) };
+        self
+    }
+
+    pub fn put_i32(&mut self, value: i32) -> &mut Self {
+        unsafe { fmt_put_i32(&mut self.raw, value) };
+        self
+    }
+
+    pub fn put_hex_u8(&mut self, value: u8) -> &mut Self {
+        unsafe { fmt_put_hex_u8(&mut self.raw, value) };
+        self
+    }
+
+    pub fn put_f32(&mut self, value: f32, num_decimals: u8) -> &mut Self {
+        unsafe { fmt_put_float(&mut self.raw, value, num_decimals) };
+        self
+    }
+
+    /// NUL terminates the output, and returns its length, or -1 if it didn't
+    /// fit, i.e. what the serialization functions are supposed to return.
+    pub fn finish(mut self) -> isize {
+        unsafe { fmt_writer_finish(&mut self.raw) }
+    }
+}
@@ -4,12 +4,10 @@
          non_snake_case)]
 
 use core::mem;
+use core::ptr;
 use core::ops::{Deref, DerefMut};
 pub use core::convert::TryFrom;
 
-use core::fmt;
-use core::ptr;
-
 use core::slice;
 use core::str;
 
@@ -23,15 +21,65 @@ pub struct message {
     pub data: *mut CVoid,
 }
 
+pub const NO_TRANSACTION_ID: u32 = 0;
+
+// The trace points subsystems record, see enum message_trace_point.
+pub const MESSAGE_TRACE_DEQUEUED: u32 = 4;
+pub const MESSAGE_TRACE_REPLY_ENQUEUED: u32 = 5;
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct error_entry {
+    pub err_code: i32,
+    pub transaction_id: u32,
+}
+
+#[repr(C)]
+pub struct stream_cursor {
+    pub offset: u32,
+    pub item: u32,
+}
+
+#[repr(C)]
+pub struct message_field {
+    pub str: *mut u8,
+    pub len: u32,
+    pub hash: u32,
+    pub mantissa: u32,
+    pub num_decimals: u8,
+    pub is_number: bool,
+    pub is_negative: bool,
+    pub is_integer: bool,
+}
+
 #[repr(C)]
 pub struct message_handler {
     pub message_name: *const u8,
-    pub parsing_func:
-        Option<unsafe extern "C" fn(msg_ptr: *mut message, save_ptr: *mut u8) -> bool>,
+    pub parsing_func: Option<
+        unsafe extern "C" fn(msg_ptr: *mut message, fields: *const message_field, num_fields: u32)
+            -> bool,
+    >,
     pub serialization_func: Option<
         unsafe extern "C" fn(msg_ptr: *const message, output_str: *mut u8, output_str_max_len: u32)
             -> isize,
     >,
+    pub binary_parsing_func: Option<
+        unsafe extern "C" fn(msg_ptr: *mut message, payload: *const u8, payload_len: u32) -> bool,
+    >,
+    pub binary_serialization_func: Option<
+        unsafe extern "C" fn(msg_ptr: *const message, output: *mut u8, output_max_len: u32)
+            -> isize,
+    >,
+    pub streaming_serialization_func: Option<
+        unsafe extern "C" fn(
+            msg_ptr: *const message,
+            cursor: *mut stream_cursor,
+            offset: u32,
+            output_str: *mut u8,
+            output_str_max_len: u32,
+        ) -> isize,
+    >,
+    pub subscribable: bool,
 }
 
 #[repr(C)]
@@ -44,10 +92,40 @@ pub struct subsystem_message_conf {
     pub outgoing_err_queue: *mut MailboxRaw,
     pub alloc_message: Option<unsafe extern "C" fn(msg_type_id: u32) -> *mut message>,
     pub free_message: Option<unsafe extern "C" fn(msg: *mut message)>,
+    pub tx_weight: u32,
+    pub incoming_credits: u32,
+    pub request_payload_size: u32,
 }
 
 extern "C" {
-    pub fn dispatcher_register_subsystem(conf: *mut subsystem_message_conf) -> bool;
+    pub fn dispatcher_notify_tx();
+    pub fn dispatcher_trace_message(transaction_id: u32, point: u32);
+    pub fn dispatcher_message_taken(conf: *const subsystem_message_conf);
+
+    pub fn message_slab_alloc(msg_type_id: u32, payload_size: u32) -> *mut message;
+    pub fn message_slab_free(msg: *mut message);
+
+    pub fn message_field_to_u32(field: *const message_field, value: *mut u32) -> bool;
+    pub fn message_field_to_float(field: *const message_field, value: *mut f32) -> bool;
+}
+
+/// Allocates a message from the dispatcher's slab (see message_slab.h), with a
+/// zeroed payload of type P inline. Returns null if the slab has no room.
+pub unsafe fn slab_alloc<P>(msg_type: u32) -> *mut message {
+    let msg = message_slab_alloc(msg_type, mem::size_of::<P>() as u32);
+
+    if !msg.is_null() {
+        ptr::write_bytes((*msg).data as *mut P, 0, 1);
+    }
+
+    msg
+}
+
+/// Gives a message allocated by slab_alloc() back to the slab.
+pub unsafe fn slab_free(msg: *mut message) {
+    if !msg.is_null() {
+        message_slab_free(msg);
+    }
 }
 
 pub struct MessageWrapper<T: Wrappable> {
@@ -275,46 +353,6 @@ macro_rules! unwrap_or_ret_false {
     }
 }
 
-pub struct CStrWriter<'buf> {
-    buf: &'buf mut [u8],
-    pos: usize,
-}
-
-impl<'buf> CStrWriter<'buf> {
-    pub fn new(buf: &mut [u8]) -> CStrWriter {
-        buf[0] = '\0' as u8;
-
-        CStrWriter { buf: buf, pos: 0 }
-    }
-
-    pub fn len(&self) -> usize {
-        self.pos
-    }
-}
-
-impl<'buf> fmt::Write for CStrWriter<'buf> {
-    fn write_str(&mut self, s: &str) -> fmt::Result {
-        let s_len = s.as_bytes().len();
-
-        if (s_len + 1) > (self.buf.len() - self.pos) {
-            return Err(fmt::Error);
-        }
-
-        unsafe {
-            ptr::copy_nonoverlapping(
-                s.as_ptr(),
-                self.buf.as_mut_ptr().offset(self.pos as isize),
-                s_len,
-            );
-        }
-
-        self.pos += s_len;
-        self.buf[self.pos] = '\0' as u8;
-
-        Ok(())
-    }
-}
-
 pub unsafe fn cstr_ptr_to_str_slice<'a>(cstr_ptr: *mut u8) -> Result<&'a mut str, str::Utf8Error> {
     let mut len = 0;
     while *cstr_ptr.offset(len) != b'\0' {
@@ -2,3 +2,4 @@ pub mod bsp;
 #[macro_use]
 pub mod message_dispatcher;
 pub mod constants;
+pub mod fmt;
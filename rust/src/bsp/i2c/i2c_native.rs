@@ -0,0 +1,105 @@
+#![allow(dead_code)]
+
+// The I2C peripherals of the native build. The devices on the buses are
+// simulated by the Meteo BSP (src/meteo/native/bsp.c), and answer right away,
+// so a transaction gets run as a whole, as soon as it's started.
+
+use super::InterruptContext;
+use super::PeripheralState;
+use super::Step;
+use super::Peripheral;
+
+extern "C" {
+    fn bsp_sim_i2c_write(periph_id: u32, dev_addr: u8, data: *const u8, len: u32) -> bool;
+    fn bsp_sim_i2c_read(periph_id: u32, dev_addr: u8, data: *mut u8, len: u32) -> bool;
+}
+
+pub struct I2C {
+    periph_id: Peripheral,
+}
+
+static I2C_BUSES: [I2C; 3] = [
+    I2C { periph_id: Peripheral::I2C1 },
+    I2C { periph_id: Peripheral::I2C2 },
+    I2C { periph_id: Peripheral::I2C3 },
+];
+
+pub fn peripheral_init(_periph: Peripheral) {}
+
+pub fn deblock_bus(_periph: Peripheral) {}
+
+impl I2C {
+    pub fn get_periph(periph: Peripheral) -> &'static I2C {
+        &I2C_BUSES[periph as usize]
+    }
+
+    pub fn reset(&self) {}
+
+    pub fn send_start(&self) {
+        rust_i2c_interrupt_handler(self.periph_id as usize);
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn rust_i2c_interrupt_handler(ctx_id: usize) {
+    let ctx = unsafe { &mut I2C_PERIPHS[ctx_id] };
+
+    if ctx.state != PeripheralState::StartBitSet {
+        return;
+    }
+
+    if let Some(ref mut trans) = ctx.current_transaction {
+        let mut ret_val = 0;
+
+        for step in trans.steps.iter_mut() {
+            let acked = unsafe {
+                match *step {
+                    Step::Read(ref mut data) => bsp_sim_i2c_read(
+                        ctx_id as u32,
+                        trans.device_addr,
+                        data.as_mut_ptr(),
+                        data.len() as u32,
+                    ),
+                    Step::Write(ref data) => bsp_sim_i2c_write(
+                        ctx_id as u32,
+                        trans.device_addr,
+                        data.as_ptr(),
+                        data.len() as u32,
+                    ),
+                }
+            };
+
+            if !acked {
+                ret_val = -1;
+                break;
+            }
+        }
+
+        ctx.state = PeripheralState::Done(ret_val);
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn rust_i2c_interrupt_error_handler(ctx_id: usize) {
+    let ctx = unsafe { &mut I2C_PERIPHS[ctx_id] };
+
+    ctx.state = PeripheralState::Done(-1);
+}
+
+pub static mut I2C_PERIPHS: [InterruptContext; 3] = [
+    InterruptContext {
+        current_transaction: None,
+        periph_id: Peripheral::I2C1,
+        state: PeripheralState::Done(0),
+    },
+    InterruptContext {
+        current_transaction: None,
+        periph_id: Peripheral::I2C2,
+        state: PeripheralState::Done(0),
+    },
+    InterruptContext {
+        current_transaction: None,
+        periph_id: Peripheral::I2C3,
+        state: PeripheralState::Done(0),
+    },
+];
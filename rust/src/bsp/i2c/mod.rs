@@ -2,6 +2,10 @@
 mod i2c_v1;
 #[cfg(feature = "stm32f411discovery")]
 use self::i2c_v1 as i2c_impl;
+#[cfg(feature = "native")]
+mod i2c_native;
+#[cfg(feature = "native")]
+use self::i2c_native as i2c_impl;
 
 pub use self::i2c_impl::{rust_i2c_interrupt_error_handler, rust_i2c_interrupt_handler};
 pub use self::i2c_impl::peripheral_init;
@@ -16,16 +16,22 @@ use self::stm32f072discovery::periph_base_addr;
 #[cfg(feature = "stm32f072discovery")]
 use self::stm32f072discovery::board_specific_init;
 
+#[cfg(feature = "native")]
+mod native;
+#[cfg(feature = "native")]
+use self::native::board_specific_init;
+
 // TODO to be removed once i2c_v2 is implemented (the switch will be done in the i2c module)
-#[cfg(feature = "stm32f411discovery")]
+#[cfg(any(feature = "stm32f411discovery", feature = "native"))]
 pub mod i2c;
 
+#[cfg(not(feature = "native"))]
 pub mod gpio;
 
 #[no_mangle]
 pub extern "C" fn rust_bsp_init() {
     board_specific_init();
 
-    #[cfg(feature = "stm32f411discovery")]
+    #[cfg(any(feature = "stm32f411discovery", feature = "native"))]
     i2c::peripheral_init(i2c::Peripheral::I2C3);
 }
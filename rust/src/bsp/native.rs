@@ -0,0 +1 @@
+pub fn board_specific_init() {}
@@ -1,13 +1,12 @@
 use mouros::CVoid;
 use mouros::tasks;
-use mouros::tasks::CriticalLock;
-use mouros::pool_alloc::Pool;
 
 use mouros::mailbox;
 use mouros::mailbox::Mailbox;
 use mouros::mailbox::{RxChannelSpsc, TxChannelSpsc};
 
 use crate::bindings::message_dispatcher as md;
+use crate::bindings::fmt::FmtWriter;
 
 use crate::bsp::i2c;
 
@@ -16,7 +15,6 @@ use core::mem;
 use core::slice;
 
 use core::convert::TryFrom;
-use core::fmt::Write;
 
 mod bmp085;
 mod tsl2651;
@@ -43,6 +41,9 @@ const PRESSURE_REPLY_MSG_ID: u32 = 5;
 const HUMIDITY_REPLY_MSG_ID: u32 = 6;
 const LIGHT_LEVEL_REPLY_MSG_ID: u32 = 7;
 
+/// The number of decimals sensor values are serialized with in ASCII messages.
+const VALUE_DECIMALS: u8 = 3;
+
 #[repr(i32)]
 #[derive(Copy, Clone, PartialEq, Eq)]
 pub enum MeteoError {
@@ -54,18 +55,7 @@ pub enum MeteoError {
     InvalidSensorData = -6,
 }
 
-static mut MESSAGE_ARR: Option<[md::message; 20]> = None;
-static mut MESSAGE_POOL: Option<CriticalLock<Pool<md::message>>> = None;
-
-static mut MESSAGE_PAYLOAD_ARR: Option<[MessagePayload; 20]> = None;
-static mut MESSAGE_PAYLOAD_POOL: Option<CriticalLock<Pool<MessagePayload>>> = None;
-
 unsafe extern "C" fn meteo_alloc(msg_type_id: u32) -> *mut md::message {
-    let msg_pool = MESSAGE_POOL.as_ref().expect("message pool not initialized");
-    let payload_pool = MESSAGE_PAYLOAD_POOL
-        .as_ref()
-        .expect("message payload pool not initialized");
-
     match msg_type_id {
         GET_TEMPERATURE_MSG_ID
         | GET_PRESSURE_MSG_ID
@@ -74,68 +64,28 @@ unsafe extern "C" fn meteo_alloc(msg_type_id: u32) -> *mut md::message {
         | TEMPERATURE_REPLY_MSG_ID
         | PRESSURE_REPLY_MSG_ID
         | HUMIDITY_REPLY_MSG_ID
-        | LIGHT_LEVEL_REPLY_MSG_ID => {
-            let m = msg_pool.lock().take().and_then(|m| {
-                if let Some(payload) = payload_pool.lock().take() {
-                    *m = mem::zeroed();
-                    *payload = mem::zeroed();
-
-                    m.msg_type = msg_type_id;
-                    m.data = payload as *mut MessagePayload as *mut CVoid;
-
-                    Some(m)
-                } else {
-                    meteo_free(m);
-                    None
-                }
-            });
-
-            m.unwrap_or(&mut *ptr::null_mut())
-        }
+        | LIGHT_LEVEL_REPLY_MSG_ID => md::slab_alloc::<MessagePayload>(msg_type_id),
         _ => ptr::null_mut(),
     }
 }
 
 unsafe extern "C" fn meteo_free(msg: *mut md::message) {
-    if msg.is_null() {
-        return;
-    }
-
-    let msg_pool = MESSAGE_POOL.as_ref().expect("message pool not initialized");
-    let payload_pool = MESSAGE_PAYLOAD_POOL
-        .as_ref()
-        .expect("message payload pool not initialized");
-
-    match (*msg).msg_type {
-        GET_TEMPERATURE_MSG_ID
-        | GET_PRESSURE_MSG_ID
-        | GET_HUMIDITY_MSG_ID
-        | GET_LIGHT_LEVEL_MSG_ID
-        | TEMPERATURE_REPLY_MSG_ID
-        | PRESSURE_REPLY_MSG_ID
-        | HUMIDITY_REPLY_MSG_ID
-        | LIGHT_LEVEL_REPLY_MSG_ID => {
-            if !(*msg).data.is_null() {
-                payload_pool
-                    .lock()
-                    .give(&mut *((*msg).data as *mut MessagePayload));
-            }
-            msg_pool.lock().give(&mut *msg);
-        }
-        _ => {}
-    }
+    md::slab_free(msg);
 }
 
 unsafe extern "C" fn single_channel_num_parse(
     msg_ptr: *mut md::message,
-    save_ptr: *mut u8,
+    fields: *const md::message_field,
+    num_fields: u32,
 ) -> bool {
-    if msg_ptr.is_null() || (*msg_ptr).data.is_null() || save_ptr.is_null() {
+    if msg_ptr.is_null() || (*msg_ptr).data.is_null() || fields.is_null() || num_fields != 1 {
         return false;
     }
 
-    let payload = unwrap_or_ret_false!(md::cstr_ptr_to_str_slice(save_ptr));
-    let ch = unwrap_or_ret_false!(payload.parse::<u32>());
+    let mut ch = 0;
+    if !md::message_field_to_u32(fields, &mut ch) {
+        return false;
+    }
 
     let msg_data = (*msg_ptr).data as *mut MessagePayload;
     (*msg_data).channel_num_payload = ch;
@@ -153,15 +103,53 @@ unsafe extern "C" fn std_response_serialize(
     }
 
     let buf = slice::from_raw_parts_mut(output_str, output_str_max_len as usize);
-    let mut w = md::CStrWriter::new(buf);
+    let mut w = FmtWriter::new(buf);
 
     let payload = &*((*msg_ptr).data as *const StdResponsePayload);
 
-    if write!(w, ",{},{}", payload.channel, payload.value).is_ok() {
-        w.len() as isize
-    } else {
-        -1
+    w.put_ch(b',')
+        .put_u32(payload.channel)
+        .put_ch(b',')
+        .put_f32(payload.value, VALUE_DECIMALS);
+
+    w.finish()
+}
+
+unsafe extern "C" fn single_channel_num_binary_parse(
+    msg_ptr: *mut md::message,
+    payload: *const u8,
+    payload_len: u32,
+) -> bool {
+    if msg_ptr.is_null() || (*msg_ptr).data.is_null() || payload.is_null() || payload_len != 4 {
+        return false;
+    }
+
+    let mut ch_bytes = [0u8; 4];
+    ch_bytes.copy_from_slice(slice::from_raw_parts(payload, 4));
+
+    let msg_data = (*msg_ptr).data as *mut MessagePayload;
+    (*msg_data).channel_num_payload = u32::from_le_bytes(ch_bytes);
+
+    true
+}
+
+unsafe extern "C" fn std_response_binary_serialize(
+    msg_ptr: *const md::message,
+    output: *mut u8,
+    output_max_len: u32,
+) -> isize {
+    if msg_ptr.is_null() || (*msg_ptr).data.is_null() || output_max_len < 8 {
+        return -1;
     }
+
+    let buf = slice::from_raw_parts_mut(output, 8);
+
+    let payload = &*((*msg_ptr).data as *const StdResponsePayload);
+
+    buf[0..4].copy_from_slice(&payload.channel.to_le_bytes());
+    buf[4..8].copy_from_slice(&payload.value.to_bits().to_le_bytes());
+
+    8
 }
 
 enum IncomingMsg<'payload> {
@@ -233,8 +221,8 @@ static mut RX_QUEUE: Option<Mailbox<*mut md::message>> = None;
 static mut TX_QUEUE_ARR: Option<[*mut md::message; 20]> = None;
 static mut TX_QUEUE: Option<Mailbox<*mut md::message>> = None;
 
-static mut ERR_QUEUE_ARR: Option<[i32; 20]> = None;
-static mut ERR_QUEUE: Option<Mailbox<i32>> = None;
+static mut ERR_QUEUE_ARR: Option<[md::error_entry; 20]> = None;
+static mut ERR_QUEUE: Option<Mailbox<md::error_entry>> = None;
 
 static mut MSG_HANDLERS: Option<[md::message_handler; 8]> = None;
 static mut MSG_CONF: Option<md::subsystem_message_conf> = None;
@@ -242,7 +230,7 @@ static mut MSG_CONF: Option<md::subsystem_message_conf> = None;
 struct MeteoTaskCtx<'mb, 'mem: 'mb> {
     rx_msg_queue: RxChannelSpsc<'mb, 'mem, *mut md::message>,
     tx_msg_queue: TxChannelSpsc<'mb, 'mem, *mut md::message>,
-    err_msg_queue: TxChannelSpsc<'mb, 'mem, i32>,
+    err_msg_queue: TxChannelSpsc<'mb, 'mem, md::error_entry>,
     press_sensor: bmp085::Bmp085,
     light_sensor: tsl2651::Tsl2561,
 }
@@ -252,14 +240,28 @@ impl<'mb, 'mem> MeteoTaskCtx<'mb, 'mem> {
     where
         T: md::Wrappable,
     {
-        self.tx_msg_queue.try_send(msg.into()).or_else(|err| {
-            T::free(err.0);
-            Err(MeteoError::TxQueueFullError)
-        })
+        unsafe {
+            md::dispatcher_trace_message(msg.get_transaction_id(), md::MESSAGE_TRACE_REPLY_ENQUEUED)
+        };
+
+        self.tx_msg_queue
+            .try_send(msg.into())
+            .map(|_| unsafe { md::dispatcher_notify_tx() })
+            .or_else(|err| {
+                T::free(err.0);
+                Err(MeteoError::TxQueueFullError)
+            })
     }
 
-    fn send_err(&self, err: MeteoError) {
-        let _ = self.err_msg_queue.try_send(err as i32);
+    fn send_err(&self, err: MeteoError, transaction_id: u32) {
+        let err_entry = md::error_entry {
+            err_code: err as i32,
+            transaction_id,
+        };
+
+        if self.err_msg_queue.try_send(err_entry).is_ok() {
+            unsafe { md::dispatcher_notify_tx() };
+        }
     }
 }
 
@@ -280,16 +282,6 @@ pub unsafe extern "C" fn rust_meteo_init() -> *const CVoid {
     ERR_QUEUE_ARR = Some(mem::zeroed());
     ERR_QUEUE = Some(Mailbox::new(ERR_QUEUE_ARR.as_mut().unwrap().as_mut()));
 
-    MESSAGE_ARR = Some(mem::zeroed());
-    MESSAGE_POOL = Some(CriticalLock::new(Pool::new(
-        MESSAGE_ARR.as_mut().unwrap().as_mut(),
-    )));
-
-    MESSAGE_PAYLOAD_ARR = Some(mem::zeroed());
-    MESSAGE_PAYLOAD_POOL = Some(CriticalLock::new(Pool::new(
-        MESSAGE_PAYLOAD_ARR.as_mut().unwrap().as_mut(),
-    )));
-
     let (rx_msg_queue, _) = mailbox::channel_spsc(RX_QUEUE.as_mut().unwrap());
     let (_, tx_msg_queue) = mailbox::channel_spsc(TX_QUEUE.as_mut().unwrap());
     let (_, err_msg_queue) = mailbox::channel_spsc(ERR_QUEUE.as_mut().unwrap());
@@ -299,41 +291,73 @@ pub unsafe extern "C" fn rust_meteo_init() -> *const CVoid {
             message_name: b"GET_TEMPERATURE\0" as *const u8,
             parsing_func: Some(single_channel_num_parse),
             serialization_func: None,
+            binary_parsing_func: Some(single_channel_num_binary_parse),
+            binary_serialization_func: None,
+            streaming_serialization_func: None,
+            subscribable: true,
         },
         md::message_handler {
             message_name: b"GET_PRESSURE\0" as *const u8,
             parsing_func: Some(single_channel_num_parse),
             serialization_func: None,
+            binary_parsing_func: Some(single_channel_num_binary_parse),
+            binary_serialization_func: None,
+            streaming_serialization_func: None,
+            subscribable: true,
         },
         md::message_handler {
             message_name: b"GET_HUMIDITY\0" as *const u8,
             parsing_func: Some(single_channel_num_parse),
             serialization_func: None,
+            binary_parsing_func: Some(single_channel_num_binary_parse),
+            binary_serialization_func: None,
+            streaming_serialization_func: None,
+            subscribable: true,
         },
         md::message_handler {
             message_name: b"GET_LIGHT_LEVEL\0" as *const u8,
             parsing_func: Some(single_channel_num_parse),
             serialization_func: None,
+            binary_parsing_func: Some(single_channel_num_binary_parse),
+            binary_serialization_func: None,
+            streaming_serialization_func: None,
+            subscribable: true,
         },
         md::message_handler {
             message_name: b"TEMPERATURE_REPLY\0" as *const u8,
             parsing_func: None,
             serialization_func: Some(std_response_serialize),
+            binary_parsing_func: None,
+            binary_serialization_func: Some(std_response_binary_serialize),
+            streaming_serialization_func: None,
+            subscribable: false,
         },
         md::message_handler {
             message_name: b"PRESSURE_REPLY\0" as *const u8,
             parsing_func: None,
             serialization_func: Some(std_response_serialize),
+            binary_parsing_func: None,
+            binary_serialization_func: Some(std_response_binary_serialize),
+            streaming_serialization_func: None,
+            subscribable: false,
         },
         md::message_handler {
             message_name: b"HUMIDITY_REPLY\0" as *const u8,
             parsing_func: None,
             serialization_func: Some(std_response_serialize),
+            binary_parsing_func: None,
+            binary_serialization_func: Some(std_response_binary_serialize),
+            streaming_serialization_func: None,
+            subscribable: false,
         },
         md::message_handler {
             message_name: b"LIGHT_LEVEL_REPLY\0" as *const u8,
             parsing_func: None,
             serialization_func: Some(std_response_serialize),
+            binary_parsing_func: None,
+            binary_serialization_func: Some(std_response_binary_serialize),
+            streaming_serialization_func: None,
+            subscribable: false,
         },
     ]);
 
@@ -346,10 +370,12 @@ pub unsafe extern "C" fn rust_meteo_init() -> *const CVoid {
         outgoing_err_queue: err_msg_queue.get_raw_mailbox(),
         alloc_message: Some(meteo_alloc),
         free_message: Some(meteo_free),
+        tx_weight: 1,
+        // One slot of a mailbox always stays free.
+        incoming_credits: RX_QUEUE_ARR.as_ref().unwrap().len() as u32 - 1,
+        request_payload_size: mem::size_of::<MessagePayload>() as u32,
     });
 
-    md::dispatcher_register_subsystem(MSG_CONF.as_mut().unwrap());
-
     let mut press_sensor = bmp085::Bmp085::new(i2c::Peripheral::I2C3);
     press_sensor.set_precision(bmp085::Precision::UltraHigh);
 
@@ -366,6 +392,13 @@ pub unsafe extern "C" fn rust_meteo_init() -> *const CVoid {
     METEO_CTX.as_ref().unwrap() as *const MeteoTaskCtx as *const CVoid
 }
 
+// The subsystem gets registered with the dispatcher by the registry entry in
+// meteo.c, which hands it this.
+#[no_mangle]
+pub unsafe extern "C" fn rust_meteo_get_conf() -> *mut md::subsystem_message_conf {
+    MSG_CONF.as_mut().unwrap()
+}
+
 fn process_msg(ctx: &mut MeteoTaskCtx, msg: md::MessageWrapper<IncomingMsg>) {
     let res = match *msg {
         IncomingMsg::GetTemperature(ch) => ctx.press_sensor.measure().and_then(|(t, _)| {
@@ -424,7 +457,7 @@ fn process_msg(ctx: &mut MeteoTaskCtx, msg: md::MessageWrapper<IncomingMsg>) {
     };
 
     if let Err(e) = res {
-        ctx.send_err(e);
+        ctx.send_err(e, msg.get_transaction_id());
     }
 }
 
@@ -433,10 +466,16 @@ pub extern "C" fn rust_meteo_comm_loop(ctx_raw: *mut CVoid) {
     let ctx = unsafe { &mut *(ctx_raw as *mut MeteoTaskCtx) };
 
     if let Ok(msg_ptr) = ctx.rx_msg_queue.try_recv() {
+        unsafe { md::dispatcher_message_taken(MSG_CONF.as_ref().unwrap()) };
+
         if let Ok(msg) = md::MessageWrapper::try_from(msg_ptr) {
+            unsafe {
+                md::dispatcher_trace_message(msg.get_transaction_id(), md::MESSAGE_TRACE_DEQUEUED)
+            };
+
             process_msg(ctx, msg);
         } else {
-            ctx.send_err(MeteoError::InvalidMsgError);
+            ctx.send_err(MeteoError::InvalidMsgError, md::NO_TRANSACTION_ID);
         }
     }
 
@@ -234,6 +234,7 @@ impl Channel {
             return;
         }
 
+        trace_message(trans_id, message_dispatcher::MESSAGE_TRACE_REPLY_ENQUEUED);
         get_outgoing_queue().write(msg.into());
     }
 
@@ -257,6 +258,7 @@ impl Channel {
             return;
         }
 
+        trace_message(trans_id, message_dispatcher::MESSAGE_TRACE_REPLY_ENQUEUED);
         get_outgoing_queue().write(msg.into());
     }
 
@@ -273,6 +275,7 @@ impl Channel {
             return;
         }
 
+        trace_message(trans_id, message_dispatcher::MESSAGE_TRACE_REPLY_ENQUEUED);
         get_outgoing_queue().write(msg.into());
     }
 
@@ -329,6 +332,19 @@ fn get_incoming_queue() -> &'static mut Mailbox<'static, *mut message_dispatcher
     }
 }
 
+fn trace_message(trans_id: u32, point: u32) {
+    unsafe { message_dispatcher::dispatcher_trace_message(trans_id, point) };
+}
+
+fn give_credit_back() {
+    unsafe {
+        match SPINNER_CTX {
+            Some(ref ctx) => message_dispatcher::dispatcher_message_taken(ctx.subsystem_conf),
+            None => panic!(),
+        }
+    }
+}
+
 fn get_outgoing_queue() -> &'static mut Mailbox<'static, *mut message_dispatcher::message> {
     unsafe {
         match SPINNER_CTX {
@@ -342,11 +358,12 @@ fn get_outgoing_queue() -> &'static mut Mailbox<'static, *mut message_dispatcher
 }
 
 #[allow(dead_code)]
-fn get_outgoing_error_queue() -> &'static mut Mailbox<'static, i32> {
+fn get_outgoing_error_queue() -> &'static mut Mailbox<'static, message_dispatcher::error_entry> {
     unsafe {
         match SPINNER_CTX {
             Some(ref ctx) => {
-                &mut *(ctx.subsystem_conf.outgoing_err_queue as *mut Mailbox<'static, i32>)
+                &mut *(ctx.subsystem_conf.outgoing_err_queue
+                    as *mut Mailbox<'static, message_dispatcher::error_entry>)
             }
             None => panic!(),
         }
@@ -395,7 +412,14 @@ pub extern "C" fn spinner_comm_loop(_params: *mut CVoid) {
     let in_queue = get_incoming_queue();
 
     if let Some(msg_ptr) = in_queue.read() {
+        give_credit_back();
+
         if let Ok(msg) = MessageWrapper::try_from(msg_ptr) {
+            trace_message(
+                msg.get_transaction_id(),
+                message_dispatcher::MESSAGE_TRACE_DEQUEUED,
+            );
+
             match *msg {
                 Message::SetSpinPlan(ref data) => {
                     let ch_num = data.channel_num as usize;
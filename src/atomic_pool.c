@@ -0,0 +1,158 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the atomic pool allocator.
+ */
+
+#include <stdbool.h> // For bools
+#include <stddef.h> // For NULL
+
+#include "atomic_pool.h"
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#include <libopencm3/cm3/sync.h> // For __ldrex(), __strex(), __dmb()
+#define ATOMIC_POOL_EXCLUSIVE
+#elif defined(__ARM_ARCH_6M__)
+#include <libopencm3/cm3/cortex.h> // For the critical section macros.
+#define ATOMIC_POOL_CRITICAL_SECTION
+#endif
+
+
+void atomic_pool_init(struct atomic_pool *pool,
+                      void *mem,
+                      uint32_t item_size,
+                      uint32_t num_items)
+{
+	uint8_t *items = mem;
+	void *head = NULL;
+
+	// Linked back to front, so that the items get taken in order.
+	for (uint32_t i = num_items; i > 0; i--) {
+		void **item = (void **) &items[(i - 1) * item_size];
+		*item = head;
+		head = item;
+	}
+
+	pool->head = head;
+	pool->num_free = num_items;
+}
+
+uint32_t atomic_pool_num_free(const struct atomic_pool *pool)
+{
+	return pool->num_free;
+}
+
+#if defined(ATOMIC_POOL_EXCLUSIVE)
+
+/*
+ * The exclusive monitor gets cleared on every exception entry & return, so a
+ * take or give interrupted by another one fails its STREX, and starts over.
+ * Unlike with compare & swap, an item that got taken and given back in the
+ * meantime (ABA) can't slip through.
+ */
+
+static void add_num_free(struct atomic_pool *pool, uint32_t delta)
+{
+	uint32_t num_free = 0;
+
+	do {
+		num_free = __ldrex(&pool->num_free) + delta;
+	} while (__strex(num_free, &pool->num_free) != 0);
+}
+
+void *atomic_pool_take(struct atomic_pool *pool)
+{
+	volatile uint32_t *head = (volatile uint32_t *) &pool->head;
+	void **item = NULL;
+
+	do {
+		item = (void **) __ldrex(head);
+		if (item == NULL) {
+			return NULL;
+		}
+	} while (__strex((uint32_t) *item, head) != 0);
+
+	__dmb();
+
+	add_num_free(pool, (uint32_t) -1);
+
+	return item;
+}
+
+void atomic_pool_give(struct atomic_pool *pool, void *item)
+{
+	volatile uint32_t *head = (volatile uint32_t *) &pool->head;
+
+	// Whatever got written into the item is done with, before it's free.
+	__dmb();
+
+	add_num_free(pool, 1);
+
+	do {
+		*(void **) item = (void *) __ldrex(head);
+	} while (__strex((uint32_t) item, head) != 0);
+}
+
+#elif defined(ATOMIC_POOL_CRITICAL_SECTION)
+
+void *atomic_pool_take(struct atomic_pool *pool)
+{
+	CM_ATOMIC_CONTEXT();
+
+	void **item = pool->head;
+	if (item != NULL) {
+		pool->head = *item;
+		pool->num_free--;
+	}
+
+	return item;
+}
+
+void atomic_pool_give(struct atomic_pool *pool, void *item)
+{
+	CM_ATOMIC_CONTEXT();
+
+	*(void **) item = pool->head;
+	pool->head = item;
+	pool->num_free++;
+}
+
+#else
+
+/*
+ * Compare & swap is open to ABA, when an item gets taken and given back
+ * between the load of the head, and the swap. The native build runs a single
+ * task at a time (see native/cpu.h), so that can't happen there.
+ */
+
+void *atomic_pool_take(struct atomic_pool *pool)
+{
+	void *item = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+
+	while (item != NULL &&
+	       !__atomic_compare_exchange_n(&pool->head, &item, *(void **) item,
+	                                    true, __ATOMIC_ACQ_REL,
+	                                    __ATOMIC_ACQUIRE)) {
+	}
+
+	if (item != NULL) {
+		__atomic_fetch_sub(&pool->num_free, 1, __ATOMIC_RELAXED);
+	}
+
+	return item;
+}
+
+void atomic_pool_give(struct atomic_pool *pool, void *item)
+{
+	__atomic_fetch_add(&pool->num_free, 1, __ATOMIC_RELAXED);
+
+	void *head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+
+	do {
+		*(void **) item = head;
+	} while (!__atomic_compare_exchange_n(&pool->head, &head, item,
+	                                      true, __ATOMIC_RELEASE,
+	                                      __ATOMIC_RELAXED));
+}
+
+#endif
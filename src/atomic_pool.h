@@ -0,0 +1,68 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for a pool allocator of fixed size items,
+ * whose free list can be taken from & given to concurrently, from tasks and
+ * interrupt handlers alike, without turning interrupts off.
+ *
+ * On the Cortex-M3/M4, the free list gets updated with LDREX/STREX, which fail
+ * and get retried if an interrupt handler got in between. The Cortex-M0 has no
+ * exclusive accesses, so there the updates take a short critical section
+ * instead. Elsewhere (the host builds), compare & swap is used.
+ */
+
+#ifndef ATOMIC_POOL_H_
+#define ATOMIC_POOL_H_
+
+#include <stdint.h> // For uint32_t, etc.
+
+/**
+ * State of the pool.
+ */
+struct atomic_pool {
+	/**
+	 * The first free item, or NULL. Every free item starts with a pointer
+	 * to the next one.
+	 */
+	void *volatile head;
+	/**
+	 * The number of free items. Gets counted up before an item is given
+	 * back, and down after one is taken, so it's never less than the
+	 * length of the free list.
+	 */
+	volatile uint32_t num_free;
+};
+
+/**
+ * Initializes the pool, with all of its items free.
+ *
+ * @param pool      The pool to initialize.
+ * @param mem       The memory of the items.
+ * @param item_size The size of an item. Must be a multiple of the pointer
+ *                  size, and at least as large as a pointer.
+ * @param num_items The number of items in mem.
+ */
+void atomic_pool_init(struct atomic_pool *pool,
+                      void *mem,
+                      uint32_t item_size,
+                      uint32_t num_items);
+
+/**
+ * Takes a free item out of the pool.
+ *
+ * @return The item, or NULL if there are none left.
+ */
+void *atomic_pool_take(struct atomic_pool *pool);
+
+/**
+ * Gives an item taken by atomic_pool_take() back to the pool.
+ */
+void atomic_pool_give(struct atomic_pool *pool, void *item);
+
+/**
+ * @return The number of free items in the pool. Takes & gives in progress may
+ *         have it off for a moment, so it's only a hint.
+ */
+uint32_t atomic_pool_num_free(const struct atomic_pool *pool);
+
+#endif /* ATOMIC_POOL_H_ */
@@ -0,0 +1,72 @@
+/**
+ * @file
+ *
+ * This file contains helpers for reading & writing the little-endian fixed
+ * width fields of binary protocol messages. The buffers don't have to be
+ * aligned.
+ */
+
+#ifndef BINARY_FIELDS_H_
+#define BINARY_FIELDS_H_
+
+#include <stdint.h> // For uint32_t, etc.
+#include <string.h> // For memcpy
+
+
+static inline void bin_put_u16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = (uint8_t) value;
+	buf[1] = (uint8_t) (value >> 8);
+}
+
+static inline void bin_put_u32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (uint8_t) value;
+	buf[1] = (uint8_t) (value >> 8);
+	buf[2] = (uint8_t) (value >> 16);
+	buf[3] = (uint8_t) (value >> 24);
+}
+
+static inline void bin_put_i32(uint8_t *buf, int32_t value)
+{
+	bin_put_u32(buf, (uint32_t) value);
+}
+
+static inline void bin_put_f32(uint8_t *buf, float value)
+{
+	uint32_t bits = 0;
+	memcpy(&bits, &value, sizeof(bits));
+
+	bin_put_u32(buf, bits);
+}
+
+static inline uint16_t bin_get_u16(const uint8_t *buf)
+{
+	return (uint16_t) (buf[0] | buf[1] << 8);
+}
+
+static inline uint32_t bin_get_u32(const uint8_t *buf)
+{
+	return (uint32_t) buf[0] |
+	       (uint32_t) buf[1] << 8 |
+	       (uint32_t) buf[2] << 16 |
+	       (uint32_t) buf[3] << 24;
+}
+
+static inline int32_t bin_get_i32(const uint8_t *buf)
+{
+	return (int32_t) bin_get_u32(buf);
+}
+
+static inline float bin_get_f32(const uint8_t *buf)
+{
+	uint32_t bits = bin_get_u32(buf);
+
+	float value = 0;
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+
+#endif /* BINARY_FIELDS_H_ */
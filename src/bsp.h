@@ -9,16 +9,69 @@
 #define BSP_H_
 
 #include <stdbool.h> // For bool...
+#include <stdint.h> // For uint32_t, etc.
 
-#include <mouros/char_buffer.h> // For the char buffers
-
+#include "byte_ring.h" // For struct byte_ring
+#include "cobs.h" // For COBS_MAX_ENCODED_LEN
 #include "constants.h" // For the TX and RX buffer sizes.
 
 
-/** The UART RX buffer. Should be manipulated by os_char_buffer_* methods. */
-extern mailbox_t bsp_rx_buffer;
-/** The UART TX buffer. Should be manipulated by os_char_buffer_* methods. */
-extern mailbox_t bsp_tx_buffer;
+/**
+ * The largest region that can be reserved in bsp_tx_buffer at once, i.e. the
+ * longest frame the dispatcher can write into it.
+ */
+#define BSP_TX_MAX_RESERVATION COBS_MAX_ENCODED_LEN(BSP_MAX_MESSAGE_LENGTH)
+
+#if (BSP_RX_BUFFER_SIZE & (BSP_RX_BUFFER_SIZE - 1)) != 0
+#error "BSP_RX_BUFFER_SIZE must be a power of two."
+#endif
+
+#if (BSP_TX_BUFFER_SIZE & (BSP_TX_BUFFER_SIZE - 1)) != 0
+#error "BSP_TX_BUFFER_SIZE must be a power of two."
+#endif
+
+/**
+ * The UART RX ring. Should be manipulated by byte_ring_* methods. Its size is
+ * BSP_RX_BUFFER_SIZE. The UART interrupt handler is the producer, the message
+ * dispatcher's RX worker the consumer.
+ */
+extern struct byte_ring bsp_rx_buffer;
+/**
+ * The UART TX buffer. Should be manipulated by byte_ring_* methods. Its size
+ * is BSP_TX_BUFFER_SIZE.
+ */
+extern struct byte_ring bsp_tx_buffer;
+
+/**
+ * Counters of characters lost on the UART RX path.
+ */
+struct bsp_uart_stats {
+	/** Characters the UART peripheral overwrote before they were read. */
+	uint32_t rx_overruns;
+	/** Characters dropped, because bsp_rx_buffer was full. */
+	uint32_t rx_dropped;
+};
+
+/** The UART RX counters. Updated from interrupt context. */
+extern volatile struct bsp_uart_stats bsp_uart_stats;
+
+/**
+ * A UART link to the host, i.e. the buffers the message dispatcher talks over.
+ */
+struct bsp_link {
+	/** The RX ring. Its size is BSP_RX_BUFFER_SIZE. */
+	struct byte_ring *rx_buffer;
+	/** The TX ring. Its size is BSP_TX_BUFFER_SIZE. */
+	struct byte_ring *tx_buffer;
+	/** The RX counters. Updated from interrupt context. */
+	volatile struct bsp_uart_stats *uart_stats;
+};
+
+/**
+ * The BSP_NUM_LINKS UART links of the board. The first one is the control link,
+ * the one of bsp_rx_buffer, bsp_tx_buffer & bsp_uart_stats.
+ */
+extern const struct bsp_link bsp_links[BSP_NUM_LINKS];
 
 // TODO Give the LEDs meaningful debug names.
 enum board_led {
@@ -37,6 +90,27 @@ enum board_led {
  */
 void bsp_init(void);
 
+/**
+ * Sets the function that the UART interrupt handlers call after they have put a
+ * '\n' character into the RX buffer of a link, or after BSP_RX_NOTIFY_THRESHOLD
+ * characters have been received on it since the last call.
+ *
+ * @note The callback is called from interrupt context.
+ *
+ * @param callback The function to be called. May be NULL.
+ */
+void bsp_set_rx_notify_callback(void (*callback)(void));
+
+/**
+ * Returns the time since bsp_init() in microseconds. Wraps around after about
+ * 71 minutes, so intervals should be calculated with unsigned subtraction.
+ *
+ * @note Safe to call from interrupt context.
+ *
+ * @return The timestamp in microseconds.
+ */
+uint32_t bsp_get_timestamp_us(void);
+
 /**
  * Returns the state of the LED.
  *
@@ -0,0 +1,190 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the byte ring buffer.
+ */
+
+#include <stddef.h> // For NULL
+#include <string.h> // For memcpy
+
+#include "byte_ring.h"
+
+
+static void publish_write_pos(struct byte_ring *ring, uint32_t write_pos);
+
+
+static void publish_write_pos(struct byte_ring *ring, uint32_t write_pos)
+{
+	// The bytes must be in place before the consumer can see them.
+	__sync_synchronize();
+	ring->write_pos = write_pos;
+
+	if (ring->write_callback != NULL) {
+		ring->write_callback();
+	}
+}
+
+
+void byte_ring_init(struct byte_ring *ring,
+                    uint8_t *buf,
+                    uint32_t size,
+                    uint32_t max_reservation,
+                    void (*write_callback)(void))
+{
+	ring->buf = buf;
+	ring->size = size;
+	ring->mask = size - 1;
+	ring->max_reservation = max_reservation;
+	ring->read_pos = 0;
+	ring->write_pos = 0;
+	ring->write_callback = write_callback;
+}
+
+uint32_t byte_ring_used_space(const struct byte_ring *ring)
+{
+	uint32_t used = ring->write_pos - ring->read_pos;
+
+	// Whichever side is asking, it mustn't touch the bytes (or the free
+	// space) the other side has published, before seeing its position.
+	__sync_synchronize();
+
+	return used;
+}
+
+uint32_t byte_ring_free_space(const struct byte_ring *ring)
+{
+	return ring->size - byte_ring_used_space(ring);
+}
+
+uint32_t byte_ring_capacity(const struct byte_ring *ring)
+{
+	return (ring->size < ring->max_reservation) ? ring->size :
+	                                              ring->max_reservation;
+}
+
+uint8_t *byte_ring_reserve(struct byte_ring *ring, uint32_t *len)
+{
+	uint32_t free_space = byte_ring_free_space(ring);
+
+	*len = (free_space < ring->max_reservation) ? free_space :
+	                                              ring->max_reservation;
+
+	return &ring->buf[ring->write_pos & ring->mask];
+}
+
+void byte_ring_commit(struct byte_ring *ring, uint32_t len)
+{
+	uint32_t index = ring->write_pos & ring->mask;
+
+	// Move the part that ran into the slack area to the start of the ring.
+	if (index + len > ring->size) {
+		memcpy(ring->buf, &ring->buf[ring->size], index + len - ring->size);
+	}
+
+	publish_write_pos(ring, ring->write_pos + len);
+}
+
+bool byte_ring_write(struct byte_ring *ring, const uint8_t *data, uint32_t len)
+{
+	if (len > byte_ring_free_space(ring)) {
+		return false;
+	}
+
+	byte_ring_write_some(ring, data, len);
+
+	return true;
+}
+
+uint32_t byte_ring_write_some(struct byte_ring *ring,
+                              const uint8_t *data,
+                              uint32_t len)
+{
+	uint32_t free_space = byte_ring_free_space(ring);
+	if (len > free_space) {
+		len = free_space;
+	}
+
+	if (len == 0) {
+		return 0;
+	}
+
+	uint32_t write_pos = ring->write_pos;
+	uint32_t index = write_pos & ring->mask;
+	uint32_t first_len = ring->size - index;
+	if (first_len > len) {
+		first_len = len;
+	}
+
+	memcpy(&ring->buf[index], data, first_len);
+	memcpy(ring->buf, &data[first_len], len - first_len);
+
+	publish_write_pos(ring, write_pos + len);
+
+	return len;
+}
+
+bool byte_ring_write_byte(struct byte_ring *ring, uint8_t byte)
+{
+	if (byte_ring_used_space(ring) == ring->size) {
+		return false;
+	}
+
+	uint32_t write_pos = ring->write_pos;
+	ring->buf[write_pos & ring->mask] = byte;
+
+	publish_write_pos(ring, write_pos + 1);
+
+	return true;
+}
+
+uint32_t byte_ring_peek(const struct byte_ring *ring, const uint8_t **data)
+{
+	uint32_t used = byte_ring_used_space(ring);
+	uint32_t index = ring->read_pos & ring->mask;
+	uint32_t first_len = ring->size - index;
+
+	*data = &ring->buf[index];
+
+	return (used < first_len) ? used : first_len;
+}
+
+void byte_ring_consume(struct byte_ring *ring, uint32_t len)
+{
+	// The bytes must be read before the producer can overwrite them.
+	__sync_synchronize();
+	ring->read_pos += len;
+}
+
+uint32_t byte_ring_read(struct byte_ring *ring, uint8_t *data, uint32_t len)
+{
+	uint32_t total_len = 0;
+
+	// At most two contiguous regions, before & after the wrap.
+	for (uint8_t i = 0; i < 2 && total_len < len; i++) {
+		const uint8_t *region = NULL;
+		uint32_t region_len = byte_ring_peek(ring, &region);
+
+		if (region_len > len - total_len) {
+			region_len = len - total_len;
+		}
+
+		memcpy(&data[total_len], region, region_len);
+		byte_ring_consume(ring, region_len);
+
+		total_len += region_len;
+	}
+
+	return total_len;
+}
+
+bool byte_ring_read_byte(struct byte_ring *ring, uint8_t *byte)
+{
+	if (byte_ring_used_space(ring) == 0) {
+		return false;
+	}
+
+	*byte = ring->buf[ring->read_pos & ring->mask];
+	byte_ring_consume(ring, 1);
+
+	return true;
+}
@@ -0,0 +1,192 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for a single producer, single consumer
+ * byte ring buffer. Besides plain reads and writes, the producer can reserve a
+ * contiguous region, fill it in place, and commit it, while the consumer can
+ * peek at the contiguous readable region (e.g. for DMA), and consume it once
+ * it's done with it.
+ *
+ * Reserved regions that would wrap around the end of the ring run into the
+ * slack area after it instead, and get moved to the start of the ring on
+ * commit.
+ *
+ * Neither side ever takes a critical section: the read & write positions are
+ * free-running counters, each only modified by its own side, and published
+ * after a memory barrier. So the producer can be an interrupt handler and the
+ * consumer a task, or the other way around. The size of the ring must be a
+ * power of two, so that positions map to indices by masking, and keep doing so
+ * when the counters wrap around.
+ */
+
+#ifndef BYTE_RING_H_
+#define BYTE_RING_H_
+
+#include <stdbool.h> // For bools
+#include <stdint.h> // For uint32_t, etc.
+
+/**
+ * The size of the memory needed for a ring of size bytes, where at most
+ * max_reservation bytes can be reserved at once.
+ */
+#define BYTE_RING_MEM_SIZE(size, max_reservation) ((size) + (max_reservation))
+
+/**
+ * State of the byte ring.
+ */
+struct byte_ring {
+	uint8_t *buf;
+	uint32_t size;
+	/** size - 1, maps a position to an index into buf. */
+	uint32_t mask;
+	uint32_t max_reservation;
+
+	/** Total bytes read. Only modified by the consumer. */
+	volatile uint32_t read_pos;
+	/** Total bytes written. Only modified by the producer. */
+	volatile uint32_t write_pos;
+
+	/**
+	 * Called after new bytes have been committed or written. May be
+	 * NULL.
+	 */
+	void (*write_callback)(void);
+};
+
+
+/**
+ * Initializes the ring.
+ *
+ * @param ring            The ring to initialize.
+ * @param buf             The ring's memory. Must be at least
+ *                        BYTE_RING_MEM_SIZE(size, max_reservation) bytes.
+ * @param size            The size of the ring. Must be a power of two, 2^31 at
+ *                        most.
+ * @param max_reservation The maximum size of a reserved region.
+ * @param write_callback  Called after each commit or write. May be NULL.
+ */
+void byte_ring_init(struct byte_ring *ring,
+                    uint8_t *buf,
+                    uint32_t size,
+                    uint32_t max_reservation,
+                    void (*write_callback)(void));
+
+/**
+ * Gets the number of bytes that can be written into the ring right now.
+ *
+ * @param ring The ring.
+ * @return The number of free bytes.
+ */
+uint32_t byte_ring_free_space(const struct byte_ring *ring);
+
+/**
+ * Gets the number of bytes that can be read from the ring right now.
+ *
+ * @param ring The ring.
+ * @return The number of readable bytes.
+ */
+uint32_t byte_ring_used_space(const struct byte_ring *ring);
+
+/**
+ * Gets the largest region the producer could ever reserve, i.e. the size of
+ * the ring, capped by max_reservation.
+ *
+ * @param ring The ring.
+ * @return The size of the largest possible reservation.
+ */
+uint32_t byte_ring_capacity(const struct byte_ring *ring);
+
+/**
+ * Reserves a contiguous region at the write position of the ring. Nothing
+ * becomes visible to the consumer until byte_ring_commit() is called.
+ *
+ * @param ring The ring.
+ * @param len  Output for the size of the region, which is the free space of
+ *             the ring, capped by max_reservation. May be 0.
+ * @return Pointer to the start of the region.
+ */
+uint8_t *byte_ring_reserve(struct byte_ring *ring, uint32_t *len);
+
+/**
+ * Makes the first len bytes of the last reserved region visible to the
+ * consumer.
+ *
+ * @param ring The ring.
+ * @param len  The number of bytes to commit. Must not be more than the size of
+ *             the reserved region.
+ */
+void byte_ring_commit(struct byte_ring *ring, uint32_t len);
+
+/**
+ * Writes a buffer into the ring, if the whole of it fits.
+ *
+ * @param ring The ring.
+ * @param data The bytes to write.
+ * @param len  The length of data.
+ * @return True if data was written, false if it didn't fit.
+ */
+bool byte_ring_write(struct byte_ring *ring, const uint8_t *data, uint32_t len);
+
+/**
+ * Writes as much of a buffer into the ring, as fits.
+ *
+ * @param ring The ring.
+ * @param data The bytes to write.
+ * @param len  The length of data.
+ * @return The number of bytes written. The rest of data didn't fit.
+ */
+uint32_t byte_ring_write_some(struct byte_ring *ring,
+                              const uint8_t *data,
+                              uint32_t len);
+
+/**
+ * Writes a single byte into the ring, e.g. from a UART RX interrupt.
+ *
+ * @param ring The ring.
+ * @param byte The byte.
+ * @return True if the byte was written, false if the ring was full.
+ */
+bool byte_ring_write_byte(struct byte_ring *ring, uint8_t byte);
+
+/**
+ * Gets the contiguous region of readable bytes at the read position of the
+ * ring. The region stays valid until it's consumed. If the readable bytes wrap
+ * around the end of the ring, the rest of them can be peeked at after
+ * consuming the first region.
+ *
+ * @param ring The ring.
+ * @param data Output for the start of the region.
+ * @return The length of the region. 0 if the ring is empty.
+ */
+uint32_t byte_ring_peek(const struct byte_ring *ring, const uint8_t **data);
+
+/**
+ * Frees the first len readable bytes of the ring.
+ *
+ * @param ring The ring.
+ * @param len  The number of bytes to free. Must not be more than what
+ *             byte_ring_peek() has returned.
+ */
+void byte_ring_consume(struct byte_ring *ring, uint32_t len);
+
+/**
+ * Reads up to len bytes from the ring.
+ *
+ * @param ring The ring.
+ * @param data Buffer for the bytes.
+ * @param len  The size of data.
+ * @return The number of bytes read.
+ */
+uint32_t byte_ring_read(struct byte_ring *ring, uint8_t *data, uint32_t len);
+
+/**
+ * Reads a single byte from the ring.
+ *
+ * @param ring The ring.
+ * @param byte Output for the byte.
+ * @return True if a byte was read, false if the ring was empty.
+ */
+bool byte_ring_read_byte(struct byte_ring *ring, uint8_t *byte);
+
+
+#endif /* BYTE_RING_H_ */
@@ -0,0 +1,158 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the COBS encoder & decoder, and
+ * the binary protocol CRC.
+ */
+
+#include <stddef.h> // For NULL
+
+#include "cobs.h"
+
+
+uint32_t cobs_encode(const uint8_t *src, uint32_t src_len,
+                     uint8_t *dst, uint32_t dst_max)
+{
+	if (dst_max < 2) {
+		return 0;
+	}
+
+	// Position of the current block's code byte, which is filled in once
+	// the block ends.
+	uint32_t code_pos = 0;
+	uint32_t dst_len = 1;
+	uint8_t code = 1;
+
+	for (uint32_t i = 0; i < src_len; i++) {
+		if (src[i] != 0) {
+			if (dst_len >= dst_max) {
+				return 0;
+			}
+
+			dst[dst_len++] = src[i];
+			code++;
+		}
+
+		// Block ends at a zero, or when it's at its maximum length.
+		if (src[i] == 0 || code == 0xFF) {
+			if (dst_len >= dst_max) {
+				return 0;
+			}
+
+			dst[code_pos] = code;
+			code_pos = dst_len++;
+			code = 1;
+		}
+	}
+
+	if (dst_len >= dst_max) {
+		return 0;
+	}
+
+	dst[code_pos] = code;
+	dst[dst_len++] = 0;
+
+	return dst_len;
+}
+
+void cobs_decoder_init(struct cobs_decoder *decoder,
+                       uint8_t *buf,
+                       uint32_t buf_size)
+{
+	decoder->buf = buf;
+	decoder->buf_size = buf_size;
+
+	cobs_decoder_reset(decoder);
+}
+
+void cobs_decoder_reset(struct cobs_decoder *decoder)
+{
+	decoder->len = 0;
+	decoder->code = 0;
+	decoder->remaining = 0;
+	decoder->error = false;
+}
+
+enum cobs_decode_result cobs_decoder_push(struct cobs_decoder *decoder,
+                                          uint8_t byte)
+{
+	if (byte == 0) {
+		// Back to back delimiters are allowed, e.g. for resynchronizing.
+		if (decoder->code == 0) {
+			return COBS_DECODE_IN_PROGRESS;
+		}
+
+		enum cobs_decode_result result = COBS_DECODE_FRAME_DONE;
+
+		if (decoder->error) {
+			result = COBS_DECODE_FRAME_TOO_LONG;
+		} else if (decoder->remaining != 0) {
+			result = COBS_DECODE_FRAME_INVALID;
+		}
+
+		uint32_t len = decoder->len;
+		cobs_decoder_reset(decoder);
+
+		// Keep the frame length around for the caller.
+		decoder->len = (result == COBS_DECODE_FRAME_DONE) ? len : 0;
+
+		return result;
+	}
+
+	if (decoder->error) {
+		return COBS_DECODE_IN_PROGRESS;
+	}
+
+	// First byte of a new frame. Drops the previous decoded frame.
+	if (decoder->code == 0) {
+		decoder->len = 0;
+	}
+
+	uint8_t data = byte;
+
+	if (decoder->remaining == 0) {
+		// A code byte. Every block, except for the maximum length
+		// ones, ends in a zero, which isn't needed after the last
+		// block of the frame, so it gets added only here.
+		bool add_zero = decoder->code != 0 && decoder->code != 0xFF;
+
+		decoder->code = byte;
+		decoder->remaining = (uint8_t) (byte - 1);
+
+		if (!add_zero) {
+			return COBS_DECODE_IN_PROGRESS;
+		}
+
+		data = 0;
+	} else {
+		decoder->remaining--;
+	}
+
+	if (decoder->len >= decoder->buf_size) {
+		decoder->error = true;
+		return COBS_DECODE_IN_PROGRESS;
+	}
+
+	decoder->buf[decoder->len++] = data;
+
+	return COBS_DECODE_IN_PROGRESS;
+}
+
+uint16_t crc16_ccitt(const uint8_t *buf, uint32_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (uint32_t i = 0; i < len; i++) {
+		crc ^= (uint16_t) (buf[i] << 8);
+
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			if (crc & 0x8000) {
+				crc = (uint16_t) ((crc << 1) ^ 0x1021);
+			} else {
+				crc = (uint16_t) (crc << 1);
+			}
+		}
+	}
+
+	return crc;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for the COBS (Consistent Overhead Byte
+ * Stuffing) encoder & streaming decoder, and the CRC used by the binary
+ * message protocol. COBS encoded frames contain no zero bytes, so a single zero
+ * byte is used as the frame delimiter.
+ */
+
+#ifndef COBS_H_
+#define COBS_H_
+
+#include <stdbool.h> // For bools
+#include <stdint.h> // For uint32_t, etc.
+
+/**
+ * The maximum size of a COBS encoded frame, including the trailing zero
+ * delimiter, for a raw frame of len bytes.
+ */
+#define COBS_MAX_ENCODED_LEN(len) ((len) + (len) / 254 + 2)
+
+/**
+ * State of the streaming COBS decoder.
+ */
+struct cobs_decoder {
+	uint8_t *buf;
+	uint32_t buf_size;
+	uint32_t len;
+
+	/** The code byte of the current block. 0 before the first one. */
+	uint8_t code;
+	/** The number of data bytes left in the current block. */
+	uint8_t remaining;
+	/** Set when a frame didn't fit into buf, or was malformed. */
+	bool error;
+};
+
+/**
+ * Result of pushing a byte into the decoder.
+ */
+enum cobs_decode_result {
+	/** The byte was consumed, the frame isn't complete yet. */
+	COBS_DECODE_IN_PROGRESS,
+	/** The byte was a delimiter, decoder->buf holds decoder->len bytes. */
+	COBS_DECODE_FRAME_DONE,
+	/** The byte was a delimiter, but the frame was malformed. */
+	COBS_DECODE_FRAME_INVALID,
+	/** The byte was a delimiter, but the frame didn't fit into the buffer. */
+	COBS_DECODE_FRAME_TOO_LONG
+};
+
+
+/**
+ * COBS encodes a frame, and appends the zero delimiter.
+ *
+ * The encoding can be done in place: src may overlap dst, as long as it starts
+ * at least 1 + src_len / 254 bytes after dst.
+ *
+ * @param src     The raw frame.
+ * @param src_len The length of src.
+ * @param dst     Buffer for the encoded frame.
+ * @param dst_max The size of dst. COBS_MAX_ENCODED_LEN(src_len) is always
+ *                enough.
+ * @return The number of bytes written to dst, including the delimiter, or 0 if
+ *         dst is too small.
+ */
+uint32_t cobs_encode(const uint8_t *src, uint32_t src_len,
+                     uint8_t *dst, uint32_t dst_max);
+
+/**
+ * Initializes the decoder.
+ *
+ * @param decoder  The decoder to initialize.
+ * @param buf      Buffer for the decoded frame.
+ * @param buf_size The size of buf.
+ */
+void cobs_decoder_init(struct cobs_decoder *decoder,
+                       uint8_t *buf,
+                       uint32_t buf_size);
+
+/**
+ * Drops the frame being decoded.
+ *
+ * @param decoder The decoder.
+ */
+void cobs_decoder_reset(struct cobs_decoder *decoder);
+
+/**
+ * Decodes the next byte of an encoded frame. After COBS_DECODE_FRAME_DONE gets
+ * returned, the decoded frame stays in the buffer until the next byte is
+ * pushed.
+ *
+ * @param decoder The decoder.
+ * @param byte    The next byte received.
+ * @return The state of the decoded frame.
+ */
+enum cobs_decode_result cobs_decoder_push(struct cobs_decoder *decoder,
+                                          uint8_t byte);
+
+/**
+ * Calculates the CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF)
+ * of a buffer.
+ *
+ * @param buf The data.
+ * @param len The length of buf.
+ * @return The CRC.
+ */
+uint16_t crc16_ccitt(const uint8_t *buf, uint32_t len);
+
+
+#endif /* COBS_H_ */
@@ -7,6 +7,11 @@
 #ifndef CONSTANTS_H_
 #define CONSTANTS_H_
 
+/**
+ * The frequency of the MourOS scheduler tick.
+ */
+#define OS_TICK_RATE_HZ 1000
+
 /**
  * The MourOS task priority to be used with RX & TX communication tasks.
  */
@@ -14,15 +19,18 @@
 
 /**
  * The number of OS ticks a comm task will sleep for, after emptying its queue,
- * before checking the queue again.
+ * before checking the queue again. A task that got notified in the meantime
+ * (e.g. the RX task by the UART ISR) skips the sleep, but one that is already
+ * asleep only notices the notification once it wakes up.
  */
 #define COMM_TASK_SLEEP_TIME_TICKS 50
 
 /**
- * The maximum number of subsystems that can be registered with the message
- * dispatcher.
+ * The number of slots in the message dispatcher's hash table of subsystem and
+ * message names. Must be a power of two. Every registered subsystem takes one
+ * slot, plus one per message type, and one slot always stays free.
  */
-#define MAX_NUM_COMM_SUBSYSTEMS 5
+#define NAME_TABLE_SIZE 64
 
 /**
  * The maximum number of error messages that can be scheduled for sending at any
@@ -30,12 +38,98 @@
  */
 #define MAX_DISPATCHER_ERROR_MESSAGES 10
 
+/**
+ * The size of the queues of subsystem messages & errors waiting to be handed
+ * over from the control link's TX worker to that of another link. See
+ * BSP_NUM_LINKS.
+ */
+#define ROUTED_QUEUE_SIZE 4
+
+/**
+ * The minimum time in microseconds between two reports of the same error code
+ * of a subsystem. Occurrences in between get counted, and sent in a single
+ * aggregated report. See err_coalescer.h.
+ */
+#define ERR_REPORT_INTERVAL_US 100000
+
+/**
+ * The number of different error codes per subsystem that can be coalesced at
+ * the same time.
+ */
+#define ERR_COALESCER_SIZE 4
+
+/**
+ * The number of the message dispatcher's own messages (e.g. protocol switch
+ * replies) that can be in flight at any given time, per link.
+ */
+#define DISPATCHER_MSG_POOL_SIZE 2
+
+/**
+ * The payload size of the small slots of the message slab, in bytes. Fits the
+ * payloads of all messages but the Spinner's spin plans. See message_slab.h.
+ */
+#define MESSAGE_SLAB_SMALL_PAYLOAD_SIZE 16
+
+/**
+ * The number of subscriptions (see the SUBSCRIBE message in
+ * message_dispatcher.h) that can be active at the same time.
+ */
+#define SUBSCRIPTION_SLOTS 4
+
+/**
+ * The maximum length of the request payload of a subscription, in bytes. ASCII
+ * payloads are stored with their commas, and a NUL terminator.
+ */
+#define SUBSCRIPTION_PAYLOAD_SIZE 32
+
+/**
+ * The maximum number of fields in the ASCII request payload of a subscription.
+ */
+#define SUBSCRIPTION_MAX_FIELDS 8
+
+/**
+ * The range of subscription periods, in milliseconds. Requested periods
+ * outside of it get clamped.
+ */
+#define SUBSCRIPTION_MIN_PERIOD_MS 10
+#define SUBSCRIPTION_MAX_PERIOD_MS 60000
+
+/**
+ * The baud rate of the UART link to the host. Characters are sent as 8N1, i.e.
+ * 10 bits each.
+ */
+#define BSP_UART_BAUD_RATE 115200
+
+/**
+ * The number of requests whose latency can be traced at the same time, when
+ * MESSAGE_TRACING is enabled. See message_trace.h.
+ */
+#define MESSAGE_TRACE_SLOTS 8
+
+/**
+ * The number of trace points that can be waiting for the message dispatcher's
+ * TX task to collect them.
+ */
+#define MESSAGE_TRACE_EVENT_QUEUE_SIZE 32
+
+/**
+ * The number of buckets in each latency histogram. The first one is for
+ * latencies under LATENCY_HISTOGRAM_FIRST_BUCKET_US, every following one four
+ * times as wide, and the last one for everything that's left.
+ */
+#define LATENCY_HISTOGRAM_BUCKETS 8
+
+/** The upper limit of the first latency histogram bucket, in microseconds. */
+#define LATENCY_HISTOGRAM_FIRST_BUCKET_US 64
+
 
 // Board specific overrides
 #if defined(STM32F072DISCOVERY)
 #include "stm32f072discovery/constants.h"
 #elif defined(STM32F411DISCOVERY)
 #include "stm32f411discovery/constants.h"
+#elif defined(NATIVE)
+#include "native/constants.h"
 #endif
 
 #endif /* CONSTANTS_H_ */
@@ -0,0 +1,119 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the error coalescer.
+ */
+
+#include <stddef.h> // For NULL
+#include <string.h> // For memset
+
+#include "err_coalescer.h"
+
+
+static bool interval_passed(const struct err_coalescer_entry *entry, uint32_t now_us);
+static struct err_coalescer_entry *find_entry(struct err_coalescer *coalescer,
+                                              int32_t err_code,
+                                              uint32_t now_us);
+
+
+static bool interval_passed(const struct err_coalescer_entry *entry, uint32_t now_us)
+{
+	// Unsigned subtraction, so that the timestamps may wrap around.
+	return now_us - entry->last_report_time_us >= ERR_REPORT_INTERVAL_US;
+}
+
+/**
+ * Finds the entry of err_code. If there isn't one, takes over an entry that is
+ * either unused, or has nothing left to report, and has been quiet for an
+ * interval.
+ *
+ * @return The entry, or NULL if all of them are busy.
+ */
+static struct err_coalescer_entry *find_entry(struct err_coalescer *coalescer,
+                                              int32_t err_code,
+                                              uint32_t now_us)
+{
+	struct err_coalescer_entry *free_entry = NULL;
+
+	for (uint32_t i = 0; i < ERR_COALESCER_SIZE; i++) {
+		struct err_coalescer_entry *entry = &coalescer->entries[i];
+
+		if (entry->in_use && entry->err_code == err_code) {
+			return entry;
+		}
+
+		if (free_entry != NULL) {
+			continue;
+		}
+
+		if (!entry->in_use ||
+		    (entry->pending.count == 0 && interval_passed(entry, now_us))) {
+			free_entry = entry;
+		}
+	}
+
+	if (free_entry != NULL) {
+		memset(free_entry, 0, sizeof(*free_entry));
+		free_entry->err_code = err_code;
+	}
+
+	return free_entry;
+}
+
+
+void err_coalescer_init(struct err_coalescer *coalescer)
+{
+	memset(coalescer, 0, sizeof(*coalescer));
+}
+
+bool err_coalescer_record(struct err_coalescer *coalescer,
+                          int32_t err_code,
+                          uint32_t now_us)
+{
+	struct err_coalescer_entry *entry = find_entry(coalescer, err_code, now_us);
+	if (entry == NULL) {
+		coalescer->num_dropped++;
+		return false;
+	}
+
+	// First occurrence, or the first one after a quiet interval.
+	if (!entry->in_use ||
+	    (entry->pending.count == 0 && interval_passed(entry, now_us))) {
+
+		entry->in_use = true;
+		entry->last_report_time_us = now_us;
+		return true;
+	}
+
+	if (entry->pending.count == 0) {
+		entry->pending.err_code = err_code;
+		entry->pending.first_time_us = now_us;
+	}
+
+	entry->pending.count++;
+	entry->pending.last_time_us = now_us;
+
+	return false;
+}
+
+bool err_coalescer_take_report(struct err_coalescer *coalescer,
+                               uint32_t now_us,
+                               struct err_report *report)
+{
+	for (uint32_t i = 0; i < ERR_COALESCER_SIZE; i++) {
+		struct err_coalescer_entry *entry = &coalescer->entries[i];
+
+		if (entry->pending.count == 0 || !interval_passed(entry, now_us)) {
+			continue;
+		}
+
+		*report = entry->pending;
+
+		entry->pending.count = 0;
+		entry->last_report_time_us = now_us;
+
+		return true;
+	}
+
+	return false;
+}
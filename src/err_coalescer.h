@@ -0,0 +1,90 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for the error coalescer, which limits
+ * how often each error code of a subsystem gets reported over the UART link.
+ *
+ * The first occurrence of an error code gets reported right away. Further
+ * occurrences within ERR_REPORT_INTERVAL_US of the last report only get
+ * counted, and are reported together in a single report once the interval has
+ * passed, with their count, and the time of the first & last one.
+ *
+ * All times are in microseconds, as returned by bsp_get_timestamp_us(), and may
+ * wrap around.
+ */
+
+#ifndef ERR_COALESCER_H_
+#define ERR_COALESCER_H_
+
+#include <stdbool.h> // For bools
+#include <stdint.h> // For uint32_t, etc.
+
+#include "constants.h" // For ERR_COALESCER_SIZE
+
+/**
+ * An aggregated report of the occurrences of an error code.
+ */
+struct err_report {
+	int32_t err_code;
+	/** The number of occurrences since the last report. */
+	uint32_t count;
+	uint32_t first_time_us;
+	uint32_t last_time_us;
+};
+
+/**
+ * State of the error coalescer of a single subsystem.
+ */
+struct err_coalescer {
+	struct err_coalescer_entry {
+		int32_t err_code;
+		/** Whether the entry is tracking err_code. */
+		bool in_use;
+		/** When err_code got last reported. */
+		uint32_t last_report_time_us;
+		/** The occurrences waiting to be reported. */
+		struct err_report pending;
+	} entries[ERR_COALESCER_SIZE];
+
+	/**
+	 * Occurrences of error codes that didn't get an entry, because all of
+	 * them were taken by codes with pending occurrences.
+	 */
+	uint32_t num_dropped;
+};
+
+
+/**
+ * Initializes the coalescer.
+ *
+ * @param coalescer The coalescer to initialize.
+ */
+void err_coalescer_init(struct err_coalescer *coalescer);
+
+/**
+ * Records an occurrence of an error code.
+ *
+ * @param coalescer The coalescer.
+ * @param err_code  The error code.
+ * @param now_us    The current time.
+ * @return True if the error should be reported right away, false if it has
+ *         been added to a later report, or dropped.
+ */
+bool err_coalescer_record(struct err_coalescer *coalescer,
+                          int32_t err_code,
+                          uint32_t now_us);
+
+/**
+ * Takes an aggregated report that is due to be sent.
+ *
+ * @param coalescer The coalescer.
+ * @param now_us    The current time.
+ * @param report    Output for the report.
+ * @return True if a report was due, false otherwise.
+ */
+bool err_coalescer_take_report(struct err_coalescer *coalescer,
+                               uint32_t now_us,
+                               struct err_report *report);
+
+
+#endif /* ERR_COALESCER_H_ */
@@ -0,0 +1,229 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the bounded output formatter.
+ */
+
+#include <math.h> // For fabsf, isnan, isinf, signbit
+#include <string.h> // For memcpy
+
+#include "fmt.h"
+
+
+_Static_assert(sizeof(struct fmt_writer) == FMT_WRITER_SIZE,
+               "struct fmt_writer changed, update FMT_WRITER_SIZE and rust/src/bindings/fmt.rs");
+
+static const uint32_t pow10_lut[FMT_MAX_DECIMALS + 1] = {
+	1u, 10u, 100u, 1000u, 10000u, 100000u,
+	1000000u, 10000000u, 100000000u, 1000000000u
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+
+static void put_padded_u32(struct fmt_writer *writer,
+                           uint32_t value,
+                           uint8_t min_digits);
+
+
+static void put_padded_u32(struct fmt_writer *writer,
+                           uint32_t value,
+                           uint8_t min_digits)
+{
+	// UINT32_MAX has 10 digits.
+	char digits[10];
+	uint8_t num_digits = 0;
+
+	do {
+		digits[num_digits++] = (char) ('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+
+	while (num_digits < min_digits) {
+		digits[num_digits++] = '0';
+	}
+
+	while (num_digits > 0) {
+		fmt_put_ch(writer, digits[--num_digits]);
+	}
+}
+
+
+void fmt_writer_init(struct fmt_writer *writer, char *buf, uint32_t max_len)
+{
+	writer->buf = buf;
+	writer->len = 0;
+	writer->max_len = max_len;
+	writer->windowed = false;
+	writer->skip = 0;
+	writer->total_len = 0;
+	writer->overflow = false;
+}
+
+void fmt_writer_init_window(struct fmt_writer *writer,
+                            char *buf,
+                            uint32_t max_len,
+                            uint32_t offset)
+{
+	fmt_writer_init(writer, buf, max_len);
+
+	writer->windowed = true;
+	writer->skip = offset;
+}
+
+ssize_t fmt_writer_finish(struct fmt_writer *writer)
+{
+	if (writer->overflow || writer->len >= writer->max_len) {
+		return -1;
+	}
+
+	writer->buf[writer->len] = '\0';
+
+	return (ssize_t) writer->len;
+}
+
+ssize_t fmt_writer_finish_window(struct fmt_writer *writer)
+{
+	if (writer->overflow) {
+		return -1;
+	}
+
+	return (ssize_t) writer->total_len;
+}
+
+void fmt_put_ch(struct fmt_writer *writer, char ch)
+{
+	if (writer->overflow) {
+		return;
+	}
+
+	if (writer->windowed) {
+		writer->total_len++;
+
+		if (writer->skip > 0) {
+			writer->skip--;
+			return;
+		}
+
+		if (writer->len >= writer->max_len) {
+			return;
+		}
+	} else if (writer->len >= writer->max_len) {
+		writer->overflow = true;
+		return;
+	}
+
+	writer->buf[writer->len++] = ch;
+}
+
+void fmt_put_str(struct fmt_writer *writer, const char *str)
+{
+	for (const char *ch = str; *ch != '\0' && !writer->overflow; ch++) {
+		fmt_put_ch(writer, *ch);
+	}
+}
+
+void fmt_put_u32(struct fmt_writer *writer, uint32_t value)
+{
+	put_padded_u32(writer, value, 1);
+}
+
+void fmt_put_i32(struct fmt_writer *writer, int32_t value)
+{
+	if (value < 0) {
+		fmt_put_ch(writer, '-');
+		put_padded_u32(writer, 0u - (uint32_t) value, 1);
+	} else {
+		put_padded_u32(writer, (uint32_t) value, 1);
+	}
+}
+
+void fmt_put_hex_u8(struct fmt_writer *writer, uint8_t value)
+{
+	fmt_put_ch(writer, hex_digits[value >> 4]);
+	fmt_put_ch(writer, hex_digits[value & 0x0F]);
+}
+
+void fmt_put_float(struct fmt_writer *writer, float value, uint8_t num_decimals)
+{
+	if (num_decimals > FMT_MAX_DECIMALS) {
+		writer->overflow = true;
+		return;
+	}
+
+	if (isnan(value)) {
+		fmt_put_str(writer, "nan");
+		return;
+	}
+
+	// Negative zeros, and negatives that round to zero, keep their sign.
+	if (signbit(value)) {
+		fmt_put_ch(writer, '-');
+	}
+
+	if (isinf(value)) {
+		fmt_put_str(writer, "inf");
+		return;
+	}
+
+	float abs_value = fabsf(value);
+
+	// 2^32, i.e. the integer part wouldn't fit into a uint32_t.
+	if (abs_value >= 4294967296.0f) {
+		writer->overflow = true;
+		return;
+	}
+
+	// Floats that large have no fractional part, so the increment in the
+	// rounding below can't overflow.
+	uint32_t int_part = (uint32_t) abs_value;
+	uint32_t frac_part = 0;
+
+	// The fractional part is exact. Scaled in integers, it stays exact, so
+	// that it gets rounded like printf() does: to the nearest, ties to even.
+	float frac = abs_value - (float) int_part;
+	if (frac > 0.0f) {
+		// frac = mantissa * 2^-shift, with an at most 24 bit mantissa.
+		// frac < 1, so shift is at least 24.
+		uint32_t bits = 0;
+		memcpy(&bits, &frac, sizeof(bits));
+
+		uint32_t biased_exp = (bits >> 23) & 0xFF;
+		uint64_t mantissa = bits & 0x7FFFFF;
+		uint32_t shift = 149;
+
+		// Normal, rather than subnormal.
+		if (biased_exp > 0) {
+			mantissa |= 0x800000;
+			shift = 150 - biased_exp;
+		}
+
+		// Less than 2^24 * 10^9 < 2^54.
+		uint64_t scaled = mantissa * pow10_lut[num_decimals];
+
+		// Anything shifted further is far below half a unit.
+		if (shift < 64) {
+			uint64_t rem = scaled & ((1ull << shift) - 1);
+			uint64_t half = 1ull << (shift - 1);
+
+			frac_part = (uint32_t) (scaled >> shift);
+
+			uint32_t last_digit = (num_decimals > 0) ? frac_part : int_part;
+			if (rem > half || (rem == half && (last_digit & 1) != 0)) {
+				frac_part++;
+			}
+		}
+	}
+
+	if (frac_part >= pow10_lut[num_decimals]) {
+		frac_part -= pow10_lut[num_decimals];
+		int_part++;
+	}
+
+	put_padded_u32(writer, int_part, 1);
+
+	if (num_decimals > 0) {
+		fmt_put_ch(writer, '.');
+		put_padded_u32(writer, frac_part, num_decimals);
+	}
+}
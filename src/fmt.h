@@ -0,0 +1,154 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for the bounded output formatter used by
+ * the message serializers instead of snprintf(). It only knows what the
+ * messages need: characters, strings, decimal & hex integers, and floats with a
+ * fixed number of decimals.
+ */
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdbool.h> // For bools
+#include <stdint.h> // For uint32_t, etc.
+#include <sys/types.h> // For ssize_t
+
+/**
+ * The maximum number of decimals fmt_put_float() can print.
+ */
+#define FMT_MAX_DECIMALS 9
+
+/**
+ * The size of struct fmt_writer. The Rust binding (rust/src/bindings/fmt.rs)
+ * mirrors the struct, and checks its own size against this, so the two must be
+ * changed together.
+ */
+#define FMT_WRITER_SIZE (sizeof(char *) + 6 * sizeof(uint32_t))
+
+/**
+ * State of the formatter. Mirrored by the Rust binding, see FMT_WRITER_SIZE.
+ */
+struct fmt_writer {
+	char *buf;
+	uint32_t len;
+	uint32_t max_len;
+
+	/**
+	 * Whether the writer only keeps a window of the output, see
+	 * fmt_writer_init_window().
+	 */
+	bool windowed;
+	/** The number of characters still to be skipped before the window. */
+	uint32_t skip;
+	/** The length of the whole output, in and out of the window. */
+	uint32_t total_len;
+
+	/**
+	 * Set once something didn't fit into buf, or couldn't be formatted.
+	 * All subsequent writes are ignored.
+	 */
+	bool overflow;
+};
+
+
+/**
+ * Initializes the formatter.
+ *
+ * @param writer  The formatter to initialize.
+ * @param buf     The output buffer.
+ * @param max_len The size of buf.
+ */
+void fmt_writer_init(struct fmt_writer *writer, char *buf, uint32_t max_len);
+
+/**
+ * Initializes the formatter to only keep the part of the output starting at
+ * offset, as much of it as fits into buf. Whatever comes before or after that
+ * window gets dropped, without it being an overflow. This lets long output be
+ * produced piecewise, without ever having all of it in memory.
+ *
+ * @param writer  The formatter to initialize.
+ * @param buf     The output buffer.
+ * @param max_len The size of buf.
+ * @param offset  The position of the window in the whole output.
+ */
+void fmt_writer_init_window(struct fmt_writer *writer,
+                            char *buf,
+                            uint32_t max_len,
+                            uint32_t offset);
+
+/**
+ * NUL terminates the output, and returns its length, i.e. what the message
+ * serialization functions are supposed to return.
+ *
+ * @param writer The formatter.
+ * @return The length of the output, excluding the NUL terminator, or -1 if it
+ *         didn't fit into the buffer along with the NUL terminator.
+ */
+ssize_t fmt_writer_finish(struct fmt_writer *writer);
+
+/**
+ * Returns the length of the whole output of a windowed formatter. The output
+ * isn't NUL terminated. writer->len is the number of characters in the window.
+ *
+ * @param writer The formatter.
+ * @return The length of the output, including the characters outside of the
+ *         window, or -1 if something couldn't be formatted.
+ */
+ssize_t fmt_writer_finish_window(struct fmt_writer *writer);
+
+/**
+ * Appends a character.
+ *
+ * @param writer The formatter.
+ * @param ch     The character.
+ */
+void fmt_put_ch(struct fmt_writer *writer, char ch);
+
+/**
+ * Appends a NUL terminated string, without the NUL terminator.
+ *
+ * @param writer The formatter.
+ * @param str    The string.
+ */
+void fmt_put_str(struct fmt_writer *writer, const char *str);
+
+/**
+ * Appends an unsigned integer in decimal.
+ *
+ * @param writer The formatter.
+ * @param value  The integer.
+ */
+void fmt_put_u32(struct fmt_writer *writer, uint32_t value);
+
+/**
+ * Appends a signed integer in decimal.
+ *
+ * @param writer The formatter.
+ * @param value  The integer.
+ */
+void fmt_put_i32(struct fmt_writer *writer, int32_t value);
+
+/**
+ * Appends a byte as two uppercase hex digits.
+ *
+ * @param writer The formatter.
+ * @param value  The byte.
+ */
+void fmt_put_hex_u8(struct fmt_writer *writer, uint8_t value);
+
+/**
+ * Appends a float in decimal, rounded to num_decimals decimals, like the "%.*f"
+ * printf() conversion, i.e. to the nearest, ties to even, and with the sign of
+ * negative zeros. NaNs and infinities are written as "nan", "inf", and
+ * "-inf". Values whose integer part doesn't fit into 32 bits can't be
+ * formatted.
+ *
+ * @param writer       The formatter.
+ * @param value        The float.
+ * @param num_decimals The number of decimals, at most FMT_MAX_DECIMALS.
+ */
+void fmt_put_float(struct fmt_writer *writer, float value, uint8_t num_decimals);
+
+
+#endif /* FMT_H_ */
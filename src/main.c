@@ -5,10 +5,7 @@
 
 #include "bsp.h"
 #include "message_dispatcher.h"
-
-#include "spinner/spinner.h"
-
-#include "meteo/meteo.h"
+#include "constants.h"
 
 int main(void)
 {
@@ -16,17 +13,10 @@ int main(void)
 
 	bsp_init();
 
+	// Also initializes the linked in subsystems.
 	dispatcher_init();
 
-#ifdef INCLUDE_SPINNER
-	spinner_init();
-#endif
-
-#ifdef INCLUDE_METEO
-	meteo_init();
-#endif
-
-	os_tasks_start(1000);
+	os_tasks_start(OS_TICK_RATE_HZ);
 
 	while (true) {
 	}
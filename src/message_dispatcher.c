@@ -5,478 +5,3775 @@
  */
 
 #include <stddef.h> // For NULL
-#include <stdlib.h> // For the string parsing functions.
-#include <errno.h> // For errno.
-#include <stdio.h> // snprintf
-#include <string.h> // For strtok_r
+#include <string.h> // For strcmp, memset, memmove
 
 #include <mouros/common.h> // For ARRAY_SIZE
+#include <mouros/pool_alloc.h> // For the dispatcher's own messages.
 
 #include "worker.h" // For the workers.
 #include "message_dispatcher.h"
-#include "bsp.h" // For bsp_rx_buffer & bsp_tx_buffer.
+#include "message_fields.h" // For the streaming field parser.
+#include "byte_ring.h" // For parsing bsp_rx_buffer & writing frames into bsp_tx_buffer in place.
+#include "cobs.h" // For binary protocol framing.
+#include "fmt.h" // For formatting ASCII frames.
+#include "binary_fields.h" // For binary protocol header fields.
+#include "err_coalescer.h" // For rate limiting error messages.
+#include "message_trace.h" // For the latency histograms.
+#include "message_slab.h" // For message_slab_init(), message_slab_free_slots()
+#include "bsp.h" // For bsp_links.
 #include "constants.h"
 #include "errors.h"
 
 
+/**
+ * The number of bytes a subsystem with a tx_weight of 1 may send per scheduler
+ * round. At least one maximum length message, so that a subsystem with pending
+ * messages always gets to send one on its turn.
+ */
+#define TX_SCHED_QUANTUM BSP_MAX_MESSAGE_LENGTH
+
+/**
+ * How long the TX worker waits for the UART to drain the TX ring, when there's
+ * no room for another frame.
+ */
+#define TX_RING_FULL_SLEEP_TICKS 1
+
+/** Transaction ID, subsystem ID, and message ID. */
+#define BINARY_HEADER_LEN 6
+#define BINARY_CRC_LEN 2
+/** Error code, count, and the times of the first & last occurrence. */
+#define BINARY_ERR_REPORT_PAYLOAD_LEN 16
+/** Subsystem ID, and four counters. */
+#define BINARY_SUBSYSTEM_STATS_PAYLOAD_LEN 17
+
+/** Subsystem ID, and its credits, for each subsystem in a CREDITS_REPLY. */
+#define BINARY_CREDITS_ENTRY_LEN 5
+
+/** The number of counters in a STATS_REPLY. */
+#define NUM_STATS_REPLY_VALUES 9
+
+/** Stage, and the histogram buckets. */
+#define BINARY_LATENCY_PAYLOAD_LEN (1 + 4 * LATENCY_HISTOGRAM_BUCKETS)
+
+/** Subsystem ID, message ID, and period, followed by the request payload. */
+#define BINARY_SUBSCRIBE_HEADER_LEN 6
+
+#define US_PER_OS_TICK (1000000 / OS_TICK_RATE_HZ)
+
+/** '*', the checksum, and "\r\n". */
+#define ASCII_FRAME_TRAILER_LEN 5
+
+/** The longest fragment header, "<transaction ID>/<sequence number>+". */
+#define ASCII_FRAGMENT_ID_MAX_LEN 22
+
+/**
+ * The link a request came in on is kept in the top bits of its transaction ID,
+ * so that the replies to it find their way back to that link. The control
+ * link's tag is 0, so with a single link, transaction IDs stay as they are.
+ */
+#define LINK_ID_SHIFT 28
+#define LINK_TRANSACTION_ID_MASK ((1u << LINK_ID_SHIFT) - 1)
+
+/**
+ * The link of bsp_rx_buffer & bsp_tx_buffer. Its TX worker is the one that
+ * takes the subsystems' messages off their queues.
+ */
+#define CONTROL_LINK_ID 0
+
+#if BSP_NUM_LINKS > 2
+#error "Only the workers of two links have names."
+#endif
+
+enum rx_frame_state {
+	RX_FRAME_IDLE,
+	RX_FRAME_BODY,
+	RX_FRAME_CSUM_HIGH,
+	RX_FRAME_CSUM_LOW,
+	RX_FRAME_CR,
+	RX_FRAME_LF
+};
+
+/**
+ * Counters of the dispatcher's activity, reported by the GET_STATS and
+ * GET_SUBSYSTEM_STATS messages. The RX counters only get incremented by the RX
+ * worker, and the TX counters by the TX worker, so they need no locking.
+ */
+struct dispatcher_stats {
+	/** Frames with a correct checksum. */
+	uint32_t rx_frames;
+	uint32_t rx_checksum_errors;
+	uint32_t rx_too_long_errors;
+	/**
+	 * The most characters taken off bsp_rx_buffer in a single wakeup of the
+	 * RX worker, i.e. a lower bound on its peak fill level.
+	 */
+	uint32_t rx_buffer_high_water;
+
+	/** Frames written into the TX ring, errors included. */
+	uint32_t tx_frames;
+	/** The peak fill level of the TX ring, in bytes. */
+	uint32_t tx_ring_high_water;
+};
+
+/**
+ * The transaction ID field of an ASCII fragment.
+ */
+struct fragment_id {
+	uint32_t transaction_id;
+	uint32_t seq;
+	/** Whether more fragments follow. */
+	bool more;
+};
+
+/**
+ * A request the RX worker routes to a subsystem periodically, as set up by a
+ * SUBSCRIBE message. The request gets parsed anew from its stored payload each
+ * time, as the subsystem frees the message once it's done with it.
+ */
+struct subscription {
+	/** The transaction ID of the SUBSCRIBE message. */
+	uint32_t id;
+	bool active;
+
+	uint8_t subsystem_id;
+	uint8_t msg_idx;
+
+	uint32_t period_us;
+	uint32_t next_due_us;
+
+	/** The protocol the payload is in. */
+	enum dispatcher_protocol protocol;
+	uint32_t payload_len;
+	/** ASCII payloads are the fields with their commas, NUL terminated. */
+	char payload[SUBSCRIPTION_PAYLOAD_SIZE];
+};
+
+/**
+ * The subscriptions. Only touched by the RX worker.
+ */
+struct subscription_table {
+	struct subscription slots[SUBSCRIPTION_SLOTS];
+	uint32_t num_active;
+};
 
 struct rx_worker_context {
-	char incoming_msg_buf[BSP_MAX_MESSAGE_LENGTH];
-	uint32_t pos_in_buf;
-	mailbox_t *rx_char_buffer;
-	bool msg_is_incoming;
+	/**
+	 * The fields of a message get handed to its subsystem's parsing
+	 * function all at once, so a fragmented message is reassembled here in
+	 * full, before it gets parsed.
+	 */
+	char incoming_msg_buf[BSP_MAX_REASSEMBLED_LENGTH];
+	struct message_field incoming_msg_fields[BSP_MAX_MESSAGE_FIELDS];
+	struct message_field_parser parser;
+	struct cobs_decoder decoder;
+	struct byte_ring *rx_char_buffer;
+	/**
+	 * The link's count of characters dropped because the RX buffer was
+	 * full, as of the last RX_BUFFER_FULL raised for them.
+	 */
+	uint32_t rx_dropped_seen;
+
+	enum dispatcher_protocol protocol;
+
+	enum rx_frame_state frame_state;
+	uint8_t calculated_csum;
+	uint8_t received_csum;
+	/** The number of characters in the frame so far, excluding the '$'. */
+	uint32_t frame_len;
+
+	/**
+	 * The fragmented message being reassembled in the parser, if any. Its
+	 * fragments have to arrive back to back.
+	 */
+	bool reassembling;
+	uint32_t reassembly_transaction_id;
+	uint32_t reassembly_next_seq;
+
+	/**
+	 * The first field of a frame arriving during reassembly. Only once
+	 * it's complete is it known whether the frame continues the message.
+	 */
+	bool in_frame_id;
+	char frame_id[ASCII_FRAGMENT_ID_MAX_LEN];
+	uint32_t frame_id_len;
+
+	/** Whether the frame continues the message being reassembled. */
+	bool frame_continues;
+	/** Whether more fragments follow the frame. */
+	bool frame_has_more;
+
+	/**
+	 * Trace points of the frame being received. They only get recorded
+	 * once it's known which transaction the frame belongs to. A message
+	 * received in fragments starts with its first fragment, and is done
+	 * with its last one.
+	 */
+	bool frame_started;
+	uint32_t frame_start_us;
+	uint32_t frame_done_us;
+	uint32_t parsed_us;
+	/**
+	 * The start of a frame arriving during reassembly, which becomes the
+	 * message's, if the frame doesn't continue the one being reassembled.
+	 */
+	uint32_t fragment_start_us;
+
+	/** For the ASCII payloads of subscriptions. */
+	char subscription_buf[SUBSCRIPTION_PAYLOAD_SIZE];
+	struct message_field subscription_fields[SUBSCRIPTION_MAX_FIELDS];
+	struct message_field_parser subscription_parser;
+
+	worker_t *worker;
+	/** The index of the link in bsp_links[]. */
+	uint8_t link_id;
 
 	struct subsystems *subsystems;
+	struct subscription_table *subscriptions;
+	struct dispatcher_stats *stats;
 
 	mailbox_t *err_msg_queue;
+	mailbox_t *dispatcher_msg_queue;
+};
+
+/**
+ * A message being sent in fragments. Nothing but errors gets sent until all of
+ * its fragments have been.
+ */
+struct tx_fragmenter {
+	/** The message, or NULL if there's none. */
+	struct message *msg;
+	struct subsystem_message_conf *conf;
+	uint8_t subsystem_id;
+
+	/** Where in the payload the next fragment starts. */
+	uint32_t offset;
+	uint32_t seq;
+	/** Where the serializer resumes for the next fragment. */
+	struct stream_cursor cursor;
+};
+
+/**
+ * State of the TX scheduler. Error queues are a strict priority class, served
+ * round robin. Regular messages are scheduled by deficit round robin, with a
+ * quantum of TX_SCHED_QUANTUM bytes times the subsystem's tx_weight. The
+ * deficits are kept in the subsystems' struct subsystem_dispatch_state.
+ */
+struct tx_scheduler {
+	/** The subsystem whose error queue gets checked first. */
+	uint32_t next_err_subsystem;
+
+	/** The subsystem whose turn it is to send messages. */
+	uint32_t current_subsystem;
+	/** Whether the current subsystem has got its quantum for its turn. */
+	bool quantum_added;
+};
+
+/**
+ * A subsystem's message, or an error of one of its transactions, handed over
+ * by the control link's TX worker to that of the link the transaction came in
+ * on, or deferred by the control link's TX worker, see
+ * hand_over_while_full().
+ */
+struct routed_entry {
+	uint8_t subsystem_id;
+	/** The message, or NULL for an error. */
+	struct message *msg;
+	struct error_entry err;
 };
 
 struct tx_worker_context {
-	mailbox_t *tx_char_buffer;
+	struct byte_ring *tx_ring;
+
+	enum dispatcher_protocol protocol;
+
+	struct tx_scheduler sched;
+	struct tx_fragmenter fragmenter;
+
+	worker_t *worker;
+	/**
+	 * The index of the link in bsp_links[]. Only the control link's worker
+	 * schedules the subsystems' queues, the others send what it hands over
+	 * to them on their routed_queue.
+	 */
+	uint8_t link_id;
+
+	/** The dispatcher's own error coalescer. */
+	struct err_coalescer disp_err_coalescer;
 
 	struct subsystems *subsystems;
+	struct dispatcher_stats *stats;
 
 	mailbox_t *err_msg_queue;
+	mailbox_t *dispatcher_msg_queue;
+	mailbox_t *routed_queue;
+
+	/**
+	 * Set on the control link while its TX ring is full. Its own subsystem
+	 * messages & errors then get deferred onto its routed_queue, so that
+	 * the other links' ones behind them can still be handed over.
+	 */
+	bool deferring;
+	/** A deferred entry that didn't fit onto the routed_queue. */
+	bool holding;
+	struct routed_entry held;
+};
+
+/**
+ * A UART link to the host, see bsp_links. Each link has RX & TX workers of its
+ * own, so that a busy link doesn't hold up the others. The subsystems, and the
+ * pool of the dispatcher's own messages are shared.
+ */
+struct dispatcher_link {
+	struct rx_worker_context rx_context;
+	struct tx_worker_context tx_context;
+
+	worker_t rx_worker;
+	worker_t tx_worker;
+
+	/** Errors of the link's own frames & messages. */
+	struct error_entry err_msg_queue_buf[MAX_DISPATCHER_ERROR_MESSAGES];
+	mailbox_t err_msg_queue;
+
+	/** The dispatcher's replies to the link's requests. */
+	struct message *dispatcher_msg_queue_buf[DISPATCHER_MSG_POOL_SIZE * BSP_NUM_LINKS];
+	mailbox_t dispatcher_msg_queue;
+
+	struct routed_entry routed_queue_buf[ROUTED_QUEUE_SIZE];
+	mailbox_t routed_queue;
+
+	struct subscription_table subscriptions;
+	struct dispatcher_stats stats;
+};
+
+/**
+ * Writes an ASCII frame into a region reserved in the TX ring, and calculates
+ * its checksum along the way.
+ */
+struct frame_writer {
+	struct fmt_writer fmt;
+	uint8_t csum;
+};
+
+/**
+ * Messages of the dispatcher's own subsystem. These get handled by the RX
+ * worker, so they don't need an incoming message queue.
+ */
+enum dispatcher_msg_type {
+	DISPATCHER_MSG_SET_PROTOCOL,
+	DISPATCHER_MSG_PROTOCOL_REPLY,
+	DISPATCHER_MSG_GET_STATS,
+	DISPATCHER_MSG_STATS_REPLY,
+	DISPATCHER_MSG_GET_SUBSYSTEM_STATS,
+	DISPATCHER_MSG_SUBSYSTEM_STATS_REPLY,
+	DISPATCHER_MSG_SUBSCRIBE,
+	DISPATCHER_MSG_SUBSCRIBE_REPLY,
+	DISPATCHER_MSG_UNSUBSCRIBE,
+	DISPATCHER_MSG_UNSUBSCRIBE_REPLY,
+	DISPATCHER_MSG_GET_CREDITS,
+	DISPATCHER_MSG_CREDITS_REPLY,
+	DISPATCHER_MSG_GET_LATENCY,
+	DISPATCHER_MSG_LATENCY_REPLY
+};
+
+struct dispatcher_msg {
+	struct message msg;
+	union dispatcher_msg_data {
+		enum dispatcher_protocol protocol;
+		uint8_t subsystem_id;
+		struct subscription subscription;
+		uint32_t subscription_id;
+		uint8_t latency_stage;
+	} data;
+};
+
+/**
+ * Hash table entry for a subsystem name, or a message name of a subsystem.
+ * Subsystem entries are keyed by the hash of the subsystem name, message
+ * entries by name_table_message_key().
+ */
+struct name_table_entry {
+	uint32_t hash;
+	struct subsystem_message_conf *conf;
+	uint32_t msg_idx;
+	/** The subsystem's ID, DISPATCHER_SUBSYSTEM_ID for the dispatcher. */
+	uint8_t subsystem_id;
 };
 
+/** The msg_idx of subsystem name entries. */
+#define NAME_TABLE_SUBSYSTEM_ENTRY UINT32_MAX
+
+/**
+ * The subsystem registry, and the name table of the registered subsystems.
+ * Subsystem IDs index the registry.
+ */
 struct subsystems {
-	struct subsystem_message_conf *subsystem_configurations[MAX_NUM_COMM_SUBSYSTEMS];
+	const struct ratfist_subsystem *registry;
 	uint32_t num_subsystems;
+
+	struct name_table_entry name_table[NAME_TABLE_SIZE];
+	uint32_t name_table_used;
 };
 
 
 static void assemble_incoming_message(void *params);
+static void check_rx_dropped(struct rx_worker_context *ctx);
 static void check_outgoing_queue(void *params);
 
+static void notify_rx_workers(void);
+static void notify_tx_workers(void);
+
+static uint32_t tag_transaction_id(uint32_t transaction_id, uint8_t link_id);
+static uint8_t transaction_link_id(uint32_t transaction_id);
+static uint32_t wire_transaction_id(uint32_t transaction_id);
+static bool transaction_id_valid(uint32_t transaction_id);
 
-static uint8_t calc_checksum(char *buffer, uint32_t len);
+static uint8_t calc_checksum(const char *buffer, uint32_t len);
 
+static void process_incoming_char(struct rx_worker_context *context, char ch);
+static void process_incoming_byte(struct rx_worker_context *context, uint8_t byte);
+static void drop_incoming_frame(struct rx_worker_context *ctx, int32_t err_code);
+static void take_frame_id(struct rx_worker_context *ctx, bool complete);
+static void abort_reassembly(struct rx_worker_context *ctx);
+static bool parse_fragment_id(const char *str,
+                              uint32_t len,
+                              struct fragment_id *id);
+static int8_t hex_digit_value(char ch);
 
 static void process_incoming_message(struct rx_worker_context *ctx);
+static void process_incoming_binary_message(struct rx_worker_context *ctx);
+static void route_incoming_message(struct rx_worker_context *ctx,
+                                   struct subsystem_message_conf *conf,
+                                   uint8_t subsystem_id,
+                                   struct message *msg);
+static bool handle_dispatcher_message(struct rx_worker_context *ctx,
+                                      struct message *msg);
+static void set_rx_protocol(struct rx_worker_context *ctx,
+                            enum dispatcher_protocol protocol);
+static void count_rx_dropped(struct rx_worker_context *ctx,
+                             uint8_t subsystem_id);
+static void trace_incoming_message(struct rx_worker_context *ctx,
+                                   struct message *msg);
+static uint32_t process_subscriptions(struct rx_worker_context *ctx);
+static void route_subscription_request(struct rx_worker_context *ctx,
+                                       struct subscription *sub);
+static struct subscription *find_subscription(struct subscription_table *table,
+                                              uint32_t id);
+static struct subsystem_message_conf *get_subsystem_conf(struct subsystems *subsys,
+                                                        uint8_t subsystem_id);
+static struct subsystem_stats *get_subsystem_stats(struct subsystems *subsys,
+                                                   uint8_t link_id,
+                                                   uint8_t subsystem_id);
+
+static void process_outgoing_err_message(struct tx_worker_context *ctx,
+                                         struct subsystem_message_conf *conf,
+                                         uint8_t subsystem_id,
+                                         uint32_t transaction_id,
+                                         const struct err_report *report);
+static uint32_t write_ascii_err_message(char *buf,
+                                        uint32_t buf_len,
+                                        struct subsystem_message_conf *conf,
+                                        uint32_t transaction_id,
+                                        const struct err_report *report);
+static uint32_t write_binary_err_message(uint8_t *reserved,
+                                         uint32_t reserved_len,
+                                         uint8_t subsystem_id,
+                                         uint32_t transaction_id,
+                                         const struct err_report *report);
+static void process_incoming_err_entry(struct tx_worker_context *ctx,
+                                       struct err_coalescer *coalescer,
+                                       struct subsystem_message_conf *conf,
+                                       uint8_t subsystem_id,
+                                       const struct error_entry *err_entry,
+                                       uint32_t now_us);
+
+static bool tx_ring_has_room(struct tx_worker_context *ctx);
+static bool send_next_message(struct tx_worker_context *context);
+static bool send_subsystem_error(struct tx_worker_context *ctx, uint32_t now_us);
+static bool send_err_report(struct tx_worker_context *ctx, uint32_t now_us);
+static bool send_subsystem_message(struct tx_worker_context *ctx);
+static void hand_over_to_link(struct tx_worker_context *ctx,
+                              uint8_t link_id,
+                              const struct routed_entry *entry);
+static bool send_routed_entry(struct tx_worker_context *ctx, uint32_t now_us);
+static void send_entry(struct tx_worker_context *ctx,
+                       const struct routed_entry *entry,
+                       uint32_t now_us);
+static void hand_over_while_full(struct tx_worker_context *ctx);
+static void defer_entry(struct tx_worker_context *ctx,
+                        const struct routed_entry *entry);
+
+static uint32_t process_outgoing_message(struct tx_worker_context *ctx,
+                                         struct subsystem_message_conf *conf,
+                                         uint8_t subsystem_id,
+                                         struct message *msg);
+static void finish_outgoing_message(struct tx_worker_context *ctx,
+                                    struct subsystem_message_conf *conf,
+                                    uint8_t subsystem_id,
+                                    struct message *msg,
+                                    int32_t err_code);
+static uint32_t send_next_fragment(struct tx_worker_context *ctx);
+static int32_t write_ascii_fragment(struct tx_worker_context *ctx,
+                                    struct tx_fragmenter *frag,
+                                    uint32_t *frame_len,
+                                    bool *last);
+static int32_t write_ascii_message(struct tx_worker_context *ctx,
+                                   struct subsystem_message_conf *conf,
+                                   struct message *msg,
+                                   uint32_t *frame_len);
+static int32_t write_binary_message(struct tx_worker_context *ctx,
+                                    struct subsystem_message_conf *conf,
+                                    uint8_t subsystem_id,
+                                    struct message *msg,
+                                    uint32_t *frame_len);
+static uint32_t max_ascii_frame_len(struct tx_worker_context *ctx);
+static void record_tx_frame(struct tx_worker_context *ctx);
+static void trace_outgoing_message(struct tx_worker_context *ctx,
+                                   struct message *msg);
+
+static void frame_writer_init(struct frame_writer *writer, char *buf, uint32_t max_len);
+static void frame_add_to_checksum(struct frame_writer *writer, uint32_t start);
+static void frame_put_ch(struct frame_writer *writer, char ch);
+static void frame_put_str(struct frame_writer *writer, const char *str);
+static void frame_put_u32(struct frame_writer *writer, uint32_t value);
+static void frame_put_i32(struct frame_writer *writer, int32_t value);
+static void frame_put_checksum(struct frame_writer *writer);
+static void frame_put_fragment_header(struct frame_writer *writer,
+                                      struct tx_fragmenter *frag,
+                                      bool last);
+
+static uint32_t binary_payload_offset(uint32_t reserved_len);
+static uint32_t binary_max_payload_len(uint32_t reserved_len);
+static uint32_t encode_binary_frame(uint8_t *reserved,
+                                    uint32_t reserved_len,
+                                    uint32_t transaction_id,
+                                    uint8_t subsystem_id,
+                                    uint8_t message_id,
+                                    uint32_t payload_len);
+
+static bool schedule_err_message(mailbox_t *err_msg_queue,
+                                 int32_t err_code,
+                                 uint32_t transaction_id);
+
+static uint32_t name_table_message_key(uint32_t subsystem_hash,
+                                       uint32_t message_hash);
+static void name_table_insert(struct subsystems *subsys,
+                              uint32_t hash,
+                              struct subsystem_message_conf *conf,
+                              uint32_t msg_idx,
+                              uint8_t subsystem_id);
+static struct name_table_entry *name_table_find(struct subsystems *subsys,
+                                                uint32_t hash,
+                                                struct subsystem_message_conf *conf,
+                                                const char *name);
+
+static bool parse_set_protocol(struct message *msg,
+                               const struct message_field *fields,
+                               uint32_t num_fields);
+static bool parse_binary_set_protocol(struct message *msg,
+                                      const uint8_t *payload,
+                                      uint32_t payload_len);
+static ssize_t serialize_protocol_reply(const struct message *msg,
+                                        char *output_str,
+                                        uint32_t output_str_max_len);
+static ssize_t serialize_binary_protocol_reply(const struct message *msg,
+                                               uint8_t *output,
+                                               uint32_t output_max_len);
+static bool parse_get_stats(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields);
+static bool parse_binary_get_stats(struct message *msg,
+                                   const uint8_t *payload,
+                                   uint32_t payload_len);
+static uint32_t get_stats_values(struct dispatcher_link *link, uint32_t *values);
+static ssize_t serialize_stats_reply(const struct message *msg,
+                                     char *output_str,
+                                     uint32_t output_str_max_len);
+static ssize_t serialize_binary_stats_reply(const struct message *msg,
+                                            uint8_t *output,
+                                            uint32_t output_max_len);
+static bool parse_get_subsystem_stats(struct message *msg,
+                                      const struct message_field *fields,
+                                      uint32_t num_fields);
+static bool parse_binary_get_subsystem_stats(struct message *msg,
+                                             const uint8_t *payload,
+                                             uint32_t payload_len);
+static void sum_subsystem_stats(const struct subsystem_dispatch_state *state,
+                                struct subsystem_stats *total);
+static ssize_t serialize_subsystem_stats_reply(const struct message *msg,
+                                               char *output_str,
+                                               uint32_t output_str_max_len);
+static ssize_t serialize_binary_subsystem_stats_reply(const struct message *msg,
+                                                      uint8_t *output,
+                                                      uint32_t output_max_len);
+static bool init_subscription(struct message *msg,
+                              uint8_t subsystem_id,
+                              uint32_t msg_idx,
+                              uint32_t period_ms,
+                              enum dispatcher_protocol protocol);
+static bool parse_subscribe(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields);
+static bool parse_binary_subscribe(struct message *msg,
+                                   const uint8_t *payload,
+                                   uint32_t payload_len);
+static ssize_t serialize_subscribe_reply(const struct message *msg,
+                                         char *output_str,
+                                         uint32_t output_str_max_len);
+static ssize_t serialize_binary_subscribe_reply(const struct message *msg,
+                                                uint8_t *output,
+                                                uint32_t output_max_len);
+static bool parse_unsubscribe(struct message *msg,
+                              const struct message_field *fields,
+                              uint32_t num_fields);
+static bool parse_binary_unsubscribe(struct message *msg,
+                                     const uint8_t *payload,
+                                     uint32_t payload_len);
+static ssize_t serialize_unsubscribe_reply(const struct message *msg,
+                                           char *output_str,
+                                           uint32_t output_str_max_len);
+static ssize_t serialize_binary_unsubscribe_reply(const struct message *msg,
+                                                  uint8_t *output,
+                                                  uint32_t output_max_len);
+static bool parse_get_credits(struct message *msg,
+                              const struct message_field *fields,
+                              uint32_t num_fields);
+static bool parse_binary_get_credits(struct message *msg,
+                                     const uint8_t *payload,
+                                     uint32_t payload_len);
+static uint32_t get_subsystem_credits(const struct subsystem_dispatch_state *state);
+static ssize_t serialize_credits_reply(const struct message *msg,
+                                       char *output_str,
+                                       uint32_t output_str_max_len);
+static ssize_t serialize_binary_credits_reply(const struct message *msg,
+                                              uint8_t *output,
+                                              uint32_t output_max_len);
+#ifdef MESSAGE_TRACING
+static bool parse_get_latency(struct message *msg,
+                              const struct message_field *fields,
+                              uint32_t num_fields);
+static bool parse_binary_get_latency(struct message *msg,
+                                     const uint8_t *payload,
+                                     uint32_t payload_len);
+static ssize_t serialize_latency_reply(const struct message *msg,
+                                       char *output_str,
+                                       uint32_t output_str_max_len);
+static ssize_t serialize_binary_latency_reply(const struct message *msg,
+                                              uint8_t *output,
+                                              uint32_t output_max_len);
+#endif
+static struct message *dispatcher_alloc_message(uint32_t msg_type_id);
+static void dispatcher_free_message(struct message *msg);
+static void register_subsystem_names(struct subsystem_message_conf *conf,
+                                     uint8_t subsystem_id);
+static void init_subsystem(uint8_t subsystem_id);
+static void init_link(uint8_t link_id);
+
+
+static struct message_handler dispatcher_msg_handlers[] = {
+	{
+		.message_name = "SET_PROTOCOL",
+		.parsing_func = parse_set_protocol,
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_set_protocol,
+		.binary_serialization_func = NULL
+	},
+	{
+		.message_name = "PROTOCOL_REPLY",
+		.parsing_func = NULL,
+		.serialization_func = serialize_protocol_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_protocol_reply
+	},
+	{
+		.message_name = "GET_STATS",
+		.parsing_func = parse_get_stats,
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_get_stats,
+		.binary_serialization_func = NULL
+	},
+	{
+		.message_name = "STATS_REPLY",
+		.parsing_func = NULL,
+		.serialization_func = serialize_stats_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_stats_reply
+	},
+	{
+		.message_name = "GET_SUBSYSTEM_STATS",
+		.parsing_func = parse_get_subsystem_stats,
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_get_subsystem_stats,
+		.binary_serialization_func = NULL
+	},
+	{
+		.message_name = "SUBSYSTEM_STATS_REPLY",
+		.parsing_func = NULL,
+		.serialization_func = serialize_subsystem_stats_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_subsystem_stats_reply
+	},
+	{
+		.message_name = "SUBSCRIBE",
+		.parsing_func = parse_subscribe,
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_subscribe,
+		.binary_serialization_func = NULL
+	},
+	{
+		.message_name = "SUBSCRIBE_REPLY",
+		.parsing_func = NULL,
+		.serialization_func = serialize_subscribe_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_subscribe_reply
+	},
+	{
+		.message_name = "UNSUBSCRIBE",
+		.parsing_func = parse_unsubscribe,
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_unsubscribe,
+		.binary_serialization_func = NULL
+	},
+	{
+		.message_name = "UNSUBSCRIBE_REPLY",
+		.parsing_func = NULL,
+		.serialization_func = serialize_unsubscribe_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_unsubscribe_reply
+	},
+	{
+		.message_name = "GET_CREDITS",
+		.parsing_func = parse_get_credits,
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_get_credits,
+		.binary_serialization_func = NULL,
+		.subscribable = true
+	},
+	{
+		.message_name = "CREDITS_REPLY",
+		.parsing_func = NULL,
+		.serialization_func = serialize_credits_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_credits_reply
+	},
+#ifdef MESSAGE_TRACING
+	{
+		.message_name = "GET_LATENCY",
+		.parsing_func = parse_get_latency,
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_get_latency,
+		.binary_serialization_func = NULL
+	},
+	{
+		.message_name = "LATENCY_REPLY",
+		.parsing_func = NULL,
+		.serialization_func = serialize_latency_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_latency_reply
+	}
+#endif
+};
 
-static void process_outgoing_err_message(mailbox_t *tx_char_buffer,
-                                         char *subsystem_name,
-                                         int32_t err_code);
+static char *protocol_name_lut[] = {
+	[DISPATCHER_PROTOCOL_ASCII] = "ASCII",
+	[DISPATCHER_PROTOCOL_BINARY] = "BINARY"
+};
 
-static void process_outgoing_message(mailbox_t *tx_char_buffer,
-                                     struct subsystem_message_conf *conf,
-                                     struct message *msg,
-                                     mailbox_t *err_msg_queue);
+/**
+ * The dispatcher's own subsystem. It doesn't get registered like the others,
+ * only its names get added to the name table.
+ */
+static struct subsystem_message_conf dispatcher_conf = {
+	.subsystem_name = "DISPATCHER",
+	.message_handlers = dispatcher_msg_handlers,
+	.num_message_types = ARRAY_SIZE(dispatcher_msg_handlers),
+	.incoming_msg_queue = NULL,
+	.outgoing_msg_queue = NULL,
+	.outgoing_err_queue = NULL,
+	.alloc_message = dispatcher_alloc_message,
+	.free_message = dispatcher_free_message
+};
 
-static bool schedule_err_message(mailbox_t *err_msg_queue, int32_t err_code);
+static pool_alloc_t dispatcher_msg_pool;
+static struct dispatcher_msg dispatcher_msg_pool_mem[DISPATCHER_MSG_POOL_SIZE * BSP_NUM_LINKS];
 
+static struct dispatcher_link links[BSP_NUM_LINKS];
 
-static int32_t disp_err_msg_queue_buf[MAX_DISPATCHER_ERROR_MESSAGES];
-static mailbox_t disp_err_msg_queue;
+static uint8_t rx_worker_stacks[BSP_NUM_LINKS][TASK_STACK_SIZE];
+static uint8_t tx_worker_stacks[BSP_NUM_LINKS][TX_TASK_STACK_SIZE];
 
-static uint8_t rx_worker_stack[TASK_STACK_SIZE];
-static worker_t rx_worker;
-static struct rx_worker_context rx_context;
+static const char *const rx_worker_names[] = { "rx_worker", "rx_worker1" };
+static const char *const tx_worker_names[] = { "tx_worker", "tx_worker1" };
 
-static uint8_t tx_worker_stack[TASK_STACK_SIZE];
-static worker_t tx_worker;
-static struct tx_worker_context tx_context;
+/*
+ * The bounds of the ratfist_subsystems section, i.e. of the subsystem registry.
+ * Provided by the linker.
+ */
+extern const struct ratfist_subsystem __start_ratfist_subsystems[];
+extern const struct ratfist_subsystem __stop_ratfist_subsystems[];
 
 static struct subsystems subsystems = {
-	.subsystem_configurations = {NULL},
-	.num_subsystems = 0
+	.registry = NULL,
+	.num_subsystems = 0,
+	.name_table = {{0}},
+	.name_table_used = 0
 };
 
 
 
 
 
+
 static void assemble_incoming_message(void *params)
 {
 	struct rx_worker_context *context = params;
-	uint32_t *pos_in_buf = &(context->pos_in_buf);
-	char *incoming_msg_buf = context->incoming_msg_buf;
-	mailbox_t *rx_char_buffer = context->rx_char_buffer;
-	bool *msg_is_incoming = &(context->msg_is_incoming);
-
-	char ch = '\0';
-	bool have_char = os_char_buffer_read_ch(rx_char_buffer, &ch);
-
-	if (have_char) {
-		if (ch == '$') {
-			*pos_in_buf = 0;
-			context->msg_is_incoming = true;
-			return;
-		}
 
-		if (!context->msg_is_incoming) {
-			return;
-		}
+	uint32_t wait_ticks = process_subscriptions(context);
 
-		incoming_msg_buf[(*pos_in_buf)++] = ch;
+	check_rx_dropped(context);
 
-		// Smallest valid message would be
-		// "$<char>,<char>,<char>*<2byte checksum>\r\n" == 11 bytes
-		// We don't save the $ though, so it's 10.
-		if (*pos_in_buf >= 10 &&
-		    incoming_msg_buf[*pos_in_buf - 2] == '\r' &&
-		    incoming_msg_buf[*pos_in_buf - 1] == '\n') {
+	const uint8_t *region = NULL;
+	uint32_t region_len = byte_ring_peek(context->rx_char_buffer, &region);
 
-			uint32_t len = *pos_in_buf;
+	if (region_len == 0) {
+		// Nothing to do until the UART ISR signals a complete line, or
+		// the next subscription is due.
+		worker_wait(context->worker, wait_ticks);
+		return;
+	}
 
-			*pos_in_buf = 0;
-			*msg_is_incoming = false;
+	uint32_t total_len = 0;
 
-			// Validate checksum
-			if (incoming_msg_buf[len - 5] != '*') {
-				schedule_err_message(context->err_msg_queue, RX_CHECKSUM_ERROR);
-				return;
-			}
+	// Drain everything that's available, parsing it right in the ring, one
+	// contiguous region at a time.
+	while (region_len > 0) {
+		total_len += region_len;
 
-			char *end_ptr = NULL;
+		// The protocol can change in the middle of a region, so it gets
+		// checked for every character.
+		for (uint32_t i = 0; i < region_len; i++) {
+			if (context->protocol == DISPATCHER_PROTOCOL_BINARY) {
+				process_incoming_byte(context, region[i]);
+			} else {
+				process_incoming_char(context, (char) region[i]);
+			}
+		}
 
-			incoming_msg_buf[len - 2] = '\0';
-			unsigned long msg_csum = strtoul(&incoming_msg_buf[len - 4], &end_ptr, 16);
-			if (end_ptr != &incoming_msg_buf[len - 2] ||
-			    msg_csum != calc_checksum(incoming_msg_buf, len - 5)) {
+		byte_ring_consume(context->rx_char_buffer, region_len);
+		region_len = byte_ring_peek(context->rx_char_buffer, &region);
+	}
 
-				schedule_err_message(context->err_msg_queue, RX_CHECKSUM_ERROR);
-				return;
-			}
+	if (total_len > context->stats->rx_buffer_high_water) {
+		context->stats->rx_buffer_high_water = total_len;
+	}
+}
 
-			// Strip the trailing csum & newline *<2byte checksum>\r\n
-			incoming_msg_buf[len - 5] = '\0';
+/**
+ * Raises an RX_BUFFER_FULL, if the UART has dropped characters since the last
+ * check. The frames they belonged to fail their checksums, or go missing, but
+ * this tells the host why.
+ */
+static void check_rx_dropped(struct rx_worker_context *ctx)
+{
+	uint32_t rx_dropped = bsp_links[ctx->link_id].uart_stats->rx_dropped;
 
-			process_incoming_message(context);
-		}
+	if (rx_dropped != ctx->rx_dropped_seen) {
+		ctx->rx_dropped_seen = rx_dropped;
 
-		// Message too long? Can't really recover from that, so just drop this message, and wait for the next
-		// one.
-		if (*pos_in_buf >= BSP_MAX_MESSAGE_LENGTH) {
-			schedule_err_message(context->err_msg_queue, MESSAGE_TOO_LONG_ERROR);
-			*pos_in_buf = 0;
-			*msg_is_incoming = false;
-		}
-	} else {
-		os_task_sleep(COMM_TASK_SLEEP_TIME_TICKS);
+		schedule_err_message(ctx->err_msg_queue, RX_BUFFER_FULL,
+		                     NO_TRANSACTION_ID);
 	}
 }
 
-static void check_outgoing_queue(void *params)
+static void process_incoming_char(struct rx_worker_context *context, char ch)
 {
-	struct tx_worker_context *context = params;
+	// A '$' always starts a new frame, even in the middle of another one.
+	if (ch == '$') {
+		// A fragment continuing the message being reassembled keeps the
+		// parser going, but that's only known at the end of its first
+		// field.
+		if (context->reassembling) {
+			context->in_frame_id = true;
+			context->frame_id_len = 0;
+			context->fragment_start_us = message_trace_timestamp();
+		} else {
+			message_field_parser_reset(&context->parser);
+			context->frame_start_us = message_trace_timestamp();
+		}
 
-	// Send out own error messages
-	int32_t err_code = NO_ERROR;
-	if (os_mailbox_read_atomic(context->err_msg_queue, &err_code)) {
-		process_outgoing_err_message(context->tx_char_buffer, "DISPATCHER", err_code);
+		context->calculated_csum = 0;
+		context->received_csum = 0;
+		context->frame_len = 0;
+		context->frame_continues = false;
+		context->frame_has_more = false;
+		context->frame_state = RX_FRAME_BODY;
 		return;
 	}
 
-	// If no own errors, then send out subsystem errors
-	for (uint32_t i = 0; i < context->subsystems->num_subsystems; i++) {
-		struct subsystem_message_conf *conf = context->subsystems->subsystem_configurations[i];
+	switch (context->frame_state) {
+	case RX_FRAME_IDLE:
+		return;
 
-		// Subsystems aren't required to have error message queues.
-		if (conf->outgoing_err_queue == NULL) {
-			continue;
+	case RX_FRAME_BODY:
+		if (ch == '*') {
+			if (context->in_frame_id) {
+				take_frame_id(context, false);
+			}
+
+			context->frame_state = RX_FRAME_CSUM_HIGH;
+			return;
 		}
 
-		if (os_mailbox_read_atomic(conf->outgoing_err_queue, &err_code)) {
-			process_outgoing_err_message(context->tx_char_buffer, conf->subsystem_name, err_code);
+		// Message ended without a checksum.
+		if (ch == '\n') {
+			drop_incoming_frame(context, RX_CHECKSUM_ERROR);
 			return;
 		}
-	}
 
-	// If no subsystem errors, send out regular messages
-	for (uint32_t i = 0; i < context->subsystems->num_subsystems; i++) {
-		struct subsystem_message_conf *conf = context->subsystems->subsystem_configurations[i];
+		context->calculated_csum ^= (uint8_t) ch;
 
-		// Subsystems aren't required to send messages.
-		if (conf->outgoing_msg_queue == NULL) {
-			continue;
+		// Frame too long? Can't really recover from that, so just drop
+		// this message, and wait for the next one.
+		if (context->frame_len + 1 >= BSP_MAX_MESSAGE_LENGTH) {
+			drop_incoming_frame(context, MESSAGE_TOO_LONG_ERROR);
+			return;
+		}
+
+		context->frame_len++;
+
+		if (context->in_frame_id) {
+			if (ch != ',' && context->frame_id_len < ASCII_FRAGMENT_ID_MAX_LEN) {
+				context->frame_id[context->frame_id_len++] = ch;
+				return;
+			}
+
+			take_frame_id(context, ch == ',');
+		}
+
+		// Same for a reassembled message that's too long.
+		if (!message_field_parser_push(&context->parser, ch)) {
+			drop_incoming_frame(context, MESSAGE_TOO_LONG_ERROR);
 		}
+		return;
 
-		struct message *msg = NULL;
-		if (os_mailbox_read_atomic(conf->outgoing_msg_queue, &msg)) {
-			process_outgoing_message(context->tx_char_buffer, conf, msg, context->err_msg_queue);
+	case RX_FRAME_CSUM_HIGH:
+	case RX_FRAME_CSUM_LOW: {
+		int8_t nibble = hex_digit_value(ch);
+		if (nibble < 0) {
+			drop_incoming_frame(context, RX_CHECKSUM_ERROR);
 			return;
 		}
+
+		context->received_csum = (uint8_t) (context->received_csum << 4 | nibble);
+		context->frame_state = (context->frame_state == RX_FRAME_CSUM_HIGH) ?
+		                       RX_FRAME_CSUM_LOW : RX_FRAME_CR;
+		return;
 	}
 
-	os_task_sleep(COMM_TASK_SLEEP_TIME_TICKS);
-}
+	case RX_FRAME_CR:
+		if (ch != '\r') {
+			drop_incoming_frame(context, RX_CHECKSUM_ERROR);
+			return;
+		}
+
+		context->frame_state = RX_FRAME_LF;
+		return;
+
+	case RX_FRAME_LF:
+		if (ch != '\n' || context->received_csum != context->calculated_csum) {
+			drop_incoming_frame(context, RX_CHECKSUM_ERROR);
+			return;
+		}
+
+		context->frame_state = RX_FRAME_IDLE;
+		context->stats->rx_frames++;
+
+		// Wait for the rest of the message.
+		if (context->frame_continues && context->frame_has_more) {
+			context->reassembly_next_seq++;
+			return;
+		}
 
+		context->frame_done_us = message_trace_timestamp();
 
+		message_field_parser_finish(&context->parser);
+
+		process_incoming_message(context);
+		return;
+	}
+}
 
-static uint8_t calc_checksum(char *buffer, uint32_t len)
+/**
+ * Drops the frame being received, and with it the message being reassembled,
+ * if any.
+ */
+static void drop_incoming_frame(struct rx_worker_context *ctx, int32_t err_code)
 {
-	uint8_t checksum = 0;
-	for (uint32_t i = 0; i < len; i++) {
-		checksum ^= (uint8_t) buffer[i];
+	schedule_err_message(ctx->err_msg_queue, err_code, NO_TRANSACTION_ID);
+
+	if (err_code == MESSAGE_TOO_LONG_ERROR) {
+		ctx->stats->rx_too_long_errors++;
+	} else {
+		ctx->stats->rx_checksum_errors++;
 	}
 
-	return checksum;
+	ctx->frame_state = RX_FRAME_IDLE;
+	abort_reassembly(ctx);
 }
 
-static void process_incoming_message(struct rx_worker_context *ctx)
+/**
+ * Takes the first field of a frame that arrived during reassembly. A fragment
+ * continuing the message gets its payload fields appended to it. Anything else
+ * drops the message, and starts a new one in the parser.
+ *
+ * @param complete Whether the field ended with a comma, i.e. whether the frame
+ *                 has more fields.
+ */
+static void take_frame_id(struct rx_worker_context *ctx, bool complete)
 {
-	char *save_ptr = NULL;
-	char *transaction_id_str = strtok_r(ctx->incoming_msg_buf, ",", &save_ptr);
+	ctx->in_frame_id = false;
 
-	// Parse the transaction id
-	char *end_ptr = NULL;
-	errno = NO_ERROR;
-	uint32_t transaction_id = strtoul(transaction_id_str, &end_ptr, 10);
-	if (errno != NO_ERROR ||  end_ptr == transaction_id_str || *end_ptr != '\0') {
+	struct fragment_id id;
+	if (complete &&
+	    parse_fragment_id(ctx->frame_id, ctx->frame_id_len, &id) &&
+	    id.transaction_id == ctx->reassembly_transaction_id &&
+	    id.seq == ctx->reassembly_next_seq) {
 
-		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR);
+		ctx->frame_continues = true;
+		ctx->frame_has_more = id.more;
 		return;
 	}
 
-	// Find the correct subsystem & message handler
-	char *subsystem_name = strtok_r(NULL, ",", &save_ptr);
-	char *msg_name = strtok_r(NULL, ",", &save_ptr);
+	abort_reassembly(ctx);
+
+	message_field_parser_reset(&ctx->parser);
+	ctx->frame_start_us = ctx->fragment_start_us;
+
+	// Can't overflow, as the field is shorter than the parser's buffer.
+	for (uint32_t i = 0; i < ctx->frame_id_len; i++) {
+		message_field_parser_push(&ctx->parser, ctx->frame_id[i]);
+	}
+}
 
-	if (subsystem_name == NULL || msg_name == NULL) {
-		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR);
+static void abort_reassembly(struct rx_worker_context *ctx)
+{
+	if (!ctx->reassembling) {
 		return;
 	}
 
-	for (uint32_t i = 0; i < ctx->subsystems->num_subsystems; i++) {
-		struct subsystem_message_conf *conf = ctx->subsystems->subsystem_configurations[i];
+	schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+	                     ctx->reassembly_transaction_id);
 
-		if (strcmp(subsystem_name, conf->subsystem_name) == 0) {
+	ctx->reassembling = false;
+	ctx->in_frame_id = false;
+}
 
-			// Find the message handler
-			for (uint32_t msg_idx = 0; msg_idx < conf->num_message_types; msg_idx++) {
-				if (strcmp(msg_name, conf->message_handlers[msg_idx].message_name) == 0) {
+/**
+ * Parses "<transaction ID>/<sequence number>", optionally followed by a '+'.
+ *
+ * @return False if str isn't a fragment's transaction ID field.
+ */
+static bool parse_fragment_id(const char *str,
+                              uint32_t len,
+                              struct fragment_id *id)
+{
+	uint32_t *value = &id->transaction_id;
+	uint32_t num_digits = 0;
+	bool seen_slash = false;
 
-					// Check we have a parsing function
-					if (conf->message_handlers[msg_idx].parsing_func == NULL) {
-						schedule_err_message(ctx->err_msg_queue, MISSING_MESSAGE_HANDLER_ERROR);
-						return;
-					}
+	id->transaction_id = 0;
+	id->seq = 0;
+	id->more = false;
 
-					// Try to allocate a msg struct
-					struct message *msg = conf->alloc_message(msg_idx);
-					if (msg == NULL) {
-						schedule_err_message(ctx->err_msg_queue, MEM_ALLOC_ERROR);
-						return;
-					}
+	for (uint32_t i = 0; i < len; i++) {
+		char ch = str[i];
 
-					msg->type = msg_idx;
-					msg->transaction_id = transaction_id;
+		// The '+' has to be the last character.
+		if (id->more) {
+			return false;
+		}
 
-					// Try to parse the message
-					if (!conf->message_handlers[msg_idx].parsing_func(msg, save_ptr)) {
-						schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR);
+		if (ch >= '0' && ch <= '9') {
+			uint32_t digit = (uint32_t) (ch - '0');
 
-						conf->free_message(msg);
-						return;
-					}
+			if (*value > (UINT32_MAX - digit) / 10) {
+				return false;
+			}
 
-					// Send the message to the subsystem
-					if (!os_mailbox_write(conf->incoming_msg_queue, &msg)) {
-						schedule_err_message(ctx->err_msg_queue, MESSAGE_ROUTING_ERROR);
+			*value = *value * 10 + digit;
+			num_digits++;
 
-						conf->free_message(msg);
-						return;
-					}
+		} else if (ch == '/' && !seen_slash && num_digits > 0) {
+			seen_slash = true;
+			value = &id->seq;
+			num_digits = 0;
 
-					// Short circuit return
-					return;
-				}
-			}
+		} else if (ch == '+' && seen_slash && num_digits > 0) {
+			id->more = true;
 
-			// Found a subsystem, but not a message parsing function.
-			schedule_err_message(ctx->err_msg_queue, UNKNOWN_MESSAGE_TYPE_ERROR);
-			return;
+		} else {
+			return false;
 		}
 	}
 
-	// Could not find subsystem
-	schedule_err_message(ctx->err_msg_queue, UNKNOWN_SUBSYSTEM_ERROR);
+	return seen_slash && num_digits > 0;
 }
 
-
-static void process_outgoing_err_message(mailbox_t *tx_char_buffer,
-                                         char *subsystem_name,
-                                         int32_t err_code)
+static void process_incoming_byte(struct rx_worker_context *context, uint8_t byte)
 {
-	char message_buf[BSP_MAX_MESSAGE_LENGTH];
-	message_buf[0] = '$';
-	uint32_t pos_in_buf = 1;
+	enum cobs_decode_result result = cobs_decoder_push(&context->decoder, byte);
 
-	int payload_len = snprintf(&message_buf[1], ARRAY_SIZE(message_buf) - 1,
-	                           "%s,ERROR,%ld", subsystem_name, err_code);
-	if (payload_len <= 0) {
+	// Delimiters between frames don't start a new one.
+	if (result == COBS_DECODE_IN_PROGRESS) {
+		if (byte != 0 && !context->frame_started) {
+			context->frame_started = true;
+			context->frame_start_us = message_trace_timestamp();
+		}
 		return;
 	}
 
-	pos_in_buf += (uint32_t) payload_len;
-	if (pos_in_buf >= ARRAY_SIZE(message_buf)) {
+	context->frame_started = false;
+
+	switch (result) {
+	case COBS_DECODE_IN_PROGRESS:
 		return;
-	}
 
-	uint8_t csum = calc_checksum(&message_buf[1], (uint32_t) payload_len);
+	case COBS_DECODE_FRAME_INVALID:
+		schedule_err_message(context->err_msg_queue, RX_CHECKSUM_ERROR,
+		                     NO_TRANSACTION_ID);
+		context->stats->rx_checksum_errors++;
+		return;
 
-	int csum_len = snprintf(&message_buf[pos_in_buf],
-	                        ARRAY_SIZE(message_buf) - pos_in_buf,
-	                        "*%02X\r\n", csum);
+	case COBS_DECODE_FRAME_TOO_LONG:
+		schedule_err_message(context->err_msg_queue, MESSAGE_TOO_LONG_ERROR,
+		                     NO_TRANSACTION_ID);
+		context->stats->rx_too_long_errors++;
+		return;
 
-	if (csum_len <= 0) {
+	case COBS_DECODE_FRAME_DONE:
+		context->frame_done_us = message_trace_timestamp();
+		process_incoming_binary_message(context);
 		return;
 	}
+}
 
-	pos_in_buf += (uint32_t) csum_len;
-	if (pos_in_buf >= ARRAY_SIZE(message_buf)) {
-		return;
+static int8_t hex_digit_value(char ch)
+{
+	if (ch >= '0' && ch <= '9') {
+		return (int8_t) (ch - '0');
+	} else if (ch >= 'A' && ch <= 'F') {
+		return (int8_t) (ch - 'A' + 10);
+	} else if (ch >= 'a' && ch <= 'f') {
+		return (int8_t) (ch - 'a' + 10);
 	}
 
-	os_char_buffer_write_buf_blocking(tx_char_buffer, message_buf, pos_in_buf);
+	return -1;
 }
 
-
-static void process_outgoing_message(mailbox_t *tx_char_buffer,
-                                     struct subsystem_message_conf *conf,
-                                     struct message *msg,
-                                     mailbox_t *err_msg_queue)
+static void check_outgoing_queue(void *params)
 {
-	if (msg->type >= conf->num_message_types ||
-	    conf->message_handlers[msg->type].serialization_func == NULL) {
+	struct tx_worker_context *context = params;
 
-		schedule_err_message(err_msg_queue, MISSING_MESSAGE_HANDLER_ERROR);
-		goto free_msg;
+	// Keep the trace event queue from filling up with the points of
+	// requests that never get a reply. Only the control link's requests get
+	// traced.
+	if (context->link_id == CONTROL_LINK_ID) {
+		message_trace_process();
 	}
 
-	char message_buf[BSP_MAX_MESSAGE_LENGTH];
-	message_buf[0] = '$';
-	uint32_t pos_in_buf = 1;
+	// Send as much as fits into the TX ring, so that messages that piled up
+	// since the last wakeup go out together.
+	while (tx_ring_has_room(context)) {
+		if (!send_next_message(context)) {
+			// Nothing to do until a message gets enqueued.
+			worker_wait(context->worker, COMM_TASK_SLEEP_TIME_TICKS);
+			return;
+		}
+	}
 
-	int prefix_len = snprintf(&message_buf[1],
-	                          ARRAY_SIZE(message_buf) - 1,
-	                          "%lu,%s,%s",
-	                           msg->transaction_id,
-	                           conf->subsystem_name,
-	                           conf->message_handlers[msg->type].message_name);
+	// Leave the rest in their queues until the UART makes some room, but
+	// don't let the other links wait for it.
+	hand_over_while_full(context);
 
-	if (prefix_len <= 0) {
-		schedule_err_message(err_msg_queue, MESSAGE_FORMATTING_ERROR);
-		goto free_msg;
-	}
+	os_task_sleep(TX_RING_FULL_SLEEP_TICKS);
+}
 
-	pos_in_buf += (uint32_t) prefix_len;
-	if (pos_in_buf >= ARRAY_SIZE(message_buf)) {
-		schedule_err_message(err_msg_queue, MESSAGE_TOO_LONG_ERROR);
-		goto free_msg;
-	}
+/**
+ * Checks whether a frame of any length would fit into the TX ring. Messages
+ * only get taken off their queues when it does, so that they don't have to be
+ * dropped for the lack of room.
+ */
+static bool tx_ring_has_room(struct tx_worker_context *ctx)
+{
+	uint32_t needed = (ctx->protocol == DISPATCHER_PROTOCOL_BINARY) ?
+	                  byte_ring_capacity(ctx->tx_ring) :
+	                  max_ascii_frame_len(ctx);
+
+	return byte_ring_free_space(ctx->tx_ring) >= needed;
+}
 
-	ssize_t payload_len = conf->message_handlers[msg->type].serialization_func(
-					msg, &message_buf[pos_in_buf],
-					ARRAY_SIZE(message_buf) - pos_in_buf);
+/**
+ * Sends the highest priority pending message.
+ *
+ * @return True if a message was sent, false if all queues were empty.
+ */
+static bool send_next_message(struct tx_worker_context *context)
+{
+	uint32_t now_us = bsp_get_timestamp_us();
 
-	if (payload_len <= 0) {
-		schedule_err_message(err_msg_queue, MESSAGE_FORMATTING_ERROR);
-		goto free_msg;
+	// Send out own error messages
+	struct error_entry err_entry;
+	if (os_mailbox_read_atomic(context->err_msg_queue, &err_entry)) {
+		process_incoming_err_entry(context, &context->disp_err_coalescer,
+		                           &dispatcher_conf, DISPATCHER_SUBSYSTEM_ID,
+		                           &err_entry, now_us);
+		return true;
 	}
 
-	pos_in_buf += (uint32_t) payload_len;
-	if (pos_in_buf >= ARRAY_SIZE(message_buf)) {
-		schedule_err_message(err_msg_queue, MESSAGE_TOO_LONG_ERROR);
-		goto free_msg;
+	// Then the rest of a message that's being sent in fragments
+	if (context->fragmenter.msg != NULL) {
+		uint8_t subsystem_id = context->fragmenter.subsystem_id;
+		uint32_t len = send_next_fragment(context);
+
+		// The fragments count against the subsystem's turns on the
+		// control link.
+		if (subsystem_id != DISPATCHER_SUBSYSTEM_ID &&
+		    context->link_id == CONTROL_LINK_ID) {
+			context->subsystems->registry[subsystem_id].state->tx_deficit -= (int32_t) len;
+		}
+		return true;
 	}
 
-	uint8_t csum = calc_checksum(&message_buf[1], pos_in_buf - 1);
+	// Then own replies
+	struct message *msg = NULL;
+	if (os_mailbox_read_atomic(context->dispatcher_msg_queue, &msg)) {
+		// The protocol reply still goes out in the old protocol.
+		enum dispatcher_protocol protocol = context->protocol;
+		if (msg->type == DISPATCHER_MSG_PROTOCOL_REPLY) {
+			protocol = ((union dispatcher_msg_data *) msg->data)->protocol;
+		}
 
-	int csum_len = snprintf(&message_buf[pos_in_buf],
-	                        ARRAY_SIZE(message_buf) - pos_in_buf,
-	                        "*%02X\r\n", csum);
+		process_outgoing_message(context, &dispatcher_conf,
+		                         DISPATCHER_SUBSYSTEM_ID, msg);
 
-	if (csum_len <= 0) {
-		schedule_err_message(err_msg_queue, MESSAGE_FORMATTING_ERROR);
-		goto free_msg;
+		context->protocol = protocol;
+		return true;
 	}
 
-	pos_in_buf += (uint32_t) csum_len;
-	if (pos_in_buf >= ARRAY_SIZE(message_buf)) {
-		schedule_err_message(err_msg_queue, MESSAGE_TOO_LONG_ERROR);
-		goto free_msg;
+	// The other links only send what the control link hands over to them.
+	// The control link sends what it deferred while its ring was full
+	// first, in order.
+	if (send_routed_entry(context, now_us)) {
+		return true;
 	}
 
-
-	if (os_char_buffer_write_buf(tx_char_buffer, message_buf, pos_in_buf) != pos_in_buf) {
-		schedule_err_message(err_msg_queue, TX_BUFFER_FULL);
+	if (context->link_id != CONTROL_LINK_ID) {
+		return false;
 	}
 
+	if (context->holding) {
+		context->holding = false;
+		send_entry(context, &context->held, now_us);
+		return true;
+	}
 
-free_msg:
-	conf->free_message(msg);
-}
+	// If no own errors, then send out subsystem errors
+	if (send_subsystem_error(context, now_us)) {
+		return true;
+	}
 
+	// Then the reports of errors that have been held back
+	if (send_err_report(context, now_us)) {
+		return true;
+	}
 
-static bool schedule_err_message(mailbox_t *msg_queue, int32_t err_code)
-{
-	return os_mailbox_write_atomic(msg_queue, &err_code);
+	// If no subsystem errors, send out regular messages
+	return send_subsystem_message(context);
 }
 
-
-void dispatcher_init(void)
+/**
+ * Takes a single error code off the queue of the first subsystem with a
+ * pending one, starting with the one after the subsystem that sent the last
+ * one, and sends it, unless it gets coalesced.
+ *
+ * @return True if an error code was taken off a queue.
+ */
+static bool send_subsystem_error(struct tx_worker_context *ctx, uint32_t now_us)
 {
-	// Outgoing error message queue
-	os_mailbox_init(&disp_err_msg_queue,
-	                disp_err_msg_queue_buf,
-	                MAX_DISPATCHER_ERROR_MESSAGES,
-	                sizeof(int32_t),
-	                NULL);
+	struct tx_scheduler *sched = &ctx->sched;
+	uint32_t num_subsystems = ctx->subsystems->num_subsystems;
 
+	for (uint32_t n = 0; n < num_subsystems; n++) {
+		uint32_t i = (sched->next_err_subsystem + n) % num_subsystems;
+		struct subsystem_dispatch_state *state = ctx->subsystems->registry[i].state;
+		struct subsystem_message_conf *conf = state->conf;
 
-	rx_context.pos_in_buf = 0;
-	rx_context.rx_char_buffer = &bsp_rx_buffer;
-	rx_context.msg_is_incoming = false;
-	rx_context.subsystems = &subsystems;
-	rx_context.err_msg_queue = &disp_err_msg_queue;
-
-	worker_task_init(&rx_worker,
-	                 "rx_worker",
-	                 rx_worker_stack,
-	                 TASK_STACK_SIZE,
-	                 COMM_TASK_PRIORITY,
-	                 assemble_incoming_message,
-	                 &rx_context);
+		// Subsystems aren't required to have error message queues.
+		if (conf == NULL || conf->outgoing_err_queue == NULL) {
+			continue;
+		}
 
-	tx_context.tx_char_buffer = &bsp_tx_buffer;
-	tx_context.subsystems = &subsystems;
-	tx_context.err_msg_queue = &disp_err_msg_queue;
+		struct error_entry err_entry;
+		if (os_mailbox_read_atomic(conf->outgoing_err_queue, &err_entry)) {
+			uint8_t link_id = transaction_link_id(err_entry.transaction_id);
+
+			struct routed_entry entry = {
+				.subsystem_id = (uint8_t) i,
+				.msg = NULL,
+				.err = err_entry
+			};
+
+			if (link_id != ctx->link_id) {
+				hand_over_to_link(ctx, link_id, &entry);
+			} else if (ctx->deferring) {
+				defer_entry(ctx, &entry);
+			} else {
+				process_incoming_err_entry(ctx, &state->err_coalescer,
+				                           conf, (uint8_t) i, &err_entry,
+				                           now_us);
+			}
 
-	worker_task_init(&tx_worker,
-	                 "tx_worker",
-	                 tx_worker_stack,
-	                 TASK_STACK_SIZE,
-	                 COMM_TASK_PRIORITY,
-	                 check_outgoing_queue,
-	                 &tx_context);
+			sched->next_err_subsystem = (i + 1) % num_subsystems;
+			return true;
+		}
+	}
 
-	// Register the tasks with the scheduler.
-	worker_start(&rx_worker);
-	worker_start(&tx_worker);
+	return false;
 }
 
-void dispatcher_deinit(void)
+/**
+ * Sends a single aggregated report of coalesced errors, if one is due.
+ *
+ * @return True if a report was sent.
+ */
+static bool send_err_report(struct tx_worker_context *ctx, uint32_t now_us)
 {
-	worker_stop(&rx_worker);
-	worker_stop(&tx_worker);
+	struct err_report report;
 
-	worker_join(&rx_worker);
-	worker_join(&tx_worker);
+	if (err_coalescer_take_report(&ctx->disp_err_coalescer, now_us, &report)) {
+		process_outgoing_err_message(ctx, &dispatcher_conf,
+		                             DISPATCHER_SUBSYSTEM_ID,
+		                             NO_TRANSACTION_ID, &report);
+		return true;
+	}
 
-	subsystems.num_subsystems = 0;
+	for (uint32_t i = 0; i < ctx->subsystems->num_subsystems; i++) {
+		struct subsystem_dispatch_state *state = ctx->subsystems->registry[i].state;
+
+		// Only registered subsystems can have errors to report.
+		if (err_coalescer_take_report(&state->err_coalescer, now_us, &report)) {
+			process_outgoing_err_message(ctx, state->conf,
+			                             (uint8_t) i, NO_TRANSACTION_ID,
+			                             &report);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Sends a single regular message, picking the subsystem by deficit round
+ * robin. A subsystem keeps its turn while it has both pending messages and a
+ * positive deficit. Subsystems without pending messages lose their deficit.
+ *
+ * @return True if a message was sent.
+ */
+static bool send_subsystem_message(struct tx_worker_context *ctx)
+{
+	struct tx_scheduler *sched = &ctx->sched;
+	uint32_t num_subsystems = ctx->subsystems->num_subsystems;
+
+	if (num_subsystems == 0) {
+		return false;
+	}
+
+	// The current subsystem may have used up its deficit, so it could take
+	// one visit more than the number of subsystems to find a message.
+	for (uint32_t n = 0; n <= num_subsystems; n++) {
+		uint32_t i = sched->current_subsystem;
+		struct subsystem_dispatch_state *state = ctx->subsystems->registry[i].state;
+		struct subsystem_message_conf *conf = state->conf;
+
+		// Subsystems aren't required to send messages.
+		if (conf != NULL && conf->outgoing_msg_queue != NULL) {
+			if (!sched->quantum_added) {
+				uint32_t weight = (conf->tx_weight > 0) ? conf->tx_weight : 1;
+				state->tx_deficit += (int32_t) (weight * TX_SCHED_QUANTUM);
+				sched->quantum_added = true;
+			}
+
+			struct message *msg = NULL;
+			if (state->tx_deficit > 0) {
+				if (os_mailbox_read_atomic(conf->outgoing_msg_queue, &msg)) {
+					uint8_t link_id = transaction_link_id(msg->transaction_id);
+					struct routed_entry entry = {
+						.subsystem_id = (uint8_t) i,
+						.msg = msg
+					};
+
+					// Handing a message over doesn't take
+					// up room on this link.
+					if (link_id != ctx->link_id) {
+						hand_over_to_link(ctx, link_id, &entry);
+						return true;
+					}
+
+					// Neither does deferring it, so it
+					// only gets charged once it's sent.
+					if (ctx->deferring) {
+						defer_entry(ctx, &entry);
+						return true;
+					}
+
+					uint32_t len = process_outgoing_message(ctx, conf,
+					                                        (uint8_t) i, msg);
+					state->tx_deficit -= (int32_t) len;
+					return true;
+				}
+
+				state->tx_deficit = 0;
+			}
+		}
+
+		sched->current_subsystem = (i + 1) % num_subsystems;
+		sched->quantum_added = false;
+	}
+
+	return false;
+}
+
+/**
+ * Hands a subsystem's message, or an error of one of its transactions, over to
+ * the TX worker of another link. If that link can't take it, the message gets
+ * dropped, and the transaction fails on that link with a TX_BUFFER_FULL.
+ */
+static void hand_over_to_link(struct tx_worker_context *ctx,
+                              uint8_t link_id,
+                              const struct routed_entry *entry)
+{
+	struct dispatcher_link *link = &links[link_id];
+
+	if (os_mailbox_write(&link->routed_queue, entry)) {
+		return;
+	}
+
+	uint32_t transaction_id = entry->err.transaction_id;
+
+	if (entry->msg != NULL) {
+		struct subsystem_dispatch_state *state = ctx->subsystems->registry[entry->subsystem_id].state;
+
+		transaction_id = entry->msg->transaction_id;
+		state->stats[ctx->link_id].tx_dropped++;
+		state->conf->free_message(entry->msg);
+	}
+
+	schedule_err_message(&link->err_msg_queue, TX_BUFFER_FULL, transaction_id);
+}
+
+/**
+ * Sends a single message or error handed over by the control link.
+ *
+ * @return True if there was one to send.
+ */
+static bool send_routed_entry(struct tx_worker_context *ctx, uint32_t now_us)
+{
+	struct routed_entry entry;
+	if (!os_mailbox_read_atomic(ctx->routed_queue, &entry)) {
+		return false;
+	}
+
+	send_entry(ctx, &entry, now_us);
+	return true;
+}
+
+/**
+ * Sends a message or error that got handed over, or deferred.
+ */
+static void send_entry(struct tx_worker_context *ctx,
+                       const struct routed_entry *entry,
+                       uint32_t now_us)
+{
+	struct subsystem_dispatch_state *state = ctx->subsystems->registry[entry->subsystem_id].state;
+
+	if (entry->msg != NULL) {
+		uint32_t len = process_outgoing_message(ctx, state->conf,
+		                                        entry->subsystem_id,
+		                                        entry->msg);
+
+		if (ctx->link_id == CONTROL_LINK_ID) {
+			state->tx_deficit -= (int32_t) len;
+		}
+	} else {
+		// Errors of a transaction don't get coalesced, so on the other
+		// links, the control link's coalescer doesn't get touched.
+		process_incoming_err_entry(ctx, &state->err_coalescer, state->conf,
+		                           entry->subsystem_id, &entry->err, now_us);
+	}
+}
+
+/**
+ * Takes the subsystems' messages & errors off their queues while the control
+ * link's TX ring is full, so that those for the other links get handed over
+ * right away, instead of waiting for the control link's UART. The control
+ * link's own ones get deferred, until the first one that doesn't fit onto its
+ * routed_queue.
+ */
+static void hand_over_while_full(struct tx_worker_context *ctx)
+{
+	if (BSP_NUM_LINKS == 1 || ctx->link_id != CONTROL_LINK_ID) {
+		return;
+	}
+
+	uint32_t now_us = bsp_get_timestamp_us();
+
+	// Whatever got held last time goes after what's been deferred before.
+	if (ctx->holding && os_mailbox_write(ctx->routed_queue, &ctx->held)) {
+		ctx->holding = false;
+	}
+
+	ctx->deferring = true;
+
+	while (!ctx->holding &&
+	       (send_subsystem_error(ctx, now_us) || send_subsystem_message(ctx))) {
+	}
+
+	ctx->deferring = false;
+}
+
+static void defer_entry(struct tx_worker_context *ctx,
+                        const struct routed_entry *entry)
+{
+	if (!os_mailbox_write(ctx->routed_queue, entry)) {
+		ctx->held = *entry;
+		ctx->holding = true;
+	}
+}
+
+
+
+/*
+ * The callbacks of the BSP & the mailboxes don't tell which link they're
+ * about, so they wake up the workers of all links. Those with nothing to do go
+ * right back to waiting.
+ */
+
+static void notify_rx_workers(void)
+{
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		worker_notify(&links[i].rx_worker);
+	}
+}
+
+static void notify_tx_workers(void)
+{
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		worker_notify(&links[i].tx_worker);
+	}
+}
+
+
+static uint32_t tag_transaction_id(uint32_t transaction_id, uint8_t link_id)
+{
+	// NO_TRANSACTION_ID has to stay recognizable.
+	if (transaction_id == NO_TRANSACTION_ID) {
+		return transaction_id;
+	}
+
+	return transaction_id | (uint32_t) link_id << LINK_ID_SHIFT;
+}
+
+/**
+ * @return The link a transaction came in on. Transaction IDs that don't carry
+ *         a valid link, e.g. ones made up by a subsystem, belong to the
+ *         control link.
+ */
+static uint8_t transaction_link_id(uint32_t transaction_id)
+{
+	uint32_t link_id = transaction_id >> LINK_ID_SHIFT;
+
+	return (link_id < BSP_NUM_LINKS) ? (uint8_t) link_id : CONTROL_LINK_ID;
+}
+
+/**
+ * @return The transaction ID as the host knows it, without the link's tag.
+ */
+static uint32_t wire_transaction_id(uint32_t transaction_id)
+{
+	if (BSP_NUM_LINKS == 1) {
+		return transaction_id;
+	}
+
+	return transaction_id & LINK_TRANSACTION_ID_MASK;
+}
+
+/**
+ * @return Whether the host may use the transaction ID. With more than one
+ *         link, the top bits are taken by the link's tag.
+ */
+static bool transaction_id_valid(uint32_t transaction_id)
+{
+	return BSP_NUM_LINKS == 1 || transaction_id <= LINK_TRANSACTION_ID_MASK;
+}
+
+
+
+static uint8_t calc_checksum(const char *buffer, uint32_t len)
+{
+	uint8_t checksum = 0;
+	for (uint32_t i = 0; i < len; i++) {
+		checksum ^= (uint8_t) buffer[i];
+	}
+
+	return checksum;
+}
+
+static void process_incoming_message(struct rx_worker_context *ctx)
+{
+	struct message_field *fields = ctx->parser.fields;
+	uint32_t num_fields = ctx->parser.num_fields;
+
+	// Every message starts with the transaction id, subsystem name, and
+	// message name.
+	if (num_fields < 3) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+		                     NO_TRANSACTION_ID);
+		return;
+	}
+
+	// The transaction id got converted while the message was coming in,
+	// unless it's that of a fragment.
+	uint32_t transaction_id = 0;
+	if (!message_field_to_u32(&fields[0], &transaction_id)) {
+		struct fragment_id id;
+		if (!parse_fragment_id(fields[0].str, fields[0].len, &id)) {
+			schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+			                     NO_TRANSACTION_ID);
+			return;
+		}
+
+		// A fragment that doesn't continue any message.
+		if (id.seq != 0) {
+			schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+			                     id.transaction_id);
+			return;
+		}
+
+		transaction_id = id.transaction_id;
+
+		// The first fragment of a message. The rest of the message gets
+		// appended to it as it arrives.
+		if (id.more && !ctx->frame_continues) {
+			ctx->reassembling = true;
+			ctx->reassembly_transaction_id = transaction_id;
+			ctx->reassembly_next_seq = 1;
+			return;
+		}
+
+		ctx->reassembling = false;
+	}
+
+	if (!transaction_id_valid(transaction_id)) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+		                     NO_TRANSACTION_ID);
+		return;
+	}
+
+	if (fields[1].len == 0 || fields[2].len == 0) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+		                     transaction_id);
+		return;
+	}
+
+	// Find the correct subsystem & message handler. The name hashes got
+	// calculated while the message was coming in.
+	struct name_table_entry *entry = name_table_find(ctx->subsystems,
+	                                                 fields[1].hash,
+	                                                 NULL,
+	                                                 fields[1].str);
+	if (entry == NULL) {
+		schedule_err_message(ctx->err_msg_queue, UNKNOWN_SUBSYSTEM_ERROR,
+		                     transaction_id);
+		return;
+	}
+
+	struct subsystem_message_conf *conf = entry->conf;
+	uint8_t subsystem_id = entry->subsystem_id;
+
+	entry = name_table_find(ctx->subsystems,
+	                        name_table_message_key(fields[1].hash, fields[2].hash),
+	                        conf,
+	                        fields[2].str);
+	if (entry == NULL) {
+		// Found a subsystem, but not a message parsing function.
+		schedule_err_message(ctx->err_msg_queue, UNKNOWN_MESSAGE_TYPE_ERROR,
+		                     transaction_id);
+		return;
+	}
+
+	uint32_t msg_idx = entry->msg_idx;
+
+	// Check we have a parsing function
+	if (conf->message_handlers[msg_idx].parsing_func == NULL) {
+		schedule_err_message(ctx->err_msg_queue, MISSING_MESSAGE_HANDLER_ERROR,
+		                     transaction_id);
+		return;
+	}
+
+	// Try to allocate a msg struct
+	struct message *msg = conf->alloc_message(msg_idx);
+	if (msg == NULL) {
+		schedule_err_message(ctx->err_msg_queue, MEM_ALLOC_ERROR,
+		                     transaction_id);
+		count_rx_dropped(ctx, subsystem_id);
+		return;
+	}
+
+	msg->type = msg_idx;
+	msg->transaction_id = tag_transaction_id(transaction_id, ctx->link_id);
+
+	// Try to parse the message
+	if (!conf->message_handlers[msg_idx].parsing_func(msg, &fields[3], num_fields - 3)) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+		                     transaction_id);
+		count_rx_dropped(ctx, subsystem_id);
+
+		conf->free_message(msg);
+		return;
+	}
+
+	ctx->parsed_us = message_trace_timestamp();
+
+	route_incoming_message(ctx, conf, subsystem_id, msg);
+}
+
+static void process_incoming_binary_message(struct rx_worker_context *ctx)
+{
+	uint8_t *frame = ctx->decoder.buf;
+	uint32_t frame_len = ctx->decoder.len;
+
+	if (frame_len < BINARY_HEADER_LEN + BINARY_CRC_LEN) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+		                     NO_TRANSACTION_ID);
+		return;
+	}
+
+	uint32_t payload_len = frame_len - BINARY_HEADER_LEN - BINARY_CRC_LEN;
+
+	if (crc16_ccitt(frame, frame_len - BINARY_CRC_LEN) !=
+	    bin_get_u16(&frame[frame_len - BINARY_CRC_LEN])) {
+
+		schedule_err_message(ctx->err_msg_queue, RX_CHECKSUM_ERROR,
+		                     NO_TRANSACTION_ID);
+		ctx->stats->rx_checksum_errors++;
+		return;
+	}
+
+	ctx->stats->rx_frames++;
+
+	uint32_t transaction_id = bin_get_u32(&frame[0]);
+	uint8_t subsystem_id = frame[4];
+	uint32_t msg_idx = frame[5];
+
+	if (!transaction_id_valid(transaction_id)) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+		                     NO_TRANSACTION_ID);
+		return;
+	}
+
+	struct subsystem_message_conf *conf = NULL;
+	if (subsystem_id == DISPATCHER_SUBSYSTEM_ID) {
+		conf = &dispatcher_conf;
+	} else if (subsystem_id < ctx->subsystems->num_subsystems &&
+	           ctx->subsystems->registry[subsystem_id].state->conf != NULL) {
+
+		conf = ctx->subsystems->registry[subsystem_id].state->conf;
+	} else {
+		schedule_err_message(ctx->err_msg_queue, UNKNOWN_SUBSYSTEM_ERROR,
+		                     transaction_id);
+		return;
+	}
+
+	if (msg_idx >= conf->num_message_types) {
+		schedule_err_message(ctx->err_msg_queue, UNKNOWN_MESSAGE_TYPE_ERROR,
+		                     transaction_id);
+		return;
+	}
+
+	if (conf->message_handlers[msg_idx].binary_parsing_func == NULL) {
+		schedule_err_message(ctx->err_msg_queue, MISSING_MESSAGE_HANDLER_ERROR,
+		                     transaction_id);
+		return;
+	}
+
+	struct message *msg = conf->alloc_message(msg_idx);
+	if (msg == NULL) {
+		schedule_err_message(ctx->err_msg_queue, MEM_ALLOC_ERROR,
+		                     transaction_id);
+		count_rx_dropped(ctx, subsystem_id);
+		return;
+	}
+
+	msg->type = msg_idx;
+	msg->transaction_id = tag_transaction_id(transaction_id, ctx->link_id);
+
+	if (!conf->message_handlers[msg_idx].binary_parsing_func(msg,
+	                                                         &frame[BINARY_HEADER_LEN],
+	                                                         payload_len)) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+		                     transaction_id);
+		count_rx_dropped(ctx, subsystem_id);
+
+		conf->free_message(msg);
+		return;
+	}
+
+	ctx->parsed_us = message_trace_timestamp();
+
+	route_incoming_message(ctx, conf, subsystem_id, msg);
+}
+
+static void route_incoming_message(struct rx_worker_context *ctx,
+                                   struct subsystem_message_conf *conf,
+                                   uint8_t subsystem_id,
+                                   struct message *msg)
+{
+	mailbox_t *queue = conf->incoming_msg_queue;
+
+	// The dispatcher's own messages get handled right away, so that the
+	// rest of the incoming characters get decoded in the new protocol.
+	if (conf == &dispatcher_conf) {
+		if (!handle_dispatcher_message(ctx, msg)) {
+			schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR,
+			                     msg->transaction_id);
+
+			conf->free_message(msg);
+			return;
+		}
+
+		queue = ctx->dispatcher_msg_queue;
+	}
+
+	// Send the message to the subsystem. A full queue means the host has
+	// run out of the subsystem's credits.
+	if (!os_mailbox_write(queue, &msg)) {
+		schedule_err_message(ctx->err_msg_queue, RX_BUFFER_FULL,
+		                     msg->transaction_id);
+		count_rx_dropped(ctx, subsystem_id);
+
+		conf->free_message(msg);
+		return;
+	}
+
+	struct subsystem_stats *subsys_stats = get_subsystem_stats(ctx->subsystems,
+	                                                           ctx->link_id,
+	                                                           subsystem_id);
+	if (subsys_stats != NULL) {
+		subsys_stats->rx_routed++;
+
+		trace_incoming_message(ctx, msg);
+	}
+}
+
+/**
+ * Turns a request to the dispatcher into its reply. The replies get serialized
+ * by the TX worker, so the statistics are as fresh as possible.
+ *
+ * @return False if the request can't be carried out on the link.
+ */
+static bool handle_dispatcher_message(struct rx_worker_context *ctx,
+                                      struct message *msg)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	switch (msg->type) {
+	case DISPATCHER_MSG_SET_PROTOCOL:
+		set_rx_protocol(ctx, data->protocol);
+		msg->type = DISPATCHER_MSG_PROTOCOL_REPLY;
+		break;
+
+	case DISPATCHER_MSG_GET_STATS:
+		msg->type = DISPATCHER_MSG_STATS_REPLY;
+		break;
+
+	case DISPATCHER_MSG_GET_SUBSYSTEM_STATS:
+		msg->type = DISPATCHER_MSG_SUBSYSTEM_STATS_REPLY;
+		break;
+
+	case DISPATCHER_MSG_SUBSCRIBE: {
+		// The subscription ID must be unique, and there must be a free
+		// slot.
+		struct subscription *sub = find_subscription(ctx->subscriptions,
+		                                             NO_TRANSACTION_ID);
+		if (sub == NULL ||
+		    find_subscription(ctx->subscriptions, msg->transaction_id) != NULL) {
+			return false;
+		}
+
+		*sub = data->subscription;
+		sub->active = true;
+		sub->next_due_us = bsp_get_timestamp_us();
+		ctx->subscriptions->num_active++;
+
+		msg->type = DISPATCHER_MSG_SUBSCRIBE_REPLY;
+		break;
+	}
+
+	case DISPATCHER_MSG_UNSUBSCRIBE: {
+		// Subscriptions are kept under the link's transaction IDs.
+		data->subscription_id = tag_transaction_id(data->subscription_id,
+		                                           ctx->link_id);
+
+		struct subscription *sub = find_subscription(ctx->subscriptions,
+		                                             data->subscription_id);
+		if (sub == NULL) {
+			return false;
+		}
+
+		sub->active = false;
+		ctx->subscriptions->num_active--;
+
+		msg->type = DISPATCHER_MSG_UNSUBSCRIBE_REPLY;
+		break;
+	}
+
+	case DISPATCHER_MSG_GET_CREDITS:
+		msg->type = DISPATCHER_MSG_CREDITS_REPLY;
+		break;
+
+	case DISPATCHER_MSG_GET_LATENCY:
+		msg->type = DISPATCHER_MSG_LATENCY_REPLY;
+		break;
+	}
+
+	return true;
+}
+
+static void set_rx_protocol(struct rx_worker_context *ctx,
+                            enum dispatcher_protocol protocol)
+{
+	ctx->protocol = protocol;
+	ctx->frame_state = RX_FRAME_IDLE;
+
+	message_field_parser_reset(&ctx->parser);
+	cobs_decoder_reset(&ctx->decoder);
+	ctx->frame_started = false;
+}
+
+static void count_rx_dropped(struct rx_worker_context *ctx,
+                             uint8_t subsystem_id)
+{
+	struct subsystem_stats *subsys_stats = get_subsystem_stats(ctx->subsystems,
+	                                                           ctx->link_id,
+	                                                           subsystem_id);
+	if (subsys_stats != NULL) {
+		subsys_stats->rx_dropped++;
+	}
+}
+
+/**
+ * Records the RX side trace points of a message that got routed to a
+ * subsystem. The dispatcher's own messages don't get traced, so that querying
+ * the histograms doesn't skew them. Neither do the messages of links other than
+ * the control link, whose replies the control link's TX worker doesn't send.
+ */
+static void trace_incoming_message(struct rx_worker_context *ctx,
+                                   struct message *msg)
+{
+	uint32_t tid = msg->transaction_id;
+
+	if (ctx->link_id != CONTROL_LINK_ID) {
+		return;
+	}
+
+	message_trace_record(tid, MESSAGE_TRACE_FRAME_START, ctx->frame_start_us);
+	message_trace_record(tid, MESSAGE_TRACE_FRAME_DONE, ctx->frame_done_us);
+	message_trace_record(tid, MESSAGE_TRACE_PARSED, ctx->parsed_us);
+	message_trace_record(tid, MESSAGE_TRACE_ROUTED, message_trace_timestamp());
+}
+
+/**
+ * Routes the requests of the subscriptions that are due.
+ *
+ * @return The number of ticks until the next one is due, at most
+ *         COMM_TASK_SLEEP_TIME_TICKS.
+ */
+static uint32_t process_subscriptions(struct rx_worker_context *ctx)
+{
+	uint32_t wait_ticks = COMM_TASK_SLEEP_TIME_TICKS;
+
+	// Without subscriptions, the clock doesn't need to be read at all.
+	if (ctx->subscriptions->num_active == 0) {
+		return wait_ticks;
+	}
+
+	uint32_t now_us = bsp_get_timestamp_us();
+
+	for (uint32_t i = 0; i < SUBSCRIPTION_SLOTS; i++) {
+		struct subscription *sub = &ctx->subscriptions->slots[i];
+
+		if (!sub->active) {
+			continue;
+		}
+
+		// Signed difference, so that the timestamps may wrap around.
+		if ((int32_t) (now_us - sub->next_due_us) >= 0) {
+			route_subscription_request(ctx, sub);
+
+			// Periods missed e.g. while the RX worker was busy get
+			// skipped, instead of being caught up on in a burst.
+			sub->next_due_us += sub->period_us;
+			if ((int32_t) (now_us - sub->next_due_us) >= 0) {
+				sub->next_due_us = now_us + sub->period_us;
+			}
+		}
+
+		if (!sub->active) {
+			continue;
+		}
+
+		uint32_t ticks = (sub->next_due_us - now_us + US_PER_OS_TICK - 1) / US_PER_OS_TICK;
+		if (ticks < wait_ticks) {
+			wait_ticks = ticks;
+		}
+	}
+
+	return wait_ticks;
+}
+
+/**
+ * Parses a subscription's request, and sends it to the subsystem like one that
+ * came over the link. Requests that fail to parse once never will, so their
+ * subscription gets dropped.
+ */
+static void route_subscription_request(struct rx_worker_context *ctx,
+                                       struct subscription *sub)
+{
+	struct subsystem_message_conf *conf = get_subsystem_conf(ctx->subsystems,
+	                                                         sub->subsystem_id);
+	struct message_handler *handler = &conf->message_handlers[sub->msg_idx];
+
+	struct message *msg = conf->alloc_message(sub->msg_idx);
+	if (msg == NULL) {
+		schedule_err_message(ctx->err_msg_queue, MEM_ALLOC_ERROR, sub->id);
+		count_rx_dropped(ctx, sub->subsystem_id);
+		return;
+	}
+
+	msg->type = sub->msg_idx;
+	msg->transaction_id = sub->id;
+
+	bool parsed = false;
+	if (sub->protocol == DISPATCHER_PROTOCOL_BINARY) {
+		parsed = handler->binary_parsing_func(msg,
+		                                      (const uint8_t *) sub->payload,
+		                                      sub->payload_len);
+	} else if (sub->payload_len == 0) {
+		parsed = handler->parsing_func(msg, ctx->subscription_fields, 0);
+	} else {
+		struct message_field_parser *parser = &ctx->subscription_parser;
+
+		parsed = message_field_parser_parse_str(parser, sub->payload) &&
+		         handler->parsing_func(msg, parser->fields, parser->num_fields);
+	}
+
+	if (!parsed) {
+		schedule_err_message(ctx->err_msg_queue, MESSAGE_PARSING_ERROR, sub->id);
+		count_rx_dropped(ctx, sub->subsystem_id);
+
+		conf->free_message(msg);
+
+		sub->active = false;
+		ctx->subscriptions->num_active--;
+		return;
+	}
+
+	mailbox_t *queue = conf->incoming_msg_queue;
+
+	// The dispatcher's own subscribable requests can't fail to be handled.
+	if (conf == &dispatcher_conf) {
+		handle_dispatcher_message(ctx, msg);
+		queue = ctx->dispatcher_msg_queue;
+	}
+
+	if (!os_mailbox_write(queue, &msg)) {
+		schedule_err_message(ctx->err_msg_queue, RX_BUFFER_FULL, sub->id);
+		count_rx_dropped(ctx, sub->subsystem_id);
+
+		conf->free_message(msg);
+		return;
+	}
+
+	struct subsystem_stats *subsys_stats = get_subsystem_stats(ctx->subsystems,
+	                                                           ctx->link_id,
+	                                                           sub->subsystem_id);
+	if (subsys_stats != NULL) {
+		subsys_stats->rx_routed++;
+	}
+}
+
+/**
+ * Finds an active subscription, or a free slot with NO_TRANSACTION_ID.
+ *
+ * @return The subscription, or NULL if there's none.
+ */
+static struct subscription *find_subscription(struct subscription_table *table,
+                                              uint32_t id)
+{
+	for (uint32_t i = 0; i < SUBSCRIPTION_SLOTS; i++) {
+		struct subscription *sub = &table->slots[i];
+
+		if (id == NO_TRANSACTION_ID ? !sub->active :
+		                              (sub->active && sub->id == id)) {
+			return sub;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @return The configuration of a subsystem, including the dispatcher's own. NULL
+ *         if the subsystem couldn't be registered.
+ */
+static struct subsystem_message_conf *get_subsystem_conf(struct subsystems *subsys,
+                                                        uint8_t subsystem_id)
+{
+	if (subsystem_id == DISPATCHER_SUBSYSTEM_ID) {
+		return &dispatcher_conf;
+	}
+
+	return subsys->registry[subsystem_id].state->conf;
+}
+
+/**
+ * @return The counters of a registered subsystem on a link, or NULL for the
+ *         dispatcher's own subsystem.
+ */
+static struct subsystem_stats *get_subsystem_stats(struct subsystems *subsys,
+                                                   uint8_t link_id,
+                                                   uint8_t subsystem_id)
+{
+	if (subsystem_id == DISPATCHER_SUBSYSTEM_ID) {
+		return NULL;
+	}
+
+	return &subsys->registry[subsystem_id].state->stats[link_id];
+}
+
+
+/**
+ * Reports an error taken off an error queue right away, or leaves it to a
+ * later aggregated report, if the same error code has been reported recently.
+ * Errors of a transaction are always reported right away, so that the host
+ * doesn't have to wait for the transaction to time out.
+ */
+static void process_incoming_err_entry(struct tx_worker_context *ctx,
+                                       struct err_coalescer *coalescer,
+                                       struct subsystem_message_conf *conf,
+                                       uint8_t subsystem_id,
+                                       const struct error_entry *err_entry,
+                                       uint32_t now_us)
+{
+	if (err_entry->transaction_id == NO_TRANSACTION_ID &&
+	    !err_coalescer_record(coalescer, err_entry->err_code, now_us)) {
+
+		return;
+	}
+
+	struct err_report report = {
+		.err_code = err_entry->err_code,
+		.count = 1,
+		.first_time_us = now_us,
+		.last_time_us = now_us
+	};
+
+	process_outgoing_err_message(ctx, conf, subsystem_id,
+	                             err_entry->transaction_id, &report);
+}
+
+/**
+ * Writes an error message into the TX ring. Reports of a single occurrence are
+ * sent as plain ERROR messages, the rest as ERROR_REPORT messages.
+ */
+static void process_outgoing_err_message(struct tx_worker_context *ctx,
+                                         struct subsystem_message_conf *conf,
+                                         uint8_t subsystem_id,
+                                         uint32_t transaction_id,
+                                         const struct err_report *report)
+{
+	// Error messages are short, so wait for the room to send them, unless
+	// they couldn't fit even into an empty ring.
+	while (true) {
+		uint32_t reserved_len = 0;
+		uint8_t *reserved = byte_ring_reserve(ctx->tx_ring, &reserved_len);
+
+		uint32_t len = 0;
+
+		if (ctx->protocol == DISPATCHER_PROTOCOL_BINARY) {
+			len = write_binary_err_message(reserved, reserved_len,
+			                               subsystem_id, transaction_id,
+			                               report);
+		} else {
+			len = write_ascii_err_message((char *) reserved, reserved_len,
+			                              conf, transaction_id, report);
+		}
+
+		if (len > 0) {
+			byte_ring_commit(ctx->tx_ring, len);
+			record_tx_frame(ctx);
+			return;
+		}
+
+		if (reserved_len >= byte_ring_capacity(ctx->tx_ring)) {
+			return;
+		}
+
+		os_task_sleep(TX_RING_FULL_SLEEP_TICKS);
+	}
+}
+
+static uint32_t write_ascii_err_message(char *buf,
+                                        uint32_t buf_len,
+                                        struct subsystem_message_conf *conf,
+                                        uint32_t transaction_id,
+                                        const struct err_report *report)
+{
+	struct frame_writer writer;
+	frame_writer_init(&writer, buf, buf_len);
+
+	// Errors that don't belong to a transaction are sent without the
+	// transaction ID field.
+	if (transaction_id != NO_TRANSACTION_ID) {
+		frame_put_u32(&writer, wire_transaction_id(transaction_id));
+		frame_put_ch(&writer, ',');
+	}
+
+	frame_put_str(&writer, conf->subsystem_name);
+
+	if (report->count == 1) {
+		frame_put_str(&writer, ",ERROR,");
+		frame_put_i32(&writer, report->err_code);
+	} else {
+		frame_put_str(&writer, ",ERROR_REPORT,");
+		frame_put_i32(&writer, report->err_code);
+		frame_put_ch(&writer, ',');
+		frame_put_u32(&writer, report->count);
+		frame_put_ch(&writer, ',');
+		frame_put_u32(&writer, report->first_time_us);
+		frame_put_ch(&writer, ',');
+		frame_put_u32(&writer, report->last_time_us);
+	}
+
+	frame_put_checksum(&writer);
+
+	return writer.fmt.overflow ? 0 : writer.fmt.len;
+}
+
+static uint32_t write_binary_err_message(uint8_t *reserved,
+                                         uint32_t reserved_len,
+                                         uint8_t subsystem_id,
+                                         uint32_t transaction_id,
+                                         const struct err_report *report)
+{
+	uint8_t *payload = &reserved[binary_payload_offset(reserved_len)];
+	uint32_t max_payload_len = binary_max_payload_len(reserved_len);
+
+	if (report->count == 1) {
+		if (max_payload_len < sizeof(int32_t)) {
+			return 0;
+		}
+
+		bin_put_i32(payload, report->err_code);
+
+		return encode_binary_frame(reserved, reserved_len, transaction_id,
+		                           subsystem_id, BINARY_ERROR_MESSAGE_ID,
+		                           sizeof(int32_t));
+	}
+
+	if (max_payload_len < BINARY_ERR_REPORT_PAYLOAD_LEN) {
+		return 0;
+	}
+
+	bin_put_i32(&payload[0], report->err_code);
+	bin_put_u32(&payload[4], report->count);
+	bin_put_u32(&payload[8], report->first_time_us);
+	bin_put_u32(&payload[12], report->last_time_us);
+
+	return encode_binary_frame(reserved, reserved_len, transaction_id,
+	                           subsystem_id, BINARY_ERROR_REPORT_MESSAGE_ID,
+	                           BINARY_ERR_REPORT_PAYLOAD_LEN);
+}
+
+
+/**
+ * Serializes a message into the TX ring, and frees it.
+ *
+ * @return The number of bytes written into the ring.
+ */
+static uint32_t process_outgoing_message(struct tx_worker_context *ctx,
+                                         struct subsystem_message_conf *conf,
+                                         uint8_t subsystem_id,
+                                         struct message *msg)
+{
+	int32_t err_code = NO_ERROR;
+	uint32_t frame_len = 0;
+
+	if (ctx->protocol == DISPATCHER_PROTOCOL_BINARY) {
+		err_code = write_binary_message(ctx, conf, subsystem_id, msg, &frame_len);
+
+	} else if (msg->type < conf->num_message_types &&
+	           conf->message_handlers[msg->type].streaming_serialization_func != NULL) {
+
+		// Messages that fit into a single frame are sent as usual.
+		struct tx_fragmenter *frag = &ctx->fragmenter;
+
+		frag->msg = msg;
+		frag->conf = conf;
+		frag->subsystem_id = subsystem_id;
+		frag->offset = 0;
+		frag->seq = 0;
+		frag->cursor.offset = 0;
+		frag->cursor.item = 0;
+
+		return send_next_fragment(ctx);
+
+	} else {
+		err_code = write_ascii_message(ctx, conf, msg, &frame_len);
+	}
+
+	if (err_code == NO_ERROR) {
+		record_tx_frame(ctx);
+	}
+
+	finish_outgoing_message(ctx, conf, subsystem_id, msg, err_code);
+
+	return frame_len;
+}
+
+/**
+ * Reports a message that couldn't be sent, updates the subsystem's counters,
+ * and frees the message.
+ */
+static void finish_outgoing_message(struct tx_worker_context *ctx,
+                                    struct subsystem_message_conf *conf,
+                                    uint8_t subsystem_id,
+                                    struct message *msg,
+                                    int32_t err_code)
+{
+	if (err_code != NO_ERROR) {
+		schedule_err_message(ctx->err_msg_queue, err_code, msg->transaction_id);
+	}
+
+	struct subsystem_stats *subsys_stats = get_subsystem_stats(ctx->subsystems,
+	                                                           ctx->link_id,
+	                                                           subsystem_id);
+	if (subsys_stats != NULL) {
+		if (err_code != NO_ERROR) {
+			subsys_stats->tx_dropped++;
+		} else {
+			subsys_stats->tx_sent++;
+
+			if (ctx->link_id == CONTROL_LINK_ID) {
+				trace_outgoing_message(ctx, msg);
+			}
+		}
+	}
+
+	conf->free_message(msg);
+}
+
+/**
+ * Sends the next fragment of ctx->fragmenter's message, and finishes the
+ * message once its last fragment has been sent, or sending one fails.
+ *
+ * @return The number of bytes written into the ring.
+ */
+static uint32_t send_next_fragment(struct tx_worker_context *ctx)
+{
+	struct tx_fragmenter *frag = &ctx->fragmenter;
+	uint32_t frame_len = 0;
+	bool last = true;
+
+	int32_t err_code = write_ascii_fragment(ctx, frag, &frame_len, &last);
+
+	if (err_code == NO_ERROR) {
+		record_tx_frame(ctx);
+	}
+
+	if (err_code != NO_ERROR || last) {
+		finish_outgoing_message(ctx, frag->conf, frag->subsystem_id,
+		                        frag->msg, err_code);
+		frag->msg = NULL;
+	}
+
+	return frame_len;
+}
+
+/**
+ * Writes as much of the message as fits into a frame. The payload gets
+ * serialized straight into the frame, one window of it per fragment, resuming
+ * where the previous fragment left off, so the whole of it never has to be in
+ * memory or formatted over again. Fragments end between fields.
+ *
+ * @param last Output for whether this was the last fragment.
+ */
+static int32_t write_ascii_fragment(struct tx_worker_context *ctx,
+                                    struct tx_fragmenter *frag,
+                                    uint32_t *frame_len,
+                                    bool *last)
+{
+	struct message_handler *handler = &frag->conf->message_handlers[frag->msg->type];
+
+	uint32_t reserved_len = 0;
+	char *reserved = (char *) byte_ring_reserve(ctx->tx_ring, &reserved_len);
+
+	// Only ever called when a maximum length frame fits.
+	uint32_t max_len = max_ascii_frame_len(ctx);
+	if (reserved_len < max_len) {
+		return TX_BUFFER_FULL;
+	}
+
+	// Whether this is the last fragment is only known once the rest of the
+	// payload has been serialized, so it goes after the shorter header of
+	// the last fragment, and gets moved back if more follow.
+	struct frame_writer writer;
+	frame_writer_init(&writer, reserved, max_len);
+	frame_put_fragment_header(&writer, frag, false);
+
+	if (writer.fmt.overflow || writer.fmt.len + ASCII_FRAME_TRAILER_LEN >= max_len) {
+		return MESSAGE_TOO_LONG_ERROR;
+	}
+
+	uint32_t more_start = writer.fmt.len;
+	uint32_t more_room = max_len - more_start - ASCII_FRAME_TRAILER_LEN;
+
+	frame_writer_init(&writer, reserved, max_len);
+	frame_put_fragment_header(&writer, frag, true);
+
+	uint32_t start = writer.fmt.len;
+	uint32_t room = max_len - start - ASCII_FRAME_TRAILER_LEN;
+
+	struct stream_cursor prev_cursor = frag->cursor;
+
+	ssize_t payload_len = handler->streaming_serialization_func(frag->msg,
+	                                                            &frag->cursor,
+	                                                            frag->offset,
+	                                                            &writer.fmt.buf[start],
+	                                                            room);
+	if (payload_len < 0) {
+		return MESSAGE_FORMATTING_ERROR;
+	}
+
+	uint32_t len = (uint32_t) payload_len;
+	*last = len <= room;
+
+	if (!*last) {
+		memmove(&writer.fmt.buf[more_start], &writer.fmt.buf[start], more_room);
+
+		frame_writer_init(&writer, reserved, max_len);
+		frame_put_fragment_header(&writer, frag, false);
+		start = more_start;
+
+		// Cut the fragment off at the last comma, which starts the next
+		// one.
+		len = more_room - 1;
+		while (len > 0 && writer.fmt.buf[start + len] != ',') {
+			len--;
+		}
+
+		// A single field longer than a frame.
+		if (len == 0) {
+			return MESSAGE_TOO_LONG_ERROR;
+		}
+
+		// The serializer may have moved on past the cut.
+		if (frag->cursor.offset > frag->offset + len) {
+			frag->cursor = prev_cursor;
+		}
+	}
+
+	writer.fmt.len += len;
+	frame_add_to_checksum(&writer, start);
+
+	frame_put_checksum(&writer);
+
+	byte_ring_commit(ctx->tx_ring, writer.fmt.len);
+	*frame_len = writer.fmt.len;
+
+	frag->offset += len;
+	frag->seq++;
+
+	return NO_ERROR;
+}
+
+static int32_t write_ascii_message(struct tx_worker_context *ctx,
+                                   struct subsystem_message_conf *conf,
+                                   struct message *msg,
+                                   uint32_t *frame_len)
+{
+	if (msg->type >= conf->num_message_types ||
+	    conf->message_handlers[msg->type].serialization_func == NULL) {
+
+		return MISSING_MESSAGE_HANDLER_ERROR;
+	}
+
+	uint32_t reserved_len = 0;
+	char *reserved = (char *) byte_ring_reserve(ctx->tx_ring, &reserved_len);
+
+	// If the ring is too full for a maximum length frame, failing to fit
+	// one in doesn't mean that the message is too long.
+	uint32_t max_len = max_ascii_frame_len(ctx);
+	bool ring_full = reserved_len < max_len;
+
+	struct frame_writer writer;
+	frame_writer_init(&writer, reserved, ring_full ? reserved_len : max_len);
+
+	frame_put_u32(&writer, wire_transaction_id(msg->transaction_id));
+	frame_put_ch(&writer, ',');
+	frame_put_str(&writer, conf->subsystem_name);
+	frame_put_ch(&writer, ',');
+	frame_put_str(&writer, conf->message_handlers[msg->type].message_name);
+
+	if (!writer.fmt.overflow) {
+		uint32_t start = writer.fmt.len;
+
+		ssize_t payload_len = conf->message_handlers[msg->type].serialization_func(
+						msg, &writer.fmt.buf[start],
+						writer.fmt.max_len - start);
+
+		if (payload_len <= 0) {
+			return ring_full ? TX_BUFFER_FULL : MESSAGE_FORMATTING_ERROR;
+		}
+
+		if ((uint32_t) payload_len >= writer.fmt.max_len - start) {
+			writer.fmt.overflow = true;
+		} else {
+			writer.fmt.len += (uint32_t) payload_len;
+			frame_add_to_checksum(&writer, start);
+		}
+	}
+
+	frame_put_checksum(&writer);
+
+	if (writer.fmt.overflow) {
+		return ring_full ? TX_BUFFER_FULL : MESSAGE_TOO_LONG_ERROR;
+	}
+
+	byte_ring_commit(ctx->tx_ring, writer.fmt.len);
+	*frame_len = writer.fmt.len;
+
+	return NO_ERROR;
+}
+
+static int32_t write_binary_message(struct tx_worker_context *ctx,
+                                    struct subsystem_message_conf *conf,
+                                    uint8_t subsystem_id,
+                                    struct message *msg,
+                                    uint32_t *frame_len)
+{
+	if (msg->type >= conf->num_message_types ||
+	    conf->message_handlers[msg->type].binary_serialization_func == NULL) {
+
+		return MISSING_MESSAGE_HANDLER_ERROR;
+	}
+
+	uint32_t reserved_len = 0;
+	uint8_t *reserved = byte_ring_reserve(ctx->tx_ring, &reserved_len);
+
+	bool ring_full = reserved_len < byte_ring_capacity(ctx->tx_ring);
+
+	uint32_t max_payload_len = binary_max_payload_len(reserved_len);
+	if (max_payload_len == 0 && ring_full) {
+		return TX_BUFFER_FULL;
+	}
+
+	ssize_t payload_len = conf->message_handlers[msg->type].binary_serialization_func(
+					msg, &reserved[binary_payload_offset(reserved_len)],
+					max_payload_len);
+
+	// Unlike ASCII messages, binary ones may have an empty payload.
+	if (payload_len < 0) {
+		return ring_full ? TX_BUFFER_FULL : MESSAGE_FORMATTING_ERROR;
+	}
+
+	if ((uint32_t) payload_len > max_payload_len) {
+		return ring_full ? TX_BUFFER_FULL : MESSAGE_TOO_LONG_ERROR;
+	}
+
+	uint32_t len = encode_binary_frame(reserved, reserved_len,
+	                                   msg->transaction_id, subsystem_id,
+	                                   (uint8_t) msg->type,
+	                                   (uint32_t) payload_len);
+
+	byte_ring_commit(ctx->tx_ring, len);
+	*frame_len = len;
+
+	return NO_ERROR;
+}
+
+static uint32_t max_ascii_frame_len(struct tx_worker_context *ctx)
+{
+	// Frames have to fit into the receiver's BSP_MAX_MESSAGE_LENGTH buffer,
+	// and into an empty ring.
+	uint32_t capacity = byte_ring_capacity(ctx->tx_ring);
+
+	return (capacity < BSP_MAX_MESSAGE_LENGTH - 1) ? capacity :
+	                                                 BSP_MAX_MESSAGE_LENGTH - 1;
+}
+
+static void record_tx_frame(struct tx_worker_context *ctx)
+{
+	uint32_t used = byte_ring_used_space(ctx->tx_ring);
+
+	ctx->stats->tx_frames++;
+	if (used > ctx->stats->tx_ring_high_water) {
+		ctx->stats->tx_ring_high_water = used;
+	}
+}
+
+/**
+ * Finishes the trace of a reply that got written into the TX ring. There's no
+ * telling when the UART actually sends it, so the time its last byte leaves is
+ * estimated from the number of bytes ahead of it in the ring.
+ */
+static void trace_outgoing_message(struct tx_worker_context *ctx,
+                                   struct message *msg)
+{
+	uint32_t serialized_us = message_trace_timestamp();
+	uint32_t used = byte_ring_used_space(ctx->tx_ring);
+
+	// 10 bits per character, without 64-bit division.
+	uint32_t send_time_us = used * 10000 / (BSP_UART_BAUD_RATE / 1000);
+
+	message_trace_finish(msg->transaction_id, serialized_us,
+	                     serialized_us + send_time_us);
+}
+
+
+static void frame_writer_init(struct frame_writer *writer, char *buf, uint32_t max_len)
+{
+	fmt_writer_init(&writer->fmt, buf, max_len);
+
+	// The leading '$' isn't part of the checksum.
+	fmt_put_ch(&writer->fmt, '$');
+	writer->csum = 0;
+}
+
+/**
+ * Adds what has been written since start to the frame checksum.
+ */
+static void frame_add_to_checksum(struct frame_writer *writer, uint32_t start)
+{
+	writer->csum ^= calc_checksum(&writer->fmt.buf[start], writer->fmt.len - start);
+}
+
+static void frame_put_ch(struct frame_writer *writer, char ch)
+{
+	uint32_t start = writer->fmt.len;
+	fmt_put_ch(&writer->fmt, ch);
+	frame_add_to_checksum(writer, start);
+}
+
+static void frame_put_str(struct frame_writer *writer, const char *str)
+{
+	uint32_t start = writer->fmt.len;
+	fmt_put_str(&writer->fmt, str);
+	frame_add_to_checksum(writer, start);
+}
+
+static void frame_put_u32(struct frame_writer *writer, uint32_t value)
+{
+	uint32_t start = writer->fmt.len;
+	fmt_put_u32(&writer->fmt, value);
+	frame_add_to_checksum(writer, start);
+}
+
+static void frame_put_i32(struct frame_writer *writer, int32_t value)
+{
+	uint32_t start = writer->fmt.len;
+	fmt_put_i32(&writer->fmt, value);
+	frame_add_to_checksum(writer, start);
+}
+
+static void frame_put_checksum(struct frame_writer *writer)
+{
+	fmt_put_ch(&writer->fmt, '*');
+	fmt_put_hex_u8(&writer->fmt, writer->csum);
+	fmt_put_str(&writer->fmt, "\r\n");
+}
+
+/**
+ * Writes the header of a fragment. A message that fits into a single frame
+ * gets the usual header, without the sequence number.
+ */
+static void frame_put_fragment_header(struct frame_writer *writer,
+                                      struct tx_fragmenter *frag,
+                                      bool last)
+{
+	frame_put_u32(writer, wire_transaction_id(frag->msg->transaction_id));
+
+	if (frag->seq > 0 || !last) {
+		frame_put_ch(writer, '/');
+		frame_put_u32(writer, frag->seq);
+
+		if (!last) {
+			frame_put_ch(writer, '+');
+		}
+	}
+
+	// The fragments after the first one go straight on with the payload.
+	if (frag->seq == 0) {
+		frame_put_ch(writer, ',');
+		frame_put_str(writer, frag->conf->subsystem_name);
+		frame_put_ch(writer, ',');
+		frame_put_str(writer, frag->conf->message_handlers[frag->msg->type].message_name);
+	}
+}
+
+
+/*
+ * Binary frames get assembled far enough from the start of the reserved region
+ * that they can be COBS encoded in place, see cobs_encode().
+ */
+
+static uint32_t binary_payload_offset(uint32_t reserved_len)
+{
+	return reserved_len / 254 + 1 + BINARY_HEADER_LEN;
+}
+
+static uint32_t binary_max_payload_len(uint32_t reserved_len)
+{
+	// Room for the header, the CRC, and the delimiter.
+	uint32_t overhead = binary_payload_offset(reserved_len) + BINARY_CRC_LEN + 1;
+	if (reserved_len < overhead) {
+		return 0;
+	}
+
+	uint32_t max_len = reserved_len - overhead;
+	uint32_t max_message_len = BSP_MAX_MESSAGE_LENGTH - BINARY_HEADER_LEN - BINARY_CRC_LEN;
+
+	return (max_len < max_message_len) ? max_len : max_message_len;
+}
+
+static uint32_t encode_binary_frame(uint8_t *reserved,
+                                    uint32_t reserved_len,
+                                    uint32_t transaction_id,
+                                    uint8_t subsystem_id,
+                                    uint8_t message_id,
+                                    uint32_t payload_len)
+{
+	uint8_t *frame = &reserved[binary_payload_offset(reserved_len) - BINARY_HEADER_LEN];
+	uint32_t len = BINARY_HEADER_LEN + payload_len;
+
+	bin_put_u32(&frame[0], wire_transaction_id(transaction_id));
+	frame[4] = subsystem_id;
+	frame[5] = message_id;
+
+	bin_put_u16(&frame[len], crc16_ccitt(frame, len));
+	len += BINARY_CRC_LEN;
+
+	return cobs_encode(frame, len, reserved, reserved_len);
+}
+
+
+static bool schedule_err_message(mailbox_t *msg_queue,
+                                 int32_t err_code,
+                                 uint32_t transaction_id)
+{
+	struct error_entry err_entry = {
+		.err_code = err_code,
+		.transaction_id = transaction_id
+	};
+
+	return os_mailbox_write_atomic(msg_queue, &err_entry);
+}
+
+
+static uint32_t name_table_message_key(uint32_t subsystem_hash,
+                                       uint32_t message_hash)
+{
+	// Rotate the subsystem hash, so that swapping the subsystem and message
+	// names gives a different key.
+	return (subsystem_hash << 13 | subsystem_hash >> 19) ^ message_hash;
+}
+
+static void name_table_insert(struct subsystems *subsys,
+                              uint32_t hash,
+                              struct subsystem_message_conf *conf,
+                              uint32_t msg_idx,
+                              uint8_t subsystem_id)
+{
+	// Linear probing. The caller makes sure there is a free slot.
+	uint32_t idx = hash & (NAME_TABLE_SIZE - 1);
+	while (subsys->name_table[idx].conf != NULL) {
+		idx = (idx + 1) & (NAME_TABLE_SIZE - 1);
+	}
+
+	subsys->name_table[idx].hash = hash;
+	subsys->name_table[idx].conf = conf;
+	subsys->name_table[idx].msg_idx = msg_idx;
+	subsys->name_table[idx].subsystem_id = subsystem_id;
+
+	subsys->name_table_used++;
+}
+
+static struct name_table_entry *name_table_find(struct subsystems *subsys,
+                                                uint32_t hash,
+                                                struct subsystem_message_conf *conf,
+                                                const char *name)
+{
+	uint32_t idx = hash & (NAME_TABLE_SIZE - 1);
+
+	for (uint32_t i = 0; i < NAME_TABLE_SIZE; i++) {
+		struct name_table_entry *entry = &subsys->name_table[idx];
+
+		// An empty slot ends the probe sequence.
+		if (entry->conf == NULL) {
+			return NULL;
+		}
+
+		if (entry->hash == hash) {
+			// Looking for a subsystem name.
+			if (conf == NULL &&
+			    entry->msg_idx == NAME_TABLE_SUBSYSTEM_ENTRY &&
+			    strcmp(entry->conf->subsystem_name, name) == 0) {
+
+				return entry;
+			}
+
+			// Looking for a message name of the given subsystem.
+			if (conf != NULL && entry->conf == conf &&
+			    entry->msg_idx != NAME_TABLE_SUBSYSTEM_ENTRY &&
+			    strcmp(conf->message_handlers[entry->msg_idx].message_name, name) == 0) {
+
+				return entry;
+			}
+		}
+
+		idx = (idx + 1) & (NAME_TABLE_SIZE - 1);
+	}
+
+	return NULL;
+}
+
+
+static bool parse_set_protocol(struct message *msg,
+                               const struct message_field *fields,
+                               uint32_t num_fields)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (num_fields != 1) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(protocol_name_lut); i++) {
+		if (strcmp(fields[0].str, protocol_name_lut[i]) == 0) {
+			data->protocol = (enum dispatcher_protocol) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool parse_binary_set_protocol(struct message *msg,
+                                      const uint8_t *payload,
+                                      uint32_t payload_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (payload_len != 1 || payload[0] >= ARRAY_SIZE(protocol_name_lut)) {
+		return false;
+	}
+
+	data->protocol = (enum dispatcher_protocol) payload[0];
+	return true;
+}
+
+static ssize_t serialize_protocol_reply(const struct message *msg,
+                                        char *output_str,
+                                        uint32_t output_str_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_str, output_str_max_len);
+
+	fmt_put_ch(&writer, ',');
+	fmt_put_str(&writer, protocol_name_lut[data->protocol]);
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_binary_protocol_reply(const struct message *msg,
+                                               uint8_t *output,
+                                               uint32_t output_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (output_max_len < 1) {
+		return -1;
+	}
+
+	output[0] = (uint8_t) data->protocol;
+	return 1;
+}
+
+static bool parse_get_stats(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields)
+{
+	(void) msg;
+	(void) fields;
+
+	return num_fields == 0;
+}
+
+static bool parse_binary_get_stats(struct message *msg,
+                                   const uint8_t *payload,
+                                   uint32_t payload_len)
+{
+	(void) msg;
+	(void) payload;
+
+	return payload_len == 0;
+}
+
+/**
+ * Collects the counters of a link, in the order they're sent in. The dropped
+ * errors of the subsystems count towards every link.
+ *
+ * @param values Output for NUM_STATS_REPLY_VALUES counters.
+ * @return The number of counters.
+ */
+static uint32_t get_stats_values(struct dispatcher_link *link, uint32_t *values)
+{
+	struct dispatcher_stats *stats = &link->stats;
+	volatile struct bsp_uart_stats *uart_stats = bsp_links[link - links].uart_stats;
+
+	uint32_t err_dropped = link->tx_context.disp_err_coalescer.num_dropped;
+	for (uint32_t i = 0; i < subsystems.num_subsystems; i++) {
+		err_dropped += subsystems.registry[i].state->err_coalescer.num_dropped;
+	}
+
+	uint32_t n = 0;
+
+	values[n++] = stats->rx_frames;
+	values[n++] = stats->rx_checksum_errors;
+	values[n++] = stats->rx_too_long_errors;
+	values[n++] = uart_stats->rx_overruns;
+	values[n++] = uart_stats->rx_dropped;
+	values[n++] = stats->rx_buffer_high_water;
+	values[n++] = stats->tx_frames;
+	values[n++] = stats->tx_ring_high_water;
+	values[n++] = err_dropped;
+
+	return n;
+}
+
+static ssize_t serialize_stats_reply(const struct message *msg,
+                                     char *output_str,
+                                     uint32_t output_str_max_len)
+{
+	struct dispatcher_link *link = &links[transaction_link_id(msg->transaction_id)];
+
+	uint32_t values[NUM_STATS_REPLY_VALUES];
+	uint32_t num_values = get_stats_values(link, values);
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_str, output_str_max_len);
+
+	for (uint32_t i = 0; i < num_values; i++) {
+		fmt_put_ch(&writer, ',');
+		fmt_put_u32(&writer, values[i]);
+	}
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_binary_stats_reply(const struct message *msg,
+                                            uint8_t *output,
+                                            uint32_t output_max_len)
+{
+	struct dispatcher_link *link = &links[transaction_link_id(msg->transaction_id)];
+
+	uint32_t values[NUM_STATS_REPLY_VALUES];
+	uint32_t num_values = get_stats_values(link, values);
+
+	if (output_max_len < num_values * sizeof(uint32_t)) {
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < num_values; i++) {
+		bin_put_u32(&output[i * sizeof(uint32_t)], values[i]);
+	}
+
+	return (ssize_t) (num_values * sizeof(uint32_t));
+}
+
+static bool parse_get_subsystem_stats(struct message *msg,
+                                      const struct message_field *fields,
+                                      uint32_t num_fields)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (num_fields != 1) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < subsystems.num_subsystems; i++) {
+		struct subsystem_message_conf *conf = subsystems.registry[i].state->conf;
+
+		if (conf != NULL && strcmp(fields[0].str, conf->subsystem_name) == 0) {
+			data->subsystem_id = (uint8_t) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool parse_binary_get_subsystem_stats(struct message *msg,
+                                             const uint8_t *payload,
+                                             uint32_t payload_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (payload_len != 1 || payload[0] >= subsystems.num_subsystems ||
+	    subsystems.registry[payload[0]].state->conf == NULL) {
+
+		return false;
+	}
+
+	data->subsystem_id = payload[0];
+	return true;
+}
+
+/**
+ * Adds up the counters of a subsystem on every link.
+ */
+static void sum_subsystem_stats(const struct subsystem_dispatch_state *state,
+                                struct subsystem_stats *total)
+{
+	memset(total, 0, sizeof(*total));
+
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		total->rx_routed += state->stats[i].rx_routed;
+		total->rx_dropped += state->stats[i].rx_dropped;
+		total->tx_sent += state->stats[i].tx_sent;
+		total->tx_dropped += state->stats[i].tx_dropped;
+	}
+}
+
+static ssize_t serialize_subsystem_stats_reply(const struct message *msg,
+                                               char *output_str,
+                                               uint32_t output_str_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+	struct subsystem_dispatch_state *state = subsystems.registry[data->subsystem_id].state;
+
+	struct subsystem_stats subsys_stats;
+	sum_subsystem_stats(state, &subsys_stats);
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_str, output_str_max_len);
+
+	fmt_put_ch(&writer, ',');
+	fmt_put_str(&writer, state->conf->subsystem_name);
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, subsys_stats.rx_routed);
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, subsys_stats.rx_dropped);
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, subsys_stats.tx_sent);
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, subsys_stats.tx_dropped);
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_binary_subsystem_stats_reply(const struct message *msg,
+                                                      uint8_t *output,
+                                                      uint32_t output_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (output_max_len < BINARY_SUBSYSTEM_STATS_PAYLOAD_LEN) {
+		return -1;
+	}
+
+	struct subsystem_stats subsys_stats;
+	sum_subsystem_stats(subsystems.registry[data->subsystem_id].state, &subsys_stats);
+
+	output[0] = data->subsystem_id;
+	bin_put_u32(&output[1], subsys_stats.rx_routed);
+	bin_put_u32(&output[5], subsys_stats.rx_dropped);
+	bin_put_u32(&output[9], subsys_stats.tx_sent);
+	bin_put_u32(&output[13], subsys_stats.tx_dropped);
+
+	return BINARY_SUBSYSTEM_STATS_PAYLOAD_LEN;
+}
+
+/**
+ * Checks that a subscription can be set up, and fills in everything but its
+ * request payload. Parsing the request is left to the subsystem's parsing
+ * function, once the subscription is due. Whether the link has room for it
+ * gets checked by handle_dispatcher_message().
+ */
+static bool init_subscription(struct message *msg,
+                              uint8_t subsystem_id,
+                              uint32_t msg_idx,
+                              uint32_t period_ms,
+                              enum dispatcher_protocol protocol)
+{
+	struct subscription *sub = &((union dispatcher_msg_data *) msg->data)->subscription;
+
+	if (msg->transaction_id == NO_TRANSACTION_ID) {
+		return false;
+	}
+
+	if (subsystem_id >= subsystems.num_subsystems &&
+	    subsystem_id != DISPATCHER_SUBSYSTEM_ID) {
+
+		return false;
+	}
+
+	// The dispatcher's own requests get handled by the RX worker.
+	struct subsystem_message_conf *conf = get_subsystem_conf(&subsystems, subsystem_id);
+	if (conf == NULL ||
+	    (conf != &dispatcher_conf && conf->incoming_msg_queue == NULL) ||
+	    msg_idx >= conf->num_message_types) {
+
+		return false;
+	}
+
+	struct message_handler *handler = &conf->message_handlers[msg_idx];
+	bool can_parse = (protocol == DISPATCHER_PROTOCOL_BINARY) ?
+	                 handler->binary_parsing_func != NULL :
+	                 handler->parsing_func != NULL;
+
+	if (!handler->subscribable || !can_parse) {
+		return false;
+	}
+
+	if (period_ms < SUBSCRIPTION_MIN_PERIOD_MS) {
+		period_ms = SUBSCRIPTION_MIN_PERIOD_MS;
+	} else if (period_ms > SUBSCRIPTION_MAX_PERIOD_MS) {
+		period_ms = SUBSCRIPTION_MAX_PERIOD_MS;
+	}
+
+	memset(sub, 0, sizeof(*sub));
+	sub->id = msg->transaction_id;
+	sub->subsystem_id = subsystem_id;
+	sub->msg_idx = (uint8_t) msg_idx;
+	sub->period_us = period_ms * 1000;
+	sub->protocol = protocol;
+
+	return true;
+}
+
+static bool parse_subscribe(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields)
+{
+	struct subscription *sub = &((union dispatcher_msg_data *) msg->data)->subscription;
+	uint32_t period_ms = 0;
+
+	if (num_fields < 3 || !message_field_to_u32(&fields[2], &period_ms)) {
+		return false;
+	}
+
+	struct name_table_entry *entry = name_table_find(&subsystems,
+	                                                 fields[0].hash,
+	                                                 NULL,
+	                                                 fields[0].str);
+	if (entry == NULL) {
+		return false;
+	}
+
+	uint8_t subsystem_id = entry->subsystem_id;
+
+	entry = name_table_find(&subsystems,
+	                        name_table_message_key(fields[0].hash, fields[1].hash),
+	                        entry->conf,
+	                        fields[1].str);
+	if (entry == NULL) {
+		return false;
+	}
+
+	if (!init_subscription(msg, subsystem_id, entry->msg_idx, period_ms,
+	                       DISPATCHER_PROTOCOL_ASCII)) {
+		return false;
+	}
+
+	// Put the request's payload fields back together, commas and all.
+	for (uint32_t i = 3; i < num_fields; i++) {
+		uint32_t separator_len = (i > 3) ? 1 : 0;
+
+		if (sub->payload_len + separator_len + fields[i].len >= SUBSCRIPTION_PAYLOAD_SIZE) {
+			return false;
+		}
+
+		if (separator_len > 0) {
+			sub->payload[sub->payload_len++] = ',';
+		}
+
+		memcpy(&sub->payload[sub->payload_len], fields[i].str, fields[i].len);
+		sub->payload_len += fields[i].len;
+	}
+
+	sub->payload[sub->payload_len] = '\0';
+
+	return true;
+}
+
+static bool parse_binary_subscribe(struct message *msg,
+                                   const uint8_t *payload,
+                                   uint32_t payload_len)
+{
+	struct subscription *sub = &((union dispatcher_msg_data *) msg->data)->subscription;
+
+	if (payload_len < BINARY_SUBSCRIBE_HEADER_LEN ||
+	    payload_len - BINARY_SUBSCRIBE_HEADER_LEN > SUBSCRIPTION_PAYLOAD_SIZE) {
+
+		return false;
+	}
+
+	if (!init_subscription(msg, payload[0], payload[1], bin_get_u32(&payload[2]),
+	                       DISPATCHER_PROTOCOL_BINARY)) {
+		return false;
+	}
+
+	sub->payload_len = payload_len - BINARY_SUBSCRIBE_HEADER_LEN;
+	memcpy(sub->payload, &payload[BINARY_SUBSCRIBE_HEADER_LEN], sub->payload_len);
+
+	return true;
+}
+
+static ssize_t serialize_subscribe_reply(const struct message *msg,
+                                         char *output_str,
+                                         uint32_t output_str_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_str, output_str_max_len);
+
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, data->subscription.period_us / 1000);
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_binary_subscribe_reply(const struct message *msg,
+                                                uint8_t *output,
+                                                uint32_t output_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (output_max_len < sizeof(uint32_t)) {
+		return -1;
+	}
+
+	bin_put_u32(output, data->subscription.period_us / 1000);
+	return sizeof(uint32_t);
+}
+
+static bool parse_unsubscribe(struct message *msg,
+                              const struct message_field *fields,
+                              uint32_t num_fields)
+{
+	union dispatcher_msg_data *data = msg->data;
+	uint32_t id = NO_TRANSACTION_ID;
+
+	if (num_fields != 1 || !message_field_to_u32(&fields[0], &id) ||
+	    id == NO_TRANSACTION_ID || !transaction_id_valid(id)) {
+
+		return false;
+	}
+
+	data->subscription_id = id;
+	return true;
+}
+
+static bool parse_binary_unsubscribe(struct message *msg,
+                                     const uint8_t *payload,
+                                     uint32_t payload_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (payload_len != sizeof(uint32_t)) {
+		return false;
+	}
+
+	uint32_t id = bin_get_u32(payload);
+	if (id == NO_TRANSACTION_ID || !transaction_id_valid(id)) {
+		return false;
+	}
+
+	data->subscription_id = id;
+	return true;
+}
+
+static ssize_t serialize_unsubscribe_reply(const struct message *msg,
+                                           char *output_str,
+                                           uint32_t output_str_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_str, output_str_max_len);
+
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, wire_transaction_id(data->subscription_id));
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_binary_unsubscribe_reply(const struct message *msg,
+                                                  uint8_t *output,
+                                                  uint32_t output_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (output_max_len < sizeof(uint32_t)) {
+		return -1;
+	}
+
+	bin_put_u32(output, wire_transaction_id(data->subscription_id));
+	return sizeof(uint32_t);
+}
+
+static bool parse_get_credits(struct message *msg,
+                              const struct message_field *fields,
+                              uint32_t num_fields)
+{
+	(void) msg;
+	(void) fields;
+
+	return num_fields == 0;
+}
+
+static bool parse_binary_get_credits(struct message *msg,
+                                     const uint8_t *payload,
+                                     uint32_t payload_len)
+{
+	(void) msg;
+	(void) payload;
+
+	return payload_len == 0;
+}
+
+/**
+ * @return The number of requests the subsystem can still take, i.e. the room
+ *         in its incoming queue, or in the slab for them and a reply, whichever
+ *         is less. The counters get read without locking, so a message that's
+ *         being routed, taken, allocated or freed at the same time may be off
+ *         by one, for a moment.
+ */
+static uint32_t get_subsystem_credits(const struct subsystem_dispatch_state *state)
+{
+	const struct subsystem_message_conf *conf = state->conf;
+
+	uint32_t rx_routed = 0;
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		rx_routed += state->stats[i].rx_routed;
+	}
+
+	uint32_t in_queue = rx_routed - state->rx_taken;
+	uint32_t credits = conf->incoming_credits;
+
+	// Taken before its routing got counted.
+	if ((int32_t) in_queue < 0) {
+		in_queue = 0;
+	}
+
+	credits = (in_queue < credits) ? credits - in_queue : 0;
+
+	if (conf->request_payload_size != 0) {
+		uint32_t free_slots = message_slab_free_slots(conf->request_payload_size);
+		uint32_t slot_credits = (free_slots > 0) ? free_slots - 1 : 0;
+
+		if (slot_credits < credits) {
+			credits = slot_credits;
+		}
+	}
+
+	return credits;
+}
+
+static ssize_t serialize_credits_reply(const struct message *msg,
+                                       char *output_str,
+                                       uint32_t output_str_max_len)
+{
+	(void) msg;
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_str, output_str_max_len);
+
+	for (uint32_t i = 0; i < subsystems.num_subsystems; i++) {
+		struct subsystem_dispatch_state *state = subsystems.registry[i].state;
+
+		if (state->conf == NULL || state->conf->incoming_credits == 0) {
+			continue;
+		}
+
+		fmt_put_ch(&writer, ',');
+		fmt_put_str(&writer, state->conf->subsystem_name);
+		fmt_put_ch(&writer, ',');
+		fmt_put_u32(&writer, get_subsystem_credits(state));
+	}
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_binary_credits_reply(const struct message *msg,
+                                              uint8_t *output,
+                                              uint32_t output_max_len)
+{
+	(void) msg;
+
+	uint32_t len = 0;
+
+	for (uint32_t i = 0; i < subsystems.num_subsystems; i++) {
+		struct subsystem_dispatch_state *state = subsystems.registry[i].state;
+
+		if (state->conf == NULL || state->conf->incoming_credits == 0) {
+			continue;
+		}
+
+		if (output_max_len - len < BINARY_CREDITS_ENTRY_LEN) {
+			return -1;
+		}
+
+		output[len] = (uint8_t) i;
+		bin_put_u32(&output[len + 1], get_subsystem_credits(state));
+		len += BINARY_CREDITS_ENTRY_LEN;
+	}
+
+	return (ssize_t) len;
 }
 
-bool dispatcher_register_subsystem(struct subsystem_message_conf *conf)
+#ifdef MESSAGE_TRACING
+static bool parse_get_latency(struct message *msg,
+                              const struct message_field *fields,
+                              uint32_t num_fields)
 {
-	if (subsystems.num_subsystems >= MAX_NUM_COMM_SUBSYSTEMS) {
+	union dispatcher_msg_data *data = msg->data;
+	uint32_t stage = 0;
+
+	if (num_fields != 1 || !message_field_to_u32(&fields[0], &stage) ||
+	    stage >= NUM_MESSAGE_TRACE_POINTS) {
+
 		return false;
 	}
 
-	subsystems.subsystem_configurations[subsystems.num_subsystems] = conf;
-	subsystems.num_subsystems++;
+	data->latency_stage = (uint8_t) stage;
+	return true;
+}
+
+static bool parse_binary_get_latency(struct message *msg,
+                                     const uint8_t *payload,
+                                     uint32_t payload_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (payload_len != 1 || payload[0] >= NUM_MESSAGE_TRACE_POINTS) {
+		return false;
+	}
 
+	data->latency_stage = payload[0];
 	return true;
 }
 
+static ssize_t serialize_latency_reply(const struct message *msg,
+                                       char *output_str,
+                                       uint32_t output_str_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+	message_trace_get_histogram(data->latency_stage, buckets);
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_str, output_str_max_len);
+
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, data->latency_stage);
+
+	for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+		fmt_put_ch(&writer, ',');
+		fmt_put_u32(&writer, buckets[i]);
+	}
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_binary_latency_reply(const struct message *msg,
+                                              uint8_t *output,
+                                              uint32_t output_max_len)
+{
+	union dispatcher_msg_data *data = msg->data;
+
+	if (output_max_len < BINARY_LATENCY_PAYLOAD_LEN) {
+		return -1;
+	}
+
+	uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+	message_trace_get_histogram(data->latency_stage, buckets);
+
+	output[0] = data->latency_stage;
+	for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+		bin_put_u32(&output[1 + i * sizeof(uint32_t)], buckets[i]);
+	}
+
+	return BINARY_LATENCY_PAYLOAD_LEN;
+}
+#endif /* MESSAGE_TRACING */
+
+static struct message *dispatcher_alloc_message(uint32_t msg_type_id)
+{
+	struct dispatcher_msg *ret = os_pool_alloc_take(&dispatcher_msg_pool);
+	if (ret == NULL) {
+		return NULL;
+	}
+
+	ret->msg.type = msg_type_id;
+	ret->msg.transaction_id = 0;
+	ret->msg.data = &ret->data;
+
+	return &ret->msg;
+}
+
+static void dispatcher_free_message(struct message *msg)
+{
+	os_pool_alloc_give(&dispatcher_msg_pool, msg);
+}
+
+
+static void register_subsystem_names(struct subsystem_message_conf *conf,
+                                     uint8_t subsystem_id)
+{
+	uint32_t subsystem_hash = message_field_hash_str(conf->subsystem_name);
+
+	name_table_insert(&subsystems, subsystem_hash, conf,
+	                  NAME_TABLE_SUBSYSTEM_ENTRY, subsystem_id);
+
+	for (uint32_t i = 0; i < conf->num_message_types; i++) {
+		uint32_t message_hash = message_field_hash_str(conf->message_handlers[i].message_name);
+
+		name_table_insert(&subsystems,
+		                  name_table_message_key(subsystem_hash, message_hash),
+		                  conf,
+		                  i,
+		                  subsystem_id);
+	}
+}
+
+/**
+ * Initializes a subsystem of the registry, and registers its message handlers.
+ */
+static void init_subsystem(uint8_t subsystem_id)
+{
+	const struct ratfist_subsystem *subsystem = &subsystems.registry[subsystem_id];
+	struct subsystem_dispatch_state *state = subsystem->state;
+
+	memset(state, 0, sizeof(*state));
+	err_coalescer_init(&state->err_coalescer);
+
+	struct subsystem_message_conf *conf = subsystem->init();
+
+	// The subsystem name, and all of its message names must fit. Keep at
+	// least one slot free, so that lookups of unknown names terminate on an
+	// empty slot.
+	if (subsystems.name_table_used + 1 + conf->num_message_types >= NAME_TABLE_SIZE) {
+		return;
+	}
+
+	register_subsystem_names(conf, subsystem_id);
+
+	state->conf = conf;
+}
+
+
+/**
+ * Initializes the queues & workers of a link, and starts the workers.
+ */
+static void init_link(uint8_t link_id)
+{
+	struct dispatcher_link *link = &links[link_id];
+	struct rx_worker_context *rx_context = &link->rx_context;
+	struct tx_worker_context *tx_context = &link->tx_context;
+
+	os_mailbox_init(&link->err_msg_queue,
+	                link->err_msg_queue_buf,
+	                MAX_DISPATCHER_ERROR_MESSAGES,
+	                sizeof(struct error_entry),
+	                notify_tx_workers);
+
+	os_mailbox_init(&link->dispatcher_msg_queue,
+	                link->dispatcher_msg_queue_buf,
+	                ARRAY_SIZE(link->dispatcher_msg_queue_buf),
+	                sizeof(struct message *),
+	                notify_tx_workers);
+
+	os_mailbox_init(&link->routed_queue,
+	                link->routed_queue_buf,
+	                ROUTED_QUEUE_SIZE,
+	                sizeof(struct routed_entry),
+	                notify_tx_workers);
+
+	memset(&link->stats, 0, sizeof(link->stats));
+	memset(&link->subscriptions, 0, sizeof(link->subscriptions));
+
+
+	message_field_parser_init(&rx_context->parser,
+	                          rx_context->incoming_msg_buf,
+	                          ARRAY_SIZE(rx_context->incoming_msg_buf),
+	                          rx_context->incoming_msg_fields,
+	                          ARRAY_SIZE(rx_context->incoming_msg_fields));
+
+	// Binary frames can't be fragmented.
+	cobs_decoder_init(&rx_context->decoder,
+	                  (uint8_t *) rx_context->incoming_msg_buf,
+	                  BSP_MAX_MESSAGE_LENGTH);
+
+	message_field_parser_init(&rx_context->subscription_parser,
+	                          rx_context->subscription_buf,
+	                          ARRAY_SIZE(rx_context->subscription_buf),
+	                          rx_context->subscription_fields,
+	                          ARRAY_SIZE(rx_context->subscription_fields));
+
+	rx_context->rx_char_buffer = bsp_links[link_id].rx_buffer;
+	rx_context->rx_dropped_seen = bsp_links[link_id].uart_stats->rx_dropped;
+	rx_context->protocol = DISPATCHER_PROTOCOL_ASCII;
+	rx_context->frame_state = RX_FRAME_IDLE;
+	rx_context->frame_started = false;
+	rx_context->reassembling = false;
+	rx_context->in_frame_id = false;
+	rx_context->worker = &link->rx_worker;
+	rx_context->link_id = link_id;
+	rx_context->subsystems = &subsystems;
+	rx_context->subscriptions = &link->subscriptions;
+	rx_context->stats = &link->stats;
+	rx_context->err_msg_queue = &link->err_msg_queue;
+	rx_context->dispatcher_msg_queue = &link->dispatcher_msg_queue;
+
+	worker_task_init(&link->rx_worker,
+	                 rx_worker_names[link_id],
+	                 rx_worker_stacks[link_id],
+	                 TASK_STACK_SIZE,
+	                 COMM_TASK_PRIORITY,
+	                 assemble_incoming_message,
+	                 rx_context);
+
+	tx_context->tx_ring = bsp_links[link_id].tx_buffer;
+	tx_context->protocol = DISPATCHER_PROTOCOL_ASCII;
+	memset(&tx_context->sched, 0, sizeof(tx_context->sched));
+	tx_context->fragmenter.msg = NULL;
+	tx_context->worker = &link->tx_worker;
+	tx_context->link_id = link_id;
+	tx_context->subsystems = &subsystems;
+	tx_context->stats = &link->stats;
+	tx_context->err_msg_queue = &link->err_msg_queue;
+	tx_context->dispatcher_msg_queue = &link->dispatcher_msg_queue;
+	tx_context->routed_queue = &link->routed_queue;
+	tx_context->deferring = false;
+	tx_context->holding = false;
+
+	err_coalescer_init(&tx_context->disp_err_coalescer);
+
+	worker_task_init(&link->tx_worker,
+	                 tx_worker_names[link_id],
+	                 tx_worker_stacks[link_id],
+	                 TX_TASK_STACK_SIZE,
+	                 COMM_TASK_PRIORITY,
+	                 check_outgoing_queue,
+	                 tx_context);
+}
+
+
+void dispatcher_init(void)
+{
+	// The dispatcher's own messages
+	os_pool_alloc_init(&dispatcher_msg_pool,
+	                   dispatcher_msg_pool_mem,
+	                   sizeof(struct dispatcher_msg),
+	                   ARRAY_SIZE(dispatcher_msg_pool_mem));
+
+	// The subsystems' messages
+	message_slab_init();
+
+	register_subsystem_names(&dispatcher_conf, DISPATCHER_SUBSYSTEM_ID);
+
+	message_trace_init();
+
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		init_link((uint8_t) i);
+	}
+
+	// Register the tasks with the scheduler.
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		worker_start(&links[i].rx_worker);
+		worker_start(&links[i].tx_worker);
+	}
+
+	bsp_set_rx_notify_callback(notify_rx_workers);
+
+	// The registry index is the subsystem ID, and the dispatcher's own ID is
+	// taken.
+	uint32_t num_subsystems = (uint32_t) (__stop_ratfist_subsystems - __start_ratfist_subsystems);
+	if (num_subsystems > DISPATCHER_SUBSYSTEM_ID) {
+		num_subsystems = DISPATCHER_SUBSYSTEM_ID;
+	}
+
+	subsystems.registry = __start_ratfist_subsystems;
+	subsystems.num_subsystems = num_subsystems;
+
+	for (uint32_t i = 0; i < num_subsystems; i++) {
+		init_subsystem((uint8_t) i);
+	}
+}
+
+void dispatcher_deinit(void)
+{
+	bsp_set_rx_notify_callback(NULL);
+
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		worker_stop(&links[i].rx_worker);
+		worker_stop(&links[i].tx_worker);
+	}
+
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		worker_join(&links[i].rx_worker);
+		worker_join(&links[i].tx_worker);
+	}
+
+	subsystems.num_subsystems = 0;
+
+	memset(subsystems.name_table, 0, sizeof(subsystems.name_table));
+	subsystems.name_table_used = 0;
+}
+
+void dispatcher_notify_tx(void)
+{
+	notify_tx_workers();
+}
+
+void dispatcher_trace_message(uint32_t transaction_id, uint32_t point)
+{
+	message_trace_record(transaction_id, point, message_trace_timestamp());
+}
+
+void dispatcher_message_taken(const struct subsystem_message_conf *conf)
+{
+	for (uint32_t i = 0; i < subsystems.num_subsystems; i++) {
+		struct subsystem_dispatch_state *state = subsystems.registry[i].state;
+
+		if (state->conf == conf) {
+			state->rx_taken++;
+			return;
+		}
+	}
+}
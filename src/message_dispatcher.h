@@ -13,6 +13,138 @@
 
 #include <mouros/mailbox.h> // For mailbox_t
 
+#include "message_fields.h" // For struct message_field
+#include "err_coalescer.h" // For struct err_coalescer
+#include "constants.h" // For BSP_NUM_LINKS
+
+/**
+ * The protocols the dispatcher can talk over the UART link. The link starts
+ * out in ASCII mode, and the host can switch it with a DISPATCHER SET_PROTOCOL
+ * message. The reply to that is sent in the old protocol, and everything after
+ * it in the new one.
+ *
+ * ASCII messages look like "$<transaction ID>,<subsystem name>,<message name>,
+ * <payload fields>*<XOR checksum in hex>\r\n".
+ *
+ * Binary messages are COBS encoded, and delimited by a zero byte. Decoded, they
+ * consist of the transaction ID (uint32_t), the subsystem ID (uint8_t, the
+ * subsystem's position in the registry, or DISPATCHER_SUBSYSTEM_ID), the message ID
+ * (uint8_t, the message's position in message_handlers[]), the payload, and a
+ * CRC-16/CCITT-FALSE of all of the preceding bytes (uint16_t). All multi-byte
+ * fields are little-endian. Errors are sent with the message ID
+ * BINARY_ERROR_MESSAGE_ID, and an int32_t error code as the payload.
+ *
+ * ASCII messages too long for a single BSP_MAX_MESSAGE_LENGTH frame are sent
+ * as fragments, split between payload fields. Fragments carry
+ * "<transaction ID>/<sequence number>" in place of the transaction ID, followed
+ * by a '+' on all but the last one. The first fragment (sequence number 0) has
+ * the subsystem & message names, and the ones after it go straight on with the
+ * payload fields, e.g. "$5/0+,SPINNER,PLAN_REPLY,0,1000,50.000*<checksum>\r\n"
+ * and "$5/1,2000,25.000*<checksum>\r\n". Each fragment has its own checksum.
+ * Incoming fragments get reassembled into the message, up to
+ * BSP_MAX_REASSEMBLED_LENGTH characters, as they arrive. They must be sent back
+ * to back: anything else arriving in between drops the fragmented message with
+ * a MESSAGE_PARSING_ERROR. Outgoing fragments are only sent for messages whose
+ * handler has a streaming_serialization_func. Binary messages can't be
+ * fragmented.
+ *
+ * Repeated errors get coalesced (see err_coalescer.h). The first occurrence of
+ * an error code is sent right away, as an ERROR message. The ones after it
+ * within ERR_REPORT_INTERVAL_US are sent together, once the interval has
+ * passed, as an ERROR_REPORT message of the error code, the number of
+ * occurrences, and the bsp_get_timestamp_us() times of the first & last one.
+ * In the binary protocol, these have the message ID
+ * BINARY_ERROR_REPORT_MESSAGE_ID, and an int32_t error code, followed by three
+ * uint32_t fields as the payload.
+ *
+ * Errors caused by a particular incoming or outgoing message carry its
+ * transaction ID, so the host can fail that transaction right away instead of
+ * waiting for it to time out. In ASCII, these look like "$<transaction ID>,
+ * <subsystem name>,ERROR,<error code>*<checksum>\r\n", while errors that don't
+ * belong to a transaction are sent without the transaction ID field. In the
+ * binary protocol, the transaction ID is in the header, and is
+ * NO_TRANSACTION_ID for the latter. Errors of a transaction are never
+ * coalesced, and aggregated reports never carry a transaction ID.
+ *
+ * The DISPATCHER subsystem also answers GET_STATS with a STATS_REPLY of its
+ * counters: frames received, checksum errors, frames too long, UART overruns,
+ * characters the UART dropped, the RX buffer high-water mark, frames sent, the
+ * TX ring high-water mark, and errors the coalescers dropped. It answers
+ * GET_SUBSYSTEM_STATS with a subsystem name (a subsystem ID in binary) with a
+ * SUBSYSTEM_STATS_REPLY of the name (ID), and the number of messages routed
+ * to the subsystem, dropped on the way to it, sent from it, and dropped on the
+ * way from it. In the binary protocol, all counters are uint32_t.
+ *
+ * Instead of polling, the host can SUBSCRIBE to a request of a subsystem, with
+ * the subsystem name, the message name, the period in milliseconds, and the
+ * request's payload fields (in binary: the subsystem ID & message ID as
+ * uint8_t, the period as uint32_t, and the request's payload). Only messages
+ * whose handler is marked subscribable can be subscribed to. The dispatcher
+ * then routes the request to the subsystem once per period, starting right
+ * away, with the SUBSCRIBE message's transaction ID, so that all of the
+ * subsystem's replies carry it as the subscription ID. SUBSCRIBE is answered
+ * with a SUBSCRIBE_REPLY of the period in effect (clamped to
+ * SUBSCRIPTION_MIN_PERIOD_MS ... SUBSCRIPTION_MAX_PERIOD_MS, uint32_t in
+ * binary). UNSUBSCRIBE with a subscription ID (uint32_t in binary) ends the
+ * subscription, and is answered with an UNSUBSCRIBE_REPLY of the ID. Requests
+ * that can't be subscribed to, subscription IDs that are NO_TRANSACTION_ID or
+ * already taken, and running out of SUBSCRIPTION_SLOTS all get a
+ * MESSAGE_PARSING_ERROR. A subscription whose request fails to parse gets
+ * dropped.
+ *
+ * With MESSAGE_TRACING, the DISPATCHER subsystem answers GET_LATENCY with a
+ * stage (an enum message_trace_point, a uint8_t in binary) with a
+ * LATENCY_REPLY of the stage, and the LATENCY_HISTOGRAM_BUCKETS counts of the
+ * stage's latency histogram (uint32_t in binary). See message_trace.h.
+ *
+ * With more than one link (see BSP_NUM_LINKS), every link has its own RX & TX
+ * workers, protocol, subscriptions and DISPATCHER counters. Replies and errors
+ * of a transaction go out on the link its request came in on, so hosts must
+ * keep their transaction IDs below 2^28, and get a MESSAGE_PARSING_ERROR
+ * otherwise. Messages & errors of the subsystems that don't belong to a
+ * transaction go out on the first link, the control link, which is also the
+ * only one whose latencies get traced. The control link's TX worker hands the
+ * other links' messages over to them, and if a link has no room for one, the
+ * message gets dropped, and its transaction fails with a TX_BUFFER_FULL.
+ *
+ * So that the host can keep several requests in flight without overrunning a
+ * subsystem, the DISPATCHER subsystem answers GET_CREDITS with a CREDITS_REPLY
+ * of the receive credits of every subsystem that advertises them (see
+ * incoming_credits in struct subsystem_message_conf): a subsystem name and the
+ * number of requests the subsystem can still take (in binary: the subsystem
+ * ID as uint8_t, and the credits as uint32_t, for each subsystem). GET_CREDITS
+ * can be subscribed to, for a periodic CREDITS_REPLY. A request that arrives
+ * while its subsystem's incoming queue is full gets dropped, and its
+ * transaction fails with an RX_BUFFER_FULL, as do characters the UART had to
+ * drop, because the RX buffer was full, with an RX_BUFFER_FULL without a
+ * transaction ID.
+ */
+enum dispatcher_protocol {
+	DISPATCHER_PROTOCOL_ASCII = 0,
+	DISPATCHER_PROTOCOL_BINARY = 1
+};
+
+/**
+ * The binary protocol subsystem ID of the dispatcher itself.
+ */
+#define DISPATCHER_SUBSYSTEM_ID 0xFF
+
+/**
+ * The binary protocol message ID of error messages.
+ */
+#define BINARY_ERROR_MESSAGE_ID 0xFF
+
+/**
+ * The binary protocol message ID of aggregated error reports.
+ */
+#define BINARY_ERROR_REPORT_MESSAGE_ID 0xFE
+
+/**
+ * The transaction ID of errors that don't belong to any transaction. Hosts
+ * must not use it for their messages.
+ */
+#define NO_TRANSACTION_ID 0
+
 /**
  * Struct representing a message.
  */
@@ -34,6 +166,30 @@ struct message {
 	void *data;
 };
 
+/**
+ * An entry of an error queue.
+ */
+struct error_entry {
+	int32_t err_code;
+	/**
+	 * The transaction ID of the message that caused the error, or
+	 * NO_TRANSACTION_ID if it wasn't caused by a particular message.
+	 */
+	uint32_t transaction_id;
+};
+
+/**
+ * Where the streaming serialization of a message may resume, so that each of
+ * its fragments only has to format its own part of the payload. Kept by the
+ * dispatcher between the fragments, and zeroed for a new message.
+ */
+struct stream_cursor {
+	/** The position in the payload where item starts. */
+	uint32_t offset;
+	/** The serializer's own resume point, e.g. the index of a field. */
+	uint32_t item;
+};
+
 /**
  * This struct describes a subsystem's messages, their parsing, serialization,
  * allocation, deallocation, and the message queues used for transmitting them
@@ -60,20 +216,25 @@ struct subsystem_message_conf {
 		char *message_name;
 
 		/**
-		 * Function used for parsing the payload of the message in
-		 * payload_str. May be NULL, in which case the message will not
+		 * Function used for parsing the payload of the message from
+		 * its fields. May be NULL, in which case the message will not
 		 * be parsed, and an error message will be sent back.
 		 *
-		 * @param msg      Preallocated struct that will be filled with
-		 *                 the data from the input string.
-		 * @param save_ptr Save pointer for the rest of the message.
-		 *                 What is returned by strtok_r after getting
-		 *                 the transaction ID, subsystem name, and
-		 *                 message name from the raw message string.
+		 * @param msg        Preallocated struct that will be filled
+		 *                   with the data from the payload fields.
+		 * @param fields     The payload fields of the message, i.e.
+		 *                   the ones after the transaction ID,
+		 *                   subsystem name, and message name. Numeric
+		 *                   fields are already converted, see
+		 *                   message_field_to_u32() and
+		 *                   message_field_to_float().
+		 * @param num_fields The number of payload fields.
 		 * @return The parsing outcome. True on success, false on
 		 *         failure.
 		 */
-		bool (*parsing_func)(struct message *msg, char *save_ptr);
+		bool (*parsing_func)(struct message *msg,
+		                     const struct message_field *fields,
+		                     uint32_t num_fields);
 
 		/**
 		 * Function used for serializing the payload of the message in
@@ -91,6 +252,78 @@ struct subsystem_message_conf {
 		ssize_t (*serialization_func)(const struct message *msg,
 		                              char *output_str,
 		                              uint32_t output_str_max_len);
+
+		/**
+		 * Function used for parsing the payload of a binary protocol
+		 * message. May be NULL, in which case the message can only be
+		 * received in the ASCII protocol.
+		 *
+		 * @param msg         Preallocated struct that will be filled
+		 *                    with the data from the payload.
+		 * @param payload     The little-endian payload of the message.
+		 * @param payload_len The length of the payload in bytes.
+		 * @return The parsing outcome. True on success, false on
+		 *         failure.
+		 */
+		bool (*binary_parsing_func)(struct message *msg,
+		                            const uint8_t *payload,
+		                            uint32_t payload_len);
+
+		/**
+		 * Function used for serializing the payload of a binary
+		 * protocol message. May be NULL, in which case the message can
+		 * only be sent in the ASCII protocol.
+		 *
+		 * @param msg            Pointer to the message struct to be
+		 *                       serialized.
+		 * @param output         Buffer for the little-endian payload.
+		 * @param output_max_len The size of output.
+		 * @return If successful, returns the number of bytes written.
+		 *         Returns -1 if an error occurred during serialization.
+		 */
+		ssize_t (*binary_serialization_func)(const struct message *msg,
+		                                     uint8_t *output,
+		                                     uint32_t output_max_len);
+
+		/**
+		 * Function used for serializing the payload of an ASCII
+		 * message piecewise, so that it can be sent in fragments. May
+		 * be NULL, in which case the message has to fit into a single
+		 * frame. Used instead of serialization_func if it isn't.
+		 *
+		 * @param msg                Pointer to the message struct to be
+		 *                           serialized.
+		 * @param cursor             Where to resume the serialization
+		 *                           from. Never past offset. May be
+		 *                           moved on to any point before
+		 *                           offset + output_str_max_len, or
+		 *                           left alone to always start over.
+		 * @param offset             The position in the payload to
+		 *                           start the output at.
+		 * @param output_str         Pointer to the buffer that should
+		 *                           hold the serialized part of the
+		 *                           payload. Not NUL terminated.
+		 * @param output_str_max_len The size of output_str. The payload
+		 *                           is cut off after it.
+		 * @return If successful, returns the length of the payload from
+		 *         offset on. The serialization may stop once that is
+		 *         longer than output_str_max_len. Returns -1 if an
+		 *         error occurred during serialization. See
+		 *         fmt_writer_init_window().
+		 */
+		ssize_t (*streaming_serialization_func)(const struct message *msg,
+		                                        struct stream_cursor *cursor,
+		                                        uint32_t offset,
+		                                        char *output_str,
+		                                        uint32_t output_str_max_len);
+
+		/**
+		 * Whether the host may SUBSCRIBE to this message, i.e. have
+		 * the dispatcher send it to the subsystem periodically. Meant
+		 * for requests whose replies are readings, and which have no
+		 * side effects.
+		 */
+		bool subscribable;
 	} *message_handlers;
 
 	/**
@@ -114,8 +347,8 @@ struct subsystem_message_conf {
 
 	/**
 	 * Priority queue for reporting asynchronous errors. Outgoing messages
-	 * are simply int32_t error codes. The dispatcher will serialize them
-	 * into message packets.
+	 * are struct error_entry. The dispatcher will serialize them into
+	 * message packets.
 	 *
 	 * May be NULL.
 	 */
@@ -124,7 +357,8 @@ struct subsystem_message_conf {
 	/**
 	 * Pointer to the function used for allocating this subsystem's message
 	 * structs. This may be NULL if there are no parsing functions, and the
-	 * subsystem will only be transmitting messages.
+	 * subsystem will only be transmitting messages. Subsystems allocate
+	 * their messages from the shared slab, see message_slab.h.
 	 *
 	 * @param msg_type_id The type of message to allocate. This must
 	 *                    correspond to the message position in
@@ -142,27 +376,163 @@ struct subsystem_message_conf {
 	 * @param msg Pointer to the message struct to be deallocated.
 	 */
 	void (*free_message)(struct message *msg);
+
+	/**
+	 * The share of the UART link this subsystem's outgoing messages get,
+	 * when several subsystems have messages waiting. A subsystem with
+	 * a weight of 2 may send twice as many bytes per scheduling round as
+	 * one with a weight of 1. Error messages are sent before any regular
+	 * messages, regardless of weights.
+	 *
+	 * 0 is treated as 1.
+	 */
+	uint32_t tx_weight;
+
+	/**
+	 * The number of messages incoming_msg_queue can hold, i.e. the receive
+	 * credits advertised to the host when the subsystem is idle. The
+	 * subsystem must then call dispatcher_message_taken() for every
+	 * message it takes off the queue.
+	 *
+	 * 0 if the subsystem doesn't advertise credits.
+	 */
+	uint32_t incoming_credits;
+
+	/**
+	 * The payload size the subsystem's usual requests get allocated with
+	 * from the message slab (see message_slab.h), regardless of the size of
+	 * their replies. 0 if it doesn't allocate them from the slab. The slots
+	 * of that size class are shared with the replies, and with other
+	 * subsystems, so the credits advertised never exceed its free slots,
+	 * less one left for a reply.
+	 *
+	 * Requests with a larger payload, e.g. Spinner's SET_PLAN, take slots
+	 * of a larger class, which the credits don't account for. They fail
+	 * with a MEM_ALLOC_ERROR when that class runs out.
+	 */
+	uint32_t request_payload_size;
+};
+
+
+/**
+ * Counters of a registered subsystem's messages on a link.
+ */
+struct subsystem_stats {
+	/** Messages handed over to the subsystem's incoming message queue. */
+	uint32_t rx_routed;
+	/** Messages for the subsystem that failed allocation, parsing or routing. */
+	uint32_t rx_dropped;
+	/** Messages of the subsystem written into the TX ring. */
+	uint32_t tx_sent;
+	/** Messages of the subsystem that failed serialization. */
+	uint32_t tx_dropped;
+};
+
+/**
+ * The dispatcher's state of a subsystem. Every RATFIST_SUBSYSTEM() brings its
+ * own, so the number of subsystems is only limited by what gets linked in.
+ * Only to be touched by the dispatcher.
+ */
+struct subsystem_dispatch_state {
+	/** The subsystem's configuration, or NULL if it couldn't be registered. */
+	struct subsystem_message_conf *conf;
+	/**
+	 * Kept per link, so that every counter has a single writer, the link's
+	 * RX or TX worker.
+	 */
+	struct subsystem_stats stats[BSP_NUM_LINKS];
+	/** Rate limits the subsystem's error messages. */
+	struct err_coalescer err_coalescer;
+	/**
+	 * Bytes the subsystem may still send on its TX scheduler turn. The size
+	 * of a message is only known after it's been sent, so this may go
+	 * negative.
+	 */
+	int32_t tx_deficit;
+	/**
+	 * Messages the subsystem has taken off its incoming message queue, see
+	 * dispatcher_message_taken(). Only written by the subsystem.
+	 */
+	volatile uint32_t rx_taken;
+};
+
+/**
+ * An entry of the subsystem registry. The entries get placed in the
+ * ratfist_subsystems linker section by RATFIST_SUBSYSTEM(), and the dispatcher
+ * walks them at boot. An entry's index in the section is the subsystem's ID in
+ * the binary protocol, so the IDs follow the link order of the subsystems, and
+ * the order of the entries within a source file.
+ */
+struct ratfist_subsystem {
+	/**
+	 * Initializes the subsystem, e.g. its queues & tasks. Gets called by
+	 * dispatcher_init().
+	 *
+	 * @return Pointer to the subsystem message handler configuration
+	 *         struct.
+	 */
+	struct subsystem_message_conf *(*init)(void);
+	struct subsystem_dispatch_state *state;
 };
 
+/**
+ * Adds a subsystem to the registry, so that it gets initialized and registered
+ * with the dispatcher by dispatcher_init(). Subsystems that don't get linked in
+ * take up neither ROM nor RAM.
+ *
+ * @param name      The subsystem's name, as a C identifier.
+ * @param init_func The subsystem's init function, see struct ratfist_subsystem.
+ */
+#define RATFIST_SUBSYSTEM(name, init_func) \
+	static struct subsystem_dispatch_state name ## _dispatch_state; \
+	static const struct ratfist_subsystem name ## _registry_entry \
+	__attribute__((used, no_reorder, section("ratfist_subsystems"))) = { \
+		.init = (init_func), \
+		.state = &name ## _dispatch_state \
+	}
+
 
 /**
- * Initializes the message dispatcher & RX and TX comm tasks.
+ * Initializes the message dispatcher & the RX and TX comm tasks of every link,
+ * and then all of the subsystems in the registry, in registry order. A
+ * subsystem whose names don't fit into the name table doesn't get registered,
+ * but keeps its ID.
  */
 void dispatcher_init(void);
 
 /**
- * Sends stop signal to the RX and TX tasks, and blocks until they are stopped.
+ * Sends stop signal to the RX and TX tasks of every link, and blocks until they
+ * are stopped.
  */
 void dispatcher_deinit(void);
 
 /**
- * Registers a subsystem's message handlers with the dispatcher.
+ * Wakes up the TX tasks, so that they send out newly enqueued messages right
+ * away. Subsystems should call this after writing into their outgoing message
+ * or error queues, e.g. by passing it to os_mailbox_init() as the write
+ * callback. Safe to call from interrupts.
+ */
+void dispatcher_notify_tx(void);
+
+/**
+ * Records a trace point of a request, for the latency histograms. Subsystems
+ * should call this with MESSAGE_TRACE_DEQUEUED when they take a message off
+ * their incoming queue, and with MESSAGE_TRACE_REPLY_ENQUEUED when they write
+ * its reply into their outgoing queue. Does nothing without MESSAGE_TRACING.
+ *
+ * @param transaction_id The transaction ID of the request.
+ * @param point          The trace point, an enum message_trace_point.
+ */
+void dispatcher_trace_message(uint32_t transaction_id, uint32_t point);
+
+/**
+ * Gives a receive credit back to the host. Subsystems that advertise credits
+ * (see incoming_credits in struct subsystem_message_conf) must call this for
+ * every message they take off their incoming queue.
  *
- * @param conf Pointer to the subsystem message handler configuration struct.
- * @return Returns true if the subsystem was successfully registered, false
- *         otherwise.
+ * @param conf The subsystem's configuration, as returned by its init function.
  */
-bool dispatcher_register_subsystem(struct subsystem_message_conf *conf);
+void dispatcher_message_taken(const struct subsystem_message_conf *conf);
 
 
 #endif /* MESSAGE_DISPATCHER_H_ */
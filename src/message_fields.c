@@ -0,0 +1,209 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the streaming message field parser.
+ */
+
+#include <stddef.h> // For NULL
+#include <stdint.h> // For UINT32_MAX
+
+#include <mouros/common.h> // For ARRAY_SIZE
+
+#include "message_fields.h"
+
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static const float pow10_lut[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+
+static void start_field(struct message_field_parser *parser);
+static bool add_digit(uint32_t *mantissa, uint8_t digit);
+
+
+static void start_field(struct message_field_parser *parser)
+{
+	struct message_field *field = &parser->fields[parser->num_fields];
+
+	field->str = &parser->buf[parser->len];
+	field->len = 0;
+	field->hash = FNV_OFFSET_BASIS;
+	field->mantissa = 0;
+	field->num_decimals = 0;
+	field->is_number = false;
+	field->is_negative = false;
+	field->is_integer = false;
+
+	parser->num_fields++;
+	parser->num_state = FIELD_NUM_START;
+}
+
+static bool add_digit(uint32_t *mantissa, uint8_t digit)
+{
+	if (*mantissa > (UINT32_MAX - digit) / 10) {
+		return false;
+	}
+
+	*mantissa = *mantissa * 10 + digit;
+	return true;
+}
+
+
+void message_field_parser_init(struct message_field_parser *parser,
+                               char *buf,
+                               uint32_t buf_size,
+                               struct message_field *fields,
+                               uint32_t max_fields)
+{
+	parser->buf = buf;
+	parser->buf_size = buf_size;
+	parser->fields = fields;
+	parser->max_fields = max_fields;
+
+	message_field_parser_reset(parser);
+}
+
+void message_field_parser_reset(struct message_field_parser *parser)
+{
+	parser->len = 0;
+	parser->num_fields = 0;
+
+	start_field(parser);
+}
+
+bool message_field_parser_push(struct message_field_parser *parser, char ch)
+{
+	// Leave room for the last field's NUL terminator.
+	if (parser->len + 1 >= parser->buf_size) {
+		return false;
+	}
+
+	if (ch == ',') {
+		if (parser->num_fields >= parser->max_fields) {
+			return false;
+		}
+
+		parser->buf[parser->len++] = '\0';
+		start_field(parser);
+		return true;
+	}
+
+	struct message_field *field = &parser->fields[parser->num_fields - 1];
+
+	parser->buf[parser->len++] = ch;
+	field->len++;
+	field->hash = (field->hash ^ (uint8_t) ch) * FNV_PRIME;
+
+	bool is_digit = ch >= '0' && ch <= '9';
+	uint8_t digit = (uint8_t) (ch - '0');
+
+	switch (parser->num_state) {
+	case FIELD_NUM_START:
+		if (ch == '-') {
+			field->is_negative = true;
+			parser->num_state = FIELD_NUM_SIGN;
+			break;
+		}
+		// fall through
+	case FIELD_NUM_SIGN:
+		parser->num_state = is_digit ? FIELD_NUM_INT_DIGITS : FIELD_NUM_INVALID;
+		if (is_digit) {
+			field->mantissa = digit;
+		}
+		break;
+
+	case FIELD_NUM_INT_DIGITS:
+		if (ch == '.') {
+			parser->num_state = FIELD_NUM_POINT;
+		} else if (!is_digit || !add_digit(&field->mantissa, digit)) {
+			parser->num_state = FIELD_NUM_INVALID;
+		}
+		break;
+
+	case FIELD_NUM_POINT:
+	case FIELD_NUM_FRAC_DIGITS:
+		if (!is_digit) {
+			parser->num_state = FIELD_NUM_INVALID;
+			break;
+		}
+
+		parser->num_state = FIELD_NUM_FRAC_DIGITS;
+
+		// Running out of precision after the decimal point only
+		// rounds the value, it doesn't invalidate it.
+		if (field->num_decimals < ARRAY_SIZE(pow10_lut) - 1 &&
+		    add_digit(&field->mantissa, digit)) {
+			field->num_decimals++;
+		}
+		break;
+
+	case FIELD_NUM_INVALID:
+		break;
+	}
+
+	field->is_number = parser->num_state == FIELD_NUM_INT_DIGITS ||
+	                   parser->num_state == FIELD_NUM_FRAC_DIGITS;
+	field->is_integer = parser->num_state == FIELD_NUM_INT_DIGITS;
+
+	return true;
+}
+
+void message_field_parser_finish(struct message_field_parser *parser)
+{
+	parser->buf[parser->len] = '\0';
+}
+
+bool message_field_parser_parse_str(struct message_field_parser *parser,
+                                    const char *str)
+{
+	message_field_parser_reset(parser);
+
+	for (const char *ch = str; *ch != '\0'; ch++) {
+		if (!message_field_parser_push(parser, *ch)) {
+			return false;
+		}
+	}
+
+	message_field_parser_finish(parser);
+
+	return true;
+}
+
+uint32_t message_field_hash_str(const char *str)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	for (const char *ch = str; *ch != '\0'; ch++) {
+		hash = (hash ^ (uint8_t) *ch) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+bool message_field_to_u32(const struct message_field *field, uint32_t *value)
+{
+	if (!field->is_integer || field->is_negative) {
+		return false;
+	}
+
+	*value = field->mantissa;
+	return true;
+}
+
+bool message_field_to_float(const struct message_field *field, float *value)
+{
+	if (!field->is_number) {
+		return false;
+	}
+
+	*value = (float) field->mantissa / pow10_lut[field->num_decimals];
+
+	if (field->is_negative) {
+		*value = -*value;
+	}
+
+	return true;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for the streaming message field parser.
+ * The parser takes the characters of a message one at a time, splits them into
+ * comma separated fields, and converts numeric fields while doing so, so that
+ * the message doesn't have to be walked again after it has been received.
+ */
+
+#ifndef MESSAGE_FIELDS_H_
+#define MESSAGE_FIELDS_H_
+
+#include <stdbool.h> // For bools
+#include <stdint.h> // For uint32_t, etc.
+
+/**
+ * A single comma separated field of a message.
+ */
+struct message_field {
+	/**
+	 * Pointer to the NUL terminated field string.
+	 */
+	char *str;
+
+	/**
+	 * The length of str, excluding the NUL terminator.
+	 */
+	uint32_t len;
+
+	/**
+	 * The FNV-1a hash of str. See message_field_hash_str().
+	 */
+	uint32_t hash;
+
+	/**
+	 * The digits of a numeric field, without the sign and the decimal
+	 * point. Digits after the decimal point that don't fit into 32 bits
+	 * are dropped.
+	 */
+	uint32_t mantissa;
+
+	/**
+	 * The number of digits in mantissa that come after the decimal point.
+	 */
+	uint8_t num_decimals;
+
+	/**
+	 * True if the field is a decimal number, i.e. an optional '-',
+	 * followed by digits, optionally followed by a '.' and more digits.
+	 */
+	bool is_number;
+
+	/**
+	 * True if the field is a number with a leading '-'.
+	 */
+	bool is_negative;
+
+	/**
+	 * True if the field is a number without a decimal point.
+	 */
+	bool is_integer;
+};
+
+/**
+ * State of the streaming field parser.
+ */
+struct message_field_parser {
+	/**
+	 * The buffer holding the characters of the parsed fields. The commas
+	 * between the fields are replaced by NUL terminators.
+	 */
+	char *buf;
+	uint32_t buf_size;
+	uint32_t len;
+
+	/**
+	 * The fields parsed so far. The last one is still being parsed, until
+	 * message_field_parser_finish() is called.
+	 */
+	struct message_field *fields;
+	uint32_t max_fields;
+	uint32_t num_fields;
+
+	/**
+	 * Where in a number the last character of the current field was.
+	 */
+	enum message_field_num_state {
+		FIELD_NUM_START,
+		FIELD_NUM_SIGN,
+		FIELD_NUM_INT_DIGITS,
+		FIELD_NUM_POINT,
+		FIELD_NUM_FRAC_DIGITS,
+		FIELD_NUM_INVALID
+	} num_state;
+};
+
+
+/**
+ * Initializes the parser, and readies it for the first message.
+ *
+ * @param parser     The parser to initialize.
+ * @param buf        Buffer for the field characters.
+ * @param buf_size   The size of buf in bytes.
+ * @param fields     Array of field structs to be filled in.
+ * @param max_fields The number of structs in fields.
+ */
+void message_field_parser_init(struct message_field_parser *parser,
+                               char *buf,
+                               uint32_t buf_size,
+                               struct message_field *fields,
+                               uint32_t max_fields);
+
+/**
+ * Drops everything parsed so far, and readies the parser for a new message.
+ *
+ * @param parser The parser to reset.
+ */
+void message_field_parser_reset(struct message_field_parser *parser);
+
+/**
+ * Adds a single character to the message being parsed.
+ *
+ * @param parser The parser.
+ * @param ch     The next message character.
+ * @return False if the message doesn't fit into the parser's buffer or field
+ *         array, true otherwise.
+ */
+bool message_field_parser_push(struct message_field_parser *parser, char ch);
+
+/**
+ * Terminates the last field of the message. After this, parser->fields and
+ * parser->num_fields describe the whole message.
+ *
+ * @param parser The parser.
+ */
+void message_field_parser_finish(struct message_field_parser *parser);
+
+/**
+ * Resets the parser, and parses the whole of str with it.
+ *
+ * @param parser The parser.
+ * @param str    The NUL terminated string to be parsed.
+ * @return False if str doesn't fit into the parser's buffer or field array,
+ *         true otherwise.
+ */
+bool message_field_parser_parse_str(struct message_field_parser *parser,
+                                    const char *str);
+
+/**
+ * Calculates the same hash for str, as the parser does for fields.
+ *
+ * @param str The NUL terminated string to be hashed.
+ * @return The FNV-1a hash of str.
+ */
+uint32_t message_field_hash_str(const char *str);
+
+/**
+ * Gets the value of a field holding an unsigned decimal integer.
+ *
+ * @param field The field.
+ * @param value Output for the value.
+ * @return True if the field is an unsigned integer fitting into 32 bits,
+ *         false otherwise.
+ */
+bool message_field_to_u32(const struct message_field *field, uint32_t *value);
+
+/**
+ * Gets the value of a field holding a decimal number, with or without a
+ * decimal point.
+ *
+ * @param field The field.
+ * @param value Output for the value.
+ * @return True if the field is a number, false otherwise.
+ */
+bool message_field_to_float(const struct message_field *field, float *value);
+
+
+#endif /* MESSAGE_FIELDS_H_ */
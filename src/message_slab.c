@@ -0,0 +1,150 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the message slab allocator.
+ */
+
+#include <stddef.h> // For NULL, offsetof()
+
+#include <mouros/common.h> // For ARRAY_SIZE()
+
+#include "message_slab.h"
+#include "atomic_pool.h"
+#include "constants.h" // For the slab sizes.
+
+
+/**
+ * A size class of the slab. Its slots are laid out back to back in memory, so
+ * that freeing a message finds its class by the message's address.
+ */
+struct slab_class {
+	struct atomic_pool pool;
+	uint8_t *slots;
+	uint32_t slot_size;
+	uint32_t num_slots;
+	uint32_t payload_size;
+};
+
+/*
+ * The payloads follow the message right away, so they are aligned like the
+ * struct message, i.e. to a word. None of them hold anything wider than that.
+ */
+struct small_slot {
+	struct message msg;
+	uint8_t payload[MESSAGE_SLAB_SMALL_PAYLOAD_SIZE];
+};
+
+struct large_slot {
+	struct message msg;
+	uint8_t payload[MESSAGE_SLAB_LARGE_PAYLOAD_SIZE];
+};
+
+/** The payload starts at the same offset in the slots of every class. */
+#define SLOT_PAYLOAD_OFFSET offsetof(struct small_slot, payload)
+
+
+static struct slab_class *find_class(const struct message *msg);
+static struct slab_class *find_payload_class(uint32_t payload_size);
+
+
+static struct small_slot small_slots[MESSAGE_SLAB_SMALL_SLOTS];
+static struct large_slot large_slots[MESSAGE_SLAB_LARGE_SLOTS];
+
+/** The size classes, smallest first. */
+static struct slab_class slab_classes[] = {
+	{
+		.slots = (uint8_t *) small_slots,
+		.slot_size = sizeof(struct small_slot),
+		.num_slots = ARRAY_SIZE(small_slots),
+		.payload_size = MESSAGE_SLAB_SMALL_PAYLOAD_SIZE
+	},
+	{
+		.slots = (uint8_t *) large_slots,
+		.slot_size = sizeof(struct large_slot),
+		.num_slots = ARRAY_SIZE(large_slots),
+		.payload_size = MESSAGE_SLAB_LARGE_PAYLOAD_SIZE
+	}
+};
+
+
+
+static struct slab_class *find_class(const struct message *msg)
+{
+	const uint8_t *addr = (const uint8_t *) msg;
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(slab_classes); i++) {
+		struct slab_class *class = &slab_classes[i];
+
+		if (addr >= class->slots &&
+		    addr < class->slots + class->slot_size * class->num_slots) {
+			return class;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @return The smallest class the payload fits into, or NULL.
+ */
+static struct slab_class *find_payload_class(uint32_t payload_size)
+{
+	for (uint32_t i = 0; i < ARRAY_SIZE(slab_classes); i++) {
+		if (payload_size <= slab_classes[i].payload_size) {
+			return &slab_classes[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+void message_slab_init(void)
+{
+	for (uint32_t i = 0; i < ARRAY_SIZE(slab_classes); i++) {
+		struct slab_class *class = &slab_classes[i];
+
+		atomic_pool_init(&class->pool,
+		                 class->slots,
+		                 class->slot_size,
+		                 class->num_slots);
+	}
+}
+
+struct message *message_slab_alloc(uint32_t msg_type_id, uint32_t payload_size)
+{
+	struct slab_class *class = find_payload_class(payload_size);
+	if (class == NULL) {
+		return NULL;
+	}
+
+	struct message *msg = atomic_pool_take(&class->pool);
+	if (msg == NULL) {
+		return NULL;
+	}
+
+	msg->type = msg_type_id;
+	msg->transaction_id = NO_TRANSACTION_ID;
+	msg->data = (uint8_t *) msg + SLOT_PAYLOAD_OFFSET;
+
+	return msg;
+}
+
+void message_slab_free(struct message *msg)
+{
+	struct slab_class *class = find_class(msg);
+
+	if (class != NULL) {
+		atomic_pool_give(&class->pool, msg);
+	}
+}
+
+uint32_t message_slab_free_slots(uint32_t payload_size)
+{
+	struct slab_class *class = find_payload_class(payload_size);
+	if (class == NULL) {
+		return 0;
+	}
+
+	return atomic_pool_num_free(&class->pool);
+}
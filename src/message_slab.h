@@ -0,0 +1,61 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for the message slab allocator, which the
+ * subsystems allocate their messages from, instead of keeping pools of their
+ * own.
+ *
+ * Each slot of the slab holds a struct message, with its payload inline right
+ * after it, so a message takes a single allocation. The slots come in a few
+ * size classes (see MESSAGE_SLAB_SMALL_PAYLOAD_SIZE &
+ * MESSAGE_SLAB_LARGE_PAYLOAD_SIZE), shared by all subsystems. A message always
+ * gets a slot of the smallest class its payload fits into, so that small
+ * messages can't starve the large ones.
+ *
+ * Allocation & freeing are safe from any task, as well as from interrupt
+ * handlers, e.g. for publishing event messages straight from them. On the
+ * Cortex-M3/M4, they don't turn interrupts off either, see atomic_pool.h.
+ */
+
+#ifndef MESSAGE_SLAB_H_
+#define MESSAGE_SLAB_H_
+
+#include <stdint.h> // For uint32_t, etc.
+
+#include "message_dispatcher.h" // For struct message
+
+/**
+ * Initializes the slab. Gets called by dispatcher_init(), before the subsystems
+ * get initialized.
+ */
+void message_slab_init(void);
+
+/**
+ * Allocates a message with an inline payload.
+ *
+ * @param msg_type_id  The type of the message.
+ * @param payload_size The size of the payload, in bytes.
+ *
+ * @return The message, with its type set, its transaction ID NO_TRANSACTION_ID,
+ *         and its data pointing to the payload, which isn't cleared. NULL, if
+ *         the size class of the payload has no free slots left, or the payload
+ *         fits none.
+ */
+struct message *message_slab_alloc(uint32_t msg_type_id, uint32_t payload_size);
+
+/**
+ * Gives a message allocated by message_slab_alloc() back to the slab.
+ */
+void message_slab_free(struct message *msg);
+
+/**
+ * @param payload_size The size of a payload, in bytes.
+ *
+ * @return The number of free slots of the size class that message_slab_alloc()
+ *         takes payloads of payload_size from, or 0 if it fits none. The slots
+ *         are shared by all subsystems, so this is only a hint, see
+ *         atomic_pool_num_free().
+ */
+uint32_t message_slab_free_slots(uint32_t payload_size);
+
+#endif /* MESSAGE_SLAB_H_ */
@@ -0,0 +1,194 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the message tracer.
+ */
+
+#ifdef MESSAGE_TRACING
+
+#include <stdbool.h> // For bools
+#include <stddef.h> // For NULL
+#include <string.h> // For memset, memcpy
+
+#include <mouros/mailbox.h> // For the trace event queue.
+
+#include "message_trace.h"
+#include "bsp.h" // For bsp_get_timestamp_us
+#include "constants.h"
+
+
+/**
+ * A trace point on its way from the recording task to the TX worker.
+ */
+struct trace_event {
+	uint32_t transaction_id;
+	uint32_t point;
+	uint32_t time_us;
+};
+
+/**
+ * The trace points of a request collected so far.
+ */
+struct trace_slot {
+	uint32_t transaction_id;
+	/** Bit n is set if point n has been recorded. */
+	uint32_t recorded;
+	uint32_t times_us[NUM_MESSAGE_TRACE_POINTS];
+};
+
+
+static struct trace_slot *find_slot(uint32_t transaction_id);
+static void take_event(const struct trace_event *event);
+static uint32_t bucket_of(uint32_t latency_us);
+
+
+static struct trace_event trace_event_queue_buf[MESSAGE_TRACE_EVENT_QUEUE_SIZE];
+static mailbox_t trace_event_queue;
+
+static struct trace_slot trace_slots[MESSAGE_TRACE_SLOTS];
+/** The slot that gets taken over by the next request. */
+static uint32_t next_slot;
+
+static uint32_t histograms[NUM_MESSAGE_TRACE_POINTS][LATENCY_HISTOGRAM_BUCKETS];
+
+
+
+static struct trace_slot *find_slot(uint32_t transaction_id)
+{
+	for (uint32_t i = 0; i < MESSAGE_TRACE_SLOTS; i++) {
+		if (trace_slots[i].recorded != 0 &&
+		    trace_slots[i].transaction_id == transaction_id) {
+
+			return &trace_slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Adds a trace point to the slot of its request. A FRAME_START starts a new
+ * trace, taking over the oldest slot if all of them are in use, i.e. requests
+ * whose replies never got sent eventually get forgotten. Other points of
+ * requests without a slot get ignored.
+ */
+static void take_event(const struct trace_event *event)
+{
+	struct trace_slot *slot = find_slot(event->transaction_id);
+
+	if (event->point == MESSAGE_TRACE_FRAME_START) {
+		if (slot == NULL) {
+			slot = &trace_slots[next_slot];
+			next_slot = (next_slot + 1) % MESSAGE_TRACE_SLOTS;
+		}
+
+		memset(slot, 0, sizeof(*slot));
+		slot->transaction_id = event->transaction_id;
+	}
+
+	if (slot == NULL || event->point >= NUM_MESSAGE_TRACE_POINTS) {
+		return;
+	}
+
+	slot->times_us[event->point] = event->time_us;
+	slot->recorded |= 1u << event->point;
+}
+
+static uint32_t bucket_of(uint32_t latency_us)
+{
+	uint32_t limit = LATENCY_HISTOGRAM_FIRST_BUCKET_US;
+
+	for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+		if (latency_us < limit) {
+			return i;
+		}
+
+		limit *= 4;
+	}
+
+	return LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+
+void message_trace_init(void)
+{
+	os_mailbox_init(&trace_event_queue,
+	                trace_event_queue_buf,
+	                MESSAGE_TRACE_EVENT_QUEUE_SIZE,
+	                sizeof(struct trace_event),
+	                NULL);
+
+	memset(trace_slots, 0, sizeof(trace_slots));
+	next_slot = 0;
+
+	memset(histograms, 0, sizeof(histograms));
+}
+
+void message_trace_record(uint32_t transaction_id, uint32_t point, uint32_t time_us)
+{
+	struct trace_event event = {
+		.transaction_id = transaction_id,
+		.point = point,
+		.time_us = time_us
+	};
+
+	// A point that doesn't fit just leaves a gap in the trace.
+	os_mailbox_write_atomic(&trace_event_queue, &event);
+}
+
+void message_trace_process(void)
+{
+	struct trace_event event;
+
+	while (os_mailbox_read_atomic(&trace_event_queue, &event)) {
+		take_event(&event);
+	}
+}
+
+void message_trace_finish(uint32_t transaction_id,
+                          uint32_t serialized_us,
+                          uint32_t sent_us)
+{
+	// The subsystem's points may still be in the queue.
+	message_trace_process();
+
+	struct trace_slot *slot = find_slot(transaction_id);
+	if (slot == NULL) {
+		return;
+	}
+
+	slot->times_us[MESSAGE_TRACE_REPLY_SERIALIZED] = serialized_us;
+	slot->times_us[MESSAGE_TRACE_REPLY_SENT] = sent_us;
+	slot->recorded |= 1u << MESSAGE_TRACE_REPLY_SERIALIZED |
+	                  1u << MESSAGE_TRACE_REPLY_SENT;
+
+	for (uint32_t i = 0; i + 1 < NUM_MESSAGE_TRACE_POINTS; i++) {
+		uint32_t both = 1u << i | 1u << (i + 1);
+
+		if ((slot->recorded & both) == both) {
+			// Unsigned subtraction, so that the timestamps may wrap
+			// around.
+			uint32_t latency_us = slot->times_us[i + 1] - slot->times_us[i];
+			histograms[i][bucket_of(latency_us)]++;
+		}
+	}
+
+	if (slot->recorded & 1u << MESSAGE_TRACE_FRAME_START) {
+		uint32_t latency_us = sent_us - slot->times_us[MESSAGE_TRACE_FRAME_START];
+		histograms[MESSAGE_TRACE_TOTAL_STAGE][bucket_of(latency_us)]++;
+	}
+
+	memset(slot, 0, sizeof(*slot));
+}
+
+void message_trace_get_histogram(uint32_t stage, uint32_t *buckets)
+{
+	memcpy(buckets, histograms[stage], sizeof(histograms[stage]));
+}
+
+uint32_t message_trace_timestamp(void)
+{
+	return bsp_get_timestamp_us();
+}
+
+#endif /* MESSAGE_TRACING */
@@ -0,0 +1,151 @@
+/**
+ * @file
+ *
+ * This file contains the declarations for the message tracer, which measures
+ * how long requests spend in each stage of their way through the MCU, from
+ * their first byte arriving to the last byte of their reply leaving.
+ *
+ * The trace points of a request are recorded under its transaction ID, from
+ * the RX worker, the subsystems' tasks, and the TX worker. They get collected
+ * by the TX worker, and once the reply has been sent, the time between each
+ * pair of consecutive points gets added to the histogram of that stage.
+ *
+ * Tracing is only compiled in with MESSAGE_TRACING defined. Otherwise, all of
+ * the functions here do nothing.
+ *
+ * All times are in microseconds, as returned by bsp_get_timestamp_us(), and may
+ * wrap around.
+ */
+
+#ifndef MESSAGE_TRACE_H_
+#define MESSAGE_TRACE_H_
+
+#include <stdint.h> // For uint32_t, etc.
+
+#include "constants.h" // For the histogram size.
+
+/**
+ * The points of a request's way through the MCU. The stage of each point ends
+ * at the next one. The stage of the last point, MESSAGE_TRACE_TOTAL_STAGE, is
+ * the whole way instead.
+ */
+enum message_trace_point {
+	/**
+	 * The RX worker took the first byte of the frame off the RX buffer. For
+	 * a message received in fragments, that of its first fragment.
+	 */
+	MESSAGE_TRACE_FRAME_START = 0,
+	/**
+	 * The RX worker took the last byte of the frame off the RX buffer. For
+	 * a message received in fragments, that of its last fragment.
+	 */
+	MESSAGE_TRACE_FRAME_DONE = 1,
+	/** The message got parsed. */
+	MESSAGE_TRACE_PARSED = 2,
+	/** The message got written into the subsystem's incoming queue. */
+	MESSAGE_TRACE_ROUTED = 3,
+	/** The subsystem took the message off its incoming queue. */
+	MESSAGE_TRACE_DEQUEUED = 4,
+	/** The subsystem wrote the reply into its outgoing queue. */
+	MESSAGE_TRACE_REPLY_ENQUEUED = 5,
+	/** The TX worker wrote the reply into the TX ring. */
+	MESSAGE_TRACE_REPLY_SERIALIZED = 6,
+	/** The last byte of the reply left the UART (estimated). */
+	MESSAGE_TRACE_REPLY_SENT = 7,
+
+	NUM_MESSAGE_TRACE_POINTS
+};
+
+/** The stage from MESSAGE_TRACE_FRAME_START to MESSAGE_TRACE_REPLY_SENT. */
+#define MESSAGE_TRACE_TOTAL_STAGE MESSAGE_TRACE_REPLY_SENT
+
+
+#ifdef MESSAGE_TRACING
+
+/**
+ * Initializes the tracer, and clears the histograms.
+ */
+void message_trace_init(void);
+
+/**
+ * Records a trace point of a request. Safe to call from any task, and from
+ * interrupts.
+ *
+ * @param transaction_id The transaction ID of the request.
+ * @param point          The trace point, an enum message_trace_point.
+ * @param time_us        The time the request got to the point.
+ */
+void message_trace_record(uint32_t transaction_id, uint32_t point, uint32_t time_us);
+
+/**
+ * Collects the recorded trace points. Must only be called by the TX worker.
+ */
+void message_trace_process(void);
+
+/**
+ * Finishes the trace of a request whose reply has been written into the TX
+ * ring, and adds its stages to the histograms. Stages with a point that didn't
+ * get recorded are left out. Must only be called by the TX worker.
+ *
+ * @param transaction_id The transaction ID of the request.
+ * @param serialized_us  The time the reply got written into the TX ring.
+ * @param sent_us        The time the last byte of the reply will have left.
+ */
+void message_trace_finish(uint32_t transaction_id,
+                          uint32_t serialized_us,
+                          uint32_t sent_us);
+
+/**
+ * Copies the latency histogram of a stage.
+ *
+ * @param stage   The stage, i.e. the trace point it starts at.
+ * @param buckets Output for LATENCY_HISTOGRAM_BUCKETS counts.
+ */
+void message_trace_get_histogram(uint32_t stage, uint32_t *buckets);
+
+/**
+ * @return The current time, for recording trace points.
+ */
+uint32_t message_trace_timestamp(void);
+
+#else
+
+static inline void message_trace_init(void)
+{
+}
+
+static inline void message_trace_record(uint32_t transaction_id,
+                                        uint32_t point,
+                                        uint32_t time_us)
+{
+	(void) transaction_id;
+	(void) point;
+	(void) time_us;
+}
+
+static inline void message_trace_process(void)
+{
+}
+
+static inline void message_trace_finish(uint32_t transaction_id,
+                                        uint32_t serialized_us,
+                                        uint32_t sent_us)
+{
+	(void) transaction_id;
+	(void) serialized_us;
+	(void) sent_us;
+}
+
+/*
+ * Without tracing, there is nothing to timestamp, so the timer doesn't get
+ * read at all.
+ */
+static inline uint32_t message_trace_timestamp(void)
+{
+	return 0;
+}
+
+#endif /* MESSAGE_TRACING */
+
+
+#endif /* MESSAGE_TRACE_H_ */
@@ -6,16 +6,18 @@
 
 #include "../constants.h"
 #include "../worker.h"
+#include "../message_dispatcher.h" // For RATFIST_SUBSYSTEM
 
 
 void *rust_meteo_init(void);
+struct subsystem_message_conf *rust_meteo_get_conf(void);
 void rust_meteo_comm_loop(void *params);
 
 __attribute__((aligned(8)))
 static uint8_t meteo_task_stack[TASK_STACK_SIZE];
 static worker_t meteo_task;
 
-void meteo_init(void)
+struct subsystem_message_conf *meteo_init(void)
 {
 	void *task_ctx = rust_meteo_init();
 
@@ -24,4 +26,8 @@ void meteo_init(void)
 					 5, rust_meteo_comm_loop, task_ctx);
 
 	worker_start(&meteo_task);
+
+	return rust_meteo_get_conf();
 }
+
+RATFIST_SUBSYSTEM(meteo, meteo_init);
@@ -7,7 +7,15 @@
 #ifndef METEO_H_
 #define METEO_H_
 
-void meteo_init(void);
+#include "../message_dispatcher.h" // For struct subsystem_message_conf
+
+/**
+ * Initializes the Meteo subsystem. Gets called by the message dispatcher, as
+ * the subsystem is in the registry.
+ *
+ * @return The subsystem's message configuration.
+ */
+struct subsystem_message_conf *meteo_init(void);
 
 #endif /* METEO_H_ */
 
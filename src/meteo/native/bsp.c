@@ -0,0 +1,201 @@
+/**
+ * @file
+ *
+ * This file contains the Meteo specific BSP functions for the native build. It
+ * simulates the sensors the Meteo subsystem talks to on the STM32F411
+ * Discovery's I2C3 bus, at the register level, so that the drivers get
+ * exercised as they are:
+ *  - a BMP085 pressure sensor, which measures the values of the example in
+ *    its datasheet: 15.0 degC and 69964 Pa,
+ *  - a TSL2561 light sensor, which measures about 94 lux, at the gain and
+ *    integration time Meteo sets.
+ *
+ * The simulated I2C peripherals (rust/src/bsp/i2c/i2c_native.rs) call the
+ * functions below for every step of a transaction.
+ */
+
+#include <stdbool.h> // For bool
+#include <stdint.h> // For uint32_t, etc.
+#include <stddef.h> // For NULL
+#include <string.h> // For memcpy(), memset()
+
+#include "../../bsp.h"
+
+#define I2C3_PERIPH_ID 2
+
+#define BMP085_I2C_ADDR 0x77
+#define BMP085_CALIB_REG 0xaa
+#define BMP085_CTRL_MEAS_REG 0xf4
+#define BMP085_RESULT_REG 0xf6
+#define BMP085_TEMP_MEAS_CMD 0x2e
+#define BMP085_PRESS_MEAS_CMD 0x34
+
+#define TSL2561_I2C_ADDR 0x29
+#define TSL2561_CMD_ADDR_MASK 0x0f
+#define TSL2561_CONTROL_REG 0x00
+#define TSL2561_DATA_REG 0x0b
+#define TSL2561_POWER_ON 0x03
+
+bool bsp_sim_i2c_write(uint32_t periph_id, uint8_t dev_addr, const uint8_t *data, uint32_t len);
+bool bsp_sim_i2c_read(uint32_t periph_id, uint8_t dev_addr, uint8_t *data, uint32_t len);
+
+static bool bmp085_write(const uint8_t *data, uint32_t len);
+static bool bmp085_read(uint8_t *data, uint32_t len);
+static bool tsl2561_write(const uint8_t *data, uint32_t len);
+static bool tsl2561_read(uint8_t *data, uint32_t len);
+
+
+/** The calibration EEPROM of the BMP085, big endian. */
+static const uint8_t bmp085_calib[] = {
+	0x01, 0x98, // AC1 = 408
+	0xff, 0xb8, // AC2 = -72
+	0xc7, 0xd1, // AC3 = -14383
+	0x7f, 0xe5, // AC4 = 32741
+	0x7f, 0xf5, // AC5 = 32757
+	0x5a, 0x71, // AC6 = 23153
+	0x18, 0x2e, // B1 = 6190
+	0x00, 0x04, // B2 = 4
+	0x80, 0x00, // MB = -32768
+	0xdd, 0xf9, // MC = -8711
+	0x0b, 0x34  // MD = 2868
+};
+
+/** UT = 27898 */
+static const uint8_t bmp085_temp_result[] = { 0x6c, 0xfa, 0x00 };
+
+/**
+ * UP = 23843, shifted so that it reads the same at every oversampling setting,
+ * once the driver shifts it back.
+ */
+static const uint8_t bmp085_press_result[] = { 0x5d, 0x23, 0x00 };
+
+/** ch0 = 1000, ch1 = 200, preceded by the block read byte count. */
+static const uint8_t tsl2561_data[] = { 4, 0xe8, 0x03, 0xc8, 0x00 };
+
+static struct {
+	uint8_t reg_addr;
+	const uint8_t *result;
+} bmp085;
+
+static struct {
+	uint8_t reg_addr;
+	bool powered_on;
+} tsl2561;
+
+
+static bool bmp085_write(const uint8_t *data, uint32_t len)
+{
+	if (len == 0) {
+		return true;
+	}
+
+	bmp085.reg_addr = data[0];
+
+	if (len >= 2 && data[0] == BMP085_CTRL_MEAS_REG) {
+		if (data[1] == BMP085_TEMP_MEAS_CMD) {
+			bmp085.result = bmp085_temp_result;
+		} else if ((data[1] & 0x3f) == BMP085_PRESS_MEAS_CMD) {
+			bmp085.result = bmp085_press_result;
+		}
+	}
+
+	return true;
+}
+
+static bool bmp085_read(uint8_t *data, uint32_t len)
+{
+	const uint8_t *src = NULL;
+	uint32_t src_len = 0;
+
+	if (bmp085.reg_addr == BMP085_CALIB_REG) {
+		src = bmp085_calib;
+		src_len = sizeof(bmp085_calib);
+	} else if (bmp085.reg_addr == BMP085_RESULT_REG && bmp085.result != NULL) {
+		src = bmp085.result;
+		src_len = sizeof(bmp085_temp_result);
+	}
+
+	memset(data, 0, len);
+	if (src != NULL) {
+		memcpy(data, src, (len < src_len) ? len : src_len);
+	}
+
+	return true;
+}
+
+/**
+ * The TSL2561 gets written with SMBus block writes: a command byte with the
+ * register address, a byte count, and the data.
+ */
+static bool tsl2561_write(const uint8_t *data, uint32_t len)
+{
+	if (len == 0) {
+		return true;
+	}
+
+	tsl2561.reg_addr = data[0] & TSL2561_CMD_ADDR_MASK;
+
+	if (len >= 3 && tsl2561.reg_addr == TSL2561_CONTROL_REG) {
+		tsl2561.powered_on = (data[2] & TSL2561_POWER_ON) == TSL2561_POWER_ON;
+	}
+
+	return true;
+}
+
+static bool tsl2561_read(uint8_t *data, uint32_t len)
+{
+	memset(data, 0, len);
+
+	// The ADCs only run while the sensor is powered on.
+	if (tsl2561.reg_addr == TSL2561_DATA_REG && tsl2561.powered_on) {
+		memcpy(data, tsl2561_data,
+		       (len < sizeof(tsl2561_data)) ? len : sizeof(tsl2561_data));
+	}
+
+	return true;
+}
+
+
+/**
+ * Writes the data to the simulated device.
+ *
+ * @return True if the device acknowledged the write, false if there's no
+ *         device at that address.
+ */
+bool bsp_sim_i2c_write(uint32_t periph_id, uint8_t dev_addr, const uint8_t *data, uint32_t len)
+{
+	if (periph_id != I2C3_PERIPH_ID) {
+		return false;
+	}
+
+	switch (dev_addr) {
+	case BMP085_I2C_ADDR:
+		return bmp085_write(data, len);
+	case TSL2561_I2C_ADDR:
+		return tsl2561_write(data, len);
+	default:
+		return false;
+	}
+}
+
+/**
+ * Reads the data from the simulated device.
+ *
+ * @return True if the device acknowledged the read, false if there's no
+ *         device at that address.
+ */
+bool bsp_sim_i2c_read(uint32_t periph_id, uint8_t dev_addr, uint8_t *data, uint32_t len)
+{
+	if (periph_id != I2C3_PERIPH_ID) {
+		return false;
+	}
+
+	switch (dev_addr) {
+	case BMP085_I2C_ADDR:
+		return bmp085_read(data, len);
+	case TSL2561_I2C_ADDR:
+		return tsl2561_read(data, len);
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,354 @@
+/**
+ * @file
+ *
+ * This file contains the BSP of the native build, which runs Ratfist as a Linux
+ * process. The UART is a pseudo terminal, whose path gets printed on start-up,
+ * and which can be used like the serial port of a board. If the
+ * RATFIST_PTY_LINK environment variable is set, a symlink to it gets created
+ * at that path as well.
+ *
+ * With BSP_SECOND_LINK, the second link gets a pty of its own, linked to from
+ * RATFIST_PTY_LINK1.
+ *
+ * The pty reader & writer threads stand in for the UART interrupt handlers, and
+ * run on the simulated CPU (see cpu.h) while they touch the buffers.
+ */
+
+#define _GNU_SOURCE // For posix_openpt(), ptsname(), cfmakeraw()
+
+#include <stddef.h> // For NULL.
+#include <stdint.h> // For uintptr_t
+#include <stdio.h> // For fprintf(), perror(), snprintf()
+#include <stdlib.h> // For getenv(), abort()
+#include <string.h> // For memchr()
+#include <errno.h> // For errno
+#include <fcntl.h> // For O_RDWR, O_NOCTTY
+#include <termios.h> // For cfmakeraw()
+#include <time.h> // For clock_gettime()
+#include <unistd.h> // For read(), write(), symlink()
+#include <pthread.h> // For the pty reader & writer threads.
+#include <assert.h> // For assert()
+
+#include "../bsp.h" // For the BSP declarations.
+#include "cpu.h" // For native_cpu_*()
+
+void rust_bsp_init(void);
+
+static bool is_initialized = false;
+
+static bool led_states[4];
+
+struct byte_ring bsp_rx_buffer;
+static uint8_t rx_buffer_mem[BSP_RX_BUFFER_SIZE];
+
+struct byte_ring bsp_tx_buffer;
+static uint8_t tx_buffer_mem[BYTE_RING_MEM_SIZE(BSP_TX_BUFFER_SIZE, BSP_TX_MAX_RESERVATION)];
+
+volatile struct bsp_uart_stats bsp_uart_stats;
+
+#ifdef BSP_SECOND_LINK
+static struct byte_ring second_rx_buffer;
+static uint8_t second_rx_buffer_mem[BSP_RX_BUFFER_SIZE];
+
+static struct byte_ring second_tx_buffer;
+static uint8_t second_tx_buffer_mem[BYTE_RING_MEM_SIZE(BSP_TX_BUFFER_SIZE, BSP_TX_MAX_RESERVATION)];
+
+static volatile struct bsp_uart_stats second_uart_stats;
+#endif
+
+const struct bsp_link bsp_links[BSP_NUM_LINKS] = {
+	{ &bsp_rx_buffer, &bsp_tx_buffer, &bsp_uart_stats },
+#ifdef BSP_SECOND_LINK
+	{ &second_rx_buffer, &second_tx_buffer, &second_uart_stats }
+#endif
+};
+
+/**
+ * The pty of a link, and the threads that stand in for its UART.
+ */
+struct pty_link {
+	/** The master side of the pty. */
+	int fd;
+	pthread_t reader_thread;
+	pthread_t writer_thread;
+	/** Signalled when there's something new in the link's TX ring. */
+	pthread_cond_t tx_cond;
+	uint32_t rx_chars_since_notify;
+};
+
+static void (*rx_notify_callback)(void) = NULL;
+
+static struct pty_link pty_links[BSP_NUM_LINKS];
+
+static struct timespec start_time;
+
+
+static void pty_init(uint32_t link_id);
+static void *pty_reader_func(void *params);
+static void *pty_writer_func(void *params);
+static void publish_rx_chars(uint32_t link_id, const char *chars, uint32_t len);
+static void wake_pty_writer(void);
+static void sleep_ms(uint32_t ms);
+
+
+
+/**
+ * Opens the pty of a link, and starts the threads that move the characters
+ * between it and the link's RX and TX buffers.
+ */
+static void pty_init(uint32_t link_id)
+{
+	struct pty_link *link = &pty_links[link_id];
+
+	pthread_cond_init(&link->tx_cond, NULL);
+	link->rx_chars_since_notify = 0;
+
+	link->fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (link->fd < 0 || grantpt(link->fd) != 0 || unlockpt(link->fd) != 0) {
+		perror("ratfist: can't open a pty");
+		abort();
+	}
+
+	// No echo, and no line discipline, as on a real serial port.
+	struct termios attrs;
+	tcgetattr(link->fd, &attrs);
+	cfmakeraw(&attrs);
+	tcsetattr(link->fd, TCSANOW, &attrs);
+
+	// The control link keeps the names it had before there were more.
+	char env_name[32] = "RATFIST_PTY_LINK";
+	const char *pty_path = ptsname(link->fd);
+	if (link_id == 0) {
+		fprintf(stderr, "ratfist: UART at %s\n", pty_path);
+	} else {
+		fprintf(stderr, "ratfist: UART %u at %s\n", link_id, pty_path);
+		snprintf(env_name, sizeof(env_name), "RATFIST_PTY_LINK%u", link_id);
+	}
+
+	const char *link_path = getenv(env_name);
+	if (link_path != NULL) {
+		unlink(link_path);
+
+		if (symlink(pty_path, link_path) != 0) {
+			perror("ratfist: can't link the pty");
+		}
+	}
+
+	void *params = (void *) (uintptr_t) link_id;
+
+	if (pthread_create(&link->reader_thread, NULL, pty_reader_func, params) != 0 ||
+	    pthread_create(&link->writer_thread, NULL, pty_writer_func, params) != 0) {
+		perror("ratfist: can't start the pty threads");
+		abort();
+	}
+}
+
+/**
+ * Stands in for the UART RX interrupt handler of a link. Reads whatever arrives
+ * over its pty, and publishes it to the link's RX buffer.
+ *
+ * Until the other end of the pty gets opened, and after it gets closed, reads
+ * fail, so they get retried every NATIVE_PTY_REOPEN_WAIT_MS.
+ */
+static void *pty_reader_func(void *params)
+{
+	uint32_t link_id = (uint32_t) (uintptr_t) params;
+	int fd = pty_links[link_id].fd;
+
+	char chunk[NATIVE_PTY_READ_CHUNK_SIZE];
+
+	while (true) {
+		ssize_t len = read(fd, chunk, sizeof(chunk));
+
+		if (len <= 0) {
+			if (len < 0 && errno == EINTR) {
+				continue;
+			}
+
+			sleep_ms(NATIVE_PTY_REOPEN_WAIT_MS);
+			continue;
+		}
+
+		native_cpu_acquire();
+		publish_rx_chars(link_id, chunk, (uint32_t) len);
+		native_cpu_release();
+	}
+
+	return NULL;
+}
+
+/**
+ * Stands in for the UART TX interrupt handler of a link. Sends whatever is in
+ * the link's TX ring over its pty, straight out of the ring.
+ */
+static void *pty_writer_func(void *params)
+{
+	uint32_t link_id = (uint32_t) (uintptr_t) params;
+	struct pty_link *link = &pty_links[link_id];
+	struct byte_ring *tx_buffer = bsp_links[link_id].tx_buffer;
+
+	native_cpu_acquire();
+
+	while (true) {
+		const uint8_t *data = NULL;
+		uint32_t len = byte_ring_peek(tx_buffer, &data);
+
+		if (len == 0) {
+			native_cpu_wait(&link->tx_cond);
+			continue;
+		}
+
+		// The peeked region stays put until it gets consumed, so the CPU
+		// can be given back while the write blocks.
+		native_cpu_release();
+
+		ssize_t written = write(link->fd, data, len);
+
+		native_cpu_acquire();
+
+		if (written > 0) {
+			byte_ring_consume(tx_buffer, (uint32_t) written);
+		} else if (!(written < 0 && errno == EINTR)) {
+			native_cpu_release();
+			sleep_ms(NATIVE_PTY_REOPEN_WAIT_MS);
+			native_cpu_acquire();
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Puts the received characters into the RX buffer of the link, and notifies the
+ * message dispatcher the same way the UART interrupt handlers of the boards do.
+ *
+ * @note Must be called on the simulated CPU.
+ */
+static void publish_rx_chars(uint32_t link_id, const char *chars, uint32_t len)
+{
+	const struct bsp_link *bsp_link = &bsp_links[link_id];
+	struct pty_link *link = &pty_links[link_id];
+
+	uint32_t written = byte_ring_write_some(bsp_link->rx_buffer,
+	                                        (const uint8_t *) chars,
+	                                        len);
+	bsp_link->uart_stats->rx_dropped += len - written;
+
+	link->rx_chars_since_notify += len;
+	if (memchr(chars, '\n', len) != NULL ||
+	    link->rx_chars_since_notify >= BSP_RX_NOTIFY_THRESHOLD) {
+		link->rx_chars_since_notify = 0;
+
+		if (rx_notify_callback != NULL) {
+			rx_notify_callback();
+		}
+	}
+}
+
+/**
+ * The write callback of the TX rings. It doesn't tell which ring got written
+ * to, so it wakes up the writers of all links.
+ */
+static void wake_pty_writer(void)
+{
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		pthread_cond_signal(&pty_links[i].tx_cond);
+	}
+}
+
+static void sleep_ms(uint32_t ms)
+{
+	struct timespec duration = {
+		.tv_sec = ms / 1000,
+		.tv_nsec = (long) (ms % 1000) * 1000000
+	};
+
+	nanosleep(&duration, NULL);
+}
+
+
+void bsp_init(void)
+{
+	assert(!is_initialized);
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+	byte_ring_init(&bsp_rx_buffer,
+	               rx_buffer_mem,
+	               BSP_RX_BUFFER_SIZE,
+	               0,
+	               NULL);
+
+	byte_ring_init(&bsp_tx_buffer,
+	               tx_buffer_mem,
+	               BSP_TX_BUFFER_SIZE,
+	               BSP_TX_MAX_RESERVATION,
+	               wake_pty_writer);
+
+#ifdef BSP_SECOND_LINK
+	byte_ring_init(&second_rx_buffer,
+	               second_rx_buffer_mem,
+	               BSP_RX_BUFFER_SIZE,
+	               0,
+	               NULL);
+
+	byte_ring_init(&second_tx_buffer,
+	               second_tx_buffer_mem,
+	               BSP_TX_BUFFER_SIZE,
+	               BSP_TX_MAX_RESERVATION,
+	               wake_pty_writer);
+#endif
+
+	for (uint32_t i = 0; i < BSP_NUM_LINKS; i++) {
+		pty_init(i);
+	}
+
+	rust_bsp_init();
+
+	is_initialized = true;
+}
+
+void bsp_set_rx_notify_callback(void (*callback)(void))
+{
+	rx_notify_callback = callback;
+}
+
+uint32_t bsp_get_timestamp_us(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	int64_t elapsed_us = (int64_t) (now.tv_sec - start_time.tv_sec) * 1000000 +
+	                     (now.tv_nsec - start_time.tv_nsec) / 1000;
+
+	// Wraps around like the timer on the boards.
+	return (uint32_t) elapsed_us;
+}
+
+bool bsp_led_get_state(enum board_led led)
+{
+	assert(is_initialized);
+
+	return led_states[led];
+}
+
+void bsp_led_on(enum board_led led)
+{
+	assert(is_initialized);
+
+	led_states[led] = true;
+}
+
+void bsp_led_off(enum board_led led)
+{
+	assert(is_initialized);
+
+	led_states[led] = false;
+}
+
+void bsp_led_toggle(enum board_led led)
+{
+	assert(is_initialized);
+
+	led_states[led] = !led_states[led];
+}
@@ -0,0 +1,105 @@
+/**
+ * @file
+ *
+ * This file contains compile time settings for the ratfist-stm32 project, specific to the native (Linux host) build.
+ */
+
+#ifndef NATIVE_CONSTANTS_H_
+#define NATIVE_CONSTANTS_H_
+
+/**
+ * The size in bytes of the UART RX ring. See bsp_rx_buffer. Must be a power of
+ * two.
+ */
+#define BSP_RX_BUFFER_SIZE 4096
+
+/**
+ * The number of characters after which the pty reader notifies the message
+ * dispatcher, even if no '\n' has been received yet.
+ */
+#define BSP_RX_NOTIFY_THRESHOLD (BSP_RX_BUFFER_SIZE / 2)
+
+/**
+ * The size in bytes of the UART TX ring. See bsp_tx_buffer. The pty writer
+ * sends the characters straight out of it. Must be a power of two.
+ */
+#define BSP_TX_BUFFER_SIZE 4096
+
+/**
+ * The size in bytes of the maximum size a single message sent over the UART can
+ * have. This is including the leading '$' and trailing '\r\n'. The same as on
+ * the STM32F411 Discovery, so that the protocol behaves the same.
+ */
+#define BSP_MAX_MESSAGE_LENGTH 1000
+
+/**
+ * The size in bytes of the longest message that can be received in fragments,
+ * once reassembled. Excluding the framing characters and the fragment headers.
+ */
+#define BSP_MAX_REASSEMBLED_LENGTH 2000
+
+/**
+ * The maximum number of comma separated fields in a single incoming message,
+ * including the transaction ID, subsystem name and message name.
+ */
+#define BSP_MAX_MESSAGE_FIELDS 208
+
+/**
+ * The number of small slots of the message slab, shared by all subsystems. See
+ * message_slab.h.
+ */
+#define MESSAGE_SLAB_SMALL_SLOTS 40
+
+/**
+ * The number of large slots of the message slab, shared by all subsystems.
+ */
+#define MESSAGE_SLAB_LARGE_SLOTS 5
+
+/**
+ * The payload size of the large slots of the message slab, in bytes. Fits a
+ * Spinner spin plan of 100 legs.
+ */
+#define MESSAGE_SLAB_LARGE_PAYLOAD_SIZE 808
+
+/**
+ * The number of UART links the message dispatcher talks over, see bsp_links.
+ * With BSP_SECOND_LINK, the second link is a pty of its own.
+ */
+#ifdef BSP_SECOND_LINK
+#define BSP_NUM_LINKS 2
+#else
+#define BSP_NUM_LINKS 1
+#endif
+
+/**
+ * The stack size of the individual tasks. Only kept for the task API, the
+ * tasks run on their own thread stacks.
+ */
+#define TASK_STACK_SIZE 4000
+
+/**
+ * The stack size of the message dispatcher's TX task. Only kept for the task
+ * API, the tasks run on their own thread stacks.
+ */
+#define TX_TASK_STACK_SIZE 3000
+
+/**
+ * The maximum number of tasks the host implementation of the MourOS task API
+ * can run.
+ */
+#define NATIVE_MAX_TASKS 16
+
+/**
+ * The number of bytes the pty reader reads at once, before putting them into
+ * bsp_rx_buffer.
+ */
+#define NATIVE_PTY_READ_CHUNK_SIZE 256
+
+/**
+ * The time in milliseconds the pty reader waits, before trying again, while no
+ * program has the other end of the pty open.
+ */
+#define NATIVE_PTY_REOPEN_WAIT_MS 100
+
+
+#endif /* NATIVE_CONSTANTS_H_ */
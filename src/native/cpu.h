@@ -0,0 +1,42 @@
+/**
+ * @file
+ *
+ * This file contains the declarations of the simulated CPU of the native build.
+ *
+ * The MourOS tasks run on threads of their own, but only one of them at a time,
+ * like on the single core of the boards: a task holds the simulated CPU until
+ * it goes to sleep. The threads simulating the peripherals take the CPU over
+ * while they "run an interrupt handler", so that everything the handlers of
+ * the boards may touch stays safe to touch from them.
+ */
+
+#ifndef NATIVE_CPU_H_
+#define NATIVE_CPU_H_
+
+#include <pthread.h> // For pthread_cond_t
+
+/**
+ * Takes the simulated CPU over from the running task, i.e. starts a simulated
+ * interrupt handler. Blocks until the running task goes to sleep.
+ *
+ * @note Must not be called from a task.
+ */
+void native_cpu_acquire(void);
+
+/**
+ * Gives the simulated CPU back, i.e. ends a simulated interrupt handler.
+ */
+void native_cpu_release(void);
+
+/**
+ * Waits for the condition to get signalled, giving the simulated CPU to the
+ * tasks in the meantime. Takes it back over before returning.
+ *
+ * @note Must only be called between native_cpu_acquire() and
+ *       native_cpu_release().
+ *
+ * @param cond The condition to wait for.
+ */
+void native_cpu_wait(pthread_cond_t *cond);
+
+#endif /* NATIVE_CPU_H_ */
@@ -0,0 +1,205 @@
+/**
+ * @file
+ *
+ * This file contains the host implementation of the MourOS task API, used by
+ * the native build instead of the Cortex-M scheduler. The mailboxes, char
+ * buffers & pool allocators are portable, and come from MourOS itself.
+ *
+ * Every task runs on a thread of its own, which holds the simulated CPU (see
+ * cpu.h) whenever the task isn't sleeping. Task priorities are ignored, and the
+ * tasks don't get preempted - like the tasks of Ratfist, they have to sleep
+ * every now and then, for the others to run.
+ */
+
+#include <stdbool.h> // For bool
+#include <stdint.h> // For uint32_t, etc.
+#include <stddef.h> // For NULL
+#include <stdio.h> // For perror()
+#include <stdlib.h> // For abort()
+#include <time.h> // For nanosleep()
+#include <unistd.h> // For pause()
+#include <sched.h> // For sched_yield()
+#include <pthread.h> // For the threads
+
+#include <mouros/tasks.h>
+
+#include "cpu.h"
+#include "../constants.h" // For NATIVE_MAX_TASKS
+
+
+/**
+ * The thread a task runs on.
+ */
+struct native_task {
+	task_t *task;
+	void (*func)(void *);
+	void *params;
+	/** True, once os_task_add() has been called for the task. */
+	bool added;
+	pthread_t thread;
+};
+
+
+static void *task_thread_func(void *task_ptr);
+static void start_task_thread(struct native_task *task);
+static struct native_task *find_task(const task_t *task);
+
+
+/** Held by whoever runs on the simulated CPU. */
+static pthread_mutex_t cpu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct native_task tasks[NATIVE_MAX_TASKS];
+static uint32_t num_tasks = 0;
+
+static bool tasks_started = false;
+static uint32_t tick_rate_hz = 1000;
+
+
+
+static void *task_thread_func(void *task_ptr)
+{
+	struct native_task *task = task_ptr;
+
+	pthread_mutex_lock(&cpu_lock);
+
+	task->func(task->params);
+
+	task->task->state = TASK_STOPPED;
+	task->added = false;
+
+	pthread_mutex_unlock(&cpu_lock);
+
+	return NULL;
+}
+
+static void start_task_thread(struct native_task *task)
+{
+	if (pthread_create(&task->thread, NULL, task_thread_func, task) != 0) {
+		perror("pthread_create");
+		abort();
+	}
+
+	pthread_detach(task->thread);
+}
+
+static struct native_task *find_task(const task_t *task)
+{
+	for (uint32_t i = 0; i < num_tasks; i++) {
+		if (tasks[i].task == task) {
+			return &tasks[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+void os_init(void)
+{
+	// The code before os_tasks_start() runs on the simulated CPU too.
+	pthread_mutex_lock(&cpu_lock);
+}
+
+bool os_task_init(task_t *task,
+                  const char *name,
+                  uint8_t *stack_base,
+                  uint32_t stack_size,
+                  uint8_t priority,
+                  void (*func)(void *),
+                  void *params)
+{
+	(void) name;
+	(void) stack_base;
+	(void) stack_size;
+	(void) priority;
+
+	struct native_task *native_task = find_task(task);
+
+	if (native_task == NULL) {
+		if (num_tasks >= NATIVE_MAX_TASKS) {
+			return false;
+		}
+
+		native_task = &tasks[num_tasks++];
+		native_task->task = task;
+	}
+
+	native_task->func = func;
+	native_task->params = params;
+	native_task->added = false;
+
+	return true;
+}
+
+bool os_task_add(task_t *task)
+{
+	struct native_task *native_task = find_task(task);
+
+	if (native_task == NULL || native_task->added) {
+		return false;
+	}
+
+	native_task->added = true;
+
+	if (tasks_started) {
+		start_task_thread(native_task);
+	}
+
+	return true;
+}
+
+void os_tasks_start(uint32_t tick_rate)
+{
+	tick_rate_hz = tick_rate;
+	tasks_started = true;
+
+	for (uint32_t i = 0; i < num_tasks; i++) {
+		if (tasks[i].added) {
+			start_task_thread(&tasks[i]);
+		}
+	}
+
+	pthread_mutex_unlock(&cpu_lock);
+
+	// Like the scheduler, never returns.
+	while (true) {
+		pause();
+	}
+}
+
+void os_task_sleep(uint32_t num_ticks)
+{
+	uint64_t sleep_ns = (uint64_t) num_ticks * 1000000000u / tick_rate_hz;
+
+	struct timespec duration = {
+		.tv_sec = (time_t) (sleep_ns / 1000000000u),
+		.tv_nsec = (long) (sleep_ns % 1000000000u)
+	};
+
+	pthread_mutex_unlock(&cpu_lock);
+
+	if (num_ticks == 0) {
+		sched_yield();
+	} else {
+		while (nanosleep(&duration, &duration) != 0) {
+		}
+	}
+
+	pthread_mutex_lock(&cpu_lock);
+}
+
+
+void native_cpu_acquire(void)
+{
+	pthread_mutex_lock(&cpu_lock);
+}
+
+void native_cpu_release(void)
+{
+	pthread_mutex_unlock(&cpu_lock);
+}
+
+void native_cpu_wait(pthread_cond_t *cond)
+{
+	pthread_cond_wait(cond, &cpu_lock);
+}
@@ -12,8 +12,15 @@
 #include "stm32f072discovery/constants.h"
 #elif defined(STM32F411DISCOVERY)
 #include "stm32f411discovery/constants.h"
+#elif defined(NATIVE)
+#include "native/constants.h"
 #endif
 
+/**
+ * The number of decimals percentages are serialized with in ASCII messages.
+ */
+#define SPINNER_PCT_DECIMALS 6
+
 #endif /* SPINNER_CONSTANTS_H_ */
 
 
@@ -0,0 +1,200 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the Spinner specific BSP functions for the native build. It simulates
+ * a single stepper motor, that behaves like the one on STM32F411 Discovery: it turns at up to
+ * SIM_STEPPER_MAX_HALF_STEPS_PER_S, and stops once it passes its stop position.
+ *
+ * The position is only brought up to date when the motor gets asked about it, or gets reconfigured, from the time
+ * passed since the last update.
+ */
+
+#include <math.h> // For fabsf(), fmodf()
+
+#include <assert.h> // For assert()
+
+#include "../bsp.h"
+#include "../constants.h"
+#include "../../bsp.h" // For bsp_get_timestamp_us()
+
+/**
+ * The state of the simulated stepper motor.
+ */
+struct sim_stepper {
+	bool moving;
+	/** Signed percentage of the maximum rate, within [-100, 100]. */
+	float rate_pct;
+	/** The position in half steps, within [0, SIM_STEPPER_HALF_STEPS_PER_REV). */
+	float pos;
+	bool has_stop_pos;
+	float stop_pos;
+	/** The time the position was last brought up to date at. */
+	uint32_t last_update_us;
+};
+
+
+static void update_pos(struct sim_stepper *stepper);
+
+
+static struct sim_stepper stepper0;
+
+static bool spinner_initialized = false;
+
+
+/**
+ * Moves the stepper by the distance it has turned since the last update. If it
+ * has passed its stop position on the way, it stops there.
+ */
+static void update_pos(struct sim_stepper *stepper)
+{
+	uint32_t now_us = bsp_get_timestamp_us();
+	uint32_t elapsed_us = now_us - stepper->last_update_us;
+	stepper->last_update_us = now_us;
+
+	if (!stepper->moving) {
+		return;
+	}
+
+	float dist = (SIM_STEPPER_MAX_HALF_STEPS_PER_S * fabsf(stepper->rate_pct) / 100.0f) *
+	             ((float) elapsed_us / 1000000.0f);
+
+	if (stepper->has_stop_pos) {
+		// The distance to the stop position in the direction of travel.
+		float dist_to_stop = (stepper->rate_pct >= 0) ?
+		                         stepper->stop_pos - stepper->pos :
+		                         stepper->pos - stepper->stop_pos;
+
+		if (dist_to_stop <= 0) {
+			dist_to_stop += SIM_STEPPER_HALF_STEPS_PER_REV;
+		}
+
+		if (dist >= dist_to_stop) {
+			stepper->pos = stepper->stop_pos;
+			stepper->moving = false;
+			return;
+		}
+	}
+
+	float new_pos = (stepper->rate_pct >= 0) ? stepper->pos + dist : stepper->pos - dist;
+
+	new_pos = fmodf(new_pos, SIM_STEPPER_HALF_STEPS_PER_REV);
+	if (new_pos < 0) {
+		new_pos += SIM_STEPPER_HALF_STEPS_PER_REV;
+	}
+
+	stepper->pos = new_pos;
+}
+
+
+void bsp_spinner_init(void)
+{
+	stepper0.moving = false;
+	stepper0.rate_pct = 0;
+	stepper0.pos = 0;
+	stepper0.has_stop_pos = false;
+	stepper0.stop_pos = 0;
+	stepper0.last_update_us = bsp_get_timestamp_us();
+
+	spinner_initialized = true;
+}
+
+
+bool bsp_stepper_is_moving(uint8_t stepper_id)
+{
+	assert(spinner_initialized);
+	if (stepper_id != 0) {
+		return false;
+	}
+
+	update_pos(&stepper0);
+
+	return stepper0.moving;
+}
+
+void bsp_stepper_start(uint8_t stepper_id)
+{
+	assert(spinner_initialized);
+	if (stepper_id != 0) {
+		return;
+	}
+
+	update_pos(&stepper0);
+
+	// Like the timer on the board, the motor doesn't move at a negligible rate.
+	stepper0.moving = fabsf(stepper0.rate_pct) > 0.1f;
+}
+
+void bsp_stepper_stop(uint8_t stepper_id)
+{
+	assert(spinner_initialized);
+	if (stepper_id != 0) {
+		return;
+	}
+
+	update_pos(&stepper0);
+
+	stepper0.moving = false;
+}
+
+float bsp_stepper_get_pos(uint8_t stepper_id)
+{
+	assert(spinner_initialized);
+	if (stepper_id != 0) {
+		return 0;
+	}
+
+	update_pos(&stepper0);
+
+	return (stepper0.pos * 360.0f) / SIM_STEPPER_HALF_STEPS_PER_REV;
+}
+
+void bsp_stepper_set_stop_pos(uint8_t stepper_id, float stop_pos_deg)
+{
+	assert(spinner_initialized);
+	if (stepper_id != 0) {
+		return;
+	}
+
+	float stop_pos_deg_adj = fmodf(stop_pos_deg, 360.0f);
+
+	if (stop_pos_deg_adj < 0) {
+		stop_pos_deg_adj += 360.0f;
+	}
+
+	update_pos(&stepper0);
+
+	stepper0.stop_pos = (SIM_STEPPER_HALF_STEPS_PER_REV * stop_pos_deg_adj) / 360.0f;
+	stepper0.has_stop_pos = true;
+}
+
+void bsp_stepper_remove_stop_pos(uint8_t stepper_id)
+{
+	assert(spinner_initialized);
+	if (stepper_id != 0) {
+		return;
+	}
+
+	update_pos(&stepper0);
+
+	stepper0.has_stop_pos = false;
+}
+
+void bsp_stepper_set_rate(uint8_t stepper_id, float rate_pct)
+{
+	assert(spinner_initialized);
+	if (stepper_id != 0) {
+		return;
+	}
+
+	float adj_rate_pct = (rate_pct > 100.0f) ?
+	                         100.0f : ((rate_pct < -100.0f) ?
+	                                      -100.0f : rate_pct);
+
+	update_pos(&stepper0);
+
+	stepper0.rate_pct = adj_rate_pct;
+
+	if (fabsf(adj_rate_pct) <= 0.1f) {
+		stepper0.moving = false;
+	}
+}
@@ -0,0 +1,47 @@
+/**
+ * @file
+ *
+ * This file contains compile time settings for the Spinner subsystem of the ratfist-stm32 project, specific to the
+ * native (Linux host) build.
+ */
+
+#ifndef SPINNER_NATIVE_CONSTANTS_H_
+#define SPINNER_NATIVE_CONSTANTS_H_
+
+/** The maximum number of legs any one spin plan may contain. */
+#define MAX_SPIN_PLAN_LEGS 100
+
+/**
+ * The maximum number of error messages that can be scheduled for sending at any
+ * given time.
+ */
+#define MAX_OUTBOUND_ERROR_MESSAGES 20
+
+/**
+ * The maximum number of normal messages, that can be scheduled for sending at
+ * any given time.
+ */
+#define MAX_OUTBOUND_MESSAGES 30
+
+/**
+ * The maximum number of normal messages, that can be buffered after receiving at
+ * any given time.
+ */
+#define MAX_INBOUND_MESSAGES 30
+
+/**
+ * The number of half steps per revolution of the simulated stepper motor. The
+ * same as the one on the STM32F411 Discovery.
+ */
+#define SIM_STEPPER_HALF_STEPS_PER_REV 4096
+
+/**
+ * The number of half steps per second the simulated stepper motor makes at
+ * a 100% rate. The same as the one on the STM32F411 Discovery.
+ */
+#define SIM_STEPPER_MAX_HALF_STEPS_PER_S 1000.0f
+
+
+#endif /* SPINNER_NATIVE_CONSTANTS_H_ */
+
+
@@ -6,14 +6,10 @@
  */
 
 #include <stddef.h>
-#include <errno.h>
 #include <string.h>
-#include <stdlib.h>
 #include <limits.h>
-#include <stdio.h>
 
 #include <mouros/mailbox.h>
-#include <mouros/pool_alloc.h>
 #include <mouros/common.h>
 
 #include <libopencm3/cm3/assert.h>
@@ -25,6 +21,9 @@
 #include "../worker.h"
 #include "../errors.h"
 #include "../message_dispatcher.h"
+#include "../message_slab.h"
+#include "../binary_fields.h"
+#include "../fmt.h"
 #include "../constants.h"
 
 // Rust init function
@@ -35,15 +34,35 @@ void spinner_comm_loop(void *subsystem_conf);
 
 
 // Message parsing
-static bool parse_set_plan(struct message *msg, char *save_ptr);
-static bool parse_get_plan(struct message *msg, char *save_ptr);
-static bool parse_set_state(struct message *msg, char *save_ptr);
-static bool parse_get_state(struct message *msg, char *save_ptr);
-
-
+static bool parse_channel_num(const struct message_field *field,
+                              uint8_t *channel_num);
+static bool parse_set_plan(struct message *msg,
+                           const struct message_field *fields,
+                           uint32_t num_fields);
+static bool parse_get_plan(struct message *msg,
+                           const struct message_field *fields,
+                           uint32_t num_fields);
+static bool parse_set_state(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields);
+static bool parse_get_state(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields);
+
+
+static void put_plan_reply_item(struct fmt_writer *writer,
+                                const struct spin_plan_data *data,
+                                uint32_t item);
+static void put_plan_reply(struct fmt_writer *writer,
+                           const struct spin_plan_data *data);
 static ssize_t serialize_plan_reply(const struct message *msg,
                                     char *output_buf,
                                     uint32_t output_buf_len);
+static ssize_t stream_plan_reply(const struct message *msg,
+                                 struct stream_cursor *cursor,
+                                 uint32_t offset,
+                                 char *output_buf,
+                                 uint32_t output_buf_len);
 static ssize_t serialize_state_reply(const struct message *msg,
                                      char *output_buf,
                                      uint32_t output_buf_len);
@@ -51,41 +70,79 @@ static ssize_t serialize_ret_val(const struct message *msg,
                                  char *output_buf,
                                  uint32_t output_buf_len);
 
+
+static bool parse_binary_set_plan(struct message *msg,
+                                  const uint8_t *payload,
+                                  uint32_t payload_len);
+static bool parse_binary_channel(struct message *msg,
+                                 const uint8_t *payload,
+                                 uint32_t payload_len);
+static bool parse_binary_set_state(struct message *msg,
+                                   const uint8_t *payload,
+                                   uint32_t payload_len);
+
+
+static ssize_t serialize_binary_plan_reply(const struct message *msg,
+                                           uint8_t *output,
+                                           uint32_t output_len);
+static ssize_t serialize_binary_state_reply(const struct message *msg,
+                                            uint8_t *output,
+                                            uint32_t output_len);
+static ssize_t serialize_binary_ret_val(const struct message *msg,
+                                        uint8_t *output,
+                                        uint32_t output_len);
+
 static struct message_handler msg_handlers[] = {
 	{
 		.message_name = "SET_PLAN",
 		.parsing_func = parse_set_plan,
-		.serialization_func = NULL
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_set_plan,
+		.binary_serialization_func = NULL
 	},
 	{
 		.message_name = "GET_PLAN",
 		.parsing_func = parse_get_plan,
-		.serialization_func = NULL
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_channel,
+		.binary_serialization_func = NULL
 	},
 	{
 		.message_name = "PLAN_REPLY",
 		.parsing_func = NULL,
-		.serialization_func = serialize_plan_reply
+		.serialization_func = serialize_plan_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_plan_reply,
+		.streaming_serialization_func = stream_plan_reply
 	},
 	{
 		.message_name = "SET_STATE",
 		.parsing_func = parse_set_state,
-		.serialization_func = NULL
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_set_state,
+		.binary_serialization_func = NULL
 	},
 	{
 		.message_name = "GET_STATE",
 		.parsing_func = parse_get_state,
-		.serialization_func = NULL
+		.serialization_func = NULL,
+		.binary_parsing_func = parse_binary_channel,
+		.binary_serialization_func = NULL,
+		.subscribable = true
 	},
 	{
 		.message_name = "STATE_REPLY",
 		.parsing_func = NULL,
-		.serialization_func = serialize_state_reply
+		.serialization_func = serialize_state_reply,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_state_reply
 	},
 	{
 		.message_name = "RET_VAL",
 		.parsing_func = NULL,
-		.serialization_func = serialize_ret_val
+		.serialization_func = serialize_ret_val,
+		.binary_parsing_func = NULL,
+		.binary_serialization_func = serialize_binary_ret_val
 	}
 };
 
@@ -100,251 +157,365 @@ static char *spin_state_lut[SPINNER_STATE_NUM_STATES] = {
 
 
 
-static bool parse_set_plan(struct message *msg, char *save_ptr)
+static bool parse_channel_num(const struct message_field *field,
+                              uint8_t *channel_num)
 {
-	struct spin_plan_data *data = msg->data;
-
-	// Get channel number string.
-	char *token = strtok_r(NULL, ",", &save_ptr);
-	if (token == NULL) {
+	uint32_t ch_num = 0;
+	if (!message_field_to_u32(field, &ch_num) || ch_num > UCHAR_MAX) {
 		return false;
 	}
 
-	char *end_ptr = NULL;
+	*channel_num = (uint8_t) ch_num;
+
+	return true;
+}
 
-	// Parse the channel number
-	errno = 0;
-	uint32_t ch_num = strtoul(token, &end_ptr, 10);
-	if (errno != 0 ||
-	    end_ptr == token || *end_ptr != '\0' ||
-	    ch_num > UCHAR_MAX) {
+static bool parse_set_plan(struct message *msg,
+                           const struct message_field *fields,
+                           uint32_t num_fields)
+{
+	struct spin_plan_data *data = msg->data;
 
+	// The channel number, followed by duration-target pairs.
+	if (num_fields == 0 || num_fields % 2 != 1) {
 		return false;
 	}
 
-	data->channel_num = (uint8_t) ch_num;
-
-	// Get duration-target pairs.
-	for (uint32_t i = 0; i < MAX_SPIN_PLAN_LEGS; i++) {
-		// Get duration string.
-		token = strtok_r(NULL, ",", &save_ptr);
-		if (token == NULL) {
-			// End of the packet.
-			data->plan_leg_count = i;
-			break;
-		}
+	// Too many legs in the plan.
+	uint32_t leg_count = (num_fields - 1) / 2;
+	if (leg_count > MAX_SPIN_PLAN_LEGS) {
+		return false;
+	}
 
-		// Parse the duration.
-		errno = 0;
-		data->plan_legs[i].duration_msecs = strtoul(token, &end_ptr, 10);
-		if (errno != 0 || end_ptr == token || *end_ptr != '\0') {
-			return false;
-		}
+	if (!parse_channel_num(&fields[0], &data->channel_num)) {
+		return false;
+	}
 
-		// Get target string.
-		token = strtok_r(NULL, ",", &save_ptr);
-		if (token == NULL) {
-			return false;
-		}
+	for (uint32_t i = 0; i < leg_count; i++) {
+		const struct message_field *duration = &fields[1 + 2*i];
+		const struct message_field *target = &fields[2 + 2*i];
 
-		// Parse the target value.
-		errno = 0;
-		data->plan_legs[i].target_pct = strtof(token, &end_ptr);
-		if (errno != 0 || end_ptr == token || *end_ptr != '\0') {
+		if (!message_field_to_u32(duration, &data->plan_legs[i].duration_msecs) ||
+		    !message_field_to_float(target, &data->plan_legs[i].target_pct)) {
 			return false;
 		}
 	}
 
-	// Not at the end of the packet! This means there were too many legs
-	// in the plan.
-	if (strtok_r(NULL, ",", &save_ptr) != NULL) {
-		return false;
-	}
+	data->plan_leg_count = leg_count;
 
 	return true;
 }
 
-static bool parse_get_plan(struct message *msg, char *save_ptr)
+static bool parse_get_plan(struct message *msg,
+                           const struct message_field *fields,
+                           uint32_t num_fields)
 {
 	struct spin_channel *data = msg->data;
 
-	// Get channel number string.
-	char *token = strtok_r(NULL, ",", &save_ptr);
-	if (token == NULL) {
+	if (num_fields != 1) {
 		return false;
 	}
 
-	char *end_ptr = NULL;
+	return parse_channel_num(&fields[0], &data->channel_num);
+}
 
-	// Parse the channel number.
-	errno = 0;
-	uint32_t ch_num = strtoul(token, &end_ptr, 10);
-	if (errno != 0 || end_ptr == token || *end_ptr != '\0' || ch_num > UCHAR_MAX) {
+static bool parse_set_state(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields)
+{
+	struct spin_state_set_data *data = msg->data;
+
+	if (num_fields != 2) {
 		return false;
 	}
 
-	data->channel_num = (uint8_t) ch_num;
+	if (!parse_channel_num(&fields[0], &data->channel_num)) {
+		return false;
+	}
+
+	if (strcmp(fields[1].str, "ON") == 0) {
+		data->state = SPINNER_STATE_RUNNING;
+
+	} else if (strcmp(fields[1].str, "OFF") == 0) {
+		data->state = SPINNER_STATE_STOPPED;
 
-	// Not at the end of the packet!! Invalid packet.
-	if (strtok_r(NULL, ",", &save_ptr) != NULL) {
+	} else {
 		return false;
 	}
 
 	return true;
 }
 
-static bool parse_set_state(struct message *msg, char *save_ptr)
+static bool parse_get_state(struct message *msg,
+                            const struct message_field *fields,
+                            uint32_t num_fields)
 {
-	struct spin_state_set_data *data = msg->data;
+	struct spin_channel *data = msg->data;
 
-	// Get channel number string.
-	char *token = strtok_r(NULL, ",", &save_ptr);
-	if (token == NULL) {
+	if (num_fields != 1) {
 		return false;
 	}
 
-	char *end_ptr = NULL;
+	return parse_channel_num(&fields[0], &data->channel_num);
+}
 
-	// Parse the channel number.
-	errno = 0;
-	uint32_t ch_num = strtoul(token, &end_ptr, 10);
-	if (errno != 0 || end_ptr == token || *end_ptr != '\0' || ch_num > UCHAR_MAX) {
-		return false;
+
+
+/**
+ * Puts a field of the plan reply. Item 0 is the channel number, the ones after
+ * it the legs of the plan, each with its two fields.
+ */
+static void put_plan_reply_item(struct fmt_writer *writer,
+                                const struct spin_plan_data *data,
+                                uint32_t item)
+{
+	fmt_put_ch(writer, ',');
+
+	if (item == 0) {
+		fmt_put_u32(writer, data->channel_num);
+		return;
 	}
 
-	data->channel_num = (uint8_t) ch_num;
+	const struct pwm_leg *leg = &data->plan_legs[item - 1];
 
+	fmt_put_u32(writer, leg->duration_msecs);
+	fmt_put_ch(writer, ',');
+	fmt_put_float(writer, leg->target_pct, SPINNER_PCT_DECIMALS);
+}
 
-	// Get the state string.
-	token = strtok_r(NULL, ",", &save_ptr);
-	if (token == NULL) {
-		return false;
+static void put_plan_reply(struct fmt_writer *writer,
+                           const struct spin_plan_data *data)
+{
+	for (uint32_t i = 0; i <= data->plan_leg_count; i++) {
+		put_plan_reply_item(writer, data, i);
 	}
+}
 
-	if (strcmp(token, "ON") == 0) {
-		data->state = SPINNER_STATE_RUNNING;
+static ssize_t serialize_plan_reply(const struct message *msg,
+                                    char *output_buf,
+                                    uint32_t output_buf_len)
+{
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_buf, output_buf_len);
 
-	} else if (strcmp(token, "OFF") == 0) {
-		data->state = SPINNER_STATE_STOPPED;
+	put_plan_reply(&writer, msg->data);
 
-	} else {
-		return false;
+	return fmt_writer_finish(&writer);
+}
+
+/**
+ * Long plans don't fit into a single frame, so the dispatcher sends them in
+ * fragments, serialized one window at a time. Each window resumes at the leg
+ * the previous one ended in, and stops after the leg it ends in, so the legs
+ * outside of it don't get formatted.
+ */
+static ssize_t stream_plan_reply(const struct message *msg,
+                                 struct stream_cursor *cursor,
+                                 uint32_t offset,
+                                 char *output_buf,
+                                 uint32_t output_buf_len)
+{
+	const struct spin_plan_data *data = msg->data;
+
+	uint32_t base = cursor->offset;
+	uint32_t window_end = offset + output_buf_len;
+
+	struct fmt_writer writer;
+	fmt_writer_init_window(&writer, output_buf, output_buf_len, offset - base);
+
+	for (uint32_t i = cursor->item; i <= data->plan_leg_count; i++) {
+		uint32_t item_start = base + writer.total_len;
+
+		// Past the end of the window, so there's no need to go on.
+		if (item_start > window_end) {
+			break;
+		}
+
+		if (item_start < window_end) {
+			cursor->offset = item_start;
+			cursor->item = i;
+		}
+
+		put_plan_reply_item(&writer, data, i);
 	}
 
+	ssize_t len = fmt_writer_finish_window(&writer);
+	if (len < 0) {
+		return -1;
+	}
+
+	return (ssize_t) (base + (uint32_t) len - offset);
+}
+
+static ssize_t serialize_state_reply(const struct message *msg,
+                                     char *output_buf,
+                                     uint32_t output_buf_len)
+{
+	struct spin_state_data *data = msg->data;
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_buf, output_buf_len);
+
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, data->channel_num);
+	fmt_put_ch(&writer, ',');
+	fmt_put_str(&writer, spin_state_lut[data->state]);
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, data->plan_time_elapsed_msecs);
+	fmt_put_ch(&writer, ',');
+	fmt_put_float(&writer, data->output_val_pct, SPINNER_PCT_DECIMALS);
+
+	return fmt_writer_finish(&writer);
+}
+
+static ssize_t serialize_ret_val(const struct message *msg,
+                                 char *output_buf,
+                                 uint32_t output_buf_len)
+{
+	struct ret_val *data = msg->data;
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, output_buf, output_buf_len);
+
+	fmt_put_ch(&writer, ',');
+	fmt_put_i32(&writer, data->ret_val);
+
+	return fmt_writer_finish(&writer);
+}
+
+
+
+// Binary message parsing. Payloads are little-endian, the channel number is a
+// single byte, durations are uint32_t, and percentages are floats.
+
+static bool parse_binary_set_plan(struct message *msg,
+                                  const uint8_t *payload,
+                                  uint32_t payload_len)
+{
+	struct spin_plan_data *data = msg->data;
+
+	// The channel number, followed by duration-target pairs.
+	const uint32_t leg_len = sizeof(uint32_t) + sizeof(float);
 
-	// Not at the end of the packet!! Invalid packet.
-	if (strtok_r(NULL, ",", &save_ptr) != NULL) {
+	if (payload_len == 0 || (payload_len - 1) % leg_len != 0) {
 		return false;
 	}
 
+	uint32_t leg_count = (payload_len - 1) / leg_len;
+	if (leg_count > MAX_SPIN_PLAN_LEGS) {
+		return false;
+	}
+
+	data->channel_num = payload[0];
+
+	for (uint32_t i = 0; i < leg_count; i++) {
+		const uint8_t *leg = &payload[1 + i * leg_len];
+
+		data->plan_legs[i].duration_msecs = bin_get_u32(&leg[0]);
+		data->plan_legs[i].target_pct = bin_get_f32(&leg[sizeof(uint32_t)]);
+	}
+
+	data->plan_leg_count = leg_count;
+
 	return true;
 }
 
-static bool parse_get_state(struct message *msg, char *save_ptr)
+static bool parse_binary_channel(struct message *msg,
+                                 const uint8_t *payload,
+                                 uint32_t payload_len)
 {
 	struct spin_channel *data = msg->data;
 
-	// Get channel number string.
-	char *token = strtok_r(NULL, ",", &save_ptr);
-	if (token == NULL) {
+	if (payload_len != 1) {
 		return false;
 	}
 
-	char *end_ptr = NULL;
+	data->channel_num = payload[0];
+
+	return true;
+}
 
-	// Parse the channel number.
-	errno = 0;
-	uint32_t ch_num = strtoul(token, &end_ptr, 10);
-	if (errno != 0 || end_ptr == token || *end_ptr != '\0' || ch_num > UCHAR_MAX) {
+static bool parse_binary_set_state(struct message *msg,
+                                   const uint8_t *payload,
+                                   uint32_t payload_len)
+{
+	struct spin_state_set_data *data = msg->data;
+
+	if (payload_len != 2) {
 		return false;
 	}
 
-	data->channel_num = (uint8_t) ch_num;
-
-	// Not at the end of the packet!! Invalid packet.
-	if (strtok_r(NULL, ",", &save_ptr) != NULL) {
+	// Same as in the ASCII protocol, only turning on & off is allowed.
+	if (payload[1] != SPINNER_STATE_RUNNING && payload[1] != SPINNER_STATE_STOPPED) {
 		return false;
 	}
 
+	data->channel_num = payload[0];
+	data->state = payload[1];
+
 	return true;
 }
 
 
 
-static ssize_t serialize_plan_reply(const struct message *msg,
-                                    char *output_buf,
-                                    uint32_t output_buf_len)
+// Binary message serialization
+
+static ssize_t serialize_binary_plan_reply(const struct message *msg,
+                                           uint8_t *output,
+                                           uint32_t output_len)
 {
 	struct spin_plan_data *data = msg->data;
 
-	ssize_t len = 0;
-	ssize_t curr_len = snprintf(output_buf, (size_t) output_buf_len,
-	                            ",%u", data->channel_num);
+	const uint32_t leg_len = sizeof(uint32_t) + sizeof(float);
+	uint32_t len = 1 + data->plan_leg_count * leg_len;
 
-	if (curr_len <= 0) {
+	if (len > output_len) {
 		return -1;
 	}
 
-	len += curr_len;
-	if ((uint32_t ) len >= output_buf_len) {
-		return -1;
-	}
+	output[0] = data->channel_num;
 
 	for (uint32_t i = 0; i < data->plan_leg_count; i++) {
-		curr_len = snprintf(&output_buf[len],
-		                    (size_t) ((ssize_t) output_buf_len - len),
-		                    ",%lu,%f",
-		                    data->plan_legs[i].duration_msecs,
-		                    data->plan_legs[i].target_pct);
-
-		if (curr_len <= 0) {
-			return -1;
-		}
+		uint8_t *leg = &output[1 + i * leg_len];
 
-		len += curr_len;
-		if ((uint32_t ) len >= output_buf_len) {
-			return -1;
-		}
+		bin_put_u32(&leg[0], data->plan_legs[i].duration_msecs);
+		bin_put_f32(&leg[sizeof(uint32_t)], data->plan_legs[i].target_pct);
 	}
 
-	return len;
+	return (ssize_t) len;
 }
 
-static ssize_t serialize_state_reply(const struct message *msg,
-                                     char *output_buf,
-                                     uint32_t output_buf_len)
+static ssize_t serialize_binary_state_reply(const struct message *msg,
+                                            uint8_t *output,
+                                            uint32_t output_len)
 {
 	struct spin_state_data *data = msg->data;
 
-	ssize_t len = snprintf(output_buf, (size_t) output_buf_len,
-	                       ",%u,%s,%lu,%f",
-	                       data->channel_num,
-	                       spin_state_lut[data->state],
-	                       data->plan_time_elapsed_msecs,
-	                       data->output_val_pct);
-
-	if (len <= 0 || (uint32_t) len >= output_buf_len) {
+	if (output_len < 10) {
 		return -1;
 	}
 
-	return len;
+	output[0] = data->channel_num;
+	output[1] = (uint8_t) data->state;
+	bin_put_u32(&output[2], data->plan_time_elapsed_msecs);
+	bin_put_f32(&output[6], data->output_val_pct);
+
+	return 10;
 }
 
-static ssize_t serialize_ret_val(const struct message *msg,
-                                 char *output_buf,
-                                 uint32_t output_buf_len)
+static ssize_t serialize_binary_ret_val(const struct message *msg,
+                                        uint8_t *output,
+                                        uint32_t output_len)
 {
 	struct ret_val *data = msg->data;
 
-	ssize_t len = snprintf(output_buf, (size_t) output_buf_len,
-	                       ",%ld",
-	                       data->ret_val);
-
-	if (len <= 0 || (uint32_t) len >= output_buf_len) {
+	if (output_len < sizeof(int32_t)) {
 		return -1;
 	}
 
-	return len;
+	bin_put_i32(output, data->ret_val);
+
+	return sizeof(int32_t);
 }
 
 
@@ -361,74 +532,35 @@ union small_size_msg_data {
 };
 
 
-static pool_alloc_t msg_pool;
-static struct message msg_pool_mem[MSG_STRUCT_POOL_SIZE];
-
-static pool_alloc_t small_sized_msg_pool;
-static union small_size_msg_data small_sized_msg_pool_mem[SMALL_SIZED_MSG_POOL_SIZE];
-
-static pool_alloc_t spin_plan_data_pool;
-static struct spin_plan_data spin_plan_data_pool_mem[SPIN_PLAN_DATA_MSG_POOL_SIZE];
-
+// The slab's size classes are set up for these.
+_Static_assert(sizeof(union small_size_msg_data) <= MESSAGE_SLAB_SMALL_PAYLOAD_SIZE,
+               "Spinner's small messages don't fit the small slab slots.");
+_Static_assert(sizeof(struct spin_plan_data) <= MESSAGE_SLAB_LARGE_PAYLOAD_SIZE,
+               "Spin plans don't fit the large slab slots.");
 
 
 struct message *spinner_alloc_message(uint32_t msg_type_id)
 {
-	struct message *ret = os_pool_alloc_take(&msg_pool);
-	if (ret == NULL) {
-		return NULL;
-	}
-
-	void *data = NULL;
-
 	switch (msg_type_id) {
 	case SPINNER_MSG_SET_PLAN:
 	case SPINNER_MSG_PLAN_REPLY:
-		data = os_pool_alloc_take(&spin_plan_data_pool);
-		break;
+		return message_slab_alloc(msg_type_id, sizeof(struct spin_plan_data));
 	case SPINNER_MSG_GET_PLAN:
 	case SPINNER_MSG_GET_STATE:
 	case SPINNER_MSG_SET_STATE:
 	case SPINNER_MSG_STATE_REPLY:
 	case SPINNER_MSG_RET_VAL:
-		data = os_pool_alloc_take(&small_sized_msg_pool);
-		break;
+		return message_slab_alloc(msg_type_id, sizeof(union small_size_msg_data));
 	default:
 		cm3_assert_failed();
 	}
 
-	if (data == NULL) {
-		os_pool_alloc_give(&msg_pool, ret);
-		return NULL;
-	}
-
-	ret->type = msg_type_id;
-	ret->data = data;
-	ret->transaction_id = 0;
-
-	return ret;
+	return NULL;
 }
 
 void spinner_free_message(struct message *msg)
 {
-	switch (msg->type) {
-	case SPINNER_MSG_SET_PLAN:
-	case SPINNER_MSG_PLAN_REPLY:
-		os_pool_alloc_give(&spin_plan_data_pool, msg->data);
-		break;
-	case SPINNER_MSG_GET_PLAN:
-	case SPINNER_MSG_GET_STATE:
-	case SPINNER_MSG_SET_STATE:
-	case SPINNER_MSG_STATE_REPLY:
-	case SPINNER_MSG_RET_VAL:
-		os_pool_alloc_give(&small_sized_msg_pool, msg->data);
-		break;
-	default:
-		cm3_assert_failed();
-	}
-
-
-	os_pool_alloc_give(&msg_pool, msg);
+	message_slab_free(msg);
 }
 
 
@@ -446,7 +578,7 @@ static mailbox_t tx_msg_queue;
 static struct message *tx_msg_queue_buf[MAX_OUTBOUND_MESSAGES];
 
 static mailbox_t tx_err_msg_queue;
-static int32_t tx_err_msg_queue_buf[MAX_OUTBOUND_ERROR_MESSAGES];
+static struct error_entry tx_err_msg_queue_buf[MAX_OUTBOUND_ERROR_MESSAGES];
 
 
 
@@ -458,47 +590,36 @@ static struct subsystem_message_conf spinner_conf = {
 	.free_message = spinner_free_message,
 	.outgoing_msg_queue = &tx_msg_queue,
 	.incoming_msg_queue = &rx_msg_queue,
-	.outgoing_err_queue = &tx_err_msg_queue
+	.outgoing_err_queue = &tx_err_msg_queue,
+	.tx_weight = 1,
+	// One slot of a mailbox always stays free.
+	.incoming_credits = MAX_INBOUND_MESSAGES - 1,
+	// All requests but SET_PLAN, so that the few large slots don't hold
+	// back the rest.
+	.request_payload_size = sizeof(union small_size_msg_data)
 };
 
 
-void spinner_init(void)
+struct subsystem_message_conf *spinner_init(void)
 {
 	bsp_spinner_init();
 
-	os_pool_alloc_init(&msg_pool,
-	                   msg_pool_mem,
-	                   sizeof(struct message),
-	                   MSG_STRUCT_POOL_SIZE);
-
-	os_pool_alloc_init(&small_sized_msg_pool,
-	                   small_sized_msg_pool_mem,
-	                   sizeof(union small_size_msg_data),
-	                   SMALL_SIZED_MSG_POOL_SIZE);
-
-	os_pool_alloc_init(&spin_plan_data_pool,
-	                   spin_plan_data_pool_mem,
-	                   sizeof(struct spin_plan_data),
-	                   SPIN_PLAN_DATA_MSG_POOL_SIZE);
-
-
 	os_mailbox_init(&rx_msg_queue, rx_msg_queue_buf,
 	                ARRAY_SIZE(rx_msg_queue_buf), sizeof(struct message *),
 	                NULL);
 
 	os_mailbox_init(&tx_msg_queue, tx_msg_queue_buf,
 	                ARRAY_SIZE(tx_msg_queue_buf), sizeof(struct message *),
-	                NULL);
+	                dispatcher_notify_tx);
 
 	os_mailbox_init(&tx_err_msg_queue, tx_err_msg_queue_buf,
-	                ARRAY_SIZE(tx_err_msg_queue_buf), sizeof(int32_t),
-	                NULL);
+	                ARRAY_SIZE(tx_err_msg_queue_buf),
+	                sizeof(struct error_entry),
+	                dispatcher_notify_tx);
 
 
 	spinner_rust_init(&spinner_conf);
 
-	dispatcher_register_subsystem(&spinner_conf);
-
 	worker_task_init(&spinner_comm,
 	                 "spinner_comm",
 	                 spinner_comm_task_stack,
@@ -508,4 +629,8 @@ void spinner_init(void)
 	                 NULL);
 
 	worker_start(&spinner_comm);
+
+	return &spinner_conf;
 }
+
+RATFIST_SUBSYSTEM(spinner, spinner_init);
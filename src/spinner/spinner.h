@@ -88,7 +88,13 @@ void spinner_free_message(struct message *msg);
 
 
 
-void spinner_init(void);
+/**
+ * Initializes the Spinner subsystem. Gets called by the message dispatcher, as
+ * the subsystem is in the registry.
+ *
+ * @return The subsystem's message configuration.
+ */
+struct subsystem_message_conf *spinner_init(void);
 
 #endif /* SPINNER_H_ */
 
@@ -30,17 +30,44 @@ static uint16_t led_pin_lut[] = {
 	GPIO9 /** Green */
 };
 
-mailbox_t bsp_rx_buffer;
-static char rx_buffer_mem[BSP_RX_BUFFER_SIZE];
+struct byte_ring bsp_rx_buffer;
+static uint8_t rx_buffer_mem[BSP_RX_BUFFER_SIZE];
 
-mailbox_t bsp_tx_buffer;
-static char tx_buffer_mem[BSP_TX_BUFFER_SIZE];
+struct byte_ring bsp_tx_buffer;
+static uint8_t tx_buffer_mem[BYTE_RING_MEM_SIZE(BSP_TX_BUFFER_SIZE, BSP_TX_MAX_RESERVATION)];
 
+volatile struct bsp_uart_stats bsp_uart_stats;
 
+const struct bsp_link bsp_links[BSP_NUM_LINKS] = {
+	{ &bsp_rx_buffer, &bsp_tx_buffer, &bsp_uart_stats }
+};
+
+static void (*rx_notify_callback)(void) = NULL;
+static uint32_t rx_chars_since_notify = 0;
+
+#ifdef BSP_UART_RX_DMA
+static uint8_t rx_dma_buffer[BSP_RX_DMA_BUFFER_SIZE];
+static uint32_t rx_dma_read_pos = 0;
+
+static void rx_dma_init(void);
+static void rx_dma_publish(void);
+#endif
+
+#ifdef BSP_UART_TX_DMA
+/** The length of the transfer in progress, 0 if there isn't one. */
+static uint32_t tx_dma_len = 0;
+
+static void tx_dma_init(void);
+static void tx_dma_start(void);
+#endif
+
+
+#ifndef BSP_UART_TX_DMA
 static void enable_usart1_tx_interrupt(void)
 {
 	usart_enable_tx_interrupt(USART1);
 }
+#endif
 
 /**
  * Initializes the clocks and GPIOS for the LEDs to work.
@@ -64,15 +91,21 @@ static void led_init(void)
  */
 static void comm_init(void)
 {
-	os_char_buffer_init(&bsp_rx_buffer,
-	                    rx_buffer_mem,
-	                    BSP_RX_BUFFER_SIZE,
-	                    NULL);
-
-	os_char_buffer_init(&bsp_tx_buffer,
-	                    tx_buffer_mem,
-	                    BSP_TX_BUFFER_SIZE,
-	                    enable_usart1_tx_interrupt);
+	byte_ring_init(&bsp_rx_buffer,
+	               rx_buffer_mem,
+	               BSP_RX_BUFFER_SIZE,
+	               0,
+	               NULL);
+
+	byte_ring_init(&bsp_tx_buffer,
+	               tx_buffer_mem,
+	               BSP_TX_BUFFER_SIZE,
+	               BSP_TX_MAX_RESERVATION,
+#ifdef BSP_UART_TX_DMA
+	               tx_dma_start);
+#else
+	               enable_usart1_tx_interrupt);
+#endif
 
 	rcc_periph_clock_enable(RCC_GPIOA);
 
@@ -81,14 +114,26 @@ static void comm_init(void)
 	gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_PULLUP, GPIO9 | GPIO10);
 	gpio_set_af(GPIOA, GPIO_AF1, GPIO9 | GPIO10);
 
-	usart_set_baudrate(USART1, 115200);
+	usart_set_baudrate(USART1, BSP_UART_BAUD_RATE);
 	usart_set_databits(USART1, 8);
 	usart_set_flow_control(USART1, USART_FLOWCONTROL_NONE);
 	usart_set_mode(USART1, USART_MODE_TX_RX);
 	usart_set_parity(USART1, USART_PARITY_NONE);
 	usart_set_stopbits(USART1, USART_CR2_STOP_1_0BIT);
 
+#ifdef BSP_UART_RX_DMA
+	rx_dma_init();
+
+	// The IDLE line interrupt publishes whatever arrived before the line went
+	// quiet.
+	USART_CR1(USART1) |= USART_CR1_IDLEIE;
+#else
 	usart_enable_rx_interrupt(USART1);
+#endif
+
+#ifdef BSP_UART_TX_DMA
+	tx_dma_init();
+#endif
 
 	usart_enable(USART1);
 
@@ -96,6 +141,176 @@ static void comm_init(void)
 	nvic_enable_irq(NVIC_USART1_IRQ);
 }
 
+#ifdef BSP_UART_RX_DMA
+/**
+ * Sets up DMA1 channel 3 (USART1_RX) to continuously copy received characters
+ * into rx_dma_buffer, wrapping around at its end.
+ */
+static void rx_dma_init(void)
+{
+	rcc_periph_clock_enable(RCC_DMA);
+
+	dma_channel_reset(DMA1, DMA_CHANNEL3);
+
+	dma_set_priority(DMA1, DMA_CHANNEL3, DMA_CCR_PL_HIGH);
+
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL3, (uint32_t) &USART1_RDR);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL3, DMA_CCR_PSIZE_8BIT);
+	dma_disable_peripheral_increment_mode(DMA1, DMA_CHANNEL3);
+
+	dma_set_memory_address(DMA1, DMA_CHANNEL3, (uint32_t) rx_dma_buffer);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL3, ARRAY_SIZE(rx_dma_buffer));
+	dma_set_memory_size(DMA1, DMA_CHANNEL3, DMA_CCR_MSIZE_8BIT);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL3);
+
+	dma_enable_circular_mode(DMA1, DMA_CHANNEL3);
+
+	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL3);
+
+	dma_clear_interrupt_flags(DMA1, DMA_CHANNEL3, DMA_GIF);
+
+	dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL3);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
+
+	// Same priority as the USART1 interrupt, so that the two never preempt
+	// each other in rx_dma_publish().
+	nvic_set_priority(NVIC_DMA1_CHANNEL2_3_DMA2_CHANNEL1_2_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL2_3_DMA2_CHANNEL1_2_IRQ);
+
+	dma_enable_channel(DMA1, DMA_CHANNEL3);
+
+	usart_enable_rx_dma(USART1);
+}
+
+/**
+ * Moves the characters the DMA controller wrote into rx_dma_buffer since the
+ * last call into bsp_rx_buffer, and notifies the message dispatcher.
+ *
+ * Called from the USART1 IDLE line, and the DMA half & full transfer
+ * interrupts.
+ */
+static void rx_dma_publish(void)
+{
+	uint32_t write_pos = ARRAY_SIZE(rx_dma_buffer) -
+	                     dma_get_number_of_data(DMA1, DMA_CHANNEL3);
+
+	if (write_pos >= ARRAY_SIZE(rx_dma_buffer)) {
+		write_pos = 0;
+	}
+
+	if (write_pos == rx_dma_read_pos) {
+		return;
+	}
+
+	// Data wrapped around the end of the buffer.
+	if (write_pos < rx_dma_read_pos) {
+		uint32_t tail_len = ARRAY_SIZE(rx_dma_buffer) - rx_dma_read_pos;
+		bsp_uart_stats.rx_dropped += tail_len -
+			byte_ring_write_some(&bsp_rx_buffer,
+			                     &rx_dma_buffer[rx_dma_read_pos],
+			                     tail_len);
+		rx_dma_read_pos = 0;
+	}
+
+	uint32_t len = write_pos - rx_dma_read_pos;
+	bsp_uart_stats.rx_dropped += len -
+		byte_ring_write_some(&bsp_rx_buffer,
+		                     &rx_dma_buffer[rx_dma_read_pos],
+		                     len);
+	rx_dma_read_pos = write_pos;
+
+	if (rx_notify_callback != NULL) {
+		rx_notify_callback();
+	}
+}
+#endif
+
+#ifdef BSP_UART_TX_DMA
+/**
+ * Sets up DMA1 channel 2 (USART1_TX) for sending characters straight out of
+ * bsp_tx_buffer. The transfers themselves are started by tx_dma_start().
+ */
+static void tx_dma_init(void)
+{
+	rcc_periph_clock_enable(RCC_DMA);
+
+	dma_channel_reset(DMA1, DMA_CHANNEL2);
+
+	dma_set_priority(DMA1, DMA_CHANNEL2, DMA_CCR_PL_MEDIUM);
+
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL2, (uint32_t) &USART1_TDR);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL2, DMA_CCR_PSIZE_8BIT);
+	dma_disable_peripheral_increment_mode(DMA1, DMA_CHANNEL2);
+
+	dma_set_memory_size(DMA1, DMA_CHANNEL2, DMA_CCR_MSIZE_8BIT);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL2);
+
+	dma_set_read_from_memory(DMA1, DMA_CHANNEL2);
+
+	dma_clear_interrupt_flags(DMA1, DMA_CHANNEL2, DMA_GIF);
+
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL2);
+
+	nvic_set_priority(NVIC_DMA1_CHANNEL2_3_DMA2_CHANNEL1_2_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL2_3_DMA2_CHANNEL1_2_IRQ);
+
+	usart_enable_tx_dma(USART1);
+}
+
+/**
+ * Starts a DMA transfer of the contiguous run of characters waiting in
+ * bsp_tx_buffer, unless one is already in progress. The characters stay in the
+ * ring until the transfer is complete.
+ *
+ * Used as the bsp_tx_buffer write callback, and called from the transfer
+ * complete interrupt to re-arm the DMA channel.
+ */
+static void tx_dma_start(void)
+{
+	CM_ATOMIC_CONTEXT();
+
+	if (tx_dma_len != 0) {
+		return;
+	}
+
+	const uint8_t *data = NULL;
+	uint32_t len = byte_ring_peek(&bsp_tx_buffer, &data);
+	if (len == 0) {
+		return;
+	}
+
+	// The transfer count register is only 16 bits wide.
+	tx_dma_len = (len > UINT16_MAX) ? UINT16_MAX : len;
+
+	// The channel has to be disabled while its addresses and transfer
+	// count are changed.
+	dma_disable_channel(DMA1, DMA_CHANNEL2);
+	dma_set_memory_address(DMA1, DMA_CHANNEL2, (uint32_t) data);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL2, (uint16_t) tx_dma_len);
+	dma_enable_channel(DMA1, DMA_CHANNEL2);
+}
+#endif
+
+/**
+ * Sets up TIM2 as a free running 32 bit microsecond counter for
+ * bsp_get_timestamp_us().
+ */
+static void timestamp_timer_init(void)
+{
+	rcc_periph_clock_enable(RCC_TIM2);
+
+	timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+
+	// APB1 isn't divided, so the timers on it run at its frequency.
+	timer_set_prescaler(TIM2, rcc_apb1_frequency / 1000000 - 1);
+	timer_set_period(TIM2, UINT32_MAX);
+
+	// Load the prescaler.
+	timer_generate_event(TIM2, TIM_EGR_UG);
+
+	timer_enable_counter(TIM2);
+}
+
 void bsp_init(void)
 {
 	cm3_assert(!is_initialized);
@@ -106,11 +321,23 @@ void bsp_init(void)
 
 	led_init();
 
+	timestamp_timer_init();
+
 	comm_init();
 
 	is_initialized = true;
 }
 
+void bsp_set_rx_notify_callback(void (*callback)(void))
+{
+	rx_notify_callback = callback;
+}
+
+uint32_t bsp_get_timestamp_us(void)
+{
+	return timer_get_counter(TIM2);
+}
+
 bool bsp_led_get_state(enum board_led led)
 {
 	cm3_assert(is_initialized);
@@ -144,27 +371,94 @@ void bsp_led_toggle(enum board_led led)
  * Interrupt handler for the USART1 peripheral.
  *
  * If the interrupt was caused by a received character, the handler adds the
- * chararacter to the rx_buffer. If the interrupt was caused by the peripheral
- * being ready to send a character, the handler takes one from the tx_buffer,
- * and writes it to the peripheral. In case the interrupt was caused by a USART
- * peripheral buffer overrun (typically happens during debugging), the handler
- * clears that interrupt flag.
+ * chararacter to the rx_buffer, and notifies the message dispatcher once a
+ * whole line (or BSP_RX_NOTIFY_THRESHOLD characters) has been received. With
+ * BSP_UART_RX_DMA, characters are received by the DMA controller instead, and
+ * the handler only publishes them to the rx_buffer once the line goes idle.
+ * Without BSP_UART_TX_DMA, if the peripheral is ready to send a character
+ * while the TX interrupt is enabled, the handler takes one from the tx_buffer,
+ * and writes it to the peripheral. With it, the tx_buffer only ever gets
+ * drained by the DMA controller. Whenever a USART peripheral buffer overrun has
+ * happened (typically during debugging), the handler clears that interrupt
+ * flag, in either RX mode. Overruns, and received characters that don't fit
+ * into the rx_buffer, are counted in bsp_uart_stats.
  */
 void usart1_isr(void)
 {
+	// Unlike on the F4, reading the data register doesn't clear an overrun,
+	// so it gets handled on its own, whatever else raised the interrupt.
+	if (usart_get_flag(USART1, USART_ISR_ORE)) {
+		USART_ICR(USART1) |= USART_ICR_ORECF;
+		bsp_uart_stats.rx_overruns++;
+	}
+
+#ifdef BSP_UART_RX_DMA
+	if (usart_get_flag(USART1, USART_ISR_IDLE)) {
+		USART_ICR(USART1) |= USART_ICR_IDLECF;
+
+		rx_dma_publish();
+	}
+#else
 	if (usart_get_flag(USART1, USART_ISR_RXNE)) {
-		char ch = (char) usart_recv(USART1);
-		os_char_buffer_write_ch(&bsp_rx_buffer, ch);
+		uint8_t ch = (uint8_t) usart_recv(USART1);
+		if (!byte_ring_write_byte(&bsp_rx_buffer, ch)) {
+			bsp_uart_stats.rx_dropped++;
+		}
+
+		rx_chars_since_notify++;
+		if (ch == '\n' || rx_chars_since_notify >= BSP_RX_NOTIFY_THRESHOLD) {
+			rx_chars_since_notify = 0;
+
+			if (rx_notify_callback != NULL) {
+				rx_notify_callback();
+			}
+		}
+	}
+#endif
+
+#ifndef BSP_UART_TX_DMA
+	// TXE is set whenever the transmitter is idle, so it only asks for the
+	// next character while its interrupt is enabled.
+	if ((USART_CR1(USART1) & USART_CR1_TXEIE) &&
+	    usart_get_flag(USART1, USART_ISR_TXE)) {
 
-	} else if (usart_get_flag(USART1, USART_ISR_TXE)) {
-		char ch = '\0';
-		if (os_char_buffer_read_ch(&bsp_tx_buffer, &ch)) {
-			usart_send(USART1, (uint8_t) ch);
+		uint8_t byte = 0;
+		if (byte_ring_read_byte(&bsp_tx_buffer, &byte)) {
+			usart_send(USART1, byte);
 		} else {
 			usart_disable_tx_interrupt(USART1);
 		}
+	}
+#endif
+}
 
-	} else if (usart_get_flag(USART1, USART_ISR_ORE)) {
-		USART_ICR(USART1) |= USART_ICR_ORECF;
+#if defined(BSP_UART_RX_DMA) || defined(BSP_UART_TX_DMA)
+/**
+ * Interrupt handler shared by DMA1 channels 2 & 3. With BSP_UART_TX_DMA, once
+ * channel 2 has sent a batch of characters, the handler frees them in the
+ * tx_buffer, and starts sending the next batch. With BSP_UART_RX_DMA, each time
+ * channel 3 has filled a half of rx_dma_buffer, the handler publishes the
+ * received characters to the rx_buffer.
+ */
+void dma1_channel2_3_dma2_channel1_2_isr(void)
+{
+#ifdef BSP_UART_TX_DMA
+	if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL2, DMA_TCIF | DMA_TEIF)) {
+		dma_clear_interrupt_flags(DMA1, DMA_CHANNEL2, DMA_TCIF | DMA_TEIF);
+
+		byte_ring_consume(&bsp_tx_buffer, tx_dma_len);
+		tx_dma_len = 0;
+
+		tx_dma_start();
+	}
+#endif
+
+#ifdef BSP_UART_RX_DMA
+	if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL3, DMA_HTIF | DMA_TCIF)) {
+		dma_clear_interrupt_flags(DMA1, DMA_CHANNEL3, DMA_HTIF | DMA_TCIF);
+
+		rx_dma_publish();
 	}
+#endif
 }
+#endif
@@ -7,11 +7,33 @@
 #ifndef STM32F072_DISCOVERY_CONSTANTS_H_
 #define STM32F072_DISCOVERY_CONSTANTS_H_
 
-/** The size in bytes of the UART RX character buffer. See bsp_rx_buffer. */
-#define BSP_RX_BUFFER_SIZE 250
+/**
+ * The size in bytes of the UART RX ring. See bsp_rx_buffer. Must be a power of
+ * two.
+ */
+#define BSP_RX_BUFFER_SIZE 256
+
+/**
+ * The number of characters after which the UART RX interrupt handler notifies
+ * the message dispatcher, even if no '\n' has been received yet.
+ */
+#define BSP_RX_NOTIFY_THRESHOLD (BSP_RX_BUFFER_SIZE / 2)
+
+/**
+ * The size in bytes of the circular buffer the DMA controller receives UART
+ * characters into, when BSP_UART_RX_DMA is enabled. The characters are moved
+ * to bsp_rx_buffer each time half of it gets filled, or the line goes idle.
+ */
+#define BSP_RX_DMA_BUFFER_SIZE 64
 
-/** The size in bytes of the UART TX character buffer. See bsp_tx_buffer. */
-#define BSP_TX_BUFFER_SIZE 250
+/**
+ * The size in bytes of the UART TX ring. See bsp_tx_buffer. With
+ * BSP_UART_TX_DMA, the DMA controller sends the characters straight out of it.
+ * The dispatcher only writes a frame when a maximum length one would fit, so
+ * this is twice BSP_MAX_MESSAGE_LENGTH, rounded up to a power of two, to let it
+ * queue up more than one. Must be a power of two.
+ */
+#define BSP_TX_BUFFER_SIZE 512
 
 /**
  * The size in bytes of the maximum size a single message sent over the UART can
@@ -19,11 +41,61 @@
  */
 #define BSP_MAX_MESSAGE_LENGTH 250
 
+/**
+ * The size in bytes of the longest message that can be received in fragments,
+ * once reassembled. Excluding the framing characters and the fragment headers.
+ * Enough for a SPINNER SET_PLAN message with all of its 20 legs, which don't
+ * fit into a single frame. The RX worker keeps a buffer of this size for good,
+ * 250 bytes more than a frame would take.
+ */
+#define BSP_MAX_REASSEMBLED_LENGTH 500
+
+/**
+ * The maximum number of comma separated fields in a single incoming message,
+ * including the transaction ID, subsystem name and message name. Enough for
+ * a SPINNER SET_PLAN message with all of its 20 legs.
+ */
+#define BSP_MAX_MESSAGE_FIELDS 48
+
+/**
+ * The number of small slots of the message slab, shared by all subsystems. See
+ * message_slab.h. Together with the large slot, the slab takes 320 bytes, about
+ * half of what Spinner's own pools used to take.
+ */
+#define MESSAGE_SLAB_SMALL_SLOTS 5
+
+/**
+ * The number of large slots of the message slab, shared by all subsystems. A
+ * single one is enough for Spinner, unless a SET_PLAN and a plan reply overlap.
+ */
+#define MESSAGE_SLAB_LARGE_SLOTS 1
+
+/**
+ * The payload size of the large slots of the message slab, in bytes. Fits a
+ * Spinner spin plan of 20 legs.
+ */
+#define MESSAGE_SLAB_LARGE_PAYLOAD_SIZE 168
+
+/**
+ * The number of UART links the message dispatcher talks over, see bsp_links.
+ * There's only RAM for the workers of one.
+ */
+#ifdef BSP_SECOND_LINK
+#error "The STM32F072 Discovery has no second link."
+#endif
+#define BSP_NUM_LINKS 1
+
 /**
  * The stack size of the individual tasks.
  */
 #define TASK_STACK_SIZE 2000
 
+/**
+ * The stack size of the message dispatcher's TX task. Frames are serialized
+ * straight into bsp_tx_buffer, so it needs less than the other tasks.
+ */
+#define TX_TASK_STACK_SIZE 1750
+
 
 #endif /* STM32F072_DISCOVERY_CONSTANTS_H_ */
 
@@ -20,6 +20,7 @@
 
 #include <mouros/common.h> // For ARRAY_SIZE()
 #include <mouros/tasks.h> // For os_set_diagnostics()
+#include <mouros/char_buffer.h> // For the diagnostics TX buffer.
 
 #include <libopencm3/cm3/cortex.h> // For the critical section macros.
 
@@ -36,15 +37,38 @@ static uint16_t led_pin_lut[] = {
 	GPIO12 /** Green */
 };
 
-mailbox_t bsp_rx_buffer;
-static char rx_buffer_mem[BSP_RX_BUFFER_SIZE];
+struct byte_ring bsp_rx_buffer;
+static uint8_t rx_buffer_mem[BSP_RX_BUFFER_SIZE];
 
-mailbox_t bsp_tx_buffer;
-static char tx_buffer_mem[BSP_TX_BUFFER_SIZE];
+struct byte_ring bsp_tx_buffer;
+static uint8_t tx_buffer_mem[BYTE_RING_MEM_SIZE(BSP_TX_BUFFER_SIZE, BSP_TX_MAX_RESERVATION)];
 
+volatile struct bsp_uart_stats bsp_uart_stats;
+
+static void (*rx_notify_callback)(void) = NULL;
+static uint32_t rx_chars_since_notify = 0;
+
+#ifdef BSP_UART_RX_DMA
+static uint8_t rx_dma_buffer[BSP_RX_DMA_BUFFER_SIZE];
+static uint32_t rx_dma_read_pos = 0;
+
+static void rx_dma_init(void);
+static void rx_dma_publish(void);
+#endif
+
+#ifdef BSP_UART_TX_DMA
+/** The length of the transfer in progress, 0 if there isn't one. */
+static uint32_t tx_dma_len = 0;
+
+static void tx_dma_init(void);
+static void tx_dma_start(void);
+#endif
+
+#ifndef BSP_UART_TX_DMA
 static void enable_usart2_tx_interrupt(void) {
 	usart_enable_tx_interrupt(USART2);
 }
+#endif
 
 #ifdef DIAG_ENABLE
 mailbox_t diag_tx_buffer;
@@ -64,6 +88,35 @@ static void diag_error_func(void)
 }
 #endif
 
+#ifdef BSP_SECOND_LINK
+#ifdef DIAG_ENABLE
+#error "The second link takes USART6 over from the MourOS diagnostics."
+#endif
+
+static struct byte_ring second_rx_buffer;
+static uint8_t second_rx_buffer_mem[BSP_RX_BUFFER_SIZE];
+
+static struct byte_ring second_tx_buffer;
+static uint8_t second_tx_buffer_mem[BYTE_RING_MEM_SIZE(BSP_TX_BUFFER_SIZE, BSP_TX_MAX_RESERVATION)];
+
+static volatile struct bsp_uart_stats second_uart_stats;
+
+static uint32_t second_rx_chars_since_notify = 0;
+
+static void second_link_init(void);
+
+static void enable_usart6_tx_interrupt(void) {
+	usart_enable_tx_interrupt(USART6);
+}
+#endif
+
+const struct bsp_link bsp_links[BSP_NUM_LINKS] = {
+	{ &bsp_rx_buffer, &bsp_tx_buffer, &bsp_uart_stats },
+#ifdef BSP_SECOND_LINK
+	{ &second_rx_buffer, &second_tx_buffer, &second_uart_stats }
+#endif
+};
+
 /**
  * Initializes the clocks and GPIOS for the LEDs to work.
  */
@@ -86,15 +139,21 @@ static void led_init(void)
  */
 static void comm_init(void)
 {
-	os_char_buffer_init(&bsp_rx_buffer,
-	                    rx_buffer_mem,
-	                    BSP_RX_BUFFER_SIZE,
-	                    NULL);
-
-	os_char_buffer_init(&bsp_tx_buffer,
-	                    tx_buffer_mem,
-	                    BSP_TX_BUFFER_SIZE,
-	                    enable_usart2_tx_interrupt);
+	byte_ring_init(&bsp_rx_buffer,
+	               rx_buffer_mem,
+	               BSP_RX_BUFFER_SIZE,
+	               0,
+	               NULL);
+
+	byte_ring_init(&bsp_tx_buffer,
+	               tx_buffer_mem,
+	               BSP_TX_BUFFER_SIZE,
+	               BSP_TX_MAX_RESERVATION,
+#ifdef BSP_UART_TX_DMA
+	               tx_dma_start);
+#else
+	               enable_usart2_tx_interrupt);
+#endif
 
 	rcc_periph_clock_enable(RCC_GPIOA);
 
@@ -103,14 +162,26 @@ static void comm_init(void)
 	gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_PULLUP, GPIO2 | GPIO3);
 	gpio_set_af(GPIOA, GPIO_AF7, GPIO2 | GPIO3);
 
-	usart_set_baudrate(USART2, 115200);
+	usart_set_baudrate(USART2, BSP_UART_BAUD_RATE);
 	usart_set_databits(USART2, 8);
 	usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE);
 	usart_set_mode(USART2, USART_MODE_TX_RX);
 	usart_set_parity(USART2, USART_PARITY_NONE);
 	usart_set_stopbits(USART2, USART_CR2_STOPBITS_1);
 
+#ifdef BSP_UART_RX_DMA
+	rx_dma_init();
+
+	// The IDLE line interrupt publishes whatever arrived before the line went
+	// quiet.
+	USART_CR1(USART2) |= USART_CR1_IDLEIE;
+#else
 	usart_enable_rx_interrupt(USART2);
+#endif
+
+#ifdef BSP_UART_TX_DMA
+	tx_dma_init();
+#endif
 
 	usart_enable(USART2);
 
@@ -144,6 +215,231 @@ static void comm_init(void)
 	nvic_set_priority(NVIC_USART6_IRQ, 0);
 	nvic_enable_irq(NVIC_USART6_IRQ);
 #endif
+
+#ifdef BSP_SECOND_LINK
+	second_link_init();
+#endif
+}
+
+#ifdef BSP_SECOND_LINK
+/**
+ * Initializes USART6 (PC6 TX, PC7 RX) as the second link, set up like the
+ * interrupt driven USART2.
+ */
+static void second_link_init(void)
+{
+	byte_ring_init(&second_rx_buffer,
+	               second_rx_buffer_mem,
+	               BSP_RX_BUFFER_SIZE,
+	               0,
+	               NULL);
+
+	byte_ring_init(&second_tx_buffer,
+	               second_tx_buffer_mem,
+	               BSP_TX_BUFFER_SIZE,
+	               BSP_TX_MAX_RESERVATION,
+	               enable_usart6_tx_interrupt);
+
+	rcc_periph_clock_enable(RCC_GPIOC);
+
+	rcc_periph_clock_enable(RCC_USART6);
+
+	gpio_mode_setup(GPIOC, GPIO_MODE_AF, GPIO_PUPD_PULLUP, GPIO6 | GPIO7);
+	gpio_set_af(GPIOC, GPIO_AF8, GPIO6 | GPIO7);
+
+	usart_set_baudrate(USART6, BSP_UART_BAUD_RATE);
+	usart_set_databits(USART6, 8);
+	usart_set_flow_control(USART6, USART_FLOWCONTROL_NONE);
+	usart_set_mode(USART6, USART_MODE_TX_RX);
+	usart_set_parity(USART6, USART_PARITY_NONE);
+	usart_set_stopbits(USART6, USART_CR2_STOPBITS_1);
+
+	usart_enable_rx_interrupt(USART6);
+
+	usart_enable(USART6);
+
+	nvic_set_priority(NVIC_USART6_IRQ, 0);
+	nvic_enable_irq(NVIC_USART6_IRQ);
+}
+#endif
+
+#ifdef BSP_UART_RX_DMA
+/**
+ * Sets up DMA1 stream 5 (channel 4 - USART2_RX) to continuously copy received
+ * characters into rx_dma_buffer, wrapping around at its end.
+ */
+static void rx_dma_init(void)
+{
+	rcc_periph_clock_enable(RCC_DMA1);
+
+	dma_stream_reset(DMA1, DMA_STREAM5);
+
+	dma_set_priority(DMA1, DMA_STREAM5, DMA_SxCR_PL_HIGH);
+
+	dma_set_memory_size(DMA1, DMA_STREAM5, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(DMA1, DMA_STREAM5, DMA_SxCR_PSIZE_8BIT);
+
+	dma_enable_memory_increment_mode(DMA1, DMA_STREAM5);
+	dma_disable_peripheral_increment_mode(DMA1, DMA_STREAM5);
+	dma_enable_circular_mode(DMA1, DMA_STREAM5);
+
+	dma_set_transfer_mode(DMA1, DMA_STREAM5, DMA_SxCR_DIR_PERIPHERAL_TO_MEM);
+
+	dma_set_peripheral_address(DMA1, DMA_STREAM5, (uint32_t) &USART2_DR);
+	dma_set_memory_address(DMA1, DMA_STREAM5, (uint32_t) rx_dma_buffer);
+
+	dma_set_number_of_data(DMA1, DMA_STREAM5, ARRAY_SIZE(rx_dma_buffer));
+
+	dma_enable_direct_mode(DMA1, DMA_STREAM5);
+
+	dma_channel_select(DMA1, DMA_STREAM5, DMA_SxCR_CHSEL_4);
+
+	dma_clear_interrupt_flags(DMA1, DMA_STREAM5,
+			DMA_TCIF | DMA_HTIF | DMA_TEIF | DMA_DMEIF | DMA_FEIF);
+
+	dma_enable_half_transfer_interrupt(DMA1, DMA_STREAM5);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_STREAM5);
+
+	// Same priority as the USART2 interrupt, so that the two never preempt
+	// each other in rx_dma_publish().
+	nvic_set_priority(NVIC_DMA1_STREAM5_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA1_STREAM5_IRQ);
+
+	dma_enable_stream(DMA1, DMA_STREAM5);
+
+	usart_enable_rx_dma(USART2);
+}
+
+/**
+ * Moves the characters the DMA controller wrote into rx_dma_buffer since the
+ * last call into bsp_rx_buffer, and notifies the message dispatcher.
+ *
+ * Called from the USART2 IDLE line, and the DMA half & full transfer
+ * interrupts.
+ */
+static void rx_dma_publish(void)
+{
+	uint32_t write_pos = ARRAY_SIZE(rx_dma_buffer) -
+	                     dma_get_number_of_data(DMA1, DMA_STREAM5);
+
+	if (write_pos >= ARRAY_SIZE(rx_dma_buffer)) {
+		write_pos = 0;
+	}
+
+	if (write_pos == rx_dma_read_pos) {
+		return;
+	}
+
+	// Data wrapped around the end of the buffer.
+	if (write_pos < rx_dma_read_pos) {
+		uint32_t tail_len = ARRAY_SIZE(rx_dma_buffer) - rx_dma_read_pos;
+		bsp_uart_stats.rx_dropped += tail_len -
+			byte_ring_write_some(&bsp_rx_buffer,
+			                     &rx_dma_buffer[rx_dma_read_pos],
+			                     tail_len);
+		rx_dma_read_pos = 0;
+	}
+
+	uint32_t len = write_pos - rx_dma_read_pos;
+	bsp_uart_stats.rx_dropped += len -
+		byte_ring_write_some(&bsp_rx_buffer,
+		                     &rx_dma_buffer[rx_dma_read_pos],
+		                     len);
+	rx_dma_read_pos = write_pos;
+
+	if (rx_notify_callback != NULL) {
+		rx_notify_callback();
+	}
+}
+#endif
+
+#ifdef BSP_UART_TX_DMA
+/**
+ * Sets up DMA1 stream 6 (channel 4 - USART2_TX) for sending characters straight
+ * out of bsp_tx_buffer. The transfers themselves are started by tx_dma_start().
+ */
+static void tx_dma_init(void)
+{
+	rcc_periph_clock_enable(RCC_DMA1);
+
+	dma_stream_reset(DMA1, DMA_STREAM6);
+
+	dma_set_priority(DMA1, DMA_STREAM6, DMA_SxCR_PL_MEDIUM);
+
+	dma_set_memory_size(DMA1, DMA_STREAM6, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(DMA1, DMA_STREAM6, DMA_SxCR_PSIZE_8BIT);
+
+	dma_enable_memory_increment_mode(DMA1, DMA_STREAM6);
+	dma_disable_peripheral_increment_mode(DMA1, DMA_STREAM6);
+
+	dma_set_transfer_mode(DMA1, DMA_STREAM6, DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+
+	dma_set_peripheral_address(DMA1, DMA_STREAM6, (uint32_t) &USART2_DR);
+
+	dma_enable_direct_mode(DMA1, DMA_STREAM6);
+
+	dma_channel_select(DMA1, DMA_STREAM6, DMA_SxCR_CHSEL_4);
+
+	dma_clear_interrupt_flags(DMA1, DMA_STREAM6,
+			DMA_TCIF | DMA_HTIF | DMA_TEIF | DMA_DMEIF | DMA_FEIF);
+
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_STREAM6);
+
+	nvic_set_priority(NVIC_DMA1_STREAM6_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA1_STREAM6_IRQ);
+
+	usart_enable_tx_dma(USART2);
+}
+
+/**
+ * Starts a DMA transfer of the contiguous run of characters waiting in
+ * bsp_tx_buffer, unless one is already in progress. The characters stay in the
+ * ring until the transfer is complete.
+ *
+ * Used as the bsp_tx_buffer write callback, and called from the transfer
+ * complete interrupt to re-arm the DMA stream.
+ */
+static void tx_dma_start(void)
+{
+	CM_ATOMIC_CONTEXT();
+
+	if (tx_dma_len != 0) {
+		return;
+	}
+
+	const uint8_t *data = NULL;
+	uint32_t len = byte_ring_peek(&bsp_tx_buffer, &data);
+	if (len == 0) {
+		return;
+	}
+
+	// The transfer length register is only 16 bits wide.
+	tx_dma_len = (len > UINT16_MAX) ? UINT16_MAX : len;
+
+	dma_set_memory_address(DMA1, DMA_STREAM6, (uint32_t) data);
+	dma_set_number_of_data(DMA1, DMA_STREAM6, (uint16_t) tx_dma_len);
+	dma_enable_stream(DMA1, DMA_STREAM6);
+}
+#endif
+
+/**
+ * Sets up TIM2 as a free running 32 bit microsecond counter for
+ * bsp_get_timestamp_us().
+ */
+static void timestamp_timer_init(void)
+{
+	rcc_periph_clock_enable(RCC_TIM2);
+
+	timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+
+	// APB1 is divided by 2, so the timers on it run at twice its frequency.
+	timer_set_prescaler(TIM2, 2 * rcc_apb1_frequency / 1000000 - 1);
+	timer_set_period(TIM2, UINT32_MAX);
+
+	// Load the prescaler.
+	timer_generate_event(TIM2, TIM_EGR_UG);
+
+	timer_enable_counter(TIM2);
 }
 
 void bsp_init(void)
@@ -172,6 +468,8 @@ void bsp_init(void)
 
 	led_init();
 
+	timestamp_timer_init();
+
 	comm_init();
 
 #ifdef DIAG_ENABLE
@@ -183,6 +481,16 @@ void bsp_init(void)
 	is_initialized = true;
 }
 
+void bsp_set_rx_notify_callback(void (*callback)(void))
+{
+	rx_notify_callback = callback;
+}
+
+uint32_t bsp_get_timestamp_us(void)
+{
+	return timer_get_counter(TIM2);
+}
+
 bool bsp_led_get_state(enum board_led led)
 {
 	cm3_assert(is_initialized);
@@ -216,29 +524,89 @@ void bsp_led_toggle(enum board_led led)
  * Interrupt handler for the USART2 peripheral.
  *
  * If the interrupt was caused by a received character, the handler adds the
- * chararacter to the rx_buffer. If the interrupt was caused by the peripheral
- * being ready to send a character, the handler takes one from the tx_buffer,
- * and writes it to the peripheral. In case the interrupt was caused by a USART
+ * chararacter to the rx_buffer, and notifies the message dispatcher once a
+ * whole line (or BSP_RX_NOTIFY_THRESHOLD characters) has been received. With
+ * BSP_UART_RX_DMA, characters are received by the DMA controller instead, and
+ * the handler only publishes them to the rx_buffer once the line goes idle.
+ * Without BSP_UART_TX_DMA, if the peripheral is ready to send a character
+ * while the TX interrupt is enabled, the handler takes one from the tx_buffer,
+ * and writes it to the peripheral. With it, the tx_buffer only ever gets
+ * drained by the DMA controller. In case the interrupt was caused by a USART
  * peripheral buffer overrun (typically happens during debugging), the handler
  * clears that interrupt flag by reading the data register and trying to write
- * it into the rx_buffer.
+ * it into the rx_buffer. Overruns, and received characters that don't fit into
+ * the rx_buffer, are counted in bsp_uart_stats.
  */
 void usart2_isr(void)
 {
+#ifdef BSP_UART_RX_DMA
+	if (usart_get_flag(USART2, USART_SR_IDLE)) {
+		if (usart_get_flag(USART2, USART_SR_ORE)) {
+			bsp_uart_stats.rx_overruns++;
+		}
+
+		// The IDLE & ORE flags get cleared by reading SR followed by DR.
+		(void) USART_DR(USART2);
+
+		rx_dma_publish();
+	}
+#else
 	if (usart_get_flag(USART2, USART_SR_RXNE) ||
 	    usart_get_flag(USART2, USART_SR_ORE)) {
-		char ch = (char) usart_recv(USART2);
-		os_char_buffer_write_ch(&bsp_rx_buffer, ch);
+		if (usart_get_flag(USART2, USART_SR_ORE)) {
+			bsp_uart_stats.rx_overruns++;
+		}
 
-	} else if (usart_get_flag(USART2, USART_SR_TXE)) {
-		char ch = '\0';
-		if (os_char_buffer_read_ch(&bsp_tx_buffer, &ch)) {
-			usart_send(USART2, (uint8_t) ch);
+		uint8_t ch = (uint8_t) usart_recv(USART2);
+		if (!byte_ring_write_byte(&bsp_rx_buffer, ch)) {
+			bsp_uart_stats.rx_dropped++;
+		}
+
+		rx_chars_since_notify++;
+		if (ch == '\n' || rx_chars_since_notify >= BSP_RX_NOTIFY_THRESHOLD) {
+			rx_chars_since_notify = 0;
+
+			if (rx_notify_callback != NULL) {
+				rx_notify_callback();
+			}
+		}
+	}
+#endif
+
+#ifndef BSP_UART_TX_DMA
+	// TXE is set whenever the transmitter is idle, so it only asks for the
+	// next character while its interrupt is enabled.
+	if ((USART_CR1(USART2) & USART_CR1_TXEIE) &&
+	    usart_get_flag(USART2, USART_SR_TXE)) {
+
+		uint8_t byte = 0;
+		if (byte_ring_read_byte(&bsp_tx_buffer, &byte)) {
+			usart_send(USART2, byte);
 		} else {
 			usart_disable_tx_interrupt(USART2);
 		}
 	}
+#endif
+}
+
+#ifdef BSP_UART_RX_DMA
+/**
+ * Interrupt handler for DMA1 stream 5 (USART2 RX). Publishes the received
+ * characters each time the DMA controller fills a half of rx_dma_buffer.
+ */
+void dma1_stream5_isr(void)
+{
+	if (dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_HTIF)) {
+		dma_clear_interrupt_flags(DMA1, DMA_STREAM5, DMA_HTIF);
+	}
+
+	if (dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_TCIF)) {
+		dma_clear_interrupt_flags(DMA1, DMA_STREAM5, DMA_TCIF);
+	}
+
+	rx_dma_publish();
 }
+#endif
 
 #ifdef DIAG_ENABLE
 void usart6_isr(void)
@@ -252,4 +620,61 @@ void usart6_isr(void)
 		}
 	}
 }
-#endif
\ No newline at end of file
+#endif
+
+#ifdef BSP_SECOND_LINK
+/**
+ * Interrupt handler for the USART6 peripheral of the second link. Works like the
+ * interrupt driven usart2_isr(), on the buffers & counters of the second link.
+ */
+void usart6_isr(void)
+{
+	if (usart_get_flag(USART6, USART_SR_RXNE) ||
+	    usart_get_flag(USART6, USART_SR_ORE)) {
+		if (usart_get_flag(USART6, USART_SR_ORE)) {
+			second_uart_stats.rx_overruns++;
+		}
+
+		uint8_t ch = (uint8_t) usart_recv(USART6);
+		if (!byte_ring_write_byte(&second_rx_buffer, ch)) {
+			second_uart_stats.rx_dropped++;
+		}
+
+		second_rx_chars_since_notify++;
+		if (ch == '\n' ||
+		    second_rx_chars_since_notify >= BSP_RX_NOTIFY_THRESHOLD) {
+			second_rx_chars_since_notify = 0;
+
+			if (rx_notify_callback != NULL) {
+				rx_notify_callback();
+			}
+		}
+
+	} else if (usart_get_flag(USART6, USART_SR_TXE)) {
+		uint8_t byte = 0;
+		if (byte_ring_read_byte(&second_tx_buffer, &byte)) {
+			usart_send(USART6, byte);
+		} else {
+			usart_disable_tx_interrupt(USART6);
+		}
+	}
+}
+#endif
+
+#ifdef BSP_UART_TX_DMA
+/**
+ * Interrupt handler for DMA1 stream 6 (USART2 TX). Frees the sent characters in
+ * the tx_buffer, and sends the next batch once the previous one is out.
+ */
+void dma1_stream6_isr(void)
+{
+	if (dma_get_interrupt_flag(DMA1, DMA_STREAM6, DMA_TCIF | DMA_TEIF)) {
+		dma_clear_interrupt_flags(DMA1, DMA_STREAM6, DMA_TCIF | DMA_TEIF);
+
+		byte_ring_consume(&bsp_tx_buffer, tx_dma_len);
+		tx_dma_len = 0;
+
+		tx_dma_start();
+	}
+}
+#endif
@@ -7,11 +7,33 @@
 #ifndef STM32F411_DISCOVERY_CONSTANTS_H_
 #define STM32F411_DISCOVERY_CONSTANTS_H_
 
-/** The size in bytes of the UART RX character buffer. See bsp_rx_buffer. */
-#define BSP_RX_BUFFER_SIZE 1000
+/**
+ * The size in bytes of the UART RX ring. See bsp_rx_buffer. Must be a power of
+ * two.
+ */
+#define BSP_RX_BUFFER_SIZE 1024
+
+/**
+ * The number of characters after which the UART RX interrupt handler notifies
+ * the message dispatcher, even if no '\n' has been received yet.
+ */
+#define BSP_RX_NOTIFY_THRESHOLD (BSP_RX_BUFFER_SIZE / 2)
+
+/**
+ * The size in bytes of the circular buffer the DMA controller receives UART
+ * characters into, when BSP_UART_RX_DMA is enabled. The characters are moved
+ * to bsp_rx_buffer each time half of it gets filled, or the line goes idle.
+ */
+#define BSP_RX_DMA_BUFFER_SIZE 256
 
-/** The size in bytes of the UART TX character buffer. See bsp_tx_buffer. */
-#define BSP_TX_BUFFER_SIZE 1000
+/**
+ * The size in bytes of the UART TX ring. See bsp_tx_buffer. With
+ * BSP_UART_TX_DMA, the DMA controller sends the characters straight out of it.
+ * The dispatcher only writes a frame when a maximum length one would fit, so
+ * this is twice BSP_MAX_MESSAGE_LENGTH, rounded up to a power of two, to let it
+ * queue up more than one. Must be a power of two.
+ */
+#define BSP_TX_BUFFER_SIZE 2048
 
 /**
  * The size in bytes of the maximum size a single message sent over the UART can
@@ -19,11 +41,59 @@
  */
 #define BSP_MAX_MESSAGE_LENGTH 1000
 
+/**
+ * The size in bytes of the longest message that can be received in fragments,
+ * once reassembled. Excluding the framing characters and the fragment headers.
+ * Enough for a SPINNER SET_PLAN message with all of its 100 legs.
+ */
+#define BSP_MAX_REASSEMBLED_LENGTH 2000
+
+/**
+ * The maximum number of comma separated fields in a single incoming message,
+ * including the transaction ID, subsystem name and message name. Enough for
+ * a SPINNER SET_PLAN message with all of its 100 legs.
+ */
+#define BSP_MAX_MESSAGE_FIELDS 208
+
+/**
+ * The number of small slots of the message slab, shared by all subsystems. See
+ * message_slab.h.
+ */
+#define MESSAGE_SLAB_SMALL_SLOTS 40
+
+/**
+ * The number of large slots of the message slab, shared by all subsystems.
+ */
+#define MESSAGE_SLAB_LARGE_SLOTS 5
+
+/**
+ * The payload size of the large slots of the message slab, in bytes. Fits a
+ * Spinner spin plan of 100 legs.
+ */
+#define MESSAGE_SLAB_LARGE_PAYLOAD_SIZE 808
+
+/**
+ * The number of UART links the message dispatcher talks over, see bsp_links.
+ * With BSP_SECOND_LINK, USART6 is a second link, instead of sending the MourOS
+ * diagnostics.
+ */
+#ifdef BSP_SECOND_LINK
+#define BSP_NUM_LINKS 2
+#else
+#define BSP_NUM_LINKS 1
+#endif
+
 /**
  * The stack size of the individual tasks.
  */
 #define TASK_STACK_SIZE 4000
 
+/**
+ * The stack size of the message dispatcher's TX task. Frames are serialized
+ * straight into bsp_tx_buffer, so it needs less than the other tasks.
+ */
+#define TX_TASK_STACK_SIZE 3000
+
 
 #endif /* STM32F411_DISCOVERY_CONSTANTS_H_ */
 
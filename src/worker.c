@@ -26,6 +26,7 @@ bool worker_task_init(worker_t *worker,
 {
 	worker->action = action;
 	worker->params = action_params;
+	worker->notified = false;
 
 	return os_task_init(&(worker->task),
 	                    name, stack_base, stack_size, priority,
@@ -49,3 +50,19 @@ void worker_join(worker_t *worker)
 {
 	while (worker->task.state != TASK_STOPPED);
 }
+
+void worker_wait(worker_t *worker, uint32_t max_ticks)
+{
+	// MourOS can't wake up a sleeping task early, so a notification can
+	// only skip the sleep, not cut it short.
+	if (!worker->notified) {
+		os_task_sleep(max_ticks);
+	}
+
+	worker->notified = false;
+}
+
+void worker_notify(worker_t *worker)
+{
+	worker->notified = true;
+}
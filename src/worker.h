@@ -17,6 +17,7 @@ typedef struct worker {
 	void (*action)(void *);
 	void *params;
 	bool stop_flag;
+	volatile bool notified;
 } worker_t;
 
 bool worker_task_init(worker_t *worker,
@@ -31,6 +32,27 @@ bool worker_start(worker_t *worker);
 void worker_stop(worker_t *worker);
 void worker_join(worker_t *worker);
 
+/**
+ * Puts the calling worker to sleep for max_ticks OS ticks, unless
+ * worker_notify() has been called for it since its last wait, in which case
+ * it returns immediately.
+ *
+ * @param worker    The worker that is waiting. Must be the calling one.
+ * @param max_ticks The maximum number of OS ticks to wait for.
+ */
+void worker_wait(worker_t *worker, uint32_t max_ticks);
+
+/**
+ * Makes the next call to worker_wait() of the worker return immediately. A
+ * worker that is already sleeping in worker_wait() doesn't get woken up early,
+ * it picks the notification up once its sleep is over.
+ *
+ * @note Safe to call from interrupt handlers.
+ *
+ * @param worker The worker to be woken up.
+ */
+void worker_notify(worker_t *worker);
+
 
 #endif /* WORKER_H_ */
 
@@ -0,0 +1,495 @@
+/**
+ * @file
+ *
+ * This file contains the host-side benchmarks of the message dispatcher, and
+ * the Spinner message codecs. Synthetic frames get pushed through the RX and
+ * TX workers, the same way the UART ISRs and the subsystem tasks would, and
+ * the throughput is reported per message type and protocol: frames per
+ * second, nanoseconds per byte on the wire, and message allocations per frame.
+ *
+ * Usage: bench_dispatcher [--frames <frames per benchmark>] [--json]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#include "../src/binary_fields.h"
+#include "../src/bsp.h"
+#include "../src/byte_ring.h"
+#include "../src/cobs.h"
+#include "../src/constants.h"
+#include "../src/message_dispatcher.h"
+#include "../src/worker.h"
+#include "../src/spinner/spinner.h"
+
+#define DEFAULT_NUM_FRAMES 1000000
+
+#define BENCH_RX_RING_SIZE 2048
+#define BENCH_TX_RING_SIZE 8192
+
+#define MAX_BENCH_WORKERS 4
+
+/** The number of legs in the plans sent & received. */
+#define BENCH_PLAN_LEGS 4
+
+void spinner_rust_init(struct subsystem_message_conf *conf);
+void spinner_comm_loop(void *params);
+
+
+/*
+ * The BSP, as seen by the dispatcher.
+ */
+
+struct byte_ring bsp_rx_buffer;
+static uint8_t rx_buffer_data[BENCH_RX_RING_SIZE];
+
+struct byte_ring bsp_tx_buffer;
+static uint8_t tx_buffer_data[BYTE_RING_MEM_SIZE(BENCH_TX_RING_SIZE, BSP_TX_MAX_RESERVATION)];
+
+volatile struct bsp_uart_stats bsp_uart_stats;
+
+const struct bsp_link bsp_links[BSP_NUM_LINKS] = {
+	{ &bsp_rx_buffer, &bsp_tx_buffer, &bsp_uart_stats }
+};
+
+void bsp_set_rx_notify_callback(void (*callback)(void))
+{
+	(void) callback;
+}
+
+uint32_t bsp_get_timestamp_us(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint32_t) now.tv_sec * 1000000 + (uint32_t) (now.tv_nsec / 1000);
+}
+
+
+/*
+ * Workers don't run on their own here. Their actions get called by the
+ * benchmarks instead, so waiting & notifying are no-ops.
+ */
+
+static struct bench_worker {
+	const char *name;
+	void (*action)(void *);
+	void *action_params;
+} workers[MAX_BENCH_WORKERS];
+
+static uint32_t num_workers = 0;
+
+bool worker_task_init(worker_t *worker,
+                      const char *name,
+                      uint8_t *stack_base,
+                      uint32_t stack_size,
+                      uint8_t priority,
+                      void (*action)(void *),
+                      void *action_params)
+{
+	(void) worker;
+	(void) stack_base;
+	(void) stack_size;
+	(void) priority;
+
+	if (num_workers >= MAX_BENCH_WORKERS) {
+		return false;
+	}
+
+	workers[num_workers].name = name;
+	workers[num_workers].action = action;
+	workers[num_workers].action_params = action_params;
+	num_workers++;
+
+	return true;
+}
+
+bool worker_start(worker_t *worker)
+{
+	(void) worker;
+	return true;
+}
+
+void worker_stop(worker_t *worker)
+{
+	(void) worker;
+}
+
+void worker_join(worker_t *worker)
+{
+	(void) worker;
+}
+
+void worker_wait(worker_t *worker, uint32_t max_ticks)
+{
+	(void) worker;
+	(void) max_ticks;
+}
+
+void worker_notify(worker_t *worker)
+{
+	(void) worker;
+}
+
+static struct bench_worker *find_worker(const char *name)
+{
+	for (uint32_t i = 0; i < num_workers; i++) {
+		if (strcmp(workers[i].name, name) == 0) {
+			return &workers[i];
+		}
+	}
+
+	fprintf(stderr, "No worker called %s\n", name);
+	exit(EXIT_FAILURE);
+}
+
+static void run_worker(struct bench_worker *worker)
+{
+	worker->action(worker->action_params);
+}
+
+
+/*
+ * The Spinner's Rust half isn't built for the host. Its init function hands
+ * over the subsystem configuration, which the benchmarks use for getting at
+ * the Spinner's queues.
+ */
+
+static struct subsystem_message_conf *spinner_conf = NULL;
+static struct message *(*spinner_alloc)(uint32_t msg_type_id) = NULL;
+static uint64_t num_allocs = 0;
+
+static struct message *counting_alloc(uint32_t msg_type_id)
+{
+	num_allocs++;
+	return spinner_alloc(msg_type_id);
+}
+
+void spinner_rust_init(struct subsystem_message_conf *conf)
+{
+	spinner_conf = conf;
+
+	spinner_alloc = conf->alloc_message;
+	conf->alloc_message = counting_alloc;
+}
+
+void spinner_comm_loop(void *params)
+{
+	(void) params;
+}
+
+
+/*
+ * Frames
+ */
+
+static uint32_t build_ascii_frame(char *frame, uint32_t frame_size, const char *body)
+{
+	uint8_t csum = 0;
+	for (const char *ch = body; *ch != '\0'; ch++) {
+		csum ^= (uint8_t) *ch;
+	}
+
+	int len = snprintf(frame, frame_size, "$%s*%02X\r\n", body, csum);
+	if (len < 0 || (uint32_t) len >= frame_size) {
+		fprintf(stderr, "Frame too long: %s\n", body);
+		exit(EXIT_FAILURE);
+	}
+
+	return (uint32_t) len;
+}
+
+static uint32_t build_binary_frame(uint8_t *encoded_frame,
+                                   uint32_t encoded_frame_size,
+                                   uint32_t transaction_id,
+                                   uint8_t subsystem_id,
+                                   uint8_t message_id,
+                                   const uint8_t *payload,
+                                   uint32_t payload_len)
+{
+	uint8_t frame[BSP_MAX_MESSAGE_LENGTH];
+
+	bin_put_u32(&frame[0], transaction_id);
+	frame[4] = subsystem_id;
+	frame[5] = message_id;
+	memcpy(&frame[6], payload, payload_len);
+	bin_put_u16(&frame[6 + payload_len], crc16_ccitt(frame, 6 + payload_len));
+
+	return cobs_encode(frame, 8 + payload_len, encoded_frame, encoded_frame_size);
+}
+
+static void fill_plan_data(void *msg_data)
+{
+	struct spin_plan_data *data = msg_data;
+
+	data->channel_num = 1;
+	data->plan_leg_count = BENCH_PLAN_LEGS;
+
+	for (uint32_t i = 0; i < BENCH_PLAN_LEGS; i++) {
+		data->plan_legs[i].duration_msecs = 1000 * (i + 1);
+		data->plan_legs[i].target_pct = 12.5f * (float) (i + 1);
+	}
+}
+
+static void fill_state_data(void *msg_data)
+{
+	struct spin_state_data *data = msg_data;
+
+	data->channel_num = 1;
+	data->state = SPINNER_STATE_RUNNING;
+	data->plan_time_elapsed_msecs = 123456;
+	data->output_val_pct = 42.125f;
+}
+
+
+/*
+ * Benchmarks
+ */
+
+struct bench_result {
+	const char *name;
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t allocs;
+	double seconds;
+};
+
+static double now_seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * Receives the same frame num_frames times. Every frame must end up in the
+ * Spinner's incoming queue.
+ */
+static void bench_rx(struct bench_result *result,
+                     const char *name,
+                     const char *frame,
+                     uint32_t frame_len,
+                     uint64_t num_frames)
+{
+	struct bench_worker *rx_worker = find_worker("rx_worker");
+
+	uint64_t start_allocs = num_allocs;
+	double start = now_seconds();
+
+	for (uint64_t i = 0; i < num_frames; i++) {
+		byte_ring_write(&bsp_rx_buffer, (const uint8_t *) frame, frame_len);
+		run_worker(rx_worker);
+
+		struct message *msg = NULL;
+		if (!os_mailbox_read(spinner_conf->incoming_msg_queue, &msg)) {
+			fprintf(stderr, "%s: frame %llu didn't get routed\n",
+			        name, (unsigned long long) i);
+			exit(EXIT_FAILURE);
+		}
+
+		spinner_conf->free_message(msg);
+	}
+
+	result->name = name;
+	result->seconds = now_seconds() - start;
+	result->frames = num_frames;
+	result->bytes = num_frames * frame_len;
+	result->allocs = num_allocs - start_allocs;
+}
+
+/**
+ * Sends num_frames messages of the given type, filled by fill_data.
+ */
+static void bench_tx(struct bench_result *result,
+                     const char *name,
+                     uint32_t msg_type,
+                     void (*fill_data)(void *data),
+                     uint64_t num_frames)
+{
+	struct bench_worker *tx_worker = find_worker("tx_worker");
+
+	static uint8_t sink[BENCH_TX_RING_SIZE];
+	uint64_t bytes = 0;
+
+	uint64_t start_allocs = num_allocs;
+	double start = now_seconds();
+
+	for (uint64_t i = 0; i < num_frames; i++) {
+		struct message *msg = spinner_conf->alloc_message(msg_type);
+		if (msg == NULL) {
+			fprintf(stderr, "%s: message allocation failed\n", name);
+			exit(EXIT_FAILURE);
+		}
+
+		msg->transaction_id = (uint32_t) i + 1;
+		fill_data(msg->data);
+
+		os_mailbox_write(spinner_conf->outgoing_msg_queue, &msg);
+		run_worker(tx_worker);
+
+		uint32_t len = byte_ring_read(&bsp_tx_buffer, sink, sizeof(sink));
+		if (len == 0) {
+			fprintf(stderr, "%s: frame %llu didn't get sent\n",
+			        name, (unsigned long long) i);
+			exit(EXIT_FAILURE);
+		}
+
+		bytes += len;
+	}
+
+	result->name = name;
+	result->seconds = now_seconds() - start;
+	result->frames = num_frames;
+	result->bytes = bytes;
+	result->allocs = num_allocs - start_allocs;
+}
+
+/**
+ * Switches the link to the binary protocol, and throws away the reply.
+ */
+static void switch_to_binary(void)
+{
+	char frame[64];
+	uint32_t len = build_ascii_frame(frame, sizeof(frame), "1,DISPATCHER,SET_PROTOCOL,BINARY");
+
+	byte_ring_write(&bsp_rx_buffer, (const uint8_t *) frame, len);
+	run_worker(find_worker("rx_worker"));
+	run_worker(find_worker("tx_worker"));
+
+	uint8_t sink[64];
+	while (byte_ring_read(&bsp_tx_buffer, sink, sizeof(sink)) > 0);
+}
+
+
+static void print_results(const struct bench_result *results,
+                          uint32_t num_results,
+                          bool json)
+{
+	if (json) {
+		printf("{\n  \"benchmarks\": [\n");
+	}
+
+	for (uint32_t i = 0; i < num_results; i++) {
+		const struct bench_result *r = &results[i];
+
+		double frames_per_s = (double) r->frames / r->seconds;
+		double ns_per_byte = r->seconds * 1e9 / (double) r->bytes;
+		double allocs_per_frame = (double) r->allocs / (double) r->frames;
+
+		if (json) {
+			printf("    {\"name\": \"%s\", \"frames\": %llu, \"bytes\": %llu, "
+			       "\"seconds\": %.6f, \"frames_per_s\": %.1f, "
+			       "\"ns_per_byte\": %.3f, \"allocs_per_frame\": %.3f}%s\n",
+			       r->name,
+			       (unsigned long long) r->frames,
+			       (unsigned long long) r->bytes,
+			       r->seconds, frames_per_s, ns_per_byte, allocs_per_frame,
+			       (i + 1 < num_results) ? "," : "");
+		} else {
+			printf("%-24s %12.0f frames/s %8.2f ns/byte %6.2f allocs/frame\n",
+			       r->name, frames_per_s, ns_per_byte, allocs_per_frame);
+		}
+	}
+
+	if (json) {
+		printf("  ]\n}\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t num_frames = DEFAULT_NUM_FRAMES;
+	bool json = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = true;
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			num_frames = strtoull(argv[++i], NULL, 10);
+		} else {
+			fprintf(stderr, "Usage: %s [--frames <frames per benchmark>] [--json]\n",
+			        argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (num_frames == 0) {
+		fprintf(stderr, "The number of frames must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	byte_ring_init(&bsp_rx_buffer, rx_buffer_data, BENCH_RX_RING_SIZE, 0, NULL);
+	byte_ring_init(&bsp_tx_buffer,
+	               tx_buffer_data,
+	               BENCH_TX_RING_SIZE,
+	               BSP_TX_MAX_RESERVATION,
+	               NULL);
+
+	// Initializes the Spinner too, through the subsystem registry.
+	dispatcher_init();
+
+	// The Spinner is the only subsystem in the registry.
+	const uint8_t spinner_id = 0;
+
+	struct bench_result results[8];
+	uint32_t n = 0;
+
+
+	// ASCII
+	char set_plan_body[BSP_MAX_MESSAGE_LENGTH] = "1234,SPINNER,SET_PLAN,1";
+	for (uint32_t i = 0; i < BENCH_PLAN_LEGS; i++) {
+		char leg[32];
+		snprintf(leg, sizeof(leg), ",%u,%.3f", 1000 * (i + 1), 12.5 * (i + 1));
+		strncat(set_plan_body, leg, sizeof(set_plan_body) - strlen(set_plan_body) - 1);
+	}
+
+	char ascii_frame[BSP_MAX_MESSAGE_LENGTH + 8];
+	uint32_t len = build_ascii_frame(ascii_frame, sizeof(ascii_frame), set_plan_body);
+	bench_rx(&results[n++], "rx_ascii_set_plan", ascii_frame, len, num_frames);
+
+	len = build_ascii_frame(ascii_frame, sizeof(ascii_frame), "1234,SPINNER,GET_STATE,1");
+	bench_rx(&results[n++], "rx_ascii_get_state", ascii_frame, len, num_frames);
+
+	bench_tx(&results[n++], "tx_ascii_plan_reply", SPINNER_MSG_PLAN_REPLY,
+	         fill_plan_data, num_frames);
+	bench_tx(&results[n++], "tx_ascii_state_reply", SPINNER_MSG_STATE_REPLY,
+	         fill_state_data, num_frames);
+
+
+	// Binary
+	switch_to_binary();
+
+	uint8_t payload[1 + BENCH_PLAN_LEGS * 8];
+	payload[0] = 1;
+	for (uint32_t i = 0; i < BENCH_PLAN_LEGS; i++) {
+		bin_put_u32(&payload[1 + i * 8], 1000 * (i + 1));
+		bin_put_f32(&payload[5 + i * 8], 12.5f * (float) (i + 1));
+	}
+
+	uint8_t binary_frame[COBS_MAX_ENCODED_LEN(BSP_MAX_MESSAGE_LENGTH)];
+	len = build_binary_frame(binary_frame, sizeof(binary_frame), 1234,
+	                         spinner_id, SPINNER_MSG_SET_PLAN,
+	                         payload, sizeof(payload));
+	bench_rx(&results[n++], "rx_binary_set_plan", (char *) binary_frame, len, num_frames);
+
+	len = build_binary_frame(binary_frame, sizeof(binary_frame), 1234,
+	                         spinner_id, SPINNER_MSG_GET_STATE,
+	                         payload, 1);
+	bench_rx(&results[n++], "rx_binary_get_state", (char *) binary_frame, len, num_frames);
+
+	bench_tx(&results[n++], "tx_binary_plan_reply", SPINNER_MSG_PLAN_REPLY,
+	         fill_plan_data, num_frames);
+	bench_tx(&results[n++], "tx_binary_state_reply", SPINNER_MSG_STATE_REPLY,
+	         fill_state_data, num_frames);
+
+
+	print_results(results, n, json);
+
+	return EXIT_SUCCESS;
+}
@@ -1,14 +0,0 @@
-/**
- * @file
- *
- * This file contains the declarations of the message dispatcher stub helpers.
- */
-
-#ifndef MESSAGE_DISPATCHER_STUB_HELPERS_H_
-#define MESSAGE_DISPATCHER_STUB_HELPERS_H_
-
-struct subsystem_message_conf *dispatcher_stubs_get_last_conf(void);
-
-#endif /* MESSAGE_DISPATCHER_STUB_HELPERS_H_ */
-
-
@@ -105,3 +105,14 @@ void worker_join(worker_t *worker)
 {
 	check_expected_ptr(worker);
 }
+
+void worker_wait(worker_t *worker, uint32_t max_ticks)
+{
+	check_expected_ptr(worker);
+	check_expected(max_ticks);
+}
+
+void worker_notify(worker_t *worker)
+{
+	check_expected_ptr(worker);
+}
@@ -0,0 +1,292 @@
+/**
+ * @file
+ *
+ * This file contains unit tests for the atomic pool allocator, and stress tests
+ * that take items on one thread while others give them back, like a task
+ * allocating messages that interrupt handlers & other tasks free. On the host,
+ * they exercise the compare & swap implementation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../src/atomic_pool.h"
+
+#define TEST_NUM_ITEMS 8
+
+/** Few, so that the stress tests run the pool dry all the time. */
+#define STRESS_NUM_ITEMS 4
+#define STRESS_MAX_GIVERS 3
+
+/** The number of items each stress test takes out of the pool. */
+#define STRESS_TAKES (256u * 1024u)
+
+/**
+ * An item of the pool. Bigger than a pointer, so that the item size gets
+ * tested too.
+ */
+struct test_item {
+	void *link;
+	/** Set while the item is out of the pool. */
+	uint32_t taken;
+	uint32_t payload;
+};
+
+/**
+ * Items handed over from the taker to the givers. Only guarded by a lock of its
+ * own, so that the pool itself gets taken from & given to concurrently.
+ */
+struct handover {
+	pthread_mutex_t lock;
+	struct test_item *items[STRESS_NUM_ITEMS];
+	uint32_t num_items;
+};
+
+struct stress_run {
+	struct atomic_pool pool;
+	struct handover handover;
+
+	/** Items taken while they were already out of the pool. */
+	uint32_t double_takes;
+	/** Items given back while they weren't out of the pool. */
+	uint32_t double_gives;
+	uint32_t taken;
+
+	/** Set once the taker is done, and the givers may stop. */
+	bool done;
+};
+
+static struct test_item items[STRESS_NUM_ITEMS > TEST_NUM_ITEMS ?
+                              STRESS_NUM_ITEMS : TEST_NUM_ITEMS];
+
+
+static void *stress_taker(void *params)
+{
+	struct stress_run *run = params;
+
+	while (run->taken < STRESS_TAKES) {
+		struct test_item *item = atomic_pool_take(&run->pool);
+		if (item == NULL) {
+			// Let the givers return some, even on a single CPU.
+			sched_yield();
+			continue;
+		}
+
+		if (__atomic_exchange_n(&item->taken, 1, __ATOMIC_ACQ_REL) != 0) {
+			run->double_takes++;
+		}
+
+		run->taken++;
+
+		pthread_mutex_lock(&run->handover.lock);
+		run->handover.items[run->handover.num_items++] = item;
+		pthread_mutex_unlock(&run->handover.lock);
+	}
+
+	__atomic_store_n(&run->done, true, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void *stress_giver(void *params)
+{
+	struct stress_run *run = params;
+
+	while (true) {
+		struct test_item *item = NULL;
+
+		pthread_mutex_lock(&run->handover.lock);
+		if (run->handover.num_items > 0) {
+			item = run->handover.items[--run->handover.num_items];
+		}
+		pthread_mutex_unlock(&run->handover.lock);
+
+		if (item == NULL) {
+			if (__atomic_load_n(&run->done, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+
+			sched_yield();
+			continue;
+		}
+
+		if (__atomic_exchange_n(&item->taken, 0, __ATOMIC_ACQ_REL) != 1) {
+			__atomic_fetch_add(&run->double_gives, 1, __ATOMIC_RELAXED);
+		}
+
+		atomic_pool_give(&run->pool, item);
+	}
+
+	return NULL;
+}
+
+static void run_stress(uint32_t num_givers)
+{
+	static struct stress_run run;
+
+	memset(&run, 0, sizeof(run));
+	memset(items, 0, sizeof(items));
+	atomic_pool_init(&run.pool, items, sizeof(struct test_item), STRESS_NUM_ITEMS);
+	pthread_mutex_init(&run.handover.lock, NULL);
+
+	pthread_t taker;
+	pthread_t givers[STRESS_MAX_GIVERS];
+	for (uint32_t i = 0; i < num_givers; i++) {
+		assert_int_equal(pthread_create(&givers[i], NULL, stress_giver, &run), 0);
+	}
+	assert_int_equal(pthread_create(&taker, NULL, stress_taker, &run), 0);
+
+	assert_int_equal(pthread_join(taker, NULL), 0);
+	for (uint32_t i = 0; i < num_givers; i++) {
+		assert_int_equal(pthread_join(givers[i], NULL), 0);
+	}
+
+	pthread_mutex_destroy(&run.handover.lock);
+
+	assert_int_equal(run.taken, STRESS_TAKES);
+	assert_int_equal(run.double_takes, 0);
+	assert_int_equal(run.double_gives, 0);
+
+	// Every item made it back, exactly once, and got counted.
+	assert_int_equal(atomic_pool_num_free(&run.pool), STRESS_NUM_ITEMS);
+
+	bool seen[STRESS_NUM_ITEMS] = {false};
+	for (uint32_t i = 0; i < STRESS_NUM_ITEMS; i++) {
+		struct test_item *item = atomic_pool_take(&run.pool);
+		assert_non_null(item);
+
+		uint32_t idx = (uint32_t) (item - items);
+		assert_in_range(idx, 0, STRESS_NUM_ITEMS - 1);
+		assert_false(seen[idx]);
+		seen[idx] = true;
+	}
+
+	assert_null(atomic_pool_take(&run.pool));
+}
+
+
+static int setup(void **state)
+{
+	(void) state;
+
+	memset(items, 0, sizeof(items));
+
+	return 0;
+}
+
+
+static void take_order_test(void **state)
+{
+	(void) state;
+
+	struct atomic_pool pool;
+	atomic_pool_init(&pool, items, sizeof(struct test_item), TEST_NUM_ITEMS);
+
+	// The items get taken in memory order.
+	for (uint32_t i = 0; i < TEST_NUM_ITEMS; i++) {
+		assert_ptr_equal(atomic_pool_take(&pool), &items[i]);
+	}
+}
+
+static void exhaustion_test(void **state)
+{
+	(void) state;
+
+	struct atomic_pool pool;
+	atomic_pool_init(&pool, items, sizeof(struct test_item), TEST_NUM_ITEMS);
+	assert_int_equal(atomic_pool_num_free(&pool), TEST_NUM_ITEMS);
+
+	for (uint32_t i = 0; i < TEST_NUM_ITEMS; i++) {
+		assert_non_null(atomic_pool_take(&pool));
+		assert_int_equal(atomic_pool_num_free(&pool), TEST_NUM_ITEMS - i - 1);
+	}
+
+	// Failed takes don't count.
+	assert_null(atomic_pool_take(&pool));
+	assert_null(atomic_pool_take(&pool));
+	assert_int_equal(atomic_pool_num_free(&pool), 0);
+
+	// A pool without items is exhausted right away.
+	atomic_pool_init(&pool, items, sizeof(struct test_item), 0);
+	assert_int_equal(atomic_pool_num_free(&pool), 0);
+	assert_null(atomic_pool_take(&pool));
+}
+
+static void round_trip_test(void **state)
+{
+	(void) state;
+
+	struct atomic_pool pool;
+	atomic_pool_init(&pool, items, sizeof(struct test_item), TEST_NUM_ITEMS);
+
+	struct test_item *first = atomic_pool_take(&pool);
+	struct test_item *second = atomic_pool_take(&pool);
+
+	// What got written into a taken item is its user's, until it's given
+	// back.
+	first->taken = 0xDEADBEEF;
+	first->payload = 0xCAFEBABE;
+	assert_ptr_equal(atomic_pool_take(&pool), &items[2]);
+	assert_int_equal(first->payload, 0xCAFEBABE);
+
+	// Items given back get taken again first, most recently given first.
+	atomic_pool_give(&pool, first);
+	atomic_pool_give(&pool, second);
+	assert_int_equal(atomic_pool_num_free(&pool), TEST_NUM_ITEMS - 1);
+
+	assert_ptr_equal(atomic_pool_take(&pool), second);
+	assert_ptr_equal(atomic_pool_take(&pool), first);
+	assert_ptr_equal(atomic_pool_take(&pool), &items[3]);
+
+	// Drain it, and refill it in a different order.
+	struct test_item *taken[TEST_NUM_ITEMS] = {first, second, &items[2], &items[3]};
+	for (uint32_t i = 4; i < TEST_NUM_ITEMS; i++) {
+		taken[i] = atomic_pool_take(&pool);
+		assert_ptr_equal(taken[i], &items[i]);
+	}
+	assert_null(atomic_pool_take(&pool));
+
+	for (uint32_t i = 0; i < TEST_NUM_ITEMS; i++) {
+		atomic_pool_give(&pool, taken[i]);
+	}
+
+	for (uint32_t i = TEST_NUM_ITEMS; i > 0; i--) {
+		assert_ptr_equal(atomic_pool_take(&pool), taken[i - 1]);
+	}
+	assert_null(atomic_pool_take(&pool));
+}
+
+static void stress_single_giver_test(void **state)
+{
+	(void) state;
+
+	run_stress(1);
+}
+
+static void stress_multi_giver_test(void **state)
+{
+	(void) state;
+
+	run_stress(STRESS_MAX_GIVERS);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(take_order_test, setup),
+		cmocka_unit_test_setup(exhaustion_test, setup),
+		cmocka_unit_test_setup(round_trip_test, setup),
+		cmocka_unit_test_setup(stress_single_giver_test, setup),
+		cmocka_unit_test_setup(stress_multi_giver_test, setup)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
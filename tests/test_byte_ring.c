@@ -0,0 +1,425 @@
+/**
+ * @file
+ *
+ * This file contains unit tests for the byte ring, and stress tests that run
+ * its producer & consumer on two threads, like a UART interrupt handler and a
+ * task.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../src/byte_ring.h"
+
+/** Small, so that the stress tests wrap around it all the time. */
+#define TEST_RING_SIZE 64
+#define TEST_MAX_RESERVATION 16
+
+/** The number of bytes each stress test pushes through the ring. */
+#define STRESS_BYTES (1024u * 1024u)
+
+/** The ways the stress test producer writes into the ring. */
+enum stress_write_mode {
+	STRESS_WRITE_BYTE,
+	STRESS_WRITE_SOME,
+	STRESS_WRITE_RESERVE
+};
+
+/** The ways the stress test consumer reads from the ring. */
+enum stress_read_mode {
+	STRESS_READ_BYTE,
+	STRESS_READ_PEEK,
+	STRESS_READ_BUF
+};
+
+struct stress_run {
+	struct byte_ring ring;
+	enum stress_write_mode write_mode;
+	enum stress_read_mode read_mode;
+
+	/** Bytes the consumer got, that weren't the ones written. */
+	uint32_t mismatches;
+	/** Bytes the consumer got. */
+	uint32_t received;
+};
+
+static uint8_t ring_mem[BYTE_RING_MEM_SIZE(TEST_RING_SIZE, TEST_MAX_RESERVATION)];
+
+static uint32_t num_write_callbacks = 0;
+
+
+static void count_write_callback(void)
+{
+	num_write_callbacks++;
+}
+
+/**
+ * The byte at a position of the stream written through the ring. Doesn't repeat
+ * with the ring's size, so stale or skipped bytes get noticed.
+ */
+static uint8_t pattern(uint32_t pos)
+{
+	return (uint8_t) (pos ^ (pos >> 8) ^ (pos >> 16));
+}
+
+/**
+ * Xorshift, for chunk lengths that keep the two threads out of lockstep.
+ */
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+static void *stress_producer(void *params)
+{
+	struct stress_run *run = params;
+	uint32_t random_state = 0x12345678;
+	uint32_t pos = 0;
+
+	while (pos < STRESS_BYTES) {
+		uint32_t start_pos = pos;
+		uint32_t len = next_random(&random_state) % TEST_MAX_RESERVATION + 1;
+		if (len > STRESS_BYTES - pos) {
+			len = STRESS_BYTES - pos;
+		}
+
+		uint8_t chunk[TEST_MAX_RESERVATION];
+		for (uint32_t i = 0; i < len; i++) {
+			chunk[i] = pattern(pos + i);
+		}
+
+		switch (run->write_mode) {
+		case STRESS_WRITE_BYTE:
+			if (byte_ring_write_byte(&run->ring, chunk[0])) {
+				pos++;
+			}
+			break;
+
+		case STRESS_WRITE_SOME:
+			pos += byte_ring_write_some(&run->ring, chunk, len);
+			break;
+
+		case STRESS_WRITE_RESERVE: {
+			uint32_t reserved_len = 0;
+			uint8_t *reserved = byte_ring_reserve(&run->ring, &reserved_len);
+			if (len > reserved_len) {
+				len = reserved_len;
+			}
+
+			memcpy(reserved, chunk, len);
+			byte_ring_commit(&run->ring, len);
+			pos += len;
+			break;
+		}
+		}
+
+		// Let the consumer make room, even on a single CPU.
+		if (pos == start_pos) {
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+static void *stress_consumer(void *params)
+{
+	struct stress_run *run = params;
+	uint32_t random_state = 0x87654321;
+
+	while (run->received < STRESS_BYTES) {
+		uint8_t chunk[TEST_RING_SIZE];
+		uint32_t len = 0;
+
+		switch (run->read_mode) {
+		case STRESS_READ_BYTE:
+			if (byte_ring_read_byte(&run->ring, &chunk[0])) {
+				len = 1;
+			}
+			break;
+
+		case STRESS_READ_PEEK: {
+			const uint8_t *region = NULL;
+			len = byte_ring_peek(&run->ring, &region);
+			memcpy(chunk, region, len);
+			byte_ring_consume(&run->ring, len);
+			break;
+		}
+
+		case STRESS_READ_BUF:
+			len = byte_ring_read(&run->ring,
+			                     chunk,
+			                     next_random(&random_state) % sizeof(chunk) + 1);
+			break;
+		}
+
+		for (uint32_t i = 0; i < len; i++) {
+			if (chunk[i] != pattern(run->received + i)) {
+				run->mismatches++;
+			}
+		}
+
+		run->received += len;
+
+		if (len == 0) {
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+static void run_stress(enum stress_write_mode write_mode,
+                       enum stress_read_mode read_mode,
+                       uint32_t start_pos)
+{
+	static struct stress_run run;
+
+	memset(&run, 0, sizeof(run));
+	byte_ring_init(&run.ring, ring_mem, TEST_RING_SIZE, TEST_MAX_RESERVATION, NULL);
+	run.ring.read_pos = start_pos;
+	run.ring.write_pos = start_pos;
+	run.write_mode = write_mode;
+	run.read_mode = read_mode;
+
+	pthread_t producer;
+	pthread_t consumer;
+	assert_int_equal(pthread_create(&consumer, NULL, stress_consumer, &run), 0);
+	assert_int_equal(pthread_create(&producer, NULL, stress_producer, &run), 0);
+
+	assert_int_equal(pthread_join(producer, NULL), 0);
+	assert_int_equal(pthread_join(consumer, NULL), 0);
+
+	assert_int_equal(run.received, STRESS_BYTES);
+	assert_int_equal(run.mismatches, 0);
+	assert_int_equal(byte_ring_used_space(&run.ring), 0);
+}
+
+
+static int setup(void **state)
+{
+	(void) state;
+
+	num_write_callbacks = 0;
+	memset(ring_mem, 0, sizeof(ring_mem));
+
+	return 0;
+}
+
+
+static void init_test(void **state)
+{
+	(void) state;
+
+	struct byte_ring ring;
+	byte_ring_init(&ring, ring_mem, TEST_RING_SIZE, TEST_MAX_RESERVATION, NULL);
+
+	assert_int_equal(ring.mask, TEST_RING_SIZE - 1);
+	assert_int_equal(byte_ring_used_space(&ring), 0);
+	assert_int_equal(byte_ring_free_space(&ring), TEST_RING_SIZE);
+	assert_int_equal(byte_ring_capacity(&ring), TEST_MAX_RESERVATION);
+
+	const uint8_t *region = NULL;
+	assert_int_equal(byte_ring_peek(&ring, &region), 0);
+
+	uint8_t byte = 0;
+	assert_false(byte_ring_read_byte(&ring, &byte));
+
+	// Without a reservation limit, the whole ring can be reserved.
+	byte_ring_init(&ring, ring_mem, TEST_RING_SIZE, TEST_RING_SIZE * 2, NULL);
+	assert_int_equal(byte_ring_capacity(&ring), TEST_RING_SIZE);
+}
+
+static void full_test(void **state)
+{
+	(void) state;
+
+	struct byte_ring ring;
+	byte_ring_init(&ring, ring_mem, TEST_RING_SIZE, TEST_MAX_RESERVATION,
+	               count_write_callback);
+
+	// Every byte of the ring can be filled.
+	for (uint32_t i = 0; i < TEST_RING_SIZE; i++) {
+		assert_true(byte_ring_write_byte(&ring, pattern(i)));
+	}
+
+	assert_int_equal(num_write_callbacks, TEST_RING_SIZE);
+	assert_int_equal(byte_ring_free_space(&ring), 0);
+	assert_false(byte_ring_write_byte(&ring, 0));
+
+	uint8_t data[4] = {0};
+	assert_false(byte_ring_write(&ring, data, 1));
+	assert_int_equal(byte_ring_write_some(&ring, data, sizeof(data)), 0);
+
+	uint32_t reserved_len = 1;
+	byte_ring_reserve(&ring, &reserved_len);
+	assert_int_equal(reserved_len, 0);
+
+	// Nothing written, nobody notified.
+	assert_int_equal(num_write_callbacks, TEST_RING_SIZE);
+
+	// Only as much as there's room for gets written.
+	uint8_t byte = 0;
+	assert_true(byte_ring_read_byte(&ring, &byte));
+	assert_int_equal(byte, pattern(0));
+	assert_true(byte_ring_read_byte(&ring, &byte));
+	assert_int_equal(byte, pattern(1));
+
+	assert_false(byte_ring_write(&ring, data, 3));
+	assert_int_equal(byte_ring_write_some(&ring, data, sizeof(data)), 2);
+	assert_int_equal(byte_ring_free_space(&ring), 0);
+}
+
+static void wrap_test(void **state)
+{
+	(void) state;
+
+	struct byte_ring ring;
+	byte_ring_init(&ring, ring_mem, TEST_RING_SIZE, TEST_MAX_RESERVATION, NULL);
+
+	uint8_t data[TEST_RING_SIZE];
+	for (uint32_t i = 0; i < sizeof(data); i++) {
+		data[i] = pattern(i);
+	}
+
+	// Leave the positions 10 bytes before the end of the ring.
+	assert_true(byte_ring_write(&ring, data, TEST_RING_SIZE - 10));
+	uint8_t check[TEST_RING_SIZE];
+	assert_int_equal(byte_ring_read(&ring, check, sizeof(check)), TEST_RING_SIZE - 10);
+
+	// The write wraps around, so the readable bytes take two regions.
+	assert_true(byte_ring_write(&ring, data, 30));
+
+	const uint8_t *region = NULL;
+	assert_int_equal(byte_ring_peek(&ring, &region), 10);
+	assert_ptr_equal(region, &ring_mem[TEST_RING_SIZE - 10]);
+	assert_memory_equal(region, data, 10);
+	byte_ring_consume(&ring, 10);
+
+	assert_int_equal(byte_ring_peek(&ring, &region), 20);
+	assert_ptr_equal(region, ring_mem);
+	assert_memory_equal(region, &data[10], 20);
+	byte_ring_consume(&ring, 20);
+
+	assert_int_equal(byte_ring_used_space(&ring), 0);
+
+	// Reads stitch the two regions back together.
+	assert_true(byte_ring_write(&ring, data, 50));
+	assert_int_equal(byte_ring_read(&ring, check, sizeof(check)), 50);
+	assert_memory_equal(check, data, 50);
+}
+
+static void reserve_wrap_test(void **state)
+{
+	(void) state;
+
+	struct byte_ring ring;
+	byte_ring_init(&ring, ring_mem, TEST_RING_SIZE, TEST_MAX_RESERVATION, NULL);
+
+	uint8_t check[TEST_RING_SIZE];
+	uint8_t filler[TEST_RING_SIZE - 4] = {0};
+	assert_true(byte_ring_write(&ring, filler, sizeof(filler)));
+	assert_int_equal(byte_ring_read(&ring, check, sizeof(check)), sizeof(filler));
+
+	// A region reserved 4 bytes before the end runs into the slack area.
+	uint32_t reserved_len = 0;
+	uint8_t *reserved = byte_ring_reserve(&ring, &reserved_len);
+	assert_ptr_equal(reserved, &ring_mem[TEST_RING_SIZE - 4]);
+	assert_int_equal(reserved_len, TEST_MAX_RESERVATION);
+
+	for (uint32_t i = 0; i < 12; i++) {
+		reserved[i] = pattern(i);
+	}
+	byte_ring_commit(&ring, 12);
+
+	// The part in the slack area got moved to the start of the ring.
+	assert_int_equal(byte_ring_used_space(&ring), 12);
+	assert_int_equal(byte_ring_read(&ring, check, sizeof(check)), 12);
+	for (uint32_t i = 0; i < 12; i++) {
+		assert_int_equal(check[i], pattern(i));
+	}
+}
+
+static void counter_wrap_test(void **state)
+{
+	(void) state;
+
+	struct byte_ring ring;
+	byte_ring_init(&ring, ring_mem, TEST_RING_SIZE, TEST_MAX_RESERVATION, NULL);
+
+	// The positions are free-running counters, so they overflow eventually.
+	ring.read_pos = UINT32_MAX - 5;
+	ring.write_pos = UINT32_MAX - 5;
+
+	uint8_t data[20];
+	for (uint32_t i = 0; i < sizeof(data); i++) {
+		data[i] = pattern(i);
+	}
+
+	assert_true(byte_ring_write(&ring, data, sizeof(data)));
+	assert_true(ring.write_pos < ring.read_pos);
+	assert_int_equal(byte_ring_used_space(&ring), sizeof(data));
+	assert_int_equal(byte_ring_free_space(&ring), TEST_RING_SIZE - sizeof(data));
+
+	uint8_t check[sizeof(data)];
+	assert_int_equal(byte_ring_read(&ring, check, sizeof(check)), sizeof(data));
+	assert_memory_equal(check, data, sizeof(data));
+	assert_int_equal(byte_ring_used_space(&ring), 0);
+}
+
+static void stress_byte_test(void **state)
+{
+	(void) state;
+
+	// Like the UART RX interrupt handler & the dispatcher's RX worker.
+	run_stress(STRESS_WRITE_BYTE, STRESS_READ_PEEK, 0);
+	run_stress(STRESS_WRITE_BYTE, STRESS_READ_BYTE, 0);
+}
+
+static void stress_bulk_test(void **state)
+{
+	(void) state;
+
+	// Like the RX DMA publishing, and the TX worker & the UART TX.
+	run_stress(STRESS_WRITE_SOME, STRESS_READ_PEEK, 0);
+	run_stress(STRESS_WRITE_SOME, STRESS_READ_BUF, 0);
+	run_stress(STRESS_WRITE_RESERVE, STRESS_READ_PEEK, 0);
+	run_stress(STRESS_WRITE_RESERVE, STRESS_READ_BYTE, 0);
+}
+
+static void stress_counter_wrap_test(void **state)
+{
+	(void) state;
+
+	run_stress(STRESS_WRITE_RESERVE, STRESS_READ_BUF, UINT32_MAX - STRESS_BYTES / 2);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(init_test, setup),
+		cmocka_unit_test_setup(full_test, setup),
+		cmocka_unit_test_setup(wrap_test, setup),
+		cmocka_unit_test_setup(reserve_wrap_test, setup),
+		cmocka_unit_test_setup(counter_wrap_test, setup),
+		cmocka_unit_test_setup(stress_byte_test, setup),
+		cmocka_unit_test_setup(stress_bulk_test, setup),
+		cmocka_unit_test_setup(stress_counter_wrap_test, setup)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -10,25 +10,68 @@
 #include <cmocka.h>
 
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include <mouros/char_buffer.h>
 #include <mouros/common.h>
 
 #include <ratfist_stubs/worker_stub_helpers.h>
 #include <ratfist_stubs/messages_stub_helpers.h>
 
+#include "../src/binary_fields.h"
+#include "../src/bsp.h"
+#include "../src/byte_ring.h"
+#include "../src/cobs.h"
 #include "../src/constants.h"
 #include "../src/errors.h"
 #include "../src/message_dispatcher.h"
+#include "../src/message_slab.h"
+#include "../src/message_trace.h"
 
 struct fake_data_struct {};
 
-mailbox_t bsp_rx_buffer;
-char rx_buffer_data[BSP_MAX_MESSAGE_LENGTH + 10];
+/** Big enough for a maximum length frame. A power of two, like the BSP's. */
+#define TEST_RX_RING_SIZE 2048
 
-mailbox_t bsp_tx_buffer;
-char tx_buffer_data[BSP_MAX_MESSAGE_LENGTH + 10];
+struct byte_ring bsp_rx_buffer;
+uint8_t rx_buffer_data[TEST_RX_RING_SIZE];
+
+/**
+ * Big enough for the TX worker to send all queued messages in one go, i.e. at
+ * least 8 * BSP_MAX_MESSAGE_LENGTH.
+ */
+#define TEST_TX_RING_SIZE 8192
+
+struct byte_ring bsp_tx_buffer;
+volatile struct bsp_uart_stats bsp_uart_stats;
+uint8_t tx_buffer_data[BYTE_RING_MEM_SIZE(TEST_TX_RING_SIZE, BSP_TX_MAX_RESERVATION)];
+
+const struct bsp_link bsp_links[BSP_NUM_LINKS] = {
+	{ &bsp_rx_buffer, &bsp_tx_buffer, &bsp_uart_stats }
+};
+
+static void (*rx_notify_callback)(void) = NULL;
+
+void bsp_set_rx_notify_callback(void (*callback)(void))
+{
+	rx_notify_callback = callback;
+}
+
+/**
+ * The fake clock moves on by fake_time_step_us every time it's read. By
+ * default that's a whole error report interval, so no errors get coalesced.
+ */
+static uint32_t fake_time_us = 0;
+static uint32_t fake_time_step_us = ERR_REPORT_INTERVAL_US;
+
+uint32_t bsp_get_timestamp_us(void)
+{
+	uint32_t now_us = fake_time_us;
+	fake_time_us += fake_time_step_us;
+
+	return now_us;
+}
 
 
 mailbox_t outgoing_msg_queue;
@@ -38,7 +81,10 @@ mailbox_t incoming_msg_queue;
 struct message *incoming_msg_queue_buf[10];
 
 mailbox_t outgoing_err_queue;
-int32_t outgoing_err_queue_buf[10];
+struct error_entry outgoing_err_queue_buf[10];
+
+mailbox_t other_outgoing_msg_queue;
+struct message *other_outgoing_msg_queue_buf[10];
 
 static char serialized_msg_buf[2 * BSP_MAX_MESSAGE_LENGTH];
 
@@ -54,9 +100,15 @@ static void fake_free(struct message *msg_ptr)
 	check_expected_ptr(msg_ptr);
 }
 
-static bool msg_parsing_func(struct message *msg_ptr, char *save_ptr)
+static bool msg_parsing_func(struct message *msg_ptr,
+                             const struct message_field *fields,
+                             uint32_t num_fields)
 {
 	check_expected_ptr(msg_ptr);
+	check_expected(num_fields);
+
+	const char *first_field = (num_fields > 0) ? fields[0].str : "";
+	check_expected_ptr(first_field);
 
 	return mock_type(bool);
 }
@@ -76,16 +128,80 @@ static ssize_t msg_serialization_func(const struct message *msg_ptr,
 	return ret_val;
 }
 
+static bool msg_binary_parsing_func(struct message *msg_ptr,
+                                    const uint8_t *payload,
+                                    uint32_t payload_len)
+{
+	check_expected_ptr(msg_ptr);
+	check_expected(payload_len);
+	check_expected_ptr(payload);
+
+	return mock_type(bool);
+}
+
+static ssize_t msg_binary_serialization_func(const struct message *msg_ptr,
+                                             uint8_t *output,
+                                             uint32_t output_max_len)
+{
+	check_expected_ptr(msg_ptr);
+
+	ssize_t ret_val = mock_type(ssize_t);
+
+	if (ret_val > 0 && (uint32_t) ret_val <= output_max_len) {
+		memcpy(output, serialized_msg_buf, (size_t) ret_val);
+	}
+
+	return ret_val;
+}
+
+/**
+ * Serves windows of serialized_msg_buf, for messages sent in fragments.
+ */
+static ssize_t msg_streaming_serialization_func(const struct message *msg_ptr,
+                                                struct stream_cursor *cursor,
+                                                uint32_t offset,
+                                                char *output_str,
+                                                uint32_t output_str_max_len)
+{
+	(void) msg_ptr;
+
+	assert_true(cursor->offset <= offset);
+
+	uint32_t len = (uint32_t) strlen(serialized_msg_buf);
+
+	if (offset < len) {
+		uint32_t window_len = len - offset;
+		if (window_len > output_str_max_len) {
+			window_len = output_str_max_len;
+		}
+
+		memcpy(output_str, &serialized_msg_buf[offset], window_len);
+	}
+
+	// Resume at the last field starting in the window.
+	for (uint32_t i = offset; i < len && i < offset + output_str_max_len; i++) {
+		if (serialized_msg_buf[i] == ',') {
+			cursor->offset = i;
+		}
+	}
+
+	return (ssize_t) (len - offset);
+}
+
 #define FAKE_SER_DES_MESSAGE 0
 #define FAKE_SER_ONLY_MESSAGE 1
 #define FAKE_DES_ONLY_MESSAGE 2
 #define FAKE_NO_SER_DES_MESSAGE 3
+#define FAKE_STREAMED_MESSAGE 4
 
 struct message_handler handlers[] = {
 	{
 		.message_name = "SER_DES_MESSAGE",
 		.parsing_func = msg_parsing_func,
 		.serialization_func = msg_serialization_func,
+		.binary_parsing_func = msg_binary_parsing_func,
+		.binary_serialization_func = msg_binary_serialization_func,
+		.subscribable = true
 	},
 	{
 		.message_name = "SER_ONLY_MESSAGE",
@@ -102,6 +218,12 @@ struct message_handler handlers[] = {
 		.parsing_func = NULL,
 		.serialization_func = NULL,
 	},
+	{
+		.message_name = "STREAMED_MESSAGE",
+		.parsing_func = NULL,
+		.serialization_func = NULL,
+		.streaming_serialization_func = msg_streaming_serialization_func,
+	},
 };
 
 struct subsystem_message_conf fake_subsystem = {
@@ -112,7 +234,20 @@ struct subsystem_message_conf fake_subsystem = {
 	.message_handlers = handlers,
 	.num_message_types = ARRAY_SIZE(handlers),
 	.alloc_message = fake_alloc,
-	.free_message = fake_free
+	.free_message = fake_free,
+	.incoming_credits = ARRAY_SIZE(incoming_msg_queue_buf) - 1
+};
+
+struct subsystem_message_conf other_fake_subsystem = {
+	.subsystem_name = "OTHER",
+	.outgoing_msg_queue = &other_outgoing_msg_queue,
+	.incoming_msg_queue = NULL,
+	.outgoing_err_queue = NULL,
+	.message_handlers = handlers,
+	.num_message_types = ARRAY_SIZE(handlers),
+	.alloc_message = NULL,
+	.free_message = fake_free,
+	.tx_weight = 2
 };
 
 struct subsystem_message_conf mini_fake_subsystem = {
@@ -126,6 +261,134 @@ struct subsystem_message_conf mini_fake_subsystem = {
 	.free_message = NULL
 };
 
+// Too many message names for the name table, so this one never gets
+// registered.
+struct subsystem_message_conf big_fake_subsystem = {
+	.subsystem_name = "BIG",
+	.num_message_types = NAME_TABLE_SIZE
+};
+
+static uint32_t num_subsystem_inits = 0;
+
+static struct subsystem_message_conf *mini_fake_init(void)
+{
+	num_subsystem_inits++;
+	return &mini_fake_subsystem;
+}
+
+static struct subsystem_message_conf *fake_init(void)
+{
+	num_subsystem_inits++;
+	return &fake_subsystem;
+}
+
+static struct subsystem_message_conf *other_fake_init(void)
+{
+	num_subsystem_inits++;
+
+	os_mailbox_init(&other_outgoing_msg_queue,
+	                other_outgoing_msg_queue_buf,
+	                ARRAY_SIZE(other_outgoing_msg_queue_buf),
+	                sizeof(struct message*),
+	                NULL);
+
+	return &other_fake_subsystem;
+}
+
+static struct subsystem_message_conf *big_fake_init(void)
+{
+	num_subsystem_inits++;
+	return &big_fake_subsystem;
+}
+
+// The subsystem registry. The IDs follow the order of the entries.
+RATFIST_SUBSYSTEM(mini_fake, mini_fake_init);
+RATFIST_SUBSYSTEM(fake, fake_init);
+RATFIST_SUBSYSTEM(other_fake, other_fake_init);
+RATFIST_SUBSYSTEM(big_fake, big_fake_init);
+
+/**
+ * Writes a string into the RX ring, as if the UART had received it.
+ */
+static void write_rx_str(const char *str)
+{
+	assert_true(byte_ring_write(&bsp_rx_buffer, (const uint8_t *) str, (uint32_t) strlen(str)));
+}
+
+static void write_binary_frame(uint32_t transaction_id,
+                               uint8_t subsystem_id,
+                               uint8_t message_id,
+                               const uint8_t *payload,
+                               uint32_t payload_len,
+                               bool corrupt_crc)
+{
+	uint8_t frame[64];
+	uint8_t encoded_frame[COBS_MAX_ENCODED_LEN(sizeof(frame))];
+
+	bin_put_u32(&frame[0], transaction_id);
+	frame[4] = subsystem_id;
+	frame[5] = message_id;
+	memcpy(&frame[6], payload, payload_len);
+	bin_put_u16(&frame[6 + payload_len], crc16_ccitt(frame, 6 + payload_len));
+
+	if (corrupt_crc) {
+		frame[6 + payload_len] ^= 0x01;
+	}
+
+	uint32_t len = cobs_encode(frame, 8 + payload_len, encoded_frame, sizeof(encoded_frame));
+	assert_int_not_equal(len, 0);
+
+	byte_ring_write(&bsp_rx_buffer, encoded_frame, len);
+}
+
+/**
+ * Formats an ASCII frame with the body, and its checksum.
+ */
+static void format_ascii_frame(char *frame, size_t frame_size, const char *body)
+{
+	uint8_t csum = 0;
+	for (const char *ch = body; *ch != '\0'; ch++) {
+		csum ^= (uint8_t) *ch;
+	}
+
+	snprintf(frame, frame_size, "$%s*%02X\r\n", body, csum);
+}
+
+/**
+ * Writes an ASCII frame with the body, and its checksum.
+ */
+static void write_ascii_frame(const char *body)
+{
+	char frame[BSP_MAX_MESSAGE_LENGTH];
+	format_ascii_frame(frame, sizeof(frame), body);
+
+	write_rx_str(frame);
+}
+
+static uint32_t read_binary_frame(uint8_t *frame, uint32_t frame_size)
+{
+	struct cobs_decoder decoder;
+	cobs_decoder_init(&decoder, frame, frame_size);
+
+	uint8_t byte = 0;
+	while (byte_ring_read_byte(&bsp_tx_buffer, &byte)) {
+		enum cobs_decode_result result = cobs_decoder_push(&decoder, byte);
+		if (result == COBS_DECODE_IN_PROGRESS) {
+			continue;
+		}
+
+		assert_int_equal(result, COBS_DECODE_FRAME_DONE);
+		assert_true(decoder.len >= 8);
+		assert_int_equal(crc16_ccitt(frame, decoder.len - 2),
+		                 bin_get_u16(&frame[decoder.len - 2]));
+
+		return decoder.len;
+	}
+
+	fail_msg("No complete binary frame in the TX buffer");
+	return 0;
+}
+
 static struct worker_init_data *get_rx_worker(void)
 {
 	struct worker_init_data *init_data = NULL;
@@ -142,14 +405,42 @@ static struct worker_init_data *get_tx_worker(void)
 	return &init_data[1];
 }
 
+/**
+ * Runs the TX worker, which sends everything that's queued up, and then waits
+ * for new messages.
+ */
+static void run_tx_worker(struct worker_init_data *tx_worker)
+{
+	expect_value(worker_wait, worker, (uintptr_t) tx_worker->worker);
+	expect_value(worker_wait, max_ticks, COMM_TASK_SLEEP_TIME_TICKS);
+	tx_worker->action(tx_worker->action_params);
+}
+
+/**
+ * Expects the TX worker to get woken up, once a message gets enqueued for it.
+ */
+static void expect_tx_notify(void)
+{
+	expect_value(worker_notify, worker, (uintptr_t) get_tx_worker()->worker);
+}
+
 
 static int setup(void **state)
 {
 	(void) state;
 	worker_stubs_init();
 
-	os_char_buffer_init(&bsp_rx_buffer, rx_buffer_data, sizeof(rx_buffer_data), NULL);
-	os_char_buffer_init(&bsp_tx_buffer, tx_buffer_data, sizeof(tx_buffer_data), NULL);
+	fake_time_us = 0;
+	fake_time_step_us = ERR_REPORT_INTERVAL_US;
+
+	fake_subsystem.request_payload_size = 0;
+
+	byte_ring_init(&bsp_rx_buffer, rx_buffer_data, TEST_RX_RING_SIZE, 0, NULL);
+	byte_ring_init(&bsp_tx_buffer,
+	               tx_buffer_data,
+	               TEST_TX_RING_SIZE,
+	               BSP_TX_MAX_RESERVATION,
+	               NULL);
 
 	os_mailbox_init(&outgoing_msg_queue,
 	                outgoing_msg_queue_buf,
@@ -164,7 +455,7 @@ static int setup(void **state)
 	os_mailbox_init(&outgoing_err_queue,
 	                outgoing_err_queue_buf,
 	                ARRAY_SIZE(outgoing_err_queue_buf),
-	                sizeof(struct message*),
+	                sizeof(struct error_entry),
 	                NULL);
 
 	expect_any_count(worker_task_init, worker, 2);
@@ -180,8 +471,6 @@ static int setup(void **state)
 	will_return_count(worker_start, true, 2);
 
 	dispatcher_init();
-	assert_true(dispatcher_register_subsystem(&mini_fake_subsystem));
-	assert_true(dispatcher_register_subsystem(&fake_subsystem));
 
 	return 0;
 }
@@ -196,6 +485,8 @@ static int teardown(void **state)
 
 	dispatcher_deinit();
 
+	assert_null(rx_notify_callback);
+
 	return 0;
 }
 
@@ -217,7 +508,7 @@ static void init_test(void **state)
 	expect_any(worker_task_init, worker);
 	expect_string(worker_task_init, name, "tx_worker");
 	expect_any(worker_task_init, stack_base);
-	expect_value(worker_task_init, stack_size, TASK_STACK_SIZE);
+	expect_value(worker_task_init, stack_size, TX_TASK_STACK_SIZE);
 	expect_value(worker_task_init, priority, COMM_TASK_PRIORITY);
 	expect_any(worker_task_init, action);
 	expect_any(worker_task_init, action_params);
@@ -227,15 +518,13 @@ static void init_test(void **state)
 	expect_any_count(worker_start, worker, 2);
 	will_return_count(worker_start, true, 2);
 
-	dispatcher_init();
-
-	struct subsystem_message_conf conf = {0};
+	num_subsystem_inits = 0;
 
-	for (uint8_t i = 0; i < MAX_NUM_COMM_SUBSYSTEMS; i++) {
-		assert_true(dispatcher_register_subsystem(&conf));
-	}
+	dispatcher_init();
 
-	assert_false(dispatcher_register_subsystem(&conf));
+	// Every subsystem in the registry gets initialized, even the ones that
+	// don't fit into the name table.
+	assert_int_equal(num_subsystem_inits, 4);
 
 	expect_any_count(worker_stop, worker, 2);
 	expect_any_count(worker_join, worker, 2);
@@ -251,8 +540,7 @@ static void send_msg_test(void **state)
 
 
 	// No msg in queue
-	expect_any(os_task_sleep, num_ticks);
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 	assert_int_equal(bsp_tx_buffer.read_pos, bsp_tx_buffer.write_pos);
 
 
@@ -267,6 +555,10 @@ static void send_msg_test(void **state)
 
 	os_mailbox_write(&outgoing_msg_queue, &msg_p);
 
+	// Subsystems wake the TX worker up after enqueuing a message.
+	expect_tx_notify();
+	dispatcher_notify_tx();
+
 	strcpy(serialized_msg_buf, ",PAYLOAD");
 
 	expect_value(msg_serialization_func, msg_ptr, (uintptr_t) msg_p);
@@ -274,10 +566,10 @@ static void send_msg_test(void **state)
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
 	char check_buf[200];
-	uint32_t len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
@@ -285,28 +577,41 @@ static void send_msg_test(void **state)
 
 
 
-	// Try TX buffer full situation
-	while (os_char_buffer_write_ch(&bsp_tx_buffer, 'a'));
+	// Try TX buffer full situation. The message stays queued until the UART
+	// makes room for it.
+	const uint8_t filler = 'a';
+	while (byte_ring_write(&bsp_tx_buffer, &filler, 1));
 
 	os_mailbox_write(&outgoing_msg_queue, &msg_p);
 
+	expect_any(os_task_sleep, num_ticks);
+	tx_worker->action(tx_worker->action_params);
+
+	char ch = '\0';
+	while (byte_ring_read_byte(&bsp_tx_buffer, (uint8_t *) &ch));
+
+	// Move the ring's write position right before its end, so that the
+	// message wraps around it.
+	while ((bsp_tx_buffer.write_pos & bsp_tx_buffer.mask) != bsp_tx_buffer.size - 5) {
+		byte_ring_write(&bsp_tx_buffer, &filler, 1);
+		byte_ring_read_byte(&bsp_tx_buffer, (uint8_t *) &ch);
+	}
+
 	expect_value(msg_serialization_func, msg_ptr, (uintptr_t) msg_p);
 	will_return(msg_serialization_func, strlen(serialized_msg_buf));
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	tx_worker->action(tx_worker->action_params);
-
-	char ch = '\0';
-	while (os_char_buffer_read_ch(&bsp_tx_buffer, &ch));
+	run_tx_worker(tx_worker);
 
-	tx_worker->action(tx_worker->action_params);
+	assert_true((bsp_tx_buffer.write_pos & bsp_tx_buffer.mask) <
+	            (bsp_tx_buffer.read_pos & bsp_tx_buffer.mask));
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-9*4B\r\n");
+	assert_string_equal(check_buf, "$1235,FAKE,SER_DES_MESSAGE,PAYLOAD*33\r\n");
 
 
 
@@ -318,17 +623,14 @@ static void send_msg_test(void **state)
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	tx_worker->action(tx_worker->action_params);
-
-	assert_false(os_char_buffer_read_ch(&bsp_tx_buffer, &ch));
-
-	tx_worker->action(tx_worker->action_params);
+	expect_tx_notify();
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-3*41\r\n");
+	assert_string_equal(check_buf, "$1235,DISPATCHER,ERROR,-3*68\r\n");
 
 
 
@@ -346,20 +648,17 @@ static void send_msg_test(void **state)
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	tx_worker->action(tx_worker->action_params);
+	expect_tx_notify();
+	run_tx_worker(tx_worker);
 
 	// Switch back to original message name (switch back before asserts so we don't influence other tests)
 	handlers[msg_p->type].message_name = orig_msg_name;
 
-	assert_false(os_char_buffer_read_ch(&bsp_tx_buffer, &ch));
-
-	tx_worker->action(tx_worker->action_params);
-
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-11*72\r\n");
+	assert_string_equal(check_buf, "$1235,DISPATCHER,ERROR,-11*5B\r\n");
 
 
 
@@ -374,17 +673,14 @@ static void send_msg_test(void **state)
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	tx_worker->action(tx_worker->action_params);
-
-	assert_false(os_char_buffer_read_ch(&bsp_tx_buffer, &ch));
-
-	tx_worker->action(tx_worker->action_params);
+	expect_tx_notify();
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-11*72\r\n");
+	assert_string_equal(check_buf, "$1235,DISPATCHER,ERROR,-11*5B\r\n");
 
 
 
@@ -396,17 +692,14 @@ static void send_msg_test(void **state)
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	tx_worker->action(tx_worker->action_params);
-
-	assert_false(os_char_buffer_read_ch(&bsp_tx_buffer, &ch));
+	expect_tx_notify();
+	run_tx_worker(tx_worker);
 
-	tx_worker->action(tx_worker->action_params);
-
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-11*72\r\n");
+	assert_string_equal(check_buf, "$1235,DISPATCHER,ERROR,-11*5B\r\n");
 
 
 
@@ -417,17 +710,14 @@ static void send_msg_test(void **state)
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	tx_worker->action(tx_worker->action_params);
-
-	assert_false(os_char_buffer_read_ch(&bsp_tx_buffer, &ch));
-
-	tx_worker->action(tx_worker->action_params);
+	expect_tx_notify();
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-8*4A\r\n");
+	assert_string_equal(check_buf, "$1235,DISPATCHER,ERROR,-8*63\r\n");
 }
 
 static void recv_msg_test(void **state)
@@ -439,27 +729,32 @@ static void recv_msg_test(void **state)
 
 
 	// No chars
-	expect_any(os_task_sleep, num_ticks);
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, COMM_TASK_SLEEP_TIME_TICKS);
 	rx_worker->action(rx_worker->action_params);
 
 
+	// The UART ISR wakes up the RX worker
+	assert_non_null(rx_notify_callback);
+	expect_value(worker_notify, worker, (uintptr_t) rx_worker->worker);
+	rx_notify_callback();
+
+
 	// Bad checksum situation
 	char ch = '\0';
-	expect_any(os_task_sleep, num_ticks);
-	tx_worker->action(tx_worker->action_params);
-	assert_false(os_char_buffer_read_ch(&bsp_tx_buffer, &ch));
+	run_tx_worker(tx_worker);
+	assert_false(byte_ring_read_byte(&bsp_tx_buffer, (uint8_t *) &ch));
 
 	char bad_csum_str[] = "124auoe$456,FAKE,SER_DES_MESSAGE,PAYLOAD*1D\r\n";
-	os_char_buffer_write_str(&bsp_rx_buffer, bad_csum_str);
+	write_rx_str(bad_csum_str);
 
-	for (uint32_t i = 0; i < sizeof(bad_csum_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
 	char check_buf[200];
-	uint32_t len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
@@ -467,15 +762,14 @@ static void recv_msg_test(void **state)
 
 
 	char bad_csum_str2[] = "$456,FAKE,SER_DES_MESSAGE,PAYLOADX1D\r\n";
-	os_char_buffer_write_str(&bsp_rx_buffer, bad_csum_str2);
+	write_rx_str(bad_csum_str2);
 
-	for (uint32_t i = 0; i < sizeof(bad_csum_str2) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
@@ -483,18 +777,19 @@ static void recv_msg_test(void **state)
 
 
 	// Message too long situation
-	os_char_buffer_write_ch(&bsp_rx_buffer, '$');
-	rx_worker->action(rx_worker->action_params);
+	byte_ring_write_byte(&bsp_rx_buffer, '$');
 
 	for (uint32_t i = 0; i < BSP_MAX_MESSAGE_LENGTH ; i++) {
-		os_char_buffer_write_ch(&bsp_rx_buffer, 'a');
-		rx_worker->action(rx_worker->action_params);
+		byte_ring_write_byte(&bsp_rx_buffer, 'a');
 	}
 
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
@@ -505,15 +800,14 @@ static void recv_msg_test(void **state)
 	// Malformed message error
 	char bad_transaction_id_str[] = "$aoue,FAKE,SER_DES_MESSAGE,PAYLOAD*28\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, bad_transaction_id_str);
+	write_rx_str(bad_transaction_id_str);
 
-	for (uint32_t i = 0; i < sizeof(bad_transaction_id_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
@@ -522,15 +816,14 @@ static void recv_msg_test(void **state)
 
 	char no_subsystem_field_str[] = "$12345,*1D\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, no_subsystem_field_str);
+	write_rx_str(no_subsystem_field_str);
 
-	for (uint32_t i = 0; i < sizeof(no_subsystem_field_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
@@ -539,125 +832,137 @@ static void recv_msg_test(void **state)
 
 	char no_message_type_field_str[] = "$12345,FAKE,*38\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, no_message_type_field_str);
+	write_rx_str(no_message_type_field_str);
 
-	for (uint32_t i = 0; i < sizeof(no_message_type_field_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-2*40\r\n");
+	assert_string_equal(check_buf, "$12345,DISPATCHER,ERROR,-2*5D\r\n");
 
 
 
 	// Unknown subsystem scenario
 	char unknown_subsystem_str[] = "$12345,NONEXISTENT,MSG*2B\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, unknown_subsystem_str);
+	write_rx_str(unknown_subsystem_str);
 
-	for (uint32_t i = 0; i < sizeof(unknown_subsystem_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$12345,DISPATCHER,ERROR,-6*59\r\n");
+
+	// Subsystems that didn't fit into the name table are unknown, too.
+	char unregistered_subsystem_str[] = "$12345,BIG,MSG*24\r\n";
+
+	write_rx_str(unregistered_subsystem_str);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-6*44\r\n");
+	assert_string_equal(check_buf, "$12345,DISPATCHER,ERROR,-6*59\r\n");
 
 
 
 	// Unknown message type scenario
 	char unknown_msg_type_str[] = "$12345,FAKE,UNKNOWN*70\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, unknown_msg_type_str);
+	write_rx_str(unknown_msg_type_str);
 
-	for (uint32_t i = 0; i < sizeof(unknown_msg_type_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-7*45\r\n");
+	assert_string_equal(check_buf, "$12345,DISPATCHER,ERROR,-7*58\r\n");
 
 
 
 	// Missing parsing function scenario
 	char missing_parsing_func_str[] = "$12345,FAKE,SER_ONLY_MESSAGE*23\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, missing_parsing_func_str);
+	write_rx_str(missing_parsing_func_str);
 
-	for (uint32_t i = 0; i < sizeof(missing_parsing_func_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-8*4A\r\n");
+	assert_string_equal(check_buf, "$12345,DISPATCHER,ERROR,-8*57\r\n");
 
 
 
 	// Allocation failure scenario
 	char correct_msg_str[] = "$456,FAKE,SER_DES_MESSAGE,PAYLOAD*01\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, correct_msg_str);
+	write_rx_str(correct_msg_str);
 
 	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
 	will_return(fake_alloc, NULL);
 
-	for (uint32_t i = 0; i < sizeof(correct_msg_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-4*46\r\n");
+	assert_string_equal(check_buf, "$456,DISPATCHER,ERROR,-4*5D\r\n");
 
 
 
 	// Payload parsing error scenario
 	struct message msg = {0};
 
-	os_char_buffer_write_str(&bsp_rx_buffer, correct_msg_str);
+	write_rx_str(correct_msg_str);
 
 	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
 	will_return(fake_alloc, &msg);
 
 	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "PAYLOAD");
 	will_return(msg_parsing_func, false);
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) &msg);
 
-	for (uint32_t i = 0; i < sizeof(correct_msg_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-2*40\r\n");
+	assert_string_equal(check_buf, "$456,DISPATCHER,ERROR,-2*5B\r\n");
 
 
 
@@ -665,44 +970,45 @@ static void recv_msg_test(void **state)
 	struct message *msg_p = &msg;
 	while (os_mailbox_write(&incoming_msg_queue, &msg_p));
 
-	os_char_buffer_write_str(&bsp_rx_buffer, correct_msg_str);
+	write_rx_str(correct_msg_str);
 
 	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
 	will_return(fake_alloc, msg_p);
 
 	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) msg_p);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "PAYLOAD");
 	will_return(msg_parsing_func, true);
 
 	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
 
-	for (uint32_t i = 0; i < sizeof(correct_msg_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
-	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-5*47\r\n");
+	assert_string_equal(check_buf, "$456,DISPATCHER,ERROR,-10*68\r\n");
 
 
 
 	// All OK scenarios
 	while (os_mailbox_read(&incoming_msg_queue, &msg_p));
 
-	os_char_buffer_write_str(&bsp_rx_buffer, correct_msg_str);
+	write_rx_str(correct_msg_str);
 
 	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
 	will_return(fake_alloc, msg_p);
 
 	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) msg_p);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "PAYLOAD");
 	will_return(msg_parsing_func, true);
 
-	for (uint32_t i = 0; i < sizeof(correct_msg_str) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	rx_worker->action(rx_worker->action_params);
 
 	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
 
@@ -712,22 +1018,50 @@ static void recv_msg_test(void **state)
 
 	char correct_msg_str2[] = "$853,FAKE,DES_ONLY_MESSAGE,FIELD1,FIELD2*39\r\n";
 
-	os_char_buffer_write_str(&bsp_rx_buffer, correct_msg_str2);
+	write_rx_str(correct_msg_str2);
 
 	expect_value(fake_alloc, message_type, FAKE_DES_ONLY_MESSAGE);
 	will_return(fake_alloc, msg_p);
 
 	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) msg_p);
+	expect_value(msg_parsing_func, num_fields, 2);
+	expect_string(msg_parsing_func, first_field, "FIELD1");
 	will_return(msg_parsing_func, true);
 
-	for (uint32_t i = 0; i < sizeof(correct_msg_str2) - 1; i++) {
-		rx_worker->action(rx_worker->action_params);
-	}
+	rx_worker->action(rx_worker->action_params);
 
 	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
 
 	assert_int_equal(msg_p->type, FAKE_DES_ONLY_MESSAGE);
 	assert_int_equal(msg_p->transaction_id, 853);
+
+
+	// Several messages drained in one go, spanning multiple RX chunks
+	write_rx_str(correct_msg_str);
+	write_rx_str(correct_msg_str2);
+
+	struct message msg2 = {0};
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "PAYLOAD");
+	will_return(msg_parsing_func, true);
+
+	expect_value(fake_alloc, message_type, FAKE_DES_ONLY_MESSAGE);
+	will_return(fake_alloc, &msg2);
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg2);
+	expect_value(msg_parsing_func, num_fields, 2);
+	expect_string(msg_parsing_func, first_field, "FIELD1");
+	will_return(msg_parsing_func, true);
+
+	rx_worker->action(rx_worker->action_params);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	assert_int_equal(msg_p->transaction_id, 456);
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	assert_int_equal(msg_p->transaction_id, 853);
 }
 
 
@@ -735,13 +1069,16 @@ static void err_msg_test(void **state)
 {
 	struct worker_init_data *tx_worker = get_tx_worker();
 
-	int32_t err_code = -12;
-	os_mailbox_write(&outgoing_err_queue, &err_code);
+	struct error_entry err_entry = {
+		.err_code = -12,
+		.transaction_id = NO_TRANSACTION_ID
+	};
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
 	char check_buf[200];
-	ssize_t len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	ssize_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
@@ -749,16 +1086,1140 @@ static void err_msg_test(void **state)
 
 
 
-	err_code = 1203;
-	os_mailbox_write(&outgoing_err_queue, &err_code);
+	err_entry.err_code = 1203;
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
 
-	tx_worker->action(tx_worker->action_params);
+	run_tx_worker(tx_worker);
 
-	len = os_char_buffer_read_buf(&bsp_tx_buffer, check_buf, sizeof(check_buf));
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
 	assert_int_not_equal(len, 0);
 	check_buf[len] = '\0';
 
 	assert_string_equal(check_buf, "$FAKE,ERROR,1203*51\r\n");
+
+}
+
+static void err_coalescing_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+	// Stop the clock.
+	fake_time_step_us = 0;
+	fake_time_us = 1000;
+
+	// Only the first one of a burst gets sent right away.
+	struct error_entry err_entry = {
+		.err_code = -12,
+		.transaction_id = NO_TRANSACTION_ID
+	};
+	for (uint8_t i = 0; i < 3; i++) {
+		os_mailbox_write(&outgoing_err_queue, &err_entry);
+	}
+
+	run_tx_worker(tx_worker);
+
+	char check_buf[200];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$FAKE,ERROR,-12*7F\r\n");
+
+
+	// Other error codes aren't held back by it.
+	err_entry.err_code = -13;
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+
+	fake_time_us = 1500;
+	err_entry.err_code = -12;
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$FAKE,ERROR,-13*7E\r\n");
+
+
+	// Errors of a transaction carry its ID, and are never held back, nor
+	// counted in the report.
+	err_entry.transaction_id = 4321;
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf,
+	                    "$4321,FAKE,ERROR,-12*57\r\n"
+	                    "$4321,FAKE,ERROR,-12*57\r\n");
+
+	err_entry.transaction_id = NO_TRANSACTION_ID;
+
+
+	// Not yet time for the report.
+	fake_time_us = 1000 + ERR_REPORT_INTERVAL_US - 1;
+
+	run_tx_worker(tx_worker);
+
+	char ch = '\0';
+	assert_false(byte_ring_read_byte(&bsp_tx_buffer, (uint8_t *) &ch));
+
+
+	// The rest of the burst goes out in a single report.
+	fake_time_us = 1000 + ERR_REPORT_INTERVAL_US;
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$FAKE,ERROR_REPORT,-12,3,1000,1500*34\r\n");
+
+
+	// After a quiet interval, errors get sent right away again.
+	fake_time_us += ERR_REPORT_INTERVAL_US;
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$FAKE,ERROR,-12*7F\r\n");
+}
+
+/**
+ * Reads the next frame out of the TX ring, and returns whether it was one of
+ * other_fake_subsystem's messages.
+ */
+static bool read_scheduled_msg(uint32_t *frame_len)
+{
+	char check_buf[BSP_MAX_MESSAGE_LENGTH + 1];
+	uint32_t len = 0;
+
+	char ch = '\0';
+	while (len < sizeof(check_buf) - 1 &&
+	       byte_ring_read_byte(&bsp_tx_buffer, (uint8_t *) &ch)) {
+
+		check_buf[len++] = ch;
+		if (ch == '\n') {
+			break;
+		}
+	}
+
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	*frame_len = len;
+
+	if (strncmp(check_buf, "$1235,OTHER,", 12) == 0) {
+		return true;
+	}
+
+	assert_memory_equal(check_buf, "$1235,FAKE,", 11);
+	return false;
+}
+
+static void tx_scheduling_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+	struct fake_data_struct fake_data;
+	struct message msg = {
+		.type = FAKE_SER_DES_MESSAGE,
+		.transaction_id = 1235,
+		.data = &fake_data
+	};
+
+	struct message *msg_p = &msg;
+
+	// Payloads long enough for a few messages to use up a quantum.
+	uint32_t payload_len = BSP_MAX_MESSAGE_LENGTH * 2 / 5;
+	serialized_msg_buf[0] = ',';
+	memset(&serialized_msg_buf[1], 'x', payload_len - 1);
+	serialized_msg_buf[payload_len] = '\0';
+
+	for (uint8_t i = 0; i < 6; i++) {
+		os_mailbox_write(&outgoing_msg_queue, &msg_p);
+		os_mailbox_write(&other_outgoing_msg_queue, &msg_p);
+	}
+
+	struct error_entry err_entry = {
+		.err_code = -12,
+		.transaction_id = NO_TRANSACTION_ID
+	};
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+
+	expect_value_count(msg_serialization_func, msg_ptr, (uintptr_t) msg_p, 12);
+	will_return_count(msg_serialization_func, strlen(serialized_msg_buf), 12);
+
+	expect_value_count(fake_free, msg_ptr, (uintptr_t) msg_p, 12);
+
+	// Everything fits into the TX ring, so it all goes out in one go.
+	run_tx_worker(tx_worker);
+
+	// Errors go first, even though they were enqueued last.
+	char check_buf[200];
+	uint32_t len = 0;
+	char ch = '\0';
+	while (byte_ring_read_byte(&bsp_tx_buffer, (uint8_t *) &ch)) {
+		check_buf[len++] = ch;
+		if (ch == '\n') {
+			break;
+		}
+	}
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$FAKE,ERROR,-12*7F\r\n");
+
+	// FAKE comes first in the registry, so it goes first, but only until it has
+	// sent a quantum worth of bytes (BSP_MAX_MESSAGE_LENGTH).
+	uint32_t frame_len = 0;
+	assert_false(read_scheduled_msg(&frame_len));
+
+	uint32_t num_fake_msgs = (BSP_MAX_MESSAGE_LENGTH + frame_len - 1) / frame_len;
+	for (uint32_t i = 1; i < num_fake_msgs; i++) {
+		assert_false(read_scheduled_msg(&frame_len));
+	}
+
+	// OTHER has twice the weight, so it gets twice the bytes.
+	assert_true(read_scheduled_msg(&frame_len));
+
+	uint32_t num_other_msgs = (2 * BSP_MAX_MESSAGE_LENGTH + frame_len - 1) / frame_len;
+	for (uint32_t i = 1; i < num_other_msgs; i++) {
+		assert_true(read_scheduled_msg(&frame_len));
+	}
+
+	// Then it's FAKE's turn again, with the bytes it went over in its last
+	// turn taken off its quantum.
+	assert_false(read_scheduled_msg(&frame_len));
+
+	// The rest
+	uint32_t num_msgs = num_fake_msgs + num_other_msgs + 1;
+	while (num_msgs < 12) {
+		read_scheduled_msg(&frame_len);
+		num_msgs++;
+	}
+
+	assert_false(byte_ring_read_byte(&bsp_tx_buffer, (uint8_t *) &ch));
+}
+
+static void stats_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *rx_worker = get_rx_worker();
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+	bsp_uart_stats.rx_overruns = 2;
+	bsp_uart_stats.rx_dropped = 3;
+
+	// A checksum error, an allocation failure, and a routed message.
+	char bad_csum_str[] = "$456,FAKE,SER_DES_MESSAGE,PAYLOAD*1D\r\n";
+	char correct_msg_str[] = "$456,FAKE,SER_DES_MESSAGE,PAYLOAD*01\r\n";
+
+	write_rx_str(bad_csum_str);
+	write_rx_str(correct_msg_str);
+	write_rx_str(correct_msg_str);
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, NULL);
+
+	struct message msg = {0};
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "PAYLOAD");
+	will_return(msg_parsing_func, true);
+
+	expect_tx_notify();
+	expect_tx_notify();
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	// All errors go out in one go, starting with the dropped characters.
+	run_tx_worker(tx_worker);
+
+	char check_buf[200];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf,
+	                    "$DISPATCHER,ERROR,-10*73\r\n"
+	                    "$DISPATCHER,ERROR,-1*43\r\n"
+	                    "$456,DISPATCHER,ERROR,-4*5D\r\n");
+
+
+	// A message of the subsystem gets sent.
+	struct message *msg_p = &msg;
+	os_mailbox_write(&outgoing_msg_queue, &msg_p);
+
+	strcpy(serialized_msg_buf, ",PAYLOAD");
+
+	expect_value(msg_serialization_func, msg_ptr, (uintptr_t) msg_p);
+	will_return(msg_serialization_func, strlen(serialized_msg_buf));
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+
+
+	// Dispatcher-wide counters
+	char get_stats_str[] = "$7,DISPATCHER,GET_STATS*78\r\n";
+	write_rx_str(get_stats_str);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$7,DISPATCHER,STATS_REPLY,3,1,0,2,3,114,4,80,0*5B\r\n");
+
+
+	// The subsystem's counters
+	char get_subsystem_stats_str[] = "$8,DISPATCHER,GET_SUBSYSTEM_STATS,FAKE*4C\r\n";
+	write_rx_str(get_subsystem_stats_str);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$8,DISPATCHER,SUBSYSTEM_STATS_REPLY,FAKE,1,1,1,0*49\r\n");
+
+
+	// Unknown subsystem
+	char unknown_subsystem_str[] = "$9,DISPATCHER,GET_SUBSYSTEM_STATS,NONEXISTENT*07\r\n";
+	write_rx_str(unknown_subsystem_str);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$9,DISPATCHER,ERROR,-2*55\r\n");
+}
+
+static void latency_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *rx_worker = get_rx_worker();
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+	// Stop the clock, and move it by hand.
+	fake_time_step_us = 0;
+	fake_time_us = 1000;
+
+	char msg_str[] = "$4321,FAKE,SER_DES_MESSAGE,PAYLOAD*32\r\n";
+	write_rx_str(msg_str);
+
+	struct message msg = {0};
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "PAYLOAD");
+	will_return(msg_parsing_func, true);
+
+	rx_worker->action(rx_worker->action_params);
+
+
+	// The subsystem takes 3 ms to reply.
+	struct message *msg_p = NULL;
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+
+	fake_time_us = 2000;
+	dispatcher_trace_message(msg_p->transaction_id, MESSAGE_TRACE_DEQUEUED);
+
+	fake_time_us = 5000;
+	dispatcher_trace_message(msg_p->transaction_id, MESSAGE_TRACE_REPLY_ENQUEUED);
+	os_mailbox_write(&outgoing_msg_queue, &msg_p);
+
+	fake_time_us = 6000;
+	strcpy(serialized_msg_buf, ",PAYLOAD");
+
+	expect_value(msg_serialization_func, msg_ptr, (uintptr_t) msg_p);
+	will_return(msg_serialization_func, strlen(serialized_msg_buf));
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
+
+	run_tx_worker(tx_worker);
+
+	char check_buf[200];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_equal(len, strlen(msg_str));
+
+
+	// The 39 byte reply leaves about 3.4 ms after getting serialized, 6.4 ms
+	// after the request came in.
+	char get_total_str[] = "$7,DISPATCHER,GET_LATENCY,7*6A\r\n";
+	write_rx_str(get_total_str);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$7,DISPATCHER,LATENCY_REPLY,7,0,0,0,0,1,0,0,0*6F\r\n");
+
+
+	// The message waited 1 ms in the subsystem's queue.
+	char get_routed_str[] = "$8,DISPATCHER,GET_LATENCY,3*61\r\n";
+	write_rx_str(get_routed_str);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$8,DISPATCHER,LATENCY_REPLY,3,0,0,1,0,0,0,0,0*64\r\n");
+
+
+	// Unknown stage
+	char bad_stage_str[] = "$9,DISPATCHER,GET_LATENCY,8*6B\r\n";
+	write_rx_str(bad_stage_str);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$9,DISPATCHER,ERROR,-2*55\r\n");
+
+
+	// A message received in fragments starts with its first fragment, and
+	// is done with its last one, 5 ms later.
+	fake_time_us = 10000;
+	write_ascii_frame("4322/0+,FAKE,SER_DES_MESSAGE,PAY");
+	rx_worker->action(rx_worker->action_params);
+
+	fake_time_us = 15000;
+	write_ascii_frame("4322/1,LOAD");
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 2);
+	expect_string(msg_parsing_func, first_field, "PAY");
+	will_return(msg_parsing_func, true);
+
+	rx_worker->action(rx_worker->action_params);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	dispatcher_trace_message(msg_p->transaction_id, MESSAGE_TRACE_DEQUEUED);
+	dispatcher_trace_message(msg_p->transaction_id, MESSAGE_TRACE_REPLY_ENQUEUED);
+	os_mailbox_write(&outgoing_msg_queue, &msg_p);
+
+	expect_value(msg_serialization_func, msg_ptr, (uintptr_t) msg_p);
+	will_return(msg_serialization_func, strlen(serialized_msg_buf));
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+
+	write_ascii_frame("10,DISPATCHER,GET_LATENCY,0");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf) - 1);
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	char expected[80];
+	format_ascii_frame(expected, sizeof(expected),
+	                   "10,DISPATCHER,LATENCY_REPLY,0,1,0,0,0,1,0,0,0");
+	assert_string_equal(check_buf, expected);
+}
+
+static void subscription_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *rx_worker = get_rx_worker();
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+	// The clock only moves when told to.
+	fake_time_step_us = 0;
+
+
+	// Subscribe, with a period below the minimum.
+	write_rx_str("$20,DISPATCHER,SUBSCRIBE,FAKE,SER_DES_MESSAGE,5,ARG*78\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	char check_buf[200];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$20,DISPATCHER,SUBSCRIBE_REPLY,10*6D\r\n");
+
+
+	// The first request gets routed right away, under the subscription ID.
+	struct message msg = {0};
+	struct message *msg_p = NULL;
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "ARG");
+	will_return(msg_parsing_func, true);
+
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, SUBSCRIPTION_MIN_PERIOD_MS * OS_TICK_RATE_HZ / 1000);
+	rx_worker->action(rx_worker->action_params);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	assert_ptr_equal(msg_p, &msg);
+	assert_int_equal(msg.type, FAKE_SER_DES_MESSAGE);
+	assert_int_equal(msg.transaction_id, 20);
+
+
+	// Halfway through the period, nothing is due yet.
+	fake_time_us += SUBSCRIPTION_MIN_PERIOD_MS * 1000 / 2;
+
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, SUBSCRIPTION_MIN_PERIOD_MS * OS_TICK_RATE_HZ / 2000);
+	rx_worker->action(rx_worker->action_params);
+
+	assert_false(os_mailbox_read(&incoming_msg_queue, &msg_p));
+
+
+	// At the end of it, the next request gets routed.
+	fake_time_us += SUBSCRIPTION_MIN_PERIOD_MS * 1000 / 2;
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "ARG");
+	will_return(msg_parsing_func, true);
+
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, SUBSCRIPTION_MIN_PERIOD_MS * OS_TICK_RATE_HZ / 1000);
+	rx_worker->action(rx_worker->action_params);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	assert_int_equal(msg.transaction_id, 20);
+
+
+	// Unsubscribe
+	write_rx_str("$21,DISPATCHER,UNSUBSCRIBE,20*79\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$21,DISPATCHER,UNSUBSCRIBE_REPLY,20*74\r\n");
+
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, COMM_TASK_SLEEP_TIME_TICKS);
+	rx_worker->action(rx_worker->action_params);
+
+
+	// Errors get reported in full from here on.
+	fake_time_step_us = ERR_REPORT_INTERVAL_US;
+
+
+	// Unknown subscription
+	write_rx_str("$22,DISPATCHER,UNSUBSCRIBE,20*7A\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$22,DISPATCHER,ERROR,-2*6C\r\n");
+
+
+	// Message that isn't subscribable
+	write_rx_str("$23,DISPATCHER,SUBSCRIBE,FAKE,DES_ONLY_MESSAGE,100*57\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$23,DISPATCHER,ERROR,-2*6D\r\n");
+
+
+	// A request that fails to parse drops its subscription. The period gets
+	// clamped to the maximum.
+	write_rx_str("$24,DISPATCHER,SUBSCRIBE,FAKE,SER_DES_MESSAGE,100000*30\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$24,DISPATCHER,SUBSCRIBE_REPLY,60000*5E\r\n");
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 0);
+	expect_string(msg_parsing_func, first_field, "");
+	will_return(msg_parsing_func, false);
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) &msg);
+
+	expect_tx_notify();
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, COMM_TASK_SLEEP_TIME_TICKS);
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$24,DISPATCHER,ERROR,-2*6A\r\n");
+
+	assert_false(os_mailbox_read(&incoming_msg_queue, &msg_p));
+}
+
+static void credits_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *rx_worker = get_rx_worker();
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+	// The clock only moves when told to.
+	fake_time_step_us = 0;
+
+
+	// Only the subsystems with an incoming queue advertise credits.
+	write_rx_str("$30,DISPATCHER,GET_CREDITS*53\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	char check_buf[200];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$30,DISPATCHER,CREDITS_REPLY,FAKE,9*67\r\n");
+
+
+	// A routed request takes a credit.
+	struct message msg = {0};
+	struct message *msg_p = NULL;
+
+	write_rx_str("$456,FAKE,SER_DES_MESSAGE,PAYLOAD*01\r\n");
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 1);
+	expect_string(msg_parsing_func, first_field, "PAYLOAD");
+	will_return(msg_parsing_func, true);
+
+	rx_worker->action(rx_worker->action_params);
+
+	write_rx_str("$31,DISPATCHER,GET_CREDITS*52\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$31,DISPATCHER,CREDITS_REPLY,FAKE,8*67\r\n");
+
+
+	// Taking the request off the queue gives the credit back, which a
+	// subscription reports right away.
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	dispatcher_message_taken(&fake_subsystem);
+
+	write_rx_str("$32,DISPATCHER,SUBSCRIBE,DISPATCHER,GET_CREDITS,10*33\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$32,DISPATCHER,SUBSCRIBE_REPLY,10*6E\r\n");
+
+	expect_tx_notify();
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, SUBSCRIPTION_MIN_PERIOD_MS * OS_TICK_RATE_HZ / 1000);
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$32,DISPATCHER,CREDITS_REPLY,FAKE,9*65\r\n");
+
+
+	// Characters the UART had to drop get reported once.
+	bsp_uart_stats.rx_dropped++;
+
+	expect_tx_notify();
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, SUBSCRIPTION_MIN_PERIOD_MS * OS_TICK_RATE_HZ / 1000);
+	rx_worker->action(rx_worker->action_params);
+
+	expect_value(worker_wait, worker, (uintptr_t) rx_worker->worker);
+	expect_value(worker_wait, max_ticks, SUBSCRIPTION_MIN_PERIOD_MS * OS_TICK_RATE_HZ / 1000);
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-10*73\r\n");
+}
+
+/**
+ * Asks for the credits, and checks the FAKE subsystem's in the reply.
+ */
+static void check_fake_credits(uint32_t credits)
+{
+	struct worker_init_data *rx_worker = get_rx_worker();
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+	write_ascii_frame("40,DISPATCHER,GET_CREDITS");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	char check_buf[200];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf) - 1);
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	char body[64];
+	snprintf(body, sizeof(body), "40,DISPATCHER,CREDITS_REPLY,FAKE,%u", credits);
+
+	char expected[80];
+	format_ascii_frame(expected, sizeof(expected), body);
+
+	assert_string_equal(check_buf, expected);
+}
+
+static void slab_credits_test(void **state)
+{
+	(void) state;
+
+	fake_time_step_us = 0;
+
+	// The FAKE subsystem's requests take large slots from now on, which are
+	// fewer than its queue can hold. One of them is left for a reply.
+	fake_subsystem.request_payload_size = MESSAGE_SLAB_LARGE_PAYLOAD_SIZE;
+	check_fake_credits(MESSAGE_SLAB_LARGE_SLOTS - 1);
+
+	struct message *taken[MESSAGE_SLAB_LARGE_SLOTS];
+	for (uint32_t i = 0; i < MESSAGE_SLAB_LARGE_SLOTS; i++) {
+		taken[i] = message_slab_alloc(FAKE_SER_DES_MESSAGE, MESSAGE_SLAB_LARGE_PAYLOAD_SIZE);
+		assert_non_null(taken[i]);
+	}
+
+	check_fake_credits(0);
+
+	// Small messages don't take the large slots.
+	struct message *small = message_slab_alloc(FAKE_SER_DES_MESSAGE, MESSAGE_SLAB_SMALL_PAYLOAD_SIZE);
+	assert_non_null(small);
+
+	for (uint32_t i = 0; i < MESSAGE_SLAB_LARGE_SLOTS; i++) {
+		message_slab_free(taken[i]);
+	}
+
+	check_fake_credits(MESSAGE_SLAB_LARGE_SLOTS - 1);
+
+	// Small requests are limited by the small slots only, so they aren't
+	// held back by the few large ones.
+	fake_subsystem.request_payload_size = MESSAGE_SLAB_SMALL_PAYLOAD_SIZE;
+	uint32_t small_credits = MESSAGE_SLAB_SMALL_SLOTS - 2;
+	if (small_credits > ARRAY_SIZE(incoming_msg_queue_buf) - 1) {
+		small_credits = ARRAY_SIZE(incoming_msg_queue_buf) - 1;
+	}
+	assert_true(small_credits > MESSAGE_SLAB_LARGE_SLOTS - 1);
+	check_fake_credits(small_credits);
+
+	for (uint32_t i = 0; i < MESSAGE_SLAB_LARGE_SLOTS; i++) {
+		taken[i] = message_slab_alloc(FAKE_SER_DES_MESSAGE, MESSAGE_SLAB_LARGE_PAYLOAD_SIZE);
+		assert_non_null(taken[i]);
+	}
+
+	check_fake_credits(small_credits);
+
+	for (uint32_t i = 0; i < MESSAGE_SLAB_LARGE_SLOTS; i++) {
+		message_slab_free(taken[i]);
+	}
+
+	message_slab_free(small);
+}
+
+static void fragmentation_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *rx_worker = get_rx_worker();
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+
+	// A payload of about one and a half frames goes out in two fragments,
+	// split between fields.
+	const char field[] = ",0123456789";
+	uint32_t num_fields = BSP_MAX_MESSAGE_LENGTH * 3 / 2 / (sizeof(field) - 1);
+
+	serialized_msg_buf[0] = '\0';
+	for (uint32_t i = 0; i < num_fields; i++) {
+		strcat(serialized_msg_buf, field);
+	}
+
+	struct message msg = {
+		.type = FAKE_STREAMED_MESSAGE,
+		.transaction_id = 30
+	};
+	struct message *msg_p = &msg;
+
+	os_mailbox_write(&outgoing_msg_queue, &msg_p);
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
+
+	run_tx_worker(tx_worker);
+
+	char check_buf[4 * BSP_MAX_MESSAGE_LENGTH];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf) - 1);
+	check_buf[len] = '\0';
+
+	const char *headers[] = {"$30/0+,FAKE,STREAMED_MESSAGE", "$30/1"};
+	char payload[2 * BSP_MAX_MESSAGE_LENGTH] = "";
+	char *frame = check_buf;
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(headers); i++) {
+		char *end = strstr(frame, "\r\n");
+		assert_non_null(end);
+		assert_true(end + 2 - frame <= BSP_MAX_MESSAGE_LENGTH - 1);
+
+		char *csum_start = end - 3;
+		assert_int_equal(*csum_start, '*');
+
+		uint8_t csum = 0;
+		for (char *ch = frame + 1; ch < csum_start; ch++) {
+			csum ^= (uint8_t) *ch;
+		}
+		assert_int_equal(strtoul(csum_start + 1, NULL, 16), csum);
+
+		size_t header_len = strlen(headers[i]);
+		assert_memory_equal(frame, headers[i], header_len);
+		assert_int_equal(frame[header_len], ',');
+
+		strncat(payload, frame + header_len, (size_t) (csum_start - frame) - header_len);
+
+		frame = end + 2;
+	}
+
+	assert_int_equal(*frame, '\0');
+	assert_string_equal(payload, serialized_msg_buf);
+
+
+	// A payload that fits into a single frame goes out as usual.
+	strcpy(serialized_msg_buf, ",SHORT");
+	os_mailbox_write(&outgoing_msg_queue, &msg_p);
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf) - 1);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$30,FAKE,STREAMED_MESSAGE,SHORT*7D\r\n");
+
+
+	// An incoming message longer than a frame gets reassembled from its
+	// fragments.
+	char long_field[BSP_MAX_MESSAGE_LENGTH / 2 + 1];
+	memset(long_field, 'x', sizeof(long_field) - 1);
+	long_field[sizeof(long_field) - 1] = '\0';
+
+	char body[BSP_MAX_MESSAGE_LENGTH];
+
+	// The RX buffer only holds about a frame, so they go in one by one.
+	snprintf(body, sizeof(body), "31/0+,FAKE,SER_DES_MESSAGE,%s", long_field);
+	write_ascii_frame(body);
+	rx_worker->action(rx_worker->action_params);
+
+	snprintf(body, sizeof(body), "31/1+,%s", long_field);
+	write_ascii_frame(body);
+	rx_worker->action(rx_worker->action_params);
+
+	write_ascii_frame("31/2,LAST");
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, &msg);
+
+	expect_value(msg_parsing_func, msg_ptr, (uintptr_t) &msg);
+	expect_value(msg_parsing_func, num_fields, 3);
+	expect_string(msg_parsing_func, first_field, long_field);
+	will_return(msg_parsing_func, true);
+
+	rx_worker->action(rx_worker->action_params);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	assert_int_equal(msg_p->type, FAKE_SER_DES_MESSAGE);
+	assert_int_equal(msg_p->transaction_id, 31);
+
+
+	// Another frame in between the fragments drops the message. So does a
+	// fragment that doesn't continue anything.
+	write_ascii_frame("32/0+,FAKE,SER_DES_MESSAGE,A");
+	write_ascii_frame("33,NOPE,MSG");
+	write_ascii_frame("32/1,B,C");
+
+	expect_tx_notify();
+	expect_tx_notify();
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf) - 1);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf,
+	                    "$32,DISPATCHER,ERROR,-2*6D\r\n"
+	                    "$33,DISPATCHER,ERROR,-6*68\r\n"
+	                    "$32,DISPATCHER,ERROR,-2*6D\r\n");
+}
+
+static void binary_protocol_test(void **state)
+{
+	(void) state;
+
+	struct worker_init_data *rx_worker = get_rx_worker();
+	struct worker_init_data *tx_worker = get_tx_worker();
+
+
+	// Switch to the binary protocol. The reply still comes in ASCII.
+	write_rx_str("$1,DISPATCHER,SET_PROTOCOL,BINARY*1E\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	char check_buf[200];
+	uint32_t len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$1,DISPATCHER,PROTOCOL_REPLY,BINARY*0E\r\n");
+
+
+
+	// Incoming message, with zeroes in the payload
+	struct message msg = {0};
+	struct message *msg_p = &msg;
+
+	uint8_t payload[] = {0xAA, 0x00, 0x00, 0xBB};
+	write_binary_frame(77, 1, FAKE_SER_DES_MESSAGE, payload, sizeof(payload), false);
+
+	expect_value(fake_alloc, message_type, FAKE_SER_DES_MESSAGE);
+	will_return(fake_alloc, msg_p);
+
+	expect_value(msg_binary_parsing_func, msg_ptr, (uintptr_t) msg_p);
+	expect_value(msg_binary_parsing_func, payload_len, sizeof(payload));
+	expect_memory(msg_binary_parsing_func, payload, payload, sizeof(payload));
+	will_return(msg_binary_parsing_func, true);
+
+	rx_worker->action(rx_worker->action_params);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg_p));
+	assert_int_equal(msg_p->type, FAKE_SER_DES_MESSAGE);
+	assert_int_equal(msg_p->transaction_id, 77);
+
+
+
+	// Outgoing message
+	msg.transaction_id = 78;
+	os_mailbox_write(&outgoing_msg_queue, &msg_p);
+
+	memcpy(serialized_msg_buf, payload, sizeof(payload));
+
+	expect_value(msg_binary_serialization_func, msg_ptr, (uintptr_t) msg_p);
+	will_return(msg_binary_serialization_func, sizeof(payload));
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg_p);
+
+	run_tx_worker(tx_worker);
+
+	uint8_t frame[64];
+	len = read_binary_frame(frame, sizeof(frame));
+
+	assert_int_equal(len, 8 + sizeof(payload));
+	assert_int_equal(bin_get_u32(&frame[0]), 78);
+	assert_int_equal(frame[4], 1);
+	assert_int_equal(frame[5], FAKE_SER_DES_MESSAGE);
+	assert_memory_equal(&frame[6], payload, sizeof(payload));
+
+
+
+	// Bad CRC
+	write_binary_frame(79, 1, FAKE_SER_DES_MESSAGE, payload, sizeof(payload), true);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = read_binary_frame(frame, sizeof(frame));
+
+	assert_int_equal(len, 8 + sizeof(int32_t));
+	assert_int_equal(bin_get_u32(&frame[0]), NO_TRANSACTION_ID);
+	assert_int_equal(frame[4], DISPATCHER_SUBSYSTEM_ID);
+	assert_int_equal(frame[5], BINARY_ERROR_MESSAGE_ID);
+	assert_int_equal(bin_get_i32(&frame[6]), RX_CHECKSUM_ERROR);
+
+
+
+	// Unknown subsystem, and missing binary parsing function. The errors
+	// carry the transaction IDs of the offending messages.
+	write_binary_frame(80, 5, 0, NULL, 0, false);
+	write_binary_frame(81, 1, FAKE_DES_ONLY_MESSAGE, NULL, 0, false);
+
+	expect_tx_notify();
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	// Both errors go out in one go.
+	run_tx_worker(tx_worker);
+	len = read_binary_frame(frame, sizeof(frame));
+	assert_int_equal(bin_get_u32(&frame[0]), 80);
+	assert_int_equal(bin_get_i32(&frame[6]), UNKNOWN_SUBSYSTEM_ERROR);
+
+	len = read_binary_frame(frame, sizeof(frame));
+	assert_int_equal(bin_get_u32(&frame[0]), 81);
+	assert_int_equal(bin_get_i32(&frame[6]), MISSING_MESSAGE_HANDLER_ERROR);
+
+
+
+	// Switch back to ASCII. The reply still comes in binary.
+	uint8_t ascii_protocol = DISPATCHER_PROTOCOL_ASCII;
+	write_binary_frame(82, DISPATCHER_SUBSYSTEM_ID, 0, &ascii_protocol, 1, false);
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = read_binary_frame(frame, sizeof(frame));
+
+	assert_int_equal(len, 9);
+	assert_int_equal(bin_get_u32(&frame[0]), 82);
+	assert_int_equal(frame[4], DISPATCHER_SUBSYSTEM_ID);
+	assert_int_equal(frame[5], 1);
+	assert_int_equal(frame[6], DISPATCHER_PROTOCOL_ASCII);
+
+	write_rx_str("$456,FAKE,SER_DES_MESSAGE,PAYLOADX1D\r\n");
+
+	expect_tx_notify();
+	rx_worker->action(rx_worker->action_params);
+
+	run_tx_worker(tx_worker);
+
+	len = byte_ring_read(&bsp_tx_buffer, (uint8_t *) check_buf, sizeof(check_buf));
+	assert_int_not_equal(len, 0);
+	check_buf[len] = '\0';
+
+	assert_string_equal(check_buf, "$DISPATCHER,ERROR,-1*43\r\n");
 }
 
 int main(void)
@@ -767,7 +2228,16 @@ int main(void)
 		cmocka_unit_test(init_test),
 		cmocka_unit_test_setup_teardown(send_msg_test, setup, teardown),
 		cmocka_unit_test_setup_teardown(recv_msg_test, setup, teardown),
-		cmocka_unit_test_setup_teardown(err_msg_test, setup, teardown)
+		cmocka_unit_test_setup_teardown(err_msg_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(err_coalescing_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(tx_scheduling_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(stats_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(latency_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(subscription_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(credits_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(slab_credits_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(fragmentation_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(binary_protocol_test, setup, teardown)
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,530 @@
+/**
+ * @file
+ *
+ * This file contains unit tests for the Ratfist message dispatcher talking over
+ * two links at the same time. Built with BSP_SECOND_LINK.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <mouros/common.h>
+
+#include <ratfist_stubs/worker_stub_helpers.h>
+
+#include "../src/bsp.h"
+#include "../src/byte_ring.h"
+#include "../src/constants.h"
+#include "../src/errors.h"
+#include "../src/message_dispatcher.h"
+
+#define NUM_TEST_LINKS 2
+
+/** The transaction ID tag of the second link, see LINK_ID_SHIFT. */
+#define SECOND_LINK_TAG (1u << 28)
+
+/** One slot of a mailbox always stays free. */
+#define ROUTED_QUEUE_CAPACITY (ROUTED_QUEUE_SIZE - 1)
+
+#define TEST_RX_RING_SIZE 2048
+#define TEST_TX_RING_SIZE 8192
+
+struct byte_ring bsp_rx_buffer;
+struct byte_ring bsp_tx_buffer;
+volatile struct bsp_uart_stats bsp_uart_stats;
+
+static struct byte_ring second_rx_buffer;
+static struct byte_ring second_tx_buffer;
+static volatile struct bsp_uart_stats second_uart_stats;
+
+static uint8_t rx_buffer_data[NUM_TEST_LINKS][TEST_RX_RING_SIZE];
+static uint8_t tx_buffer_data[NUM_TEST_LINKS][BYTE_RING_MEM_SIZE(TEST_TX_RING_SIZE, BSP_TX_MAX_RESERVATION)];
+
+const struct bsp_link bsp_links[BSP_NUM_LINKS] = {
+	{ &bsp_rx_buffer, &bsp_tx_buffer, &bsp_uart_stats },
+	{ &second_rx_buffer, &second_tx_buffer, &second_uart_stats }
+};
+
+void bsp_set_rx_notify_callback(void (*callback)(void))
+{
+	(void) callback;
+}
+
+static uint32_t fake_time_us = 0;
+
+uint32_t bsp_get_timestamp_us(void)
+{
+	fake_time_us += ERR_REPORT_INTERVAL_US;
+	return fake_time_us;
+}
+
+
+#define FAKE_REQUEST 0
+#define FAKE_REPLY 1
+
+static mailbox_t incoming_msg_queue;
+static struct message *incoming_msg_queue_buf[10];
+
+static mailbox_t outgoing_msg_queue;
+static struct message *outgoing_msg_queue_buf[10];
+
+static mailbox_t outgoing_err_queue;
+static struct error_entry outgoing_err_queue_buf[10];
+
+static struct message fake_msg;
+
+static struct message *fake_alloc(uint32_t message_type)
+{
+	(void) message_type;
+
+	return &fake_msg;
+}
+
+static void fake_free(struct message *msg_ptr)
+{
+	check_expected_ptr(msg_ptr);
+}
+
+static bool parse_request(struct message *msg_ptr,
+                          const struct message_field *fields,
+                          uint32_t num_fields)
+{
+	(void) msg_ptr;
+	(void) fields;
+
+	return num_fields == 0;
+}
+
+static ssize_t serialize_reply(const struct message *msg_ptr,
+                               char *output_str,
+                               uint32_t output_str_max_len)
+{
+	(void) msg_ptr;
+
+	return snprintf(output_str, output_str_max_len, ",42");
+}
+
+static struct message_handler handlers[] = {
+	{
+		.message_name = "REQUEST",
+		.parsing_func = parse_request
+	},
+	{
+		.message_name = "REPLY",
+		.serialization_func = serialize_reply
+	}
+};
+
+static struct subsystem_message_conf fake_subsystem = {
+	.subsystem_name = "FAKE",
+	.outgoing_msg_queue = &outgoing_msg_queue,
+	.incoming_msg_queue = &incoming_msg_queue,
+	.outgoing_err_queue = &outgoing_err_queue,
+	.message_handlers = handlers,
+	.num_message_types = ARRAY_SIZE(handlers),
+	.alloc_message = fake_alloc,
+	.free_message = fake_free
+};
+
+static struct subsystem_message_conf *fake_init(void)
+{
+	return &fake_subsystem;
+}
+
+RATFIST_SUBSYSTEM(fake, fake_init);
+
+
+/**
+ * Writes an ASCII frame with the body, and its checksum.
+ */
+static void format_frame(char *frame, uint32_t frame_size, const char *body)
+{
+	uint8_t csum = 0;
+	for (const char *ch = body; *ch != '\0'; ch++) {
+		csum ^= (uint8_t) *ch;
+	}
+
+	snprintf(frame, frame_size, "$%s*%02X\r\n", body, csum);
+}
+
+static void write_frame(struct byte_ring *rx_buffer, const char *body)
+{
+	char frame[100];
+	format_frame(frame, sizeof(frame), body);
+
+	byte_ring_write(rx_buffer, (const uint8_t *) frame, (uint32_t) strlen(frame));
+}
+
+/**
+ * Checks that the TX ring holds exactly the frames of the bodies, in order.
+ */
+static void assert_sent(struct byte_ring *tx_buffer, const char *bodies[], uint32_t num_bodies)
+{
+	char expected[500] = "";
+	for (uint32_t i = 0; i < num_bodies; i++) {
+		char frame[100];
+		format_frame(frame, sizeof(frame), bodies[i]);
+		strcat(expected, frame);
+	}
+
+	char sent[500];
+	uint32_t len = byte_ring_read(tx_buffer, (uint8_t *) sent, sizeof(sent) - 1);
+	sent[len] = '\0';
+
+	assert_string_equal(sent, expected);
+}
+
+static struct worker_init_data *get_worker(uint32_t idx)
+{
+	struct worker_init_data *init_data = NULL;
+	assert_int_equal(worker_stubs_get_workers(&init_data), 2 * NUM_TEST_LINKS);
+
+	return &init_data[idx];
+}
+
+static struct worker_init_data *get_rx_worker(uint32_t link)
+{
+	return get_worker(2 * link);
+}
+
+static struct worker_init_data *get_tx_worker(uint32_t link)
+{
+	return get_worker(2 * link + 1);
+}
+
+/**
+ * Expects the TX workers of all links to get woken up, once a message gets
+ * enqueued for any of them.
+ */
+static void expect_tx_notify(void)
+{
+	for (uint32_t i = 0; i < NUM_TEST_LINKS; i++) {
+		expect_value(worker_notify, worker, (uintptr_t) get_tx_worker(i)->worker);
+	}
+}
+
+static void run_rx_worker(uint32_t link)
+{
+	struct worker_init_data *rx_worker = get_rx_worker(link);
+	rx_worker->action(rx_worker->action_params);
+}
+
+/**
+ * Runs a TX worker, which sends everything that's queued up for it, and then
+ * waits for new messages.
+ */
+static void run_tx_worker(uint32_t link)
+{
+	struct worker_init_data *tx_worker = get_tx_worker(link);
+
+	expect_value(worker_wait, worker, (uintptr_t) tx_worker->worker);
+	expect_value(worker_wait, max_ticks, COMM_TASK_SLEEP_TIME_TICKS);
+	tx_worker->action(tx_worker->action_params);
+}
+
+
+static int setup(void **state)
+{
+	(void) state;
+	worker_stubs_init();
+
+	for (uint32_t i = 0; i < NUM_TEST_LINKS; i++) {
+		byte_ring_init(bsp_links[i].rx_buffer,
+		               rx_buffer_data[i],
+		               TEST_RX_RING_SIZE,
+		               0,
+		               NULL);
+		byte_ring_init(bsp_links[i].tx_buffer,
+		               tx_buffer_data[i],
+		               TEST_TX_RING_SIZE,
+		               BSP_TX_MAX_RESERVATION,
+		               NULL);
+	}
+
+	os_mailbox_init(&incoming_msg_queue,
+	                incoming_msg_queue_buf,
+	                ARRAY_SIZE(incoming_msg_queue_buf),
+	                sizeof(struct message *),
+	                NULL);
+	os_mailbox_init(&outgoing_msg_queue,
+	                outgoing_msg_queue_buf,
+	                ARRAY_SIZE(outgoing_msg_queue_buf),
+	                sizeof(struct message *),
+	                NULL);
+	os_mailbox_init(&outgoing_err_queue,
+	                outgoing_err_queue_buf,
+	                ARRAY_SIZE(outgoing_err_queue_buf),
+	                sizeof(struct error_entry),
+	                NULL);
+
+	expect_any_count(worker_task_init, worker, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_task_init, name, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_task_init, stack_base, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_task_init, stack_size, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_task_init, priority, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_task_init, action, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_task_init, action_params, 2 * NUM_TEST_LINKS);
+	will_return_count(worker_task_init, true, 2 * NUM_TEST_LINKS);
+
+	expect_any_count(worker_start, worker, 2 * NUM_TEST_LINKS);
+	will_return_count(worker_start, true, 2 * NUM_TEST_LINKS);
+
+	dispatcher_init();
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	(void) state;
+	worker_stubs_deinit();
+
+	expect_any_count(worker_stop, worker, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_join, worker, 2 * NUM_TEST_LINKS);
+
+	dispatcher_deinit();
+
+	return 0;
+}
+
+static void init_test(void **state)
+{
+	(void) state;
+
+	assert_int_equal(BSP_NUM_LINKS, NUM_TEST_LINKS);
+
+	const char *names[] = { "rx_worker", "tx_worker", "rx_worker1", "tx_worker1" };
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(names); i++) {
+		expect_any(worker_task_init, worker);
+		expect_string(worker_task_init, name, names[i]);
+		expect_any(worker_task_init, stack_base);
+		expect_value(worker_task_init, stack_size,
+		             (i % 2 == 0) ? TASK_STACK_SIZE : TX_TASK_STACK_SIZE);
+		expect_value(worker_task_init, priority, COMM_TASK_PRIORITY);
+		expect_any(worker_task_init, action);
+		expect_any(worker_task_init, action_params);
+		will_return(worker_task_init, true);
+	}
+
+	expect_any_count(worker_start, worker, 2 * NUM_TEST_LINKS);
+	will_return_count(worker_start, true, 2 * NUM_TEST_LINKS);
+
+	dispatcher_init();
+
+	expect_any_count(worker_stop, worker, 2 * NUM_TEST_LINKS);
+	expect_any_count(worker_join, worker, 2 * NUM_TEST_LINKS);
+
+	dispatcher_deinit();
+}
+
+static void reply_routing_test(void **state)
+{
+	(void) state;
+
+	struct message *msg = NULL;
+
+	// A request on the second link carries the link's tag to the
+	// subsystem.
+	write_frame(&second_rx_buffer, "7,FAKE,REQUEST");
+	run_rx_worker(1);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg));
+	assert_ptr_equal(msg, &fake_msg);
+	assert_int_equal(msg->transaction_id, 7 | SECOND_LINK_TAG);
+
+	// The control link's TX worker takes the reply off the subsystem's
+	// queue, and hands it over.
+	msg->type = FAKE_REPLY;
+	os_mailbox_write(&outgoing_msg_queue, &msg);
+
+	expect_tx_notify();
+	run_tx_worker(0);
+	assert_sent(&bsp_tx_buffer, NULL, 0);
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg);
+	run_tx_worker(1);
+
+	const char *second_link_reply[] = { "7,FAKE,REPLY,42" };
+	assert_sent(&second_tx_buffer, second_link_reply, 1);
+
+
+	// The control link's requests stay on it.
+	write_frame(&bsp_rx_buffer, "8,FAKE,REQUEST");
+	run_rx_worker(0);
+
+	assert_true(os_mailbox_read(&incoming_msg_queue, &msg));
+	assert_int_equal(msg->transaction_id, 8);
+
+	msg->type = FAKE_REPLY;
+	os_mailbox_write(&outgoing_msg_queue, &msg);
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg);
+	run_tx_worker(0);
+	run_tx_worker(1);
+
+	const char *control_link_reply[] = { "8,FAKE,REPLY,42" };
+	assert_sent(&bsp_tx_buffer, control_link_reply, 1);
+	assert_sent(&second_tx_buffer, NULL, 0);
+}
+
+static void err_routing_test(void **state)
+{
+	(void) state;
+
+	// Errors of the second link's transactions get handed over, the ones
+	// without a transaction stay on the control link.
+	struct error_entry err_entry = {
+		.err_code = MESSAGE_FORMATTING_ERROR,
+		.transaction_id = 9 | SECOND_LINK_TAG
+	};
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+
+	err_entry.transaction_id = NO_TRANSACTION_ID;
+	os_mailbox_write(&outgoing_err_queue, &err_entry);
+
+	expect_tx_notify();
+	run_tx_worker(0);
+	run_tx_worker(1);
+
+	const char *control_link_err[] = { "FAKE,ERROR,-3" };
+	assert_sent(&bsp_tx_buffer, control_link_err, 1);
+
+	const char *second_link_err[] = { "9,FAKE,ERROR,-3" };
+	assert_sent(&second_tx_buffer, second_link_err, 1);
+}
+
+static void dispatcher_msg_test(void **state)
+{
+	(void) state;
+
+	// Each link reports its own counters, and its own frames.
+	write_frame(&second_rx_buffer, "3,DISPATCHER,GET_STATS");
+
+	expect_tx_notify();
+	run_rx_worker(1);
+
+	run_tx_worker(0);
+	run_tx_worker(1);
+
+	assert_sent(&bsp_tx_buffer, NULL, 0);
+
+	char sent[100];
+	uint32_t len = byte_ring_read(&second_tx_buffer, (uint8_t *) sent, sizeof(sent) - 1);
+	sent[len] = '\0';
+
+	const char *expected = "$3,DISPATCHER,STATS_REPLY,1,0,0,0,0,";
+	assert_memory_equal(sent, expected, strlen(expected));
+
+
+	// The tags take up the top bits of the transaction IDs.
+	write_frame(&second_rx_buffer, "268435456,FAKE,REQUEST");
+
+	expect_tx_notify();
+	run_rx_worker(1);
+
+	run_tx_worker(1);
+
+	const char *parsing_err[] = { "DISPATCHER,ERROR,-2" };
+	assert_sent(&second_tx_buffer, parsing_err, 1);
+}
+
+static void hand_over_full_test(void **state)
+{
+	(void) state;
+
+	struct message *msg = &fake_msg;
+	fake_msg.type = FAKE_REPLY;
+	fake_msg.transaction_id = 5 | SECOND_LINK_TAG;
+
+	for (uint32_t i = 0; i < ROUTED_QUEUE_CAPACITY + 1; i++) {
+		os_mailbox_write(&outgoing_msg_queue, &msg);
+	}
+
+	// The reply that doesn't fit gets dropped, and fails its transaction
+	// on the second link.
+	for (uint32_t i = 0; i < ROUTED_QUEUE_CAPACITY; i++) {
+		expect_tx_notify();
+	}
+	expect_value(fake_free, msg_ptr, (uintptr_t) msg);
+	expect_tx_notify();
+	run_tx_worker(0);
+
+	assert_sent(&bsp_tx_buffer, NULL, 0);
+
+	for (uint32_t i = 0; i < ROUTED_QUEUE_CAPACITY; i++) {
+		expect_value(fake_free, msg_ptr, (uintptr_t) msg);
+	}
+	run_tx_worker(1);
+
+	const char *second_link_frames[ROUTED_QUEUE_CAPACITY + 1] = { "5,DISPATCHER,ERROR,-9" };
+	for (uint32_t i = 1; i <= ROUTED_QUEUE_CAPACITY; i++) {
+		second_link_frames[i] = "5,FAKE,REPLY,42";
+	}
+	assert_sent(&second_tx_buffer, second_link_frames, ROUTED_QUEUE_CAPACITY + 1);
+}
+
+static void control_link_full_test(void **state)
+{
+	(void) state;
+
+	// The control link's reply is ahead of the second link's in the
+	// subsystem's queue, while the control link's TX ring is full.
+	const uint8_t filler = 'a';
+	while (byte_ring_write(&bsp_tx_buffer, &filler, 1));
+
+	struct message control_msg = {
+		.type = FAKE_REPLY,
+		.transaction_id = 8
+	};
+	struct message second_msg = {
+		.type = FAKE_REPLY,
+		.transaction_id = 5 | SECOND_LINK_TAG
+	};
+	struct message *msg = &control_msg;
+	os_mailbox_write(&outgoing_msg_queue, &msg);
+	msg = &second_msg;
+	os_mailbox_write(&outgoing_msg_queue, &msg);
+
+	// The control link's reply gets deferred, and the second link's one
+	// handed over anyway.
+	expect_tx_notify();
+	expect_tx_notify();
+	expect_any(os_task_sleep, num_ticks);
+	get_tx_worker(0)->action(get_tx_worker(0)->action_params);
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) &second_msg);
+	run_tx_worker(1);
+
+	const char *second_link_reply[] = { "5,FAKE,REPLY,42" };
+	assert_sent(&second_tx_buffer, second_link_reply, 1);
+
+	// The control link's reply goes out once its UART made room.
+	uint8_t ch = 0;
+	while (byte_ring_read_byte(&bsp_tx_buffer, &ch));
+
+	expect_value(fake_free, msg_ptr, (uintptr_t) &control_msg);
+	run_tx_worker(0);
+
+	const char *control_link_reply[] = { "8,FAKE,REPLY,42" };
+	assert_sent(&bsp_tx_buffer, control_link_reply, 1);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(init_test),
+		cmocka_unit_test_setup_teardown(reply_routing_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(err_routing_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(dispatcher_msg_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(hand_over_full_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(control_link_full_test, setup, teardown)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,280 @@
+/**
+ * @file
+ *
+ * This file contains unit tests for the bounded output formatter. Floats get
+ * checked against what the "%.*f" printf() conversion, which the formatter
+ * replaced, makes of them.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/fmt.h"
+
+#define TEST_BUF_SIZE 64
+
+/** The number of pseudo random floats checked against printf(). */
+#define NUM_RANDOM_FLOATS 20000
+
+static char buf[TEST_BUF_SIZE];
+
+
+/**
+ * Formats a float with fmt_put_float(), and checks it against printf().
+ */
+static void check_float(float value, uint8_t num_decimals)
+{
+	char expected[TEST_BUF_SIZE];
+	snprintf(expected, sizeof(expected), "%.*f", num_decimals, (double) value);
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, buf, sizeof(buf));
+	fmt_put_float(&writer, value, num_decimals);
+
+	assert_int_equal(fmt_writer_finish(&writer), strlen(expected));
+	assert_string_equal(buf, expected);
+}
+
+/**
+ * Xorshift, so that the random floats are the same on every run.
+ */
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+
+static int setup(void **state)
+{
+	(void) state;
+
+	memset(buf, 0x55, sizeof(buf));
+
+	return 0;
+}
+
+
+static void integer_test(void **state)
+{
+	(void) state;
+
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, buf, sizeof(buf));
+
+	fmt_put_u32(&writer, 0);
+	fmt_put_ch(&writer, ',');
+	fmt_put_u32(&writer, UINT32_MAX);
+	fmt_put_ch(&writer, ',');
+	fmt_put_i32(&writer, -1);
+	fmt_put_ch(&writer, ',');
+	fmt_put_i32(&writer, INT32_MIN);
+	fmt_put_ch(&writer, ',');
+	fmt_put_i32(&writer, INT32_MAX);
+	fmt_put_ch(&writer, ',');
+	fmt_put_hex_u8(&writer, 0x0A);
+	fmt_put_hex_u8(&writer, 0xF5);
+	fmt_put_ch(&writer, ',');
+	fmt_put_str(&writer, "str");
+
+	assert_int_equal(fmt_writer_finish(&writer), 47);
+	assert_string_equal(buf, "0,4294967295,-1,-2147483648,2147483647,0AF5,str");
+}
+
+static void float_carry_test(void **state)
+{
+	(void) state;
+
+	// The rounding of the fractional part carries into the integer part.
+	check_float(0.9999996f, 6);
+	check_float(9.9999996f, 6);
+	check_float(0.96f, 1);
+	check_float(0.5f, 0);
+	check_float(1.5f, 0);
+	check_float(2.5f, 0);
+	check_float(4294967040.0f, 2);
+
+	char expected[] = "1.000000";
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, buf, sizeof(buf));
+	fmt_put_float(&writer, 0.9999996f, 6);
+	assert_int_equal(fmt_writer_finish(&writer), strlen(expected));
+	assert_string_equal(buf, expected);
+}
+
+static void float_negative_test(void **state)
+{
+	(void) state;
+
+	check_float(-1.5f, 2);
+	check_float(-123.456f, 3);
+	check_float(-0.9999996f, 6);
+
+	// Negative zeros, and negatives that round to zero keep their sign.
+	check_float(-0.0f, 6);
+	check_float(-0.0f, 0);
+	check_float(-0.0000001f, 6);
+	check_float(-0.4f, 0);
+	check_float(0.0f, 3);
+}
+
+static void float_special_test(void **state)
+{
+	(void) state;
+
+	check_float(NAN, 2);
+	check_float(INFINITY, 2);
+	check_float(-INFINITY, 2);
+
+	check_float(4294967040.0f, 0);
+
+	// The integer part of these doesn't fit into 32 bits.
+	float too_large[] = { 4294967296.0f, -4294967296.0f, 1e20f, FLT_MAX };
+
+	for (uint32_t i = 0; i < sizeof(too_large) / sizeof(too_large[0]); i++) {
+		struct fmt_writer writer;
+		fmt_writer_init(&writer, buf, sizeof(buf));
+		fmt_put_float(&writer, too_large[i], 2);
+
+		assert_int_equal(fmt_writer_finish(&writer), -1);
+	}
+
+	// Neither can more than FMT_MAX_DECIMALS decimals.
+	struct fmt_writer writer;
+	fmt_writer_init(&writer, buf, sizeof(buf));
+	fmt_put_float(&writer, 1.0f, FMT_MAX_DECIMALS + 1);
+
+	assert_int_equal(fmt_writer_finish(&writer), -1);
+}
+
+static void float_printf_test(void **state)
+{
+	(void) state;
+
+	uint32_t random_state = 0x2545F491;
+
+	for (uint32_t i = 0; i < NUM_RANDOM_FLOATS; i++) {
+		// Random bit patterns, with the exponent limited to the range
+		// that can be formatted.
+		uint32_t bits = next_random(&random_state);
+		uint32_t exponent = (bits >> 23) & 0xFF;
+		bits = (bits & ~(0xFFu << 23)) | ((exponent % 158) << 23);
+
+		float value = 0.0f;
+		memcpy(&value, &bits, sizeof(value));
+
+		check_float(value, (uint8_t) (i % (FMT_MAX_DECIMALS + 1)));
+	}
+}
+
+static void overflow_test(void **state)
+{
+	(void) state;
+
+	struct fmt_writer writer;
+
+	// The output fits along with the NUL terminator.
+	fmt_writer_init(&writer, buf, 5);
+	fmt_put_str(&writer, "abcd");
+	assert_int_equal(fmt_writer_finish(&writer), 4);
+	assert_string_equal(buf, "abcd");
+
+	// No room for the NUL terminator.
+	fmt_writer_init(&writer, buf, 4);
+	fmt_put_str(&writer, "abcd");
+	assert_int_equal(fmt_writer_finish(&writer), -1);
+
+	// Once something didn't fit, nothing else gets written.
+	memset(buf, 0x55, sizeof(buf));
+	fmt_writer_init(&writer, buf, 4);
+	fmt_put_u32(&writer, 12345);
+	fmt_put_ch(&writer, 'x');
+	assert_int_equal(fmt_writer_finish(&writer), -1);
+	assert_memory_equal(buf, "1234", 4);
+	assert_int_equal(buf[4], 0x55);
+
+	fmt_writer_init(&writer, buf, 4);
+	fmt_put_float(&writer, -1.25f, 2);
+	assert_int_equal(fmt_writer_finish(&writer), -1);
+}
+
+static void window_test(void **state)
+{
+	(void) state;
+
+	struct fmt_writer writer;
+
+	// A window in the middle of the output.
+	fmt_writer_init_window(&writer, buf, 4, 3);
+	fmt_put_str(&writer, "012");
+	fmt_put_u32(&writer, 3456789);
+	assert_int_equal(fmt_writer_finish_window(&writer), 10);
+	assert_int_equal(writer.len, 4);
+	assert_memory_equal(buf, "3456", 4);
+
+	// The last window of the output is only partly filled.
+	fmt_writer_init_window(&writer, buf, 4, 8);
+	fmt_put_str(&writer, "0123456789");
+	assert_int_equal(fmt_writer_finish_window(&writer), 10);
+	assert_int_equal(writer.len, 2);
+	assert_memory_equal(buf, "89", 2);
+
+	// A window past the end of the output.
+	fmt_writer_init_window(&writer, buf, 4, 20);
+	fmt_put_str(&writer, "0123456789");
+	assert_int_equal(fmt_writer_finish_window(&writer), 10);
+	assert_int_equal(writer.len, 0);
+
+	// The windows put together make up the whole output.
+	char whole[TEST_BUF_SIZE] = {0};
+	uint32_t offset = 0;
+	ssize_t total_len = 0;
+
+	do {
+		fmt_writer_init_window(&writer, buf, 3, offset);
+		fmt_put_ch(&writer, ',');
+		fmt_put_float(&writer, -12.345f, 3);
+		fmt_put_ch(&writer, ',');
+		fmt_put_i32(&writer, -42);
+
+		total_len = fmt_writer_finish_window(&writer);
+		memcpy(&whole[offset], buf, writer.len);
+		offset += writer.len;
+	} while (offset < (uint32_t) total_len);
+
+	assert_int_equal(total_len, 12);
+	assert_string_equal(whole, ",-12.345,-42");
+
+	// Things that can't be formatted still fail a window.
+	fmt_writer_init_window(&writer, buf, 4, 0);
+	fmt_put_float(&writer, INFINITY, FMT_MAX_DECIMALS + 1);
+	assert_int_equal(fmt_writer_finish_window(&writer), -1);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(integer_test, setup),
+		cmocka_unit_test_setup(float_carry_test, setup),
+		cmocka_unit_test_setup(float_negative_test, setup),
+		cmocka_unit_test_setup(float_special_test, setup),
+		cmocka_unit_test_setup(float_printf_test, setup),
+		cmocka_unit_test_setup(overflow_test, setup),
+		cmocka_unit_test_setup(window_test, setup)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
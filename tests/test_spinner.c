@@ -16,9 +16,13 @@
 #include <math.h>
 #include <errno.h>
 
-#include <ratfist_stubs/message_dispatcher_stub_helpers.h>
+#include <mouros/common.h>
 
+
+#include "../src/binary_fields.h"
 #include "../src/message_dispatcher.h"
+#include "../src/message_slab.h"
+#include "../src/constants.h"
 
 #include "../src/spinner/spinner.h"
 
@@ -44,11 +48,25 @@ static bool float_equals(float lhs, float rhs) {
 	return float_equals_imprecise(lhs, rhs, FLT_EPSILON);
 }
 
-static struct subsystem_message_conf *init(void)
+static bool parse_msg(struct message_handler *handler,
+                      struct message *msg,
+                      const char *msg_str)
 {
-	expect_any(dispatcher_register_subsystem, conf);
-	will_return(dispatcher_register_subsystem, true);
+	static char field_buf[16 * MAX_SPIN_PLAN_LEGS];
+	static struct message_field fields[2 * MAX_SPIN_PLAN_LEGS + 4];
+	struct message_field_parser parser;
+
+	message_field_parser_init(&parser, field_buf, sizeof(field_buf),
+	                          fields, ARRAY_SIZE(fields));
+
+	assert_true(message_field_parser_parse_str(&parser, msg_str));
 
+	// Skip the message name.
+	return handler->parsing_func(msg, &fields[1], parser.num_fields - 1);
+}
+
+static struct subsystem_message_conf *init(void)
+{
 	expect_any(worker_task_init, worker);
 	expect_any(worker_task_init, name);
 	expect_any(worker_task_init, stack_base);
@@ -61,9 +79,10 @@ static struct subsystem_message_conf *init(void)
 	expect_any(worker_start, worker);
 	will_return(worker_start, true);
 
-	spinner_init();
+	// Done by dispatcher_init(), which is stubbed out.
+	message_slab_init();
 
-	return dispatcher_stubs_get_last_conf();
+	return spinner_init();
 }
 
 static struct message_handler *get_message_handler(struct subsystem_message_conf *conf, char *handler_name)
@@ -91,6 +110,11 @@ static void init_test(void **state)
 	                 MAX_INBOUND_MESSAGES);
 	assert_int_equal(conf->outgoing_err_queue->msg_buf_len / conf->outgoing_err_queue->msg_size,
 	                 MAX_OUTBOUND_ERROR_MESSAGES);
+
+	// The credits follow the small slots, which all requests but SET_PLAN
+	// take.
+	assert_int_equal(message_slab_free_slots(conf->request_payload_size),
+	                 MESSAGE_SLAB_SMALL_SLOTS);
 }
 
 
@@ -101,32 +125,43 @@ static void alloc_test(void **state)
 	struct subsystem_message_conf *conf = init();
 	assert_non_null(conf);
 
-	struct message *msgs[MSG_STRUCT_POOL_SIZE];
-	for (uint8_t i = 0; i < SPIN_PLAN_DATA_MSG_POOL_SIZE; i++) {
+	// Spin plans take up the large slots of the slab, the rest the small
+	// ones, and one kind running out doesn't affect the other.
+	struct message *msgs[MESSAGE_SLAB_SMALL_SLOTS];
+	for (uint8_t i = 0; i < MESSAGE_SLAB_LARGE_SLOTS; i++) {
 		msgs[i] = conf->alloc_message(SPINNER_MSG_SET_PLAN);
 		assert_non_null(msgs[i]);
+		assert_ptr_equal(msgs[i]->data, msgs[i] + 1);
 	}
 
 	assert_null(conf->alloc_message(SPINNER_MSG_SET_PLAN));
 
-	for (uint8_t i = 0; i < SPIN_PLAN_DATA_MSG_POOL_SIZE; i++) {
+	struct message *msg = conf->alloc_message(SPINNER_MSG_SET_STATE);
+	assert_non_null(msg);
+	conf->free_message(msg);
+
+	for (uint8_t i = 0; i < MESSAGE_SLAB_LARGE_SLOTS; i++) {
 		conf->free_message(msgs[i]);
 	}
 
-	struct message *msg = conf->alloc_message(SPINNER_MSG_SET_PLAN);
+	msg = conf->alloc_message(SPINNER_MSG_SET_PLAN);
 	assert_non_null(msg);
 	conf->free_message(msg);
 
 
 
-	for (uint8_t i = 0; i < SMALL_SIZED_MSG_POOL_SIZE; i++) {
+	for (uint8_t i = 0; i < MESSAGE_SLAB_SMALL_SLOTS; i++) {
 		msgs[i] = conf->alloc_message(SPINNER_MSG_SET_STATE);
 		assert_non_null(msgs[i]);
 	}
 
 	assert_null(conf->alloc_message(SPINNER_MSG_SET_STATE));
 
-	for (uint8_t i = 0; i < SMALL_SIZED_MSG_POOL_SIZE; i++) {
+	msg = conf->alloc_message(SPINNER_MSG_PLAN_REPLY);
+	assert_non_null(msg);
+	conf->free_message(msg);
+
+	for (uint8_t i = 0; i < MESSAGE_SLAB_SMALL_SLOTS; i++) {
 		conf->free_message(msgs[i]);
 	}
 
@@ -152,38 +187,27 @@ static void set_plan_parsing_test(void **state)
 
 
 	char empty_msg_str[] = "SET_PLAN";
-	char *save_ptr = NULL;
-
-	strtok_r(empty_msg_str, ",", &save_ptr);
 
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, empty_msg_str));
 
 
 
 	char invalid_ch_num_str1[] = "SET_PLAN,123.4,40,50";
-	strtok_r(invalid_ch_num_str1, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str1));
 
 
 	char invalid_ch_num_str2[] = "SET_PLAN,abc,40,50";
-	strtok_r(invalid_ch_num_str2, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str2));
 
 
 
 	char invalid_duration_str[] = "SET_PLAN,1,12,21,ab1,50";
-	strtok_r(invalid_duration_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_duration_str));
 
 
 
 	char invalid_target_str[] = "SET_PLAN,1,12,21,40,50/";
-	strtok_r(invalid_target_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_target_str));
 
 
 
@@ -195,16 +219,12 @@ static void set_plan_parsing_test(void **state)
 	}
 	strcpy(&message_too_long_str[9 + 2 + 6*MAX_SPIN_PLAN_LEGS], "2");
 
-	strtok_r(message_too_long_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, message_too_long_str));
 
 
 
 	char valid_message_str1[] = "SET_PLAN,4,12,13.3,42,52";
-	strtok_r(valid_message_str1, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, valid_message_str1));
 
 	struct spin_plan_data *data = msg->data;
 	assert_int_equal(data->channel_num, 4);
@@ -219,9 +239,7 @@ static void set_plan_parsing_test(void **state)
 
 
 	char valid_message_str2[] = "SET_PLAN,6,1,1.1,2,2.2,3,3.3,4,4.4,5,5.5";
-	strtok_r(valid_message_str2, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, valid_message_str2));
 
 	assert_int_equal(data->channel_num, 6);
 	assert_int_equal(data->plan_leg_count, 5);
@@ -259,39 +277,28 @@ static void get_plan_parsing_test(void **state)
 
 
 	char empty_msg_str[] = "GET_PLAN";
-	char *save_ptr = NULL;
-
-	strtok_r(empty_msg_str, ",", &save_ptr);
 
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, empty_msg_str));
 
 
 
 	char invalid_ch_num_str1[] = "GET_PLAN,a";
-	strtok_r(invalid_ch_num_str1, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str1));
 
 
 
 	char invalid_ch_num_str2[] = "GET_PLAN,-1";
-	strtok_r(invalid_ch_num_str2, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str2));
 
 
 
 	char message_too_long_str[] = "GET_PLAN,4,213";
-	strtok_r(message_too_long_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, message_too_long_str));
 
 
 
 	char valid_message_str1[] = "GET_PLAN,6";
-	strtok_r(valid_message_str1, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, valid_message_str1));
 
 	struct spin_channel *data = msg->data;
 	assert_int_equal(data->channel_num, 6);
@@ -299,9 +306,7 @@ static void get_plan_parsing_test(void **state)
 
 
 	char valid_message_str2[] = "GET_PLAN,123";
-	strtok_r(valid_message_str2, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, valid_message_str2));
 
 	assert_int_equal(data->channel_num, 123);
 }
@@ -387,6 +392,30 @@ static void plan_reply_serialization_test(void **state)
 
 	len = handler->serialization_func(msg, output_buf, 30);
 	assert_int_equal(len, -1);
+
+
+	// Streamed in windows of a few bytes, the plan comes out the same, each
+	// window resuming where the one before it left off.
+	char full_buf[200];
+	ssize_t full_len = handler->serialization_func(msg, full_buf, sizeof(full_buf));
+	assert_true(full_len > 0);
+
+	char streamed_buf[200];
+	struct stream_cursor cursor = {0};
+	for (uint32_t offset = 0; offset < (uint32_t) full_len; offset += 7) {
+		len = handler->streaming_serialization_func(msg, &cursor, offset,
+		                                           &streamed_buf[offset], 7);
+		assert_true(cursor.offset <= offset + 7);
+
+		if (offset + 7 < (uint32_t) full_len) {
+			assert_true(len > 7);
+		} else {
+			assert_int_equal(len, full_len - offset);
+		}
+	}
+
+	assert_memory_equal(streamed_buf, full_buf, (size_t) full_len);
+	assert_int_equal(cursor.item, data->plan_leg_count);
 }
 
 
@@ -405,53 +434,38 @@ static void set_state_parsing_test(void **state)
 
 
 	char empty_msg_str[] = "SET_STATE";
-	char *save_ptr = NULL;
-
-	strtok_r(empty_msg_str, ",", &save_ptr);
 
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, empty_msg_str));
 
 
 
 	char invalid_ch_num_str1[] = "SET_STATE,a,ON";
-	strtok_r(invalid_ch_num_str1, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str1));
 
 
 
 	char invalid_ch_num_str2[] = "SET_STATE,-1,ON";
-	strtok_r(invalid_ch_num_str2, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str2));
 
 
 
 	char invalid_state_str[] = "SET_STATE,1,start";
-	strtok_r(invalid_state_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_state_str));
 
 
 
 	char missing_state_str[] = "SET_STATE,1";
-	strtok_r(missing_state_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, missing_state_str));
 
 
 
 	char extra_packet_field_str[] = "SET_STATE,1,ON,extra";
-	strtok_r(extra_packet_field_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, extra_packet_field_str));
 
 
 
 	char state_on_str[] = "SET_STATE,1,ON";
-	strtok_r(state_on_str, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, state_on_str));
 	struct spin_state_set_data *data = msg->data;
 	assert_int_equal(data->channel_num, 1);
 	assert_int_equal(data->state, SPINNER_STATE_RUNNING);
@@ -459,9 +473,7 @@ static void set_state_parsing_test(void **state)
 
 
 	char state_off_str[] = "SET_STATE,12,OFF";
-	strtok_r(state_off_str, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, state_off_str));
 	assert_int_equal(data->channel_num, 12);
 	assert_int_equal(data->state, SPINNER_STATE_STOPPED);
 }
@@ -483,39 +495,28 @@ static void get_state_parsing_test(void **state)
 
 
 	char empty_msg_str[] = "GET_STATE";
-	char *save_ptr = NULL;
-
-	strtok_r(empty_msg_str, ",", &save_ptr);
 
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, empty_msg_str));
 
 
 
 	char invalid_ch_num_str1[] = "GET_STATE,a";
-	strtok_r(invalid_ch_num_str1, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str1));
 
 
 
 	char invalid_ch_num_str2[] = "GET_STATE,-1";
-	strtok_r(invalid_ch_num_str2, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, invalid_ch_num_str2));
 
 
 
 	char message_too_long_str[] = "GET_STATE,4,213";
-	strtok_r(message_too_long_str, ",", &save_ptr);
-
-	assert_false(handler->parsing_func(msg, save_ptr));
+	assert_false(parse_msg(handler, msg, message_too_long_str));
 
 
 
 	char valid_message_str1[] = "GET_STATE,6";
-	strtok_r(valid_message_str1, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, valid_message_str1));
 
 	struct spin_channel *data = msg->data;
 	assert_int_equal(data->channel_num, 6);
@@ -523,9 +524,7 @@ static void get_state_parsing_test(void **state)
 
 
 	char valid_message_str2[] = "GET_STATE,123";
-	strtok_r(valid_message_str2, ",", &save_ptr);
-
-	assert_true(handler->parsing_func(msg, save_ptr));
+	assert_true(parse_msg(handler, msg, valid_message_str2));
 
 	assert_int_equal(data->channel_num, 123);
 }
@@ -716,6 +715,99 @@ static void ret_val_serialization_test(void **state)
 }
 
 
+static void binary_message_test(void **state)
+{
+	(void) state;
+
+	struct subsystem_message_conf *conf = init();
+	assert_non_null(conf);
+
+
+	// SET_PLAN
+	struct message_handler *handler = get_message_handler(conf, "SET_PLAN");
+	assert_non_null(handler);
+
+	struct message *msg = conf->alloc_message(SPINNER_MSG_SET_PLAN);
+	assert_non_null(msg);
+
+	uint8_t payload[1 + 2 * 8];
+	payload[0] = 3;
+	bin_put_u32(&payload[1], 1000);
+	bin_put_f32(&payload[5], 12.5f);
+	bin_put_u32(&payload[9], 2500);
+	bin_put_f32(&payload[13], -3.25f);
+
+	// Partial leg
+	assert_false(handler->binary_parsing_func(msg, payload, sizeof(payload) - 1));
+	assert_false(handler->binary_parsing_func(msg, payload, 0));
+
+	assert_true(handler->binary_parsing_func(msg, payload, sizeof(payload)));
+
+	struct spin_plan_data *plan_data = msg->data;
+	assert_int_equal(plan_data->channel_num, 3);
+	assert_int_equal(plan_data->plan_leg_count, 2);
+	assert_int_equal(plan_data->plan_legs[0].duration_msecs, 1000);
+	assert_true(float_equals(plan_data->plan_legs[0].target_pct, 12.5f));
+	assert_int_equal(plan_data->plan_legs[1].duration_msecs, 2500);
+	assert_true(float_equals(plan_data->plan_legs[1].target_pct, -3.25f));
+
+
+	// PLAN_REPLY gives back the same payload
+	handler = get_message_handler(conf, "PLAN_REPLY");
+	assert_non_null(handler);
+
+	uint8_t output[64];
+	assert_int_equal(handler->binary_serialization_func(msg, output, sizeof(output)),
+	                 sizeof(payload));
+	assert_memory_equal(output, payload, sizeof(payload));
+
+	assert_int_equal(handler->binary_serialization_func(msg, output, sizeof(payload) - 1), -1);
+
+	conf->free_message(msg);
+
+
+	// SET_STATE
+	handler = get_message_handler(conf, "SET_STATE");
+	assert_non_null(handler);
+
+	msg = conf->alloc_message(SPINNER_MSG_SET_STATE);
+	assert_non_null(msg);
+
+	uint8_t state_payload[] = {2, SPINNER_STATE_SPINNING_DOWN};
+	assert_false(handler->binary_parsing_func(msg, state_payload, sizeof(state_payload)));
+
+	state_payload[1] = SPINNER_STATE_RUNNING;
+	assert_true(handler->binary_parsing_func(msg, state_payload, sizeof(state_payload)));
+
+	struct spin_state_set_data *state_set_data = msg->data;
+	assert_int_equal(state_set_data->channel_num, 2);
+	assert_int_equal(state_set_data->state, SPINNER_STATE_RUNNING);
+
+	conf->free_message(msg);
+
+
+	// STATE_REPLY
+	handler = get_message_handler(conf, "STATE_REPLY");
+	assert_non_null(handler);
+
+	msg = conf->alloc_message(SPINNER_MSG_STATE_REPLY);
+	assert_non_null(msg);
+
+	struct spin_state_data *state_data = msg->data;
+	state_data->channel_num = 12;
+	state_data->state = SPINNER_STATE_SPINNING_DOWN;
+	state_data->plan_time_elapsed_msecs = 1234;
+	state_data->output_val_pct = 42.1f;
+
+	assert_int_equal(handler->binary_serialization_func(msg, output, sizeof(output)), 10);
+	assert_int_equal(output[0], 12);
+	assert_int_equal(output[1], SPINNER_STATE_SPINNING_DOWN);
+	assert_int_equal(bin_get_u32(&output[2]), 1234);
+	assert_true(float_equals(bin_get_f32(&output[6]), 42.1f));
+
+	conf->free_message(msg);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -727,7 +819,8 @@ int main(void)
 		cmocka_unit_test(set_state_parsing_test),
 		cmocka_unit_test(get_state_parsing_test),
 		cmocka_unit_test(state_reply_serialization_test),
-		cmocka_unit_test(ret_val_serialization_test)
+		cmocka_unit_test(ret_val_serialization_test),
+		cmocka_unit_test(binary_message_test)
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
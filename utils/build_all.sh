@@ -105,6 +105,22 @@ check_retval
 
 
 
+echo
+echo "Building Ratfist - Native Debug"
+mkdir -p "${script_dir}/../build/ratfist-native-debug"
+check_retval
+
+cd "${script_dir}/../build/ratfist-native-debug"
+check_retval
+
+cmake "-DCMAKE_INSTALL_PREFIX=../install" "-DBOARD_TYPE=native" "-DCMAKE_TOOLCHAIN_FILE=../../libsrc/mouros/cmake/gcc-linux-x86-toolchain.cmake" "-DCMAKE_BUILD_TYPE=Debug" "-DINCLUDE_SPINNER=1" "-DINCLUDE_METEO=1" ../..
+check_retval
+
+cmake --build .
+check_retval
+
+
+
 echo
 echo "Building Ratfist - Unit Tests - STM32F072 Discovery"
 mkdir -p "${script_dir}/../build/ratfist-tests-stm32f072"